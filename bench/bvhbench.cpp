@@ -0,0 +1,371 @@
+// Benchmarks Bvh: build time with and without jobs, and closest-hit and
+// any-hit rays per second, on obj/african_head.obj and generated spheres.
+// A sample of the rays is checked against a brute force loop over every
+// triangle; any disagreement exits with 1. Results go out as JSON, one
+// result per line.
+//
+// Linux build, from the repository root, with DirectXMath on the include
+// path:
+//
+//   g++ -std=c++17 -O2 -pthread -Isrc -o bvhbench bench/bvhbench.cpp
+//       src/bvh.cpp src/jobs.cpp src/parcer.cpp src/mappedfile.cpp
+//       src/profiler.cpp
+//
+// Usage:
+//
+//   bvhbench [--sizes 100k,1m] [--rays 1m] [--verify 200] [--repeat 3]
+//            [--threads 0] [--obj path]
+
+#include "bvh.h"
+#include "jobs.h"
+#include "parcer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+    struct Mesh
+    {
+        std::string name;
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+    };
+
+    struct BenchOptions
+    {
+        size_t rayCount = 1000000;
+        size_t verifyCount = 200;
+        int repeat = 3;
+    };
+
+    double Seconds(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // (rings + 1) x (segments + 1) grid, as geometrybench writes it.
+    void BuildSphere(Mesh& mesh, size_t triangleCount)
+    {
+        size_t segments = std::max<size_t>(3, (size_t)std::sqrt((double)triangleCount / 2.0));
+        size_t rings = std::max<size_t>(2, triangleCount / (2 * segments));
+
+        mesh.vertices.clear();
+        mesh.indices.clear();
+        mesh.vertices.reserve((rings + 1) * (segments + 1));
+        mesh.indices.reserve(rings * segments * 6);
+
+        for (size_t r = 0; r <= rings; r++)
+        {
+            float phi = 3.14159265f * r / rings;
+            for (size_t s = 0; s <= segments; s++)
+            {
+                float theta = 2.0f * 3.14159265f * s / segments;
+
+                Vertex v = {};
+                v.position = XMFLOAT3(std::sin(phi) * std::cos(theta), std::cos(phi), std::sin(phi) * std::sin(theta));
+                v.normal = v.position;
+                mesh.vertices.push_back(v);
+            }
+        }
+
+        for (size_t r = 0; r < rings; r++)
+        {
+            for (size_t s = 0; s < segments; s++)
+            {
+                uint32_t a = (uint32_t)(r * (segments + 1) + s);
+                uint32_t b = a + (uint32_t)segments + 1;
+                mesh.indices.insert(mesh.indices.end(), { a, b, a + 1, a + 1, b, b + 1 });
+            }
+        }
+    }
+
+    // From a shell around the bounds towards a random point inside them,
+    // so most rays enter the tree and about half of them hit.
+    void GenerateRays(const Bvh& bvh, size_t count, std::vector<Ray>& rays)
+    {
+        XMFLOAT3 lo = bvh.BoundsMin();
+        XMFLOAT3 hi = bvh.BoundsMax();
+        float center[3] = { (lo.x + hi.x) * 0.5f, (lo.y + hi.y) * 0.5f, (lo.z + hi.z) * 0.5f };
+        float extent[3] = { hi.x - lo.x, hi.y - lo.y, hi.z - lo.z };
+        float radius = std::max(extent[0], std::max(extent[1], extent[2]));
+
+        std::mt19937 rng(1234);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+        rays.resize(count);
+        for (Ray& ray : rays)
+        {
+            float d[3];
+            float length;
+            do
+            {
+                d[0] = unit(rng);
+                d[1] = unit(rng);
+                d[2] = unit(rng);
+                length = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+            } while (length > 1.0f || length < 1e-3f);
+
+            float origin[3];
+            float target[3];
+            for (int a = 0; a < 3; a++)
+            {
+                origin[a] = center[a] + d[a] / length * radius * 2.0f;
+                target[a] = center[a] + unit(rng) * extent[a] * 0.5f;
+            }
+
+            ray.origin = XMFLOAT3(origin[0], origin[1], origin[2]);
+            ray.direction = XMFLOAT3(target[0] - origin[0], target[1] - origin[1], target[2] - origin[2]);
+        }
+    }
+
+    // Every triangle in turn, same double-sided test as Bvh.
+    bool BruteForce(const Mesh& mesh, const Ray& ray, RayHit& hit)
+    {
+        const float o[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+        const float d[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+        float tMax = ray.tMax;
+
+        hit = RayHit();
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+        {
+            const XMFLOAT3& p0 = mesh.vertices[mesh.indices[i]].position;
+            const XMFLOAT3& p1 = mesh.vertices[mesh.indices[i + 1]].position;
+            const XMFLOAT3& p2 = mesh.vertices[mesh.indices[i + 2]].position;
+
+            float e1[3] = { p1.x - p0.x, p1.y - p0.y, p1.z - p0.z };
+            float e2[3] = { p2.x - p0.x, p2.y - p0.y, p2.z - p0.z };
+
+            float p[3] = { d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0] };
+            float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+            if (det == 0.0f)
+                continue;
+
+            float invDet = 1.0f / det;
+            float t[3] = { o[0] - p0.x, o[1] - p0.y, o[2] - p0.z };
+            float u = (t[0] * p[0] + t[1] * p[1] + t[2] * p[2]) * invDet;
+
+            float q[3] = { t[1] * e1[2] - t[2] * e1[1], t[2] * e1[0] - t[0] * e1[2], t[0] * e1[1] - t[1] * e1[0] };
+            float v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * invDet;
+            float distance = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * invDet;
+
+            if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && distance >= ray.tMin && distance <= tMax)
+            {
+                tMax = distance;
+                hit.t = distance;
+                hit.u = u;
+                hit.v = v;
+                hit.triangle = (uint32_t)(i / 3);
+            }
+        }
+        return hit.Valid();
+    }
+
+    // Same hit distance within rounding; the triangle may differ where
+    // two share an edge.
+    size_t Verify(const Mesh& mesh, const Bvh& bvh, const std::vector<Ray>& rays, size_t count)
+    {
+        size_t mismatches = 0;
+        count = std::min(count, rays.size());
+
+        for (size_t i = 0; i < count; i++)
+        {
+            const Ray& ray = rays[i * (rays.size() / count)];
+
+            RayHit expected;
+            RayHit hit;
+            bool found = BruteForce(mesh, ray, expected);
+
+            if (bvh.Intersect(ray, hit) != found || bvh.Occluded(ray) != found)
+                ++mismatches;
+            else if (found && std::fabs(hit.t - expected.t) > 1e-5f * std::max(1.0f, expected.t))
+                ++mismatches;
+        }
+        return mismatches;
+    }
+
+    void RunMesh(const Mesh& mesh, JobSystem& jobs, const BenchOptions& options, bool& first, bool& failed)
+    {
+        Bvh bvh;
+        double buildSeconds[2] = { 1e30, 1e30 };
+
+        for (int threaded = 0; threaded < 2; threaded++)
+        {
+            for (int r = 0; r < options.repeat; r++)
+            {
+                auto start = std::chrono::steady_clock::now();
+                bvh.Build(
+                    mesh.vertices.data(), mesh.vertices.size(),
+                    mesh.indices.data(), mesh.indices.size(),
+                    BvhBuildOptions(), threaded ? &jobs : nullptr
+                );
+                buildSeconds[threaded] = std::min(buildSeconds[threaded], Seconds(start));
+            }
+        }
+
+        std::vector<Ray> rays;
+        GenerateRays(bvh, options.rayCount, rays);
+
+        double closestSeconds = 1e30;
+        double anySeconds = 1e30;
+        size_t hits = 0;
+        size_t occluded = 0;
+
+        for (int r = 0; r < options.repeat; r++)
+        {
+            hits = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (const Ray& ray : rays)
+            {
+                RayHit hit;
+                hits += bvh.Intersect(ray, hit);
+            }
+            closestSeconds = std::min(closestSeconds, Seconds(start));
+
+            occluded = 0;
+            start = std::chrono::steady_clock::now();
+            for (const Ray& ray : rays)
+                occluded += bvh.Occluded(ray);
+            anySeconds = std::min(anySeconds, Seconds(start));
+        }
+
+        size_t mismatches = Verify(mesh, bvh, rays, options.verifyCount);
+        failed = failed || mismatches || hits != occluded;
+
+        const BvhStats& stats = bvh.Stats();
+        printf("%s    {\"mesh\": \"%s\", \"triangles\": %zu, \"nodes\": %zu, \"leaves\": %zu, \"depth\": %u, "
+            "\"sahCost\": %.2f, \"buildSeconds\": %.6f, \"buildSecondsJobs\": %.6f, \"rays\": %zu, "
+            "\"hitRate\": %.3f, \"closestRaysPerSecond\": %.0f, \"anyRaysPerSecond\": %.0f, "
+            "\"verified\": %zu, \"mismatches\": %zu}",
+            first ? "" : ",\n",
+            mesh.name.c_str(),
+            bvh.TriangleCount(),
+            stats.nodes,
+            stats.leaves,
+            stats.maxDepth,
+            stats.sahCost,
+            buildSeconds[0],
+            buildSeconds[1],
+            rays.size(),
+            rays.empty() ? 0.0 : (double)hits / rays.size(),
+            rays.size() / std::max(closestSeconds, 1e-9),
+            rays.size() / std::max(anySeconds, 1e-9),
+            std::min(options.verifyCount, rays.size()),
+            mismatches);
+        fflush(stdout);
+        first = false;
+    }
+
+    bool ParseCount(const std::string& text, size_t& count)
+    {
+        char* end = nullptr;
+        double value = strtod(text.c_str(), &end);
+        if (end == text.c_str() || value < 0.0)
+            return false;
+
+        switch (*end)
+        {
+        case 'k': case 'K': value *= 1e3; break;
+        case 'm': case 'M': value *= 1e6; break;
+        case '\0': break;
+        default: return false;
+        }
+
+        count = (size_t)value;
+        return true;
+    }
+
+    bool ParseSizes(const std::string& text, std::vector<size_t>& sizes)
+    {
+        sizes.clear();
+        size_t begin = 0;
+        while (begin <= text.size())
+        {
+            size_t end = text.find(',', begin);
+            if (end == std::string::npos)
+                end = text.size();
+
+            size_t size = 0;
+            if (!ParseCount(text.substr(begin, end - begin), size) || size == 0)
+                return false;
+            sizes.push_back(size);
+            begin = end + 1;
+        }
+        return !sizes.empty();
+    }
+
+    void PrintUsage()
+    {
+        fprintf(stderr,
+            "usage: bvhbench [--sizes 100k,1m] [--rays 1m] [--verify 200] [--repeat 3]\n"
+            "                [--threads 0] [--obj path]\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    std::vector<size_t> sizes = { 100000, 1000000 };
+    std::string objPath = "obj/african_head.obj";
+    unsigned threads = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--sizes" && hasValue && ParseSizes(argv[i + 1], sizes))
+            ++i;
+        else if (arg == "--rays" && hasValue && ParseCount(argv[i + 1], options.rayCount))
+            ++i;
+        else if (arg == "--verify" && hasValue && ParseCount(argv[i + 1], options.verifyCount))
+            ++i;
+        else if (arg == "--repeat" && hasValue)
+            options.repeat = std::max(1, atoi(argv[++i]));
+        else if (arg == "--threads" && hasValue)
+            threads = (unsigned)atoi(argv[++i]);
+        else if (arg == "--obj" && hasValue)
+            objPath = argv[++i];
+        else
+        {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    JobSystem jobs;
+    jobs.Initialize(threads);
+
+    printf("{\n  \"threads\": %u,\n  \"results\": [\n", jobs.ThreadCount());
+
+    bool first = true;
+    bool failed = false;
+
+    Mesh mesh;
+    mesh.name = objPath;
+    if (LoadOBJ(objPath, mesh.vertices, mesh.indices))
+        RunMesh(mesh, jobs, options, first, failed);
+    else
+        fprintf(stderr, "failed to load %s\n", objPath.c_str());
+
+    for (size_t size : sizes)
+    {
+        mesh.name = "sphere_" + std::to_string(size);
+        BuildSphere(mesh, size);
+        RunMesh(mesh, jobs, options, first, failed);
+    }
+
+    printf("\n  ]\n}\n");
+
+    if (failed)
+        fprintf(stderr, "BVH results differ from brute force\n");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,446 @@
+// Benchmarks CullSpheres and CullBoxes over random objects around a
+// camera, on every CullPath the CPU has and over 1, 2, 4 ... threads,
+// against a plain loop over SphereInFrustum and BoxInFrustum. Every run
+// must return the same indices as that loop. Also times CullMeshlets on a
+// terrain against a loop of SphereInFrustum and ConeBackfacing per
+// meshlet; both must draw every front-facing triangle in view, checked per
+// triangle, and nothing twice. A mismatch exits with 1. Results go out as
+// JSON.
+//
+// Linux build, from the repository root, with DirectXMath on the include
+// path:
+//
+//   g++ -std=c++17 -O2 -pthread -Isrc -o cullbench bench/cullbench.cpp
+//       src/culling.cpp src/meshlet.cpp
+//
+// Usage:
+//
+//   cullbench [--objects 1m] [--visible 0.3] [--triangles 2m] [--threads 0]
+//             [--repeat 20]
+
+#include "culling.h"
+#include "meshlet.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double Seconds(Clock::time_point start, Clock::time_point end)
+    {
+        return std::chrono::duration<double>(end - start).count();
+    }
+
+    struct Result
+    {
+        std::string kind;
+        std::string path;
+        unsigned threads = 1;
+        size_t objects = 0;
+        size_t visible = 0;
+        double seconds = 1e30;
+        bool valid = true;
+    };
+
+    const char* PathName(CullPath path)
+    {
+        switch (path)
+        {
+        case CullPath::Scalar: return "scalar";
+        case CullPath::SSE: return "sse";
+        case CullPath::AVX2: return "avx2";
+        default: return "auto";
+        }
+    }
+
+    // The camera of the D3D12 path at the origin looking down +z; objects
+    // fill a box around the frustum whose size sets the share in view.
+    XMFLOAT4X4 MakeViewProj()
+    {
+        XMMATRIX view = XMMatrixLookAtLH(XMVectorSet(0, 0, 0, 1), XMVectorSet(0, 0, 1, 1), XMVectorSet(0, 1, 0, 0));
+        XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 1000.0f);
+
+        XMFLOAT4X4 viewProj;
+        XMStoreFloat4x4(&viewProj, view * projection);
+        return viewProj;
+    }
+
+    void MakeScene(size_t count, float spread, SphereBounds& spheres, BoxBounds& boxes)
+    {
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<float> side(-spread, spread);
+        std::uniform_real_distribution<float> depth(-100.0f, 1000.0f);
+        std::uniform_real_distribution<float> size(0.1f, 2.0f);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            XMFLOAT3 center(side(rng), side(rng) * 0.6f, depth(rng));
+            XMFLOAT3 extent(size(rng), size(rng), size(rng));
+
+            spheres.Add(center, std::max(extent.x, std::max(extent.y, extent.z)));
+            boxes.Add(
+                XMFLOAT3(center.x - extent.x, center.y - extent.y, center.z - extent.z),
+                XMFLOAT3(center.x + extent.x, center.y + extent.y, center.z + extent.z)
+            );
+        }
+    }
+
+    // The loop the batch API replaces, and the reference every path must
+    // match.
+    size_t CullLoop(const Frustum& frustum, const SphereBounds& bounds, uint32_t* out)
+    {
+        size_t n = 0;
+        for (size_t i = 0; i < bounds.Size(); i++)
+        {
+            if (SphereInFrustum(frustum, XMFLOAT3(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]), bounds.radius[i]))
+                out[n++] = (uint32_t)i;
+        }
+        return n;
+    }
+
+    size_t CullLoop(const Frustum& frustum, const BoxBounds& bounds, uint32_t* out)
+    {
+        size_t n = 0;
+        for (size_t i = 0; i < bounds.Size(); i++)
+        {
+            XMFLOAT3 center(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]);
+            XMFLOAT3 extent(bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i]);
+            if (BoxInFrustum(frustum, center, extent))
+                out[n++] = (uint32_t)i;
+        }
+        return n;
+    }
+
+    template <typename Cull>
+    Result Measure(const char* kind, const char* path, unsigned threads, size_t count, unsigned repeat,
+        const std::vector<uint32_t>& expected, Cull cull)
+    {
+        Result result;
+        result.kind = kind;
+        result.path = path;
+        result.threads = threads;
+        result.objects = count;
+
+        std::vector<uint32_t> visible(count);
+        for (unsigned r = 0; r < repeat; r++)
+        {
+            auto start = Clock::now();
+            size_t n = cull(visible.data());
+            result.seconds = std::min(result.seconds, Seconds(start, Clock::now()));
+
+            result.visible = n;
+            result.valid = result.valid && n == expected.size() &&
+                std::equal(expected.begin(), expected.end(), visible.begin());
+        }
+
+        return result;
+    }
+
+    template <typename Bounds, typename BatchCull>
+    void MeasureKind(const char* kind, const Frustum& frustum, const Bounds& bounds, unsigned maxThreads,
+        unsigned repeat, BatchCull batchCull, std::vector<Result>& results)
+    {
+        size_t count = bounds.Size();
+
+        std::vector<uint32_t> expected(count);
+        expected.resize(CullLoop(frustum, bounds, expected.data()));
+
+        results.push_back(Measure(kind, "loop", 1, count, repeat, expected, [&](uint32_t* out)
+        {
+            return CullLoop(frustum, bounds, out);
+        }));
+
+        CullPath paths[] = { CullPath::Scalar, CullPath::SSE, CullPath::AVX2 };
+        for (CullPath path : paths)
+        {
+            // Paths the CPU lacks would only measure the fallback again.
+            if (path > DetectCullPath())
+                continue;
+
+            for (unsigned t = 1; ; t = std::min(t * 2, maxThreads))
+            {
+                CullOptions options;
+                options.path = path;
+                options.threadCount = t;
+
+                results.push_back(Measure(kind, PathName(path), t, count, repeat, expected, [&](uint32_t* out)
+                {
+                    return batchCull(frustum, bounds, out, options);
+                }));
+
+                if (t == maxThreads)
+                    break;
+            }
+        }
+    }
+
+    // Rolling terrain below the eye, one unit per grid cell, in rows along
+    // x so meshlets stay compact.
+    void MakeTerrain(size_t triangles, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+    {
+        uint32_t side = std::max<uint32_t>(1, (uint32_t)std::sqrt(triangles / 2.0));
+        float cell = 1000.0f / side;
+
+        vertices.resize((size_t)(side + 1) * (side + 1));
+        for (uint32_t z = 0; z <= side; z++)
+        {
+            for (uint32_t x = 0; x <= side; x++)
+            {
+                Vertex& v = vertices[(size_t)z * (side + 1) + x];
+                v = Vertex();
+                float px = -500.0f + x * cell;
+                float pz = z * cell;
+                v.position = XMFLOAT3(px, std::sin(px * 0.05f) * std::cos(pz * 0.04f) * 15.0f - 20.0f, pz);
+                v.normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+            }
+        }
+
+        indices.clear();
+        indices.reserve((size_t)side * side * 6);
+        for (uint32_t z = 0; z < side; z++)
+        {
+            for (uint32_t x = 0; x < side; x++)
+            {
+                uint32_t i = z * (side + 1) + x;
+                indices.insert(indices.end(), { i, i + side + 1, i + 1, i + 1, i + side + 1, i + side + 2 });
+            }
+        }
+    }
+
+    // Triangles that must be drawn: some vertex clearly inside the clip
+    // volume and the eye clearly on the front side. Clockwise front faces,
+    // left-handed.
+    std::vector<uint8_t> RequiredTriangles(
+        const XMFLOAT4X4& viewProj,
+        const XMFLOAT3& eye,
+        const std::vector<Vertex>& vertices,
+        const std::vector<uint32_t>& indices)
+    {
+        std::vector<uint8_t> required(indices.size() / 3, 0);
+        for (size_t t = 0; t < required.size(); t++)
+        {
+            const XMFLOAT3* p[3] = {
+                &vertices[indices[t * 3]].position,
+                &vertices[indices[t * 3 + 1]].position,
+                &vertices[indices[t * 3 + 2]].position,
+            };
+
+            bool inView = false;
+            for (int k = 0; k < 3 && !inView; k++)
+            {
+                double clip[4];
+                for (int c = 0; c < 4; c++)
+                    clip[c] = p[k]->x * viewProj.m[0][c] + p[k]->y * viewProj.m[1][c] + p[k]->z * viewProj.m[2][c] + viewProj.m[3][c];
+
+                double w = clip[3] * (1.0 - 1e-4);
+                inView = w > 0.0 && std::fabs(clip[0]) < w && std::fabs(clip[1]) < w && clip[2] > clip[3] * 1e-4 && clip[2] < w;
+            }
+
+            double ux = p[1]->x - p[0]->x, uy = p[1]->y - p[0]->y, uz = p[1]->z - p[0]->z;
+            double vx = p[2]->x - p[0]->x, vy = p[2]->y - p[0]->y, vz = p[2]->z - p[0]->z;
+            double nx = uy * vz - uz * vy, ny = uz * vx - ux * vz, nz = ux * vy - uy * vx;
+            double ex = eye.x - p[0]->x, ey = eye.y - p[0]->y, ez = eye.z - p[0]->z;
+            double n = std::sqrt(nx * nx + ny * ny + nz * nz);
+            double e = std::sqrt(ex * ex + ey * ey + ez * ez);
+
+            required[t] = inView && nx * ex + ny * ey + nz * ez > 1e-3 * n * e;
+        }
+        return required;
+    }
+
+    // The per-meshlet loop CullMeshlets replaced.
+    void CullMeshletLoop(const MeshletData& data, const Frustum& frustum, const XMFLOAT3& eye, std::vector<DrawRange>& ranges)
+    {
+        for (const Meshlet& m : data.meshlets)
+        {
+            if (!SphereInFrustum(frustum, m.center, m.radius) ||
+                ConeBackfacing(m.center, m.radius, m.coneAxis, m.coneCutoff, eye))
+                continue;
+
+            if (!ranges.empty() && ranges.back().indexOffset + ranges.back().indexCount == m.indexOffset)
+                ranges.back().indexCount += m.triangleCount * 3;
+            else
+                ranges.push_back({ m.indexOffset, m.triangleCount * 3 });
+        }
+    }
+
+    template <typename Cull>
+    Result MeasureMeshlets(const char* path, const MeshletData& data, const std::vector<uint8_t>& required,
+        unsigned repeat, Cull cull)
+    {
+        Result result;
+        result.kind = "meshlets";
+        result.path = path;
+        result.objects = data.meshlets.size();
+
+        std::vector<DrawRange> ranges;
+        for (unsigned r = 0; r < repeat; r++)
+        {
+            ranges.clear();
+            auto start = Clock::now();
+            cull(ranges);
+            result.seconds = std::min(result.seconds, Seconds(start, Clock::now()));
+        }
+
+        std::vector<uint8_t> drawn(required.size(), 0);
+        for (const DrawRange& range : ranges)
+        {
+            for (uint32_t t = range.indexOffset / 3; t < (range.indexOffset + range.indexCount) / 3 && t < drawn.size(); t++)
+                drawn[t]++;
+        }
+
+        for (size_t t = 0; t < drawn.size(); t++)
+        {
+            result.visible += drawn[t];
+            result.valid = result.valid && drawn[t] <= 1 && (drawn[t] || !required[t]);
+        }
+
+        return result;
+    }
+
+    bool ParseCount(const std::string& text, size_t& count)
+    {
+        char* end = nullptr;
+        double value = strtod(text.c_str(), &end);
+        if (end == text.c_str() || value <= 0.0)
+            return false;
+
+        switch (*end)
+        {
+        case 'k': case 'K': value *= 1e3; break;
+        case 'm': case 'M': value *= 1e6; break;
+        case '\0': break;
+        default: return false;
+        }
+
+        count = (size_t)value;
+        return true;
+    }
+
+    void PrintUsage()
+    {
+        fprintf(stderr, "usage: cullbench [--objects 1m] [--visible 0.3] [--triangles 2m] [--threads 0] [--repeat 20]\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = 1000000;
+    double visibleShare = 0.3;
+    size_t triangles = 2000000;
+    unsigned threads = 0;
+    unsigned repeat = 20;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--objects" && hasValue && ParseCount(argv[i + 1], count))
+            ++i;
+        else if (arg == "--visible" && hasValue)
+            visibleShare = std::min(1.0, std::max(0.01, atof(argv[++i])));
+        else if (arg == "--triangles" && hasValue && ParseCount(argv[i + 1], triangles))
+            ++i;
+        else if (arg == "--threads" && hasValue)
+            threads = (unsigned)std::max(0, atoi(argv[++i]));
+        else if (arg == "--repeat" && hasValue)
+            repeat = (unsigned)std::max(1, atoi(argv[++i]));
+        else
+        {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // At depth d the frustum is 0.83 * d high and 1.47 * d wide, so over
+    // depths 0 to 1000 it averages 1.22 * 1000^2 / 3 square units. The scene
+    // box is 2 * spread by 1.2 * spread and 10% of it lies behind the eye;
+    // spread is set so roughly visibleShare of the objects fall inside.
+    float spread = (float)std::sqrt(1.22e6 / 3.0 * (1000.0 / 1100.0) / (2.4 * visibleShare));
+
+    SphereBounds spheres;
+    BoxBounds boxes;
+    MakeScene(count, spread, spheres, boxes);
+
+    XMFLOAT4X4 viewProj = MakeViewProj();
+    Frustum frustum = ExtractFrustum(viewProj);
+
+    std::vector<Result> results;
+    MeasureKind("spheres", frustum, spheres, threads, repeat,
+        [](const Frustum& f, const SphereBounds& b, uint32_t* out, const CullOptions& o) { return CullSpheres(f, b, out, o); },
+        results);
+    MeasureKind("boxes", frustum, boxes, threads, repeat,
+        [](const Frustum& f, const BoxBounds& b, uint32_t* out, const CullOptions& o) { return CullBoxes(f, b, out, o); },
+        results);
+
+    // Meshlets: the visible count is triangles drawn.
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    MakeTerrain(triangles, vertices, indices);
+
+    MeshletData meshlets = BuildMeshlets(vertices.data(), vertices.size(), indices.data(), indices.size(), MeshletOptions());
+    XMFLOAT3 eye(0.0f, 0.0f, 0.0f);
+    std::vector<uint8_t> required = RequiredTriangles(viewProj, eye, vertices, indices);
+
+    results.push_back(MeasureMeshlets("loop", meshlets, required, repeat, [&](std::vector<DrawRange>& ranges)
+    {
+        CullMeshletLoop(meshlets, frustum, eye, ranges);
+    }));
+
+    std::vector<uint32_t> meshletScratch;
+    results.push_back(MeasureMeshlets(PathName(DetectCullPath()), meshlets, required, repeat, [&](std::vector<DrawRange>& ranges)
+    {
+        CullMeshlets(meshlets, frustum, eye, ranges, meshletScratch);
+    }));
+
+    bool pass = true;
+    printf("{\n  \"objects\": %zu,\n  \"threads\": %u,\n  \"detectedPath\": \"%s\",\n  \"results\": [\n",
+        count, threads, PathName(DetectCullPath()));
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result& r = results[i];
+        pass = pass && r.valid;
+
+        // Against the plain loop of the same kind.
+        double loop = 0.0;
+        for (const Result& other : results)
+        {
+            if (other.kind == r.kind && other.path == "loop")
+                loop = other.seconds;
+        }
+
+        printf("    {\"kind\": \"%s\", \"path\": \"%s\", \"threads\": %u, \"objects\": %zu, \"visible\": %zu, "
+            "\"ms\": %.3f, \"nsPerObject\": %.2f, \"speedup\": %.2f, \"valid\": %s}%s\n",
+            r.kind.c_str(),
+            r.path.c_str(),
+            r.threads,
+            r.objects,
+            r.visible,
+            r.seconds * 1e3,
+            r.seconds * 1e9 / (double)std::max<size_t>(r.objects, 1),
+            r.seconds > 0.0 ? loop / r.seconds : 1.0,
+            r.valid ? "true" : "false",
+            i + 1 < results.size() ? "," : "");
+    }
+    printf("  ],\n  \"pass\": %s\n}\n", pass ? "true" : "false");
+
+    if (!pass)
+        fprintf(stderr, "a batch path disagreed with the scalar loop, or meshlet culling dropped a visible triangle\n");
+
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,680 @@
+// Headless benchmarks for the asset and geometry pipeline: LoadOBJ and every
+// stage BuildObj runs on its result, on obj/african_head.obj and on
+// generated meshes. Results go out as JSON; --compare checks them against
+// a stored baseline and exits with 1 on a regression.
+//
+// Linux build, from the repository root, with DirectXMath on the include
+// path:
+//
+//   g++ -std=c++17 -O2 -pthread -Isrc -o geometrybench bench/geometrybench.cpp
+//       src/parcer.cpp src/mappedfile.cpp src/meshopt.cpp src/simplify.cpp
+//       src/meshlet.cpp src/culling.cpp src/vertexpack.cpp src/meshcache.cpp
+//       src/hash.cpp src/profiler.cpp
+//
+// Usage:
+//
+//   geometrybench [--sizes 10k,100k,1m,10m,50m] [--repeat 3] [--obj path]
+//                 [--tmp dir] [--out results.json]
+//                 [--compare baseline.json] [--threshold 0.10] [--noise 0.0005]
+
+#include "parcer.h"
+#include "meshopt.h"
+#include "simplify.h"
+#include "meshlet.h"
+#include "vertexpack.h"
+#include "meshcache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <new>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace DirectX;
+
+// ===== allocation counting =====
+
+// GCC pairs the inlined malloc and free below with new and delete and warns.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+namespace
+{
+    std::atomic<uint64_t> gAllocations(0);
+    std::atomic<uint64_t> gAllocatedBytes(0);
+}
+
+void* operator new(size_t size)
+{
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    gAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+
+    if (void* p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+
+namespace
+{
+    // ===== peak memory =====
+
+    // Restarts the peak RSS counter where the OS allows it (Linux
+    // /proc/self/clear_refs); otherwise peaks are for the whole process.
+    void ResetPeakRss()
+    {
+#if !defined(_WIN32)
+        if (FILE* f = fopen("/proc/self/clear_refs", "w"))
+        {
+            fputs("5", f);
+            fclose(f);
+        }
+#endif
+    }
+
+    uint64_t PeakRss()
+    {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters = {};
+        if (K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            return counters.PeakWorkingSetSize;
+        return 0;
+#else
+        if (FILE* f = fopen("/proc/self/status", "r"))
+        {
+            char line[256];
+            unsigned long long kb = 0;
+            while (fgets(line, sizeof(line), f))
+            {
+                if (sscanf(line, "VmHWM: %llu kB", &kb) == 1)
+                    break;
+            }
+            fclose(f);
+            if (kb)
+                return kb * 1024;
+        }
+
+        rusage usage = {};
+        getrusage(RUSAGE_SELF, &usage);
+        return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+    }
+
+    // ===== measurement =====
+
+    struct Sample
+    {
+        double seconds = 0.0;
+        uint64_t allocations = 0;
+        uint64_t allocatedBytes = 0;
+        uint64_t peakRss = 0;
+    };
+
+    template <typename Fn>
+    Sample Measure(Fn fn)
+    {
+        ResetPeakRss();
+
+        uint64_t allocations = gAllocations.load();
+        uint64_t bytes = gAllocatedBytes.load();
+        auto start = std::chrono::steady_clock::now();
+
+        fn();
+
+        auto end = std::chrono::steady_clock::now();
+
+        Sample sample;
+        sample.seconds = std::chrono::duration<double>(end - start).count();
+        sample.allocations = gAllocations.load() - allocations;
+        sample.allocatedBytes = gAllocatedBytes.load() - bytes;
+        sample.peakRss = PeakRss();
+        return sample;
+    }
+
+    struct Result
+    {
+        std::string stage;
+        std::string mesh;
+        uint64_t triangles = 0;
+        // Input bytes the stage processes.
+        uint64_t bytes = 0;
+        // Best of the repeats; memory figures come from the same run.
+        Sample best;
+        bool valid = false;
+
+        void Add(const Sample& sample)
+        {
+            if (!valid || sample.seconds < best.seconds)
+                best = sample;
+            valid = true;
+        }
+    };
+
+    // Keeps one Result per (stage, mesh) across repeats, in first-seen order.
+    class ResultTable
+    {
+    public:
+        void Add(const std::string& stage, const std::string& mesh, uint64_t triangles, uint64_t bytes, const Sample& sample)
+        {
+            for (Result& r : mResults)
+            {
+                if (r.stage == stage && r.mesh == mesh)
+                {
+                    r.Add(sample);
+                    return;
+                }
+            }
+
+            Result r;
+            r.stage = stage;
+            r.mesh = mesh;
+            r.triangles = triangles;
+            r.bytes = bytes;
+            r.Add(sample);
+            mResults.push_back(r);
+        }
+
+        const std::vector<Result>& Results() const { return mResults; }
+
+    private:
+        std::vector<Result> mResults;
+    };
+
+    // ===== generated meshes =====
+
+    // UV sphere with about triangleCount triangles, as OBJ text with
+    // positions and normals. Returns the exact triangle count.
+    uint64_t WriteSphereObj(const std::string& path, uint64_t triangleCount)
+    {
+        uint64_t segments = std::max<uint64_t>(3, (uint64_t)std::sqrt((double)triangleCount / 2.0));
+        uint64_t rings = std::max<uint64_t>(2, triangleCount / (2 * segments));
+
+        FILE* f = fopen(path.c_str(), "wb");
+        if (!f)
+            return 0;
+
+        std::vector<char> buffer(1 << 20);
+        setvbuf(f, buffer.data(), _IOFBF, buffer.size());
+
+        // (rings + 1) x (segments + 1) grid, seam and poles duplicated.
+        for (uint64_t r = 0; r <= rings; r++)
+        {
+            double phi = 3.14159265358979 * r / rings;
+            for (uint64_t s = 0; s <= segments; s++)
+            {
+                double theta = 2.0 * 3.14159265358979 * s / segments;
+                double x = sin(phi) * cos(theta);
+                double y = cos(phi);
+                double z = sin(phi) * sin(theta);
+                fprintf(f, "v %.6f %.6f %.6f\nvn %.4f %.4f %.4f\n", x, y, z, x, y, z);
+            }
+        }
+
+        uint64_t written = 0;
+        for (uint64_t r = 0; r < rings; r++)
+        {
+            for (uint64_t s = 0; s < segments; s++)
+            {
+                uint64_t a = r * (segments + 1) + s + 1;
+                uint64_t b = a + segments + 1;
+                fprintf(f, "f %llu//%llu %llu//%llu %llu//%llu\n",
+                    (unsigned long long)a, (unsigned long long)a,
+                    (unsigned long long)b, (unsigned long long)b,
+                    (unsigned long long)(a + 1), (unsigned long long)(a + 1));
+                fprintf(f, "f %llu//%llu %llu//%llu %llu//%llu\n",
+                    (unsigned long long)(a + 1), (unsigned long long)(a + 1),
+                    (unsigned long long)b, (unsigned long long)b,
+                    (unsigned long long)(b + 1), (unsigned long long)(b + 1));
+                written += 2;
+            }
+        }
+
+        if (fclose(f) != 0)
+            return 0;
+        return written;
+    }
+
+    // ===== pipeline =====
+
+    // LoadOBJ, then the stages BuildObj runs on a cold start, each timed on
+    // its own.
+    bool RunPipeline(const std::string& path, const std::string& mesh, ResultTable& table)
+    {
+        uint64_t fileBytes = std::filesystem::file_size(path);
+
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        OBJLoadOptions loadOptions;
+        OBJLoadStats stats;
+        bool loaded = false;
+
+        Sample sample = Measure([&] { loaded = LoadOBJ(path, vertices, indices, loadOptions, &stats); });
+        if (!loaded)
+            return false;
+
+        uint64_t triangles = indices.size() / 3;
+        auto geometryBytes = [&] { return vertices.size() * sizeof(Vertex) + indices.size() * sizeof(uint32_t); };
+
+        table.Add("LoadOBJ", mesh, triangles, fileBytes, sample);
+
+        MeshOptimizeOptions optimizeOptions;
+        table.Add("OptimizeVertexCache", mesh, triangles, geometryBytes(), Measure([&]
+        {
+            OptimizeVertexCache(indices, vertices.size(), optimizeOptions.cacheSize);
+        }));
+
+        table.Add("OptimizeOverdraw", mesh, triangles, geometryBytes(), Measure([&]
+        {
+            OptimizeOverdraw(indices, vertices, optimizeOptions.cacheSize, optimizeOptions.overdrawThreshold);
+        }));
+
+        table.Add("OptimizeVertexFetch", mesh, triangles, geometryBytes(), Measure([&]
+        {
+            OptimizeVertexFetch(vertices, indices);
+        }));
+
+        LodChainOptions lodOptions;
+        std::vector<MeshLod> lods;
+        table.Add("BuildLodChain", mesh, triangles, geometryBytes(), Measure([&]
+        {
+            lods = BuildLodChain(vertices.data(), vertices.size(), indices, lodOptions);
+        }));
+
+        table.Add("BuildMeshlets", mesh, triangles, geometryBytes(), Measure([&]
+        {
+            MeshletData meshlets = BuildMeshlets(
+                vertices.data(), vertices.size(),
+                indices.data() + lods[0].indexOffset, lods[0].indexCount,
+                MeshletOptions()
+            );
+        }));
+
+        std::vector<PackedVertex> packed(vertices.size());
+        table.Add("PackVertices", mesh, triangles, vertices.size() * sizeof(Vertex), Measure([&]
+        {
+            PackVertices(vertices.data(), vertices.size(), stats.boundsMin, stats.boundsMax, packed.data());
+        }));
+
+        MeshData data;
+        data.vertices = vertices;
+        data.indices = indices;
+        data.lods = lods;
+        data.boundsMin = stats.boundsMin;
+        data.boundsMax = stats.boundsMax;
+        data.subsets.push_back({ 0, lods[0].indexCount, 0, (uint32_t)vertices.size() });
+
+        MeshCacheKey key;
+        table.Add("ComputeMeshCacheKey", mesh, triangles, fileBytes, Measure([&]
+        {
+            ComputeMeshCacheKey(path, loadOptions, optimizeOptions, lodOptions, key);
+        }));
+
+        std::string cachePath = MeshCachePath(path);
+        table.Add("WriteMeshCache", mesh, triangles, geometryBytes(), Measure([&]
+        {
+            WriteMeshCache(cachePath, key, data);
+        }));
+
+        table.Add("OpenMeshCache", mesh, triangles, geometryBytes(), Measure([&]
+        {
+            MeshCacheFile cache;
+            cache.Open(cachePath, key);
+        }));
+
+        std::error_code ec;
+        std::filesystem::remove(cachePath, ec);
+        return true;
+    }
+
+    // ===== JSON =====
+
+    // One result per line, so the baseline reader stays trivial.
+    bool WriteJson(FILE* f, const ResultTable& table)
+    {
+        fprintf(f, "{\n  \"version\": 1,\n  \"results\": [\n");
+
+        const std::vector<Result>& results = table.Results();
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const Result& r = results[i];
+            double seconds = std::max(r.best.seconds, 1e-9);
+
+            fprintf(f,
+                "    {\"stage\": \"%s\", \"mesh\": \"%s\", \"triangles\": %llu, \"bytes\": %llu, "
+                "\"seconds\": %.6f, \"mbPerSecond\": %.2f, \"trianglesPerSecond\": %.0f, "
+                "\"peakRssMB\": %.2f, \"allocations\": %llu, \"allocatedMB\": %.2f}%s\n",
+                r.stage.c_str(),
+                r.mesh.c_str(),
+                (unsigned long long)r.triangles,
+                (unsigned long long)r.bytes,
+                r.best.seconds,
+                r.bytes / seconds / (1024.0 * 1024.0),
+                r.triangles / seconds,
+                r.best.peakRss / (1024.0 * 1024.0),
+                (unsigned long long)r.best.allocations,
+                r.best.allocatedBytes / (1024.0 * 1024.0),
+                i + 1 < results.size() ? "," : "");
+        }
+
+        fprintf(f, "  ]\n}\n");
+        return !ferror(f);
+    }
+
+    bool JsonString(const std::string& line, const char* key, std::string& value)
+    {
+        std::string pattern = std::string("\"") + key + "\": \"";
+        size_t begin = line.find(pattern);
+        if (begin == std::string::npos)
+            return false;
+
+        begin += pattern.size();
+        size_t end = line.find('"', begin);
+        if (end == std::string::npos)
+            return false;
+
+        value = line.substr(begin, end - begin);
+        return true;
+    }
+
+    bool JsonNumber(const std::string& line, const char* key, double& value)
+    {
+        std::string pattern = std::string("\"") + key + "\": ";
+        size_t begin = line.find(pattern);
+        if (begin == std::string::npos)
+            return false;
+
+        value = atof(line.c_str() + begin + pattern.size());
+        return true;
+    }
+
+    struct BaselineEntry
+    {
+        std::string stage;
+        std::string mesh;
+        double seconds;
+        double allocations;
+    };
+
+    bool ReadBaseline(const std::string& path, std::vector<BaselineEntry>& entries)
+    {
+        FILE* f = fopen(path.c_str(), "r");
+        if (!f)
+            return false;
+
+        char buffer[1024];
+        while (fgets(buffer, sizeof(buffer), f))
+        {
+            std::string line = buffer;
+
+            BaselineEntry entry;
+            if (JsonString(line, "stage", entry.stage) &&
+                JsonString(line, "mesh", entry.mesh) &&
+                JsonNumber(line, "seconds", entry.seconds) &&
+                JsonNumber(line, "allocations", entry.allocations))
+                entries.push_back(entry);
+        }
+
+        fclose(f);
+        return true;
+    }
+
+    // Slower by more than threshold and by more than noise seconds, or more
+    // allocations, is a regression. The absolute floor keeps sub-millisecond
+    // stages from failing on timer jitter.
+    int Compare(const ResultTable& table, const std::vector<BaselineEntry>& baseline, double threshold, double noise)
+    {
+        int regressions = 0;
+
+        fprintf(stderr, "%-22s %-16s %12s %12s %8s\n", "stage", "mesh", "baseline ms", "current ms", "change");
+        for (const Result& r : table.Results())
+        {
+            const BaselineEntry* base = nullptr;
+            for (const BaselineEntry& b : baseline)
+            {
+                if (b.stage == r.stage && b.mesh == r.mesh)
+                    base = &b;
+            }
+
+            if (!base)
+            {
+                fprintf(stderr, "%-22s %-16s %12s %12.3f %8s\n", r.stage.c_str(), r.mesh.c_str(), "-", r.best.seconds * 1e3, "new");
+                continue;
+            }
+
+            double change = base->seconds > 0.0 ? r.best.seconds / base->seconds - 1.0 : 0.0;
+            bool slower = change > threshold && r.best.seconds - base->seconds > noise;
+            bool allocates = r.best.allocations > base->allocations * (1.0 + threshold);
+
+            fprintf(stderr, "%-22s %-16s %12.3f %12.3f %+7.1f%%%s%s\n",
+                r.stage.c_str(),
+                r.mesh.c_str(),
+                base->seconds * 1e3,
+                r.best.seconds * 1e3,
+                change * 100.0,
+                slower ? "  REGRESSION" : "",
+                allocates ? "  MORE ALLOCATIONS" : "");
+
+            if (slower || allocates)
+                ++regressions;
+        }
+
+        return regressions;
+    }
+
+    // ===== command line =====
+
+    bool ParseCount(const std::string& text, uint64_t& count)
+    {
+        char* end = nullptr;
+        double value = strtod(text.c_str(), &end);
+        if (end == text.c_str() || value <= 0.0)
+            return false;
+
+        switch (*end)
+        {
+        case 'k': case 'K': value *= 1e3; break;
+        case 'm': case 'M': value *= 1e6; break;
+        case 'g': case 'G': value *= 1e9; break;
+        case '\0': break;
+        default: return false;
+        }
+
+        count = (uint64_t)value;
+        return true;
+    }
+
+    bool ParseSizes(const std::string& text, std::vector<uint64_t>& sizes)
+    {
+        sizes.clear();
+
+        size_t begin = 0;
+        while (begin <= text.size())
+        {
+            size_t end = text.find(',', begin);
+            if (end == std::string::npos)
+                end = text.size();
+
+            uint64_t count;
+            if (!ParseCount(text.substr(begin, end - begin), count))
+                return false;
+            sizes.push_back(count);
+
+            begin = end + 1;
+        }
+
+        return !sizes.empty();
+    }
+
+    std::string SizeName(uint64_t triangles)
+    {
+        char name[64];
+        if (triangles >= 1000000 && triangles % 1000000 == 0)
+            snprintf(name, sizeof(name), "sphere_%llum", (unsigned long long)(triangles / 1000000));
+        else if (triangles >= 1000 && triangles % 1000 == 0)
+            snprintf(name, sizeof(name), "sphere_%lluk", (unsigned long long)(triangles / 1000));
+        else
+            snprintf(name, sizeof(name), "sphere_%llu", (unsigned long long)triangles);
+        return name;
+    }
+
+    void PrintUsage()
+    {
+        fprintf(stderr,
+            "usage: geometrybench [--sizes 10k,100k,1m,10m,50m] [--repeat N] [--obj path]\n"
+            "                     [--tmp dir] [--out results.json]\n"
+            "                     [--compare baseline.json] [--threshold 0.10] [--noise 0.0005]\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<uint64_t> sizes = { 10000, 100000, 1000000, 10000000, 50000000 };
+    int repeat = 3;
+    std::string objPath = "obj/african_head.obj";
+    std::string tmpDir = std::filesystem::temp_directory_path().string();
+    std::string outPath;
+    std::string baselinePath;
+    double threshold = 0.10;
+    double noise = 0.0005;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--sizes" && hasValue)
+        {
+            if (!ParseSizes(argv[++i], sizes))
+            {
+                PrintUsage();
+                return 2;
+            }
+        }
+        else if (arg == "--repeat" && hasValue)
+            repeat = std::max(1, atoi(argv[++i]));
+        else if (arg == "--obj" && hasValue)
+            objPath = argv[++i];
+        else if (arg == "--tmp" && hasValue)
+            tmpDir = argv[++i];
+        else if (arg == "--out" && hasValue)
+            outPath = argv[++i];
+        else if (arg == "--compare" && hasValue)
+            baselinePath = argv[++i];
+        else if (arg == "--threshold" && hasValue)
+            threshold = atof(argv[++i]);
+        else if (arg == "--noise" && hasValue)
+            noise = atof(argv[++i]);
+        else
+        {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    ResultTable table;
+
+    if (!objPath.empty() && std::filesystem::exists(objPath))
+    {
+        std::string mesh = std::filesystem::path(objPath).stem().string();
+        for (int r = 0; r < repeat; r++)
+            RunPipeline(objPath, mesh, table);
+        fprintf(stderr, "%s done\n", mesh.c_str());
+    }
+    else
+    {
+        fprintf(stderr, "%s not found, skipped\n", objPath.c_str());
+    }
+
+    for (uint64_t size : sizes)
+    {
+        std::string mesh = SizeName(size);
+        std::string path = (std::filesystem::path(tmpDir) / (mesh + ".obj")).string();
+
+        if (WriteSphereObj(path, size) == 0)
+        {
+            fprintf(stderr, "failed to write %s\n", path.c_str());
+            return 1;
+        }
+
+        for (int r = 0; r < repeat; r++)
+        {
+            if (!RunPipeline(path, mesh, table))
+                fprintf(stderr, "%s: LoadOBJ failed\n", mesh.c_str());
+        }
+
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+        fprintf(stderr, "%s done\n", mesh.c_str());
+    }
+
+    if (outPath.empty())
+    {
+        WriteJson(stdout, table);
+    }
+    else
+    {
+        FILE* f = fopen(outPath.c_str(), "w");
+        bool ok = f && WriteJson(f, table);
+        if (f)
+            ok = fclose(f) == 0 && ok;
+        if (!ok)
+        {
+            fprintf(stderr, "failed to write %s\n", outPath.c_str());
+            return 1;
+        }
+    }
+
+    if (!baselinePath.empty())
+    {
+        std::vector<BaselineEntry> baseline;
+        if (!ReadBaseline(baselinePath, baseline))
+        {
+            fprintf(stderr, "failed to read %s\n", baselinePath.c_str());
+            return 1;
+        }
+
+        int regressions = Compare(table, baseline, threshold, noise);
+        fprintf(stderr, "%d regression(s) over %.0f%%\n", regressions, threshold * 100.0);
+        return regressions > 0 ? 1 : 0;
+    }
+
+    return 0;
+}
@@ -0,0 +1,666 @@
+// Fuzzes and benchmarks TlsfAllocator and GpuMemoryPool.
+//
+// The fuzz runs random allocate and free sequences, seeded, against a
+// shadow copy of the live allocations: every allocation must be aligned,
+// in range and disjoint from the others, the counters must match the
+// shadow, and Validate must pass after every operation. The pool fuzz
+// adds oversized requests, defragmentation moves and a fake heap backend
+// that checks blocks are created and destroyed in pairs. Any failure
+// exits with 1.
+//
+// The benchmark times single Allocate and Free calls on a half full
+// allocator, and reports how fragmented the free space gets under a
+// steady churn, and what a defragmentation pass gives back in the pool.
+// Results go out as JSON.
+//
+// Linux build, from the repository root:
+//
+//   g++ -std=c++17 -O2 -Isrc -o heapbench bench/heapbench.cpp src/tlsf.cpp
+//       src/gpuheap.cpp
+//
+// Usage:
+//
+//   heapbench [--seeds 30] [--ops 20k] [--latency-ops 1m]
+
+#include "tlsf.h"
+#include "gpuheap.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Live ranges keyed by offset, for overlap checks.
+    class Shadow
+    {
+    public:
+        // False when [offset, offset + size) overlaps a live range.
+        bool Insert(uint64_t offset, uint64_t size)
+        {
+            auto next = mRanges.lower_bound(offset);
+            if (next != mRanges.end() && next->first < offset + size)
+                return false;
+            if (next != mRanges.begin() && std::prev(next)->second > offset)
+                return false;
+
+            mRanges[offset] = offset + size;
+            mBytes += size;
+            return true;
+        }
+
+        void Erase(uint64_t offset)
+        {
+            auto it = mRanges.find(offset);
+            mBytes -= it->second - it->first;
+            mRanges.erase(it);
+        }
+
+        size_t Count() const { return mRanges.size(); }
+        uint64_t Bytes() const { return mBytes; }
+
+    private:
+        std::map<uint64_t, uint64_t> mRanges;
+        uint64_t mBytes = 0;
+    };
+
+    // Log uniform between 1 and maxSize.
+    uint64_t RandomSize(std::mt19937_64& rng, uint64_t maxSize)
+    {
+        std::uniform_real_distribution<double> exponent(0.0, std::log2((double)maxSize));
+        return std::max<uint64_t>(1, (uint64_t)std::exp2(exponent(rng)));
+    }
+
+    uint64_t RandomAlignment(std::mt19937_64& rng, uint32_t maxShift)
+    {
+        return 1ull << std::uniform_int_distribution<uint32_t>(0, maxShift)(rng);
+    }
+
+    struct FuzzResult
+    {
+        uint64_t ops = 0;
+        uint64_t allocations = 0;
+        uint64_t failedAllocations = 0;
+        uint64_t errors = 0;
+    };
+
+    // ===== TlsfAllocator fuzz =====
+
+    void FuzzTlsf(uint64_t seed, size_t ops, FuzzResult& result)
+    {
+        std::mt19937_64 rng(seed);
+
+        uint64_t granularity = RandomAlignment(rng, 8);
+        uint64_t size = (1ull << std::uniform_int_distribution<uint32_t>(16, 26)(rng)) +
+            std::uniform_int_distribution<uint64_t>(0, 1 << 16)(rng);
+
+        TlsfAllocator allocator;
+        allocator.Initialize(size, granularity);
+
+        std::vector<TlsfAllocation> live;
+        Shadow shadow;
+
+        auto fail = [&](const char* what, size_t op)
+        {
+            if (result.errors++ < 10)
+                fprintf(stderr, "tlsf seed %llu op %zu: %s\n", (unsigned long long)seed, op, what);
+        };
+
+        // Phases of mostly allocating and mostly freeing, so the allocator
+        // runs both nearly full and nearly empty.
+        double allocateBias = 0.7;
+
+        for (size_t op = 0; op < ops; op++)
+        {
+            if (op % 2000 == 0)
+                allocateBias = allocateBias > 0.5 ? 0.3 : 0.7;
+
+            bool allocate = live.empty() || std::uniform_real_distribution<double>(0.0, 1.0)(rng) < allocateBias;
+            if (allocate)
+            {
+                uint64_t request = RandomSize(rng, allocator.Size() / 8);
+                uint64_t alignment = RandomAlignment(rng, 16);
+
+                TlsfAllocation allocation;
+                if (allocator.Allocate(request, alignment, allocation))
+                {
+                    ++result.allocations;
+                    if (allocation.size < request || allocation.size % granularity != 0)
+                        fail("allocation size", op);
+                    if (allocation.offset % std::max(alignment, granularity) != 0)
+                        fail("allocation alignment", op);
+                    if (allocation.offset + allocation.size > allocator.Size())
+                        fail("allocation out of range", op);
+                    if (!shadow.Insert(allocation.offset, allocation.size))
+                        fail("allocation overlaps a live one", op);
+                    else
+                        live.push_back(allocation);
+                }
+                else
+                {
+                    ++result.failedAllocations;
+                    // Good fit may skip a region, but never with room for
+                    // the worst case alignment padding.
+                    uint64_t worst = ((request + granularity - 1) / granularity * granularity) +
+                        std::max(alignment, granularity) - granularity;
+                    if (allocator.LargestFreeRegion() >= 2 * worst + 2 * granularity * 16)
+                        fail("allocation failed with room to spare", op);
+                }
+            }
+            else
+            {
+                size_t index = std::uniform_int_distribution<size_t>(0, live.size() - 1)(rng);
+                shadow.Erase(live[index].offset);
+                allocator.Free(live[index]);
+                live[index] = live.back();
+                live.pop_back();
+            }
+
+            if (!allocator.Validate())
+                fail("Validate", op);
+            if (allocator.UsedBytes() != shadow.Bytes() || allocator.AllocationCount() != shadow.Count())
+                fail("counters differ from the live allocations", op);
+
+            if (op % 1000 == 999)
+            {
+                std::vector<TlsfAllocation> listed;
+                allocator.GetAllocations(listed);
+                bool ordered = listed.size() == live.size();
+                for (size_t i = 1; i < listed.size() && ordered; i++)
+                    ordered = listed[i - 1].offset + listed[i - 1].size <= listed[i].offset;
+                if (!ordered)
+                    fail("GetAllocations", op);
+            }
+        }
+
+        for (const TlsfAllocation& allocation : live)
+            allocator.Free(allocation);
+
+        if (!allocator.Validate() || allocator.UsedBytes() != 0 || allocator.FreeRegionCount() != 1 ||
+            allocator.LargestFreeRegion() != allocator.Size())
+            fail("free space did not merge back into one region", ops);
+
+        result.ops += ops;
+    }
+
+    // ===== GpuMemoryPool fuzz =====
+
+    // Checks the pool creates and destroys every block exactly once.
+    class FakeBackend : public GpuHeapBackend
+    {
+    public:
+        bool CreateHeap(uint32_t block, uint64_t size, uint64_t alignment) override
+        {
+            if (block >= mSizes.size())
+                mSizes.resize(block + 1, 0);
+            if (mSizes[block] != 0 || size == 0 || size % alignment != 0)
+                ++errors;
+
+            mSizes[block] = size;
+            ++created;
+            return true;
+        }
+
+        void DestroyHeap(uint32_t block) override
+        {
+            if (block >= mSizes.size() || mSizes[block] == 0)
+                ++errors;
+            else
+                mSizes[block] = 0;
+            ++destroyed;
+        }
+
+        uint64_t Size(uint32_t block) const { return block < mSizes.size() ? mSizes[block] : 0; }
+
+        uint32_t AliveCount() const
+        {
+            uint32_t count = 0;
+            for (uint64_t size : mSizes)
+                count += size != 0;
+            return count;
+        }
+
+        uint64_t created = 0;
+        uint64_t destroyed = 0;
+        uint64_t errors = 0;
+
+    private:
+        std::vector<uint64_t> mSizes;
+    };
+
+    void FuzzPool(uint64_t seed, size_t ops, FuzzResult& result)
+    {
+        std::mt19937_64 rng(seed);
+
+        GpuPoolOptions options;
+        options.blockSize = 16ull << 20;
+        options.maxEmptyBlocks = std::uniform_int_distribution<uint32_t>(0, 2)(rng);
+
+        FakeBackend backend;
+        GpuMemoryPool pool;
+        pool.Initialize(&backend, options);
+
+        std::vector<GpuAllocation> live;
+        std::vector<Shadow> shadows;
+
+        auto fail = [&](const char* what, size_t op)
+        {
+            if (result.errors++ < 10)
+                fprintf(stderr, "pool seed %llu op %zu: %s\n", (unsigned long long)seed, op, what);
+        };
+
+        auto track = [&](const GpuAllocation& allocation, uint64_t alignment, size_t op)
+        {
+            if (allocation.Offset() % std::max(alignment, options.granularity) != 0)
+                fail("allocation alignment", op);
+            if (allocation.Offset() + allocation.Size() > backend.Size(allocation.block))
+                fail("allocation outside its heap", op);
+
+            if (allocation.block >= shadows.size())
+                shadows.resize(allocation.block + 1);
+            if (!shadows[allocation.block].Insert(allocation.Offset(), allocation.Size()))
+                fail("allocation overlaps a live one", op);
+        };
+
+        double allocateBias = 0.7;
+
+        for (size_t op = 0; op < ops; op++)
+        {
+            if (op % 2000 == 0)
+                allocateBias = allocateBias > 0.5 ? 0.3 : 0.7;
+
+            double roll = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+            if (roll < 0.005)
+            {
+                // Defragment and carry out every move.
+                std::vector<GpuDefragMove> moves;
+                pool.PlanDefragment(std::uniform_int_distribution<uint64_t>(1, 64)(rng) << 20, moves);
+
+                for (const GpuDefragMove& move : moves)
+                {
+                    auto it = std::find_if(live.begin(), live.end(), [&](const GpuAllocation& a)
+                    {
+                        return a.block == move.source.block && a.Offset() == move.source.Offset();
+                    });
+                    if (it == live.end())
+                    {
+                        fail("move of an allocation that is not live", op);
+                        continue;
+                    }
+
+                    track(move.destination, move.source.range.alignment, op);
+                    shadows[move.source.block].Erase(move.source.Offset());
+                    pool.CompleteMove(move);
+                    *it = move.destination;
+                }
+            }
+            else if (live.empty() || roll < allocateBias)
+            {
+                // A few requests larger than a block get a dedicated one.
+                uint64_t size = roll < 0.02 ? options.blockSize + RandomSize(rng, options.blockSize) :
+                    RandomSize(rng, 4ull << 20);
+                uint64_t alignment = RandomAlignment(rng, 22);
+
+                GpuAllocation allocation;
+                if (pool.Allocate(size, alignment, allocation))
+                {
+                    ++result.allocations;
+                    if (allocation.Size() < size)
+                        fail("allocation size", op);
+                    track(allocation, alignment, op);
+                    live.push_back(allocation);
+                }
+                else
+                {
+                    ++result.failedAllocations;
+                    fail("allocation failed; the pool can always add a block", op);
+                }
+            }
+            else
+            {
+                size_t index = std::uniform_int_distribution<size_t>(0, live.size() - 1)(rng);
+                shadows[live[index].block].Erase(live[index].Offset());
+                pool.Free(live[index]);
+                live[index] = live.back();
+                live.pop_back();
+            }
+
+            GpuPoolStats stats = pool.Stats();
+            uint64_t bytes = 0;
+            for (const Shadow& shadow : shadows)
+                bytes += shadow.Bytes();
+
+            if (stats.usedBytes != bytes || stats.allocationCount != live.size())
+                fail("stats differ from the live allocations", op);
+            if (stats.blockCount != backend.AliveCount())
+                fail("block count differs from the heaps alive", op);
+        }
+
+        for (GpuAllocation& allocation : live)
+            pool.Free(allocation);
+
+        GpuPoolStats stats = pool.Stats();
+        if (stats.usedBytes != 0 || stats.blockCount > options.maxEmptyBlocks)
+            fail("empty blocks outlived maxEmptyBlocks", ops);
+
+        pool.Shutdown();
+        if (backend.AliveCount() != 0 || backend.created != backend.destroyed)
+            fail("heaps left alive after Shutdown", ops);
+
+        result.errors += backend.errors;
+        result.ops += ops;
+    }
+
+    // ===== latency =====
+
+    struct Latency
+    {
+        double p50 = 0.0;
+        double p99 = 0.0;
+        double p999 = 0.0;
+        double max = 0.0;
+        double mean = 0.0;
+    };
+
+    Latency Summarize(std::vector<double>& ns)
+    {
+        Latency latency;
+        if (ns.empty())
+            return latency;
+
+        std::sort(ns.begin(), ns.end());
+        auto at = [&](double q) { return ns[std::min(ns.size() - 1, (size_t)(q * ns.size()))]; };
+
+        latency.p50 = at(0.5);
+        latency.p99 = at(0.99);
+        latency.p999 = at(0.999);
+        latency.max = ns.back();
+
+        double sum = 0.0;
+        for (double v : ns)
+            sum += v;
+        latency.mean = sum / ns.size();
+        return latency;
+    }
+
+    // One Allocate and one Free per step on a 256MB allocator kept about
+    // half full, timed one by one. The clock read is part of every sample.
+    void MeasureLatency(size_t ops, Latency& allocate, Latency& free)
+    {
+        std::mt19937_64 rng(1);
+
+        TlsfAllocator allocator;
+        allocator.Initialize(256ull << 20, 256);
+
+        std::vector<TlsfAllocation> live;
+        while (allocator.UsedBytes() < allocator.Size() / 2)
+        {
+            TlsfAllocation allocation;
+            if (allocator.Allocate(RandomSize(rng, 1 << 20), RandomAlignment(rng, 12), allocation))
+                live.push_back(allocation);
+        }
+
+        // Drawn up front so the generator stays out of the samples.
+        std::vector<uint64_t> sizes(ops);
+        std::vector<uint64_t> alignments(ops);
+        std::vector<size_t> victims(ops);
+        for (size_t i = 0; i < ops; i++)
+        {
+            sizes[i] = RandomSize(rng, 1 << 20);
+            alignments[i] = RandomAlignment(rng, 12);
+            victims[i] = (size_t)rng();
+        }
+
+        std::vector<double> allocateNs;
+        std::vector<double> freeNs;
+        allocateNs.reserve(ops);
+        freeNs.reserve(ops);
+
+        for (size_t i = 0; i < ops; i++)
+        {
+            TlsfAllocation allocation;
+            auto start = Clock::now();
+            bool ok = allocator.Allocate(sizes[i], alignments[i], allocation);
+            auto end = Clock::now();
+            allocateNs.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+
+            if (ok)
+                live.push_back(allocation);
+
+            size_t index = victims[i] % live.size();
+            start = Clock::now();
+            allocator.Free(live[index]);
+            end = Clock::now();
+            freeNs.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+
+            live[index] = live.back();
+            live.pop_back();
+        }
+
+        allocate = Summarize(allocateNs);
+        free = Summarize(freeNs);
+    }
+
+    // ===== fragmentation =====
+
+    struct Fragmentation
+    {
+        double fill = 0.0;
+        double fragmentation = 0.0;
+        uint32_t freeRegions = 0;
+        uint64_t largestFreeRegion = 0;
+        // Allocations that failed although FreeBytes would have held them.
+        uint64_t failedWithRoom = 0;
+    };
+
+    // Churn at a fixed fill level with mixed sizes, then read the layout.
+    Fragmentation MeasureTlsfFragmentation(double targetFill, size_t ops)
+    {
+        std::mt19937_64 rng(2);
+
+        TlsfAllocator allocator;
+        allocator.Initialize(256ull << 20, 256);
+
+        std::vector<TlsfAllocation> live;
+        Fragmentation result;
+
+        for (size_t i = 0; i < ops; i++)
+        {
+            bool allocate = live.empty() || (double)allocator.UsedBytes() < targetFill * allocator.Size();
+            if (allocate)
+            {
+                uint64_t size = RandomSize(rng, 4 << 20);
+                TlsfAllocation allocation;
+                if (allocator.Allocate(size, RandomAlignment(rng, 16), allocation))
+                    live.push_back(allocation);
+                else if (allocator.FreeBytes() >= size)
+                    ++result.failedWithRoom;
+            }
+            else
+            {
+                size_t index = (size_t)(rng() % live.size());
+                allocator.Free(live[index]);
+                live[index] = live.back();
+                live.pop_back();
+            }
+        }
+
+        uint64_t freeBytes = allocator.FreeBytes();
+        result.fill = (double)allocator.UsedBytes() / allocator.Size();
+        result.freeRegions = allocator.FreeRegionCount();
+        result.largestFreeRegion = allocator.LargestFreeRegion();
+        result.fragmentation = freeBytes > 0 ? 1.0 - (double)result.largestFreeRegion / freeBytes : 0.0;
+        return result;
+    }
+
+    struct PoolDefrag
+    {
+        GpuPoolStats before;
+        GpuPoolStats after;
+        size_t moves = 0;
+        uint64_t movedBytes = 0;
+    };
+
+    // Fills the pool, frees most of it at random, then defragments.
+    PoolDefrag MeasurePoolDefrag()
+    {
+        std::mt19937_64 rng(3);
+
+        FakeBackend backend;
+        GpuPoolOptions options;
+        options.blockSize = 64ull << 20;
+
+        GpuMemoryPool pool;
+        pool.Initialize(&backend, options);
+
+        std::vector<GpuAllocation> live;
+        for (int i = 0; i < 4000; i++)
+        {
+            GpuAllocation allocation;
+            if (pool.Allocate(RandomSize(rng, 2 << 20), RandomAlignment(rng, 16), allocation))
+                live.push_back(allocation);
+        }
+
+        for (size_t i = 0; i < live.size(); i++)
+        {
+            if (rng() % 4 != 0)
+                pool.Free(live[i]);
+        }
+
+        PoolDefrag result;
+        result.before = pool.Stats();
+
+        std::vector<GpuDefragMove> moves;
+        pool.PlanDefragment(~0ull, moves);
+        for (const GpuDefragMove& move : moves)
+        {
+            result.movedBytes += move.source.Size();
+            pool.CompleteMove(move);
+        }
+
+        result.moves = moves.size();
+        result.after = pool.Stats();
+        return result;
+    }
+
+    bool ParseCount(const std::string& text, size_t& count)
+    {
+        char* end = nullptr;
+        double value = strtod(text.c_str(), &end);
+        if (end == text.c_str() || value <= 0.0)
+            return false;
+
+        switch (*end)
+        {
+        case 'k': case 'K': value *= 1e3; break;
+        case 'm': case 'M': value *= 1e6; break;
+        case '\0': break;
+        default: return false;
+        }
+
+        count = (size_t)value;
+        return true;
+    }
+
+    void PrintUsage()
+    {
+        fprintf(stderr, "usage: heapbench [--seeds 30] [--ops 20k] [--latency-ops 1m]\n");
+    }
+
+    void PrintLatency(const char* name, const Latency& latency, const char* separator)
+    {
+        printf("    \"%s\": {\"meanNs\": %.1f, \"p50Ns\": %.1f, \"p99Ns\": %.1f, \"p999Ns\": %.1f, \"maxNs\": %.1f}%s\n",
+            name, latency.mean, latency.p50, latency.p99, latency.p999, latency.max, separator);
+    }
+
+    void PrintPoolStats(const char* name, const GpuPoolStats& stats, const char* separator)
+    {
+        printf("    \"%s\": {\"blocks\": %u, \"reservedMB\": %.1f, \"usedMB\": %.1f, \"freeRegions\": %u, "
+            "\"fragmentation\": %.3f}%s\n",
+            name, stats.blockCount, stats.reservedBytes / 1048576.0, stats.usedBytes / 1048576.0,
+            stats.freeRegionCount, stats.Fragmentation(), separator);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t seeds = 30;
+    size_t ops = 20000;
+    size_t latencyOps = 1000000;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--seeds" && hasValue && ParseCount(argv[i + 1], seeds))
+            ++i;
+        else if (arg == "--ops" && hasValue && ParseCount(argv[i + 1], ops))
+            ++i;
+        else if (arg == "--latency-ops" && hasValue && ParseCount(argv[i + 1], latencyOps))
+            ++i;
+        else
+        {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    FuzzResult tlsf;
+    FuzzResult pool;
+    for (size_t seed = 1; seed <= seeds; seed++)
+    {
+        FuzzTlsf(seed, ops, tlsf);
+        FuzzPool(seed, ops, pool);
+    }
+
+    Latency allocateLatency;
+    Latency freeLatency;
+    MeasureLatency(latencyOps, allocateLatency, freeLatency);
+
+    const double fills[] = { 0.5, 0.75, 0.9 };
+    std::vector<Fragmentation> churn;
+    for (double fill : fills)
+        churn.push_back(MeasureTlsfFragmentation(fill, 200000));
+
+    PoolDefrag defrag = MeasurePoolDefrag();
+
+    bool pass = tlsf.errors == 0 && pool.errors == 0;
+
+    printf("{\n  \"fuzz\": {\n");
+    printf("    \"seeds\": %zu,\n    \"opsPerSeed\": %zu,\n", seeds, ops);
+    printf("    \"tlsf\": {\"ops\": %llu, \"allocations\": %llu, \"failedAllocations\": %llu, \"errors\": %llu},\n",
+        (unsigned long long)tlsf.ops, (unsigned long long)tlsf.allocations,
+        (unsigned long long)tlsf.failedAllocations, (unsigned long long)tlsf.errors);
+    printf("    \"pool\": {\"ops\": %llu, \"allocations\": %llu, \"failedAllocations\": %llu, \"errors\": %llu}\n",
+        (unsigned long long)pool.ops, (unsigned long long)pool.allocations,
+        (unsigned long long)pool.failedAllocations, (unsigned long long)pool.errors);
+    printf("  },\n  \"latency\": {\n");
+    PrintLatency("allocate", allocateLatency, ",");
+    PrintLatency("free", freeLatency, "");
+    printf("  },\n  \"fragmentation\": [\n");
+    for (size_t i = 0; i < churn.size(); i++)
+    {
+        const Fragmentation& f = churn[i];
+        printf("    {\"targetFill\": %.2f, \"fill\": %.3f, \"fragmentation\": %.3f, \"freeRegions\": %u, "
+            "\"largestFreeMB\": %.2f, \"failedWithRoom\": %llu}%s\n",
+            fills[i], f.fill, f.fragmentation, f.freeRegions, f.largestFreeRegion / 1048576.0,
+            (unsigned long long)f.failedWithRoom, i + 1 < churn.size() ? "," : "");
+    }
+    printf("  ],\n  \"defragment\": {\n");
+    printf("    \"moves\": %zu,\n    \"movedMB\": %.1f,\n", defrag.moves, defrag.movedBytes / 1048576.0);
+    PrintPoolStats("before", defrag.before, ",");
+    PrintPoolStats("after", defrag.after, "");
+    printf("  },\n  \"pass\": %s\n}\n", pass ? "true" : "false");
+
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,365 @@
+// Benchmarks InstanceBatcher at crowd sizes: what Add costs per instance,
+// how fast Build fills the instance buffer on one thread and on the job
+// system, and what Filter costs, against the one-draw-per-copy path it
+// replaced, which wrote a whole ObjectConstants per copy. The global
+// allocator is counted: once a frame's count has been seen, a frame that
+// still allocates fails. Every frame's buffer and draws are checked against
+// the instances added; a mismatch exits with 1. Results go out as JSON.
+//
+// Linux build, from the repository root, with DirectXMath on the include
+// path:
+//
+//   g++ -std=c++17 -O2 -pthread -Isrc -o instancingbench bench/instancingbench.cpp
+//       src/instancing.cpp src/jobs.cpp
+//
+// Usage:
+//
+//   instancingbench [--instances 100k] [--meshes 8] [--frames 50] [--threads 0]
+
+#include "instancing.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+    std::atomic<uint64_t> gAllocations(0);
+}
+
+// Counts every heap allocation of the process, workers included.
+void* operator new(size_t size)
+{
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+
+    if (void* p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double Seconds(Clock::time_point start, Clock::time_point end)
+    {
+        return std::chrono::duration<double>(end - start).count();
+    }
+
+    struct Instance
+    {
+        MeshHandle mesh;
+        XMFLOAT4X4 world;
+        XMFLOAT4 color;
+    };
+
+    // A crowd spread over the meshes unevenly, the way real scenes are:
+    // mesh m gets about twice the copies of mesh m + 1.
+    std::vector<Instance> MakeCrowd(size_t count, size_t meshes)
+    {
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+        std::vector<Instance> crowd(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            size_t mesh = 0;
+            while (mesh + 1 < meshes && unit(rng) < 0.5f)
+                mesh++;
+
+            float angle = unit(rng) * 6.2831853f;
+            float scale = 0.5f + unit(rng);
+            float c = std::cos(angle) * scale;
+            float s = std::sin(angle) * scale;
+
+            Instance& instance = crowd[i];
+            instance.mesh = (MeshHandle)mesh;
+            instance.world = {
+                c, 0.0f, -s, 0.0f,
+                0.0f, scale, 0.0f, 0.0f,
+                s, 0.0f, c, 0.0f,
+                unit(rng) * 1000.0f, 0.0f, unit(rng) * 1000.0f, 1.0f
+            };
+            instance.color = XMFLOAT4(unit(rng), unit(rng), unit(rng), 1.0f);
+        }
+        return crowd;
+    }
+
+    // The buffer holds every mesh's instances in registration order, each
+    // the transposed world rows and color of what was added.
+    bool CheckBuild(
+        const std::vector<Instance>& crowd,
+        size_t meshes,
+        const InstanceData* buffer,
+        const std::vector<InstanceDraw>& draws,
+        const std::vector<uint8_t>* keep)
+    {
+        std::vector<std::vector<size_t>> expected(meshes);
+        for (size_t i = 0; i < crowd.size(); i++)
+        {
+            if (!keep || (*keep)[i])
+                expected[crowd[i].mesh].push_back(i);
+        }
+
+        uint32_t first = 0;
+        size_t d = 0;
+        for (size_t m = 0; m < meshes; m++)
+        {
+            if (expected[m].empty())
+                continue;
+
+            if (d >= draws.size() || draws[d].mesh != m || draws[d].firstInstance != first ||
+                draws[d].instanceCount != expected[m].size())
+                return false;
+
+            for (size_t k = 0; k < expected[m].size(); k++)
+            {
+                const Instance& source = crowd[expected[m][k]];
+                const InstanceData& built = buffer[first + k];
+                for (int r = 0; r < 3; r++)
+                {
+                    if (built.world[r].x != source.world.m[0][r] || built.world[r].y != source.world.m[1][r] ||
+                        built.world[r].z != source.world.m[2][r] || built.world[r].w != source.world.m[3][r])
+                        return false;
+                }
+                if (memcmp(&built.color, &source.color, sizeof(XMFLOAT4)) != 0)
+                    return false;
+            }
+
+            first += (uint32_t)expected[m].size();
+            d++;
+        }
+
+        return d == draws.size();
+    }
+
+    // Best of the frames: the rest is noise from the machine.
+    struct Timing
+    {
+        double best = 1e30;
+
+        void Add(double seconds)
+        {
+            best = std::min(best, seconds);
+        }
+    };
+
+    bool ParseCount(const std::string& text, size_t& count)
+    {
+        char* end = nullptr;
+        double value = strtod(text.c_str(), &end);
+        if (end == text.c_str() || value <= 0.0)
+            return false;
+
+        switch (*end)
+        {
+        case 'k': case 'K': value *= 1e3; break;
+        case 'm': case 'M': value *= 1e6; break;
+        case '\0': break;
+        default: return false;
+        }
+
+        count = (size_t)value;
+        return true;
+    }
+
+    void PrintUsage()
+    {
+        fprintf(stderr, "usage: instancingbench [--instances 100k] [--meshes 8] [--frames 50] [--threads 0]\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = 100000;
+    size_t meshes = 8;
+    int frames = 50;
+    unsigned threads = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--instances" && hasValue && ParseCount(argv[i + 1], count))
+            ++i;
+        else if (arg == "--meshes" && hasValue && ParseCount(argv[i + 1], meshes))
+            ++i;
+        else if (arg == "--frames" && hasValue)
+            frames = std::max(2, atoi(argv[++i]));
+        else if (arg == "--threads" && hasValue)
+            threads = (unsigned)std::max(0, atoi(argv[++i]));
+        else
+        {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<Instance> crowd = MakeCrowd(count, meshes);
+
+    // Every other instance survives the filter.
+    std::vector<uint8_t> keep(count);
+    for (size_t i = 0; i < count; i++)
+        keep[i] = (uint8_t)(i % 2 == 0);
+
+    JobSystem jobs;
+    jobs.Initialize(threads);
+
+    InstanceBatcher batcher;
+    for (size_t m = 0; m < meshes; m++)
+        batcher.RegisterMesh({ 3000, (uint32_t)(m * 3000), 0 });
+
+    std::vector<InstanceData> buffer(count);
+    std::vector<InstanceData> parallelBuffer(count);
+    std::vector<InstanceDraw> draws;
+    std::vector<InstanceDraw> parallelDraws;
+    draws.reserve(meshes);
+    parallelDraws.reserve(meshes);
+
+    // One draw per copy: a whole constant buffer each.
+    std::vector<ObjectConstants> constants(count);
+
+    Timing add;
+    Timing build;
+    Timing buildParallel;
+    Timing filter;
+    Timing perCopy;
+    uint64_t steadyAllocations = 0;
+    bool valid = true;
+
+    for (int frame = 0; frame < frames; frame++)
+    {
+        // The first frame sizes the lists; from the second on nothing may
+        // allocate.
+        uint64_t allocationsBefore = gAllocations.load();
+
+        auto start = Clock::now();
+        batcher.Clear();
+        for (const Instance& instance : crowd)
+            batcher.Add(instance.mesh, instance.world, instance.color);
+        auto added = Clock::now();
+
+        batcher.Build(buffer.data(), draws);
+        auto built = Clock::now();
+
+        batcher.Build(parallelBuffer.data(), parallelDraws, &jobs);
+        auto builtParallel = Clock::now();
+
+        size_t index = 0;
+        size_t dropped = batcher.Filter([&](MeshHandle, const InstanceData&)
+        {
+            // Filter visits mesh after mesh, in the order Build wrote.
+            return keep[index++] != 0;
+        });
+        auto filtered = Clock::now();
+
+        if (frame > 0)
+            steadyAllocations += gAllocations.load() - allocationsBefore;
+
+        add.Add(Seconds(start, added));
+        build.Add(Seconds(added, built));
+        buildParallel.Add(Seconds(built, builtParallel));
+        filter.Add(Seconds(builtParallel, filtered));
+
+        auto copyStart = Clock::now();
+        for (size_t i = 0; i < count; i++)
+        {
+            ObjectConstants& object = constants[i];
+            object.world = XMMatrixTranspose(XMLoadFloat4x4(&crowd[i].world));
+        }
+        perCopy.Add(Seconds(copyStart, Clock::now()));
+
+        // Checking every frame would dominate the run; the first and last
+        // are enough to catch a wrong layout or a stale list.
+        if (frame == 0 || frame == frames - 1)
+        {
+            valid = valid && CheckBuild(crowd, meshes, buffer.data(), draws, nullptr);
+            valid = valid && parallelDraws.size() == draws.size() &&
+                memcmp(buffer.data(), parallelBuffer.data(), count * sizeof(InstanceData)) == 0;
+
+            // The filter keeps the instances at even positions of the
+            // built buffer, in order.
+            std::vector<uint8_t> keptInCrowd(count, 0);
+            std::vector<std::vector<size_t>> byMesh(meshes);
+            for (size_t i = 0; i < count; i++)
+                byMesh[crowd[i].mesh].push_back(i);
+            size_t position = 0;
+            for (const std::vector<size_t>& list : byMesh)
+            {
+                for (size_t i : list)
+                    keptInCrowd[i] = keep[position++];
+            }
+
+            batcher.Build(buffer.data(), draws);
+            valid = valid && dropped == count / 2 && batcher.InstanceCount() == count - count / 2;
+            valid = valid && CheckBuild(crowd, meshes, buffer.data(), draws, &keptInCrowd);
+        }
+    }
+
+    bool noAllocations = steadyAllocations == 0;
+    bool pass = valid && noAllocations;
+
+    double bytes = (double)count * sizeof(InstanceData);
+    printf("{\n");
+    printf("  \"instances\": %zu,\n  \"meshes\": %zu,\n  \"frames\": %d,\n  \"threads\": %u,\n", count, meshes, frames, threads);
+    printf("  \"bytesPerInstance\": %zu,\n  \"bytesPerCopyDraw\": %zu,\n", sizeof(InstanceData), sizeof(ObjectConstants));
+    printf("  \"draws\": %zu,\n", draws.size());
+    printf("  \"addNsPerInstance\": %.2f,\n", add.best * 1e9 / count);
+    printf("  \"buildMs\": %.3f,\n  \"buildGBPerSecond\": %.2f,\n", build.best * 1e3, bytes / build.best * 1e-9);
+    printf("  \"buildParallelMs\": %.3f,\n  \"buildParallelGBPerSecond\": %.2f,\n",
+        buildParallel.best * 1e3, bytes / buildParallel.best * 1e-9);
+    printf("  \"filterMs\": %.3f,\n", filter.best * 1e3);
+    printf("  \"frameMs\": %.3f,\n", (add.best + buildParallel.best) * 1e3);
+    printf("  \"perCopyConstantsMs\": %.3f,\n", perCopy.best * 1e3);
+    printf("  \"steadyStateAllocations\": %llu,\n", (unsigned long long)steadyAllocations);
+    printf("  \"valid\": %s,\n", valid ? "true" : "false");
+    printf("  \"pass\": %s\n}\n", pass ? "true" : "false");
+
+    if (!valid)
+        fprintf(stderr, "the instance buffer or draws did not match the instances added\n");
+    if (!noAllocations)
+        fprintf(stderr, "%llu heap allocations after the first frame\n", (unsigned long long)steadyAllocations);
+
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,349 @@
+// Benchmarks JobSystem: what a spawned empty job costs from a worker and
+// from another thread, how much of one worker's spawns the others steal,
+// how fast a SpawnAfter chain advances, and how ParallelFor over a fixed
+// amount of work scales with the thread count. Every job is counted;
+// a job that never ran or ran twice exits with 1. Results go out as JSON.
+//
+// Linux build, from the repository root:
+//
+//   g++ -std=c++17 -O2 -pthread -Isrc -o jobsbench bench/jobsbench.cpp
+//       src/jobs.cpp
+//
+// Usage:
+//
+//   jobsbench [--jobs 1m] [--chain 100k] [--threads 0] [--repeat 3]
+
+#include "jobs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double Seconds(Clock::time_point start, Clock::time_point end)
+    {
+        return std::chrono::duration<double>(end - start).count();
+    }
+
+    // Spins for roughly the cost of a small real job.
+    uint32_t Work(uint32_t seed, unsigned rounds)
+    {
+        for (unsigned i = 0; i < rounds; i++)
+        {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+        }
+        return seed;
+    }
+
+    struct Result
+    {
+        std::string name;
+        unsigned threads = 0;
+        size_t jobs = 0;
+        double seconds = 1e30;
+        JobStats stats;
+        bool valid = true;
+    };
+
+    // count empty jobs spawned and waited on from the calling thread, in
+    // batches below the ring size so spawns do not fall back to inline.
+    Result Spawn(JobSystem& jobs, size_t count, unsigned repeat)
+    {
+        const size_t BATCH = 512;
+
+        Result result;
+        result.name = "spawn";
+        result.threads = jobs.ThreadCount();
+        result.jobs = count;
+
+        for (unsigned r = 0; r < repeat; r++)
+        {
+            std::atomic<size_t> runs(0);
+            std::atomic<size_t>* pruns = &runs;
+
+            jobs.ResetStats();
+            auto start = Clock::now();
+            for (size_t done = 0; done < count; done += BATCH)
+            {
+                JobCounter counter;
+                size_t batch = std::min(BATCH, count - done);
+                for (size_t i = 0; i < batch; i++)
+                    jobs.Spawn(counter, [pruns]() { pruns->fetch_add(1, std::memory_order_relaxed); });
+                jobs.Wait(counter);
+            }
+            double seconds = Seconds(start, Clock::now());
+
+            if (seconds < result.seconds)
+            {
+                result.seconds = seconds;
+                result.stats = jobs.Stats();
+            }
+            result.valid = result.valid && runs.load() == count;
+        }
+
+        return result;
+    }
+
+    // Same, from a thread that is not a worker, through the shared queue.
+    Result SpawnExternal(JobSystem& jobs, size_t count, unsigned repeat)
+    {
+        Result result;
+        std::thread thread([&]()
+        {
+            result = Spawn(jobs, count, repeat);
+        });
+        thread.join();
+
+        result.name = "spawn_external";
+        return result;
+    }
+
+    // Jobs with some work, all spawned by worker 0; the rest only steal.
+    Result Steal(JobSystem& jobs, size_t count, unsigned repeat)
+    {
+        const size_t BATCH = 512;
+        const unsigned ROUNDS = 256;
+
+        Result result;
+        result.name = "steal";
+        result.threads = jobs.ThreadCount();
+        result.jobs = count;
+
+        for (unsigned r = 0; r < repeat; r++)
+        {
+            std::atomic<size_t> runs(0);
+            std::atomic<size_t>* pruns = &runs;
+
+            jobs.ResetStats();
+            auto start = Clock::now();
+            for (size_t done = 0; done < count; done += BATCH)
+            {
+                JobCounter counter;
+                size_t batch = std::min(BATCH, count - done);
+                for (size_t i = 0; i < batch; i++)
+                {
+                    uint32_t seed = (uint32_t)(done + i + 1);
+                    jobs.Spawn(counter, [pruns, seed]()
+                    {
+                        if (Work(seed, ROUNDS) != 0)
+                            pruns->fetch_add(1, std::memory_order_relaxed);
+                    });
+                }
+                jobs.Wait(counter);
+            }
+            double seconds = Seconds(start, Clock::now());
+
+            if (seconds < result.seconds)
+            {
+                result.seconds = seconds;
+                result.stats = jobs.Stats();
+            }
+            result.valid = result.valid && runs.load() == count;
+        }
+
+        return result;
+    }
+
+    // A chain of count links, every one a SpawnAfter on the one before.
+    Result Chain(JobSystem& jobs, size_t count, unsigned repeat)
+    {
+        Result result;
+        result.name = "spawn_after_chain";
+        result.threads = jobs.ThreadCount();
+        result.jobs = count;
+
+        for (unsigned r = 0; r < repeat; r++)
+        {
+            std::vector<JobCounter> counters(count);
+            std::atomic<size_t> order(0);
+            std::atomic<size_t> misordered(0);
+            struct Context { std::atomic<size_t>* order; std::atomic<size_t>* misordered; };
+            Context context = { &order, &misordered };
+            Context* pcontext = &context;
+
+            jobs.ResetStats();
+            auto start = Clock::now();
+            jobs.Spawn(counters[0], [pcontext]() { pcontext->order->fetch_add(1); });
+            for (size_t i = 1; i < count; i++)
+            {
+                jobs.SpawnAfter(counters[i - 1], counters[i], [pcontext, i]()
+                {
+                    if (pcontext->order->fetch_add(1) != i)
+                        pcontext->misordered->fetch_add(1);
+                });
+            }
+            jobs.Wait(counters[count - 1]);
+            double seconds = Seconds(start, Clock::now());
+
+            if (seconds < result.seconds)
+            {
+                result.seconds = seconds;
+                result.stats = jobs.Stats();
+            }
+            result.valid = result.valid && order.load() == count && misordered.load() == 0;
+        }
+
+        return result;
+    }
+
+    // The same total work split by ParallelFor over every thread count.
+    Result Scaling(unsigned threads, size_t count, unsigned repeat)
+    {
+        const unsigned ROUNDS = 64;
+
+        JobSystem jobs;
+        jobs.Initialize(threads);
+
+        Result result;
+        result.name = "parallel_for";
+        result.threads = threads;
+        result.jobs = count;
+
+        std::vector<uint32_t> out(count);
+        uint32_t* pout = out.data();
+
+        for (unsigned r = 0; r < repeat; r++)
+        {
+            std::fill(out.begin(), out.end(), 0);
+
+            jobs.ResetStats();
+            auto start = Clock::now();
+            jobs.ParallelFor(count, 1024, [pout](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                    pout[i] = Work((uint32_t)i + 1, ROUNDS);
+            });
+            double seconds = Seconds(start, Clock::now());
+
+            if (seconds < result.seconds)
+            {
+                result.seconds = seconds;
+                result.stats = jobs.Stats();
+            }
+
+            for (size_t i = 0; i < count; i += 997)
+                result.valid = result.valid && pout[i] == Work((uint32_t)i + 1, ROUNDS);
+            result.valid = result.valid && std::find(out.begin(), out.end(), 0u) == out.end();
+        }
+
+        return result;
+    }
+
+    bool ParseCount(const std::string& text, size_t& count)
+    {
+        char* end = nullptr;
+        double value = strtod(text.c_str(), &end);
+        if (end == text.c_str() || value <= 0.0)
+            return false;
+
+        switch (*end)
+        {
+        case 'k': case 'K': value *= 1e3; break;
+        case 'm': case 'M': value *= 1e6; break;
+        case '\0': break;
+        default: return false;
+        }
+
+        count = (size_t)value;
+        return true;
+    }
+
+    void PrintUsage()
+    {
+        fprintf(stderr, "usage: jobsbench [--jobs 1m] [--chain 100k] [--threads 0] [--repeat 3]\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = 1000000;
+    size_t chain = 100000;
+    unsigned threads = 0;
+    unsigned repeat = 3;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--jobs" && hasValue && ParseCount(argv[i + 1], count))
+            ++i;
+        else if (arg == "--chain" && hasValue && ParseCount(argv[i + 1], chain))
+            ++i;
+        else if (arg == "--threads" && hasValue)
+            threads = (unsigned)std::max(0, atoi(argv[++i]));
+        else if (arg == "--repeat" && hasValue)
+            repeat = (unsigned)std::max(1, atoi(argv[++i]));
+        else
+        {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<Result> results;
+    {
+        JobSystem jobs;
+        jobs.Initialize(threads);
+
+        results.push_back(Spawn(jobs, count, repeat));
+        results.push_back(SpawnExternal(jobs, count, repeat));
+        results.push_back(Steal(jobs, count, repeat));
+        results.push_back(Chain(jobs, chain, repeat));
+    }
+
+    // 1, 2, 4, ... and the full count when it is not a power of two.
+    double serial = 0.0;
+    for (unsigned t = 1; ; t = std::min(t * 2, threads))
+    {
+        results.push_back(Scaling(t, count, repeat));
+        if (t == 1)
+            serial = results.back().seconds;
+        if (t == threads)
+            break;
+    }
+
+    bool pass = true;
+    printf("{\n  \"threads\": %u,\n  \"results\": [\n", threads);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result& r = results[i];
+        pass = pass && r.valid;
+
+        double speedup = r.name == "parallel_for" && r.seconds > 0.0 ? serial / r.seconds : 1.0;
+
+        printf("    {\"case\": \"%s\", \"threads\": %u, \"jobs\": %zu, \"ms\": %.3f, \"nsPerJob\": %.1f, "
+            "\"executed\": %llu, \"steals\": %llu, \"inlined\": %llu, \"speedup\": %.2f, \"valid\": %s}%s\n",
+            r.name.c_str(),
+            r.threads,
+            r.jobs,
+            r.seconds * 1e3,
+            r.seconds * 1e9 / (double)std::max<size_t>(r.jobs, 1),
+            (unsigned long long)r.stats.executed,
+            (unsigned long long)r.stats.steals,
+            (unsigned long long)r.stats.inlined,
+            speedup,
+            r.valid ? "true" : "false",
+            i + 1 < results.size() ? "," : "");
+    }
+    printf("  ],\n  \"pass\": %s\n}\n", pass ? "true" : "false");
+
+    if (!pass)
+        fprintf(stderr, "a job was lost, repeated or ran out of order\n");
+
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,435 @@
+// Benchmarks and checks OcclusionBuffer on synthetic scenes:
+//
+//   wall  - one large wall in front of the camera; boxes behind it must be
+//           culled, boxes in front of it or beside it must not.
+//   city  - a grid of box buildings around a street level camera with
+//           random boxes scattered between them. Every culled box is
+//           checked with rays from the eye to points on its surface; a ray
+//           that reaches one is a false occlusion.
+//
+// Any failed check exits with 1. Results go out as JSON, one result per
+// line.
+//
+// Linux build, from the repository root, with DirectXMath on the include
+// path:
+//
+//   g++ -std=c++17 -O2 -pthread -Isrc -o occlusionbench bench/occlusionbench.cpp
+//       src/occlusion.cpp src/culling.cpp src/bvh.cpp src/jobs.cpp
+//
+// Usage:
+//
+//   occlusionbench [--width 320] [--height 180] [--buildings 32] [--boxes 10k]
+//                  [--frames 20] [--threads 0]
+
+#include "occlusion.h"
+#include "bvh.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+    struct Box
+    {
+        XMFLOAT3 min;
+        XMFLOAT3 max;
+    };
+
+    struct Scene
+    {
+        // Occluders as one mesh, world space.
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+
+        // Boxes to test, and for the wall scene whether each must survive.
+        std::vector<Box> boxes;
+        std::vector<uint8_t> mustBeVisible;
+        std::vector<uint8_t> mustBeHidden;
+
+        XMFLOAT3 eye;
+        XMFLOAT3 target;
+    };
+
+    // 12 triangles, clockwise seen from outside like every mesh the renderer
+    // draws.
+    void AddBoxMesh(Scene& scene, const Box& box)
+    {
+        const float lo[3] = { box.min.x, box.min.y, box.min.z };
+        const float hi[3] = { box.max.x, box.max.y, box.max.z };
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            for (int side = 0; side < 2; side++)
+            {
+                int u = (axis + 1) % 3;
+                int v = (axis + 2) % 3;
+
+                uint32_t base = (uint32_t)scene.vertices.size();
+                for (int corner = 0; corner < 4; corner++)
+                {
+                    float p[3];
+                    p[axis] = side ? hi[axis] : lo[axis];
+                    p[u] = (corner == 1 || corner == 2) ? hi[u] : lo[u];
+                    p[v] = (corner >= 2) ? hi[v] : lo[v];
+
+                    Vertex vertex = {};
+                    vertex.position = XMFLOAT3(p[0], p[1], p[2]);
+                    scene.vertices.push_back(vertex);
+                }
+
+                // Corners run around the face; flip so the winding is
+                // clockwise seen from the outward normal in a left-handed
+                // frame, i.e. cross(e1, e2) points outward.
+                const XMFLOAT3& p0 = scene.vertices[base].position;
+                const XMFLOAT3& p1 = scene.vertices[base + 1].position;
+                const XMFLOAT3& p2 = scene.vertices[base + 2].position;
+                float e1[3] = { p1.x - p0.x, p1.y - p0.y, p1.z - p0.z };
+                float e2[3] = { p2.x - p0.x, p2.y - p0.y, p2.z - p0.z };
+                float n = e1[(axis + 1) % 3] * e2[(axis + 2) % 3] - e1[(axis + 2) % 3] * e2[(axis + 1) % 3];
+                bool outward = side ? n > 0.0f : n < 0.0f;
+
+                if (outward)
+                    scene.indices.insert(scene.indices.end(), { base, base + 1, base + 2, base, base + 2, base + 3 });
+                else
+                    scene.indices.insert(scene.indices.end(), { base, base + 2, base + 1, base, base + 3, base + 2 });
+            }
+        }
+    }
+
+    void BuildWall(Scene& scene)
+    {
+        scene.eye = XMFLOAT3(0.0f, 2.0f, 0.0f);
+        scene.target = XMFLOAT3(0.0f, 2.0f, 1.0f);
+
+        // 20 wide, 20 high, 20 ahead: its edges project to x = +-z / 2 and
+        // y = 2 + 0.4 z, inside the screen.
+        AddBoxMesh(scene, { XMFLOAT3(-10.0f, -10.0f, 20.0f), XMFLOAT3(10.0f, 10.0f, 21.0f) });
+
+        auto add = [&](const Box& box, bool visible, bool hidden)
+        {
+            scene.boxes.push_back(box);
+            scene.mustBeVisible.push_back(visible);
+            scene.mustBeHidden.push_back(hidden);
+        };
+
+        for (int z = 0; z < 8; z++)
+        {
+            for (int x = -4; x <= 4; x++)
+            {
+                float cx = x * 2.0f;
+                float cz = 30.0f + z * 10.0f;
+
+                // Well inside the wall's shadow.
+                add({ XMFLOAT3(cx - 0.5f, 1.0f, cz), XMFLOAT3(cx + 0.5f, 2.0f, cz + 1.0f) }, false, true);
+                // In front of the wall.
+                add({ XMFLOAT3(cx - 0.5f, 1.0f, 10.0f + z), XMFLOAT3(cx + 0.5f, 2.0f, 10.5f + z) }, true, false);
+            }
+
+            // Beside and above the wall, seen past its edges.
+            float cz = 40.0f + z * 10.0f;
+            add({ XMFLOAT3(0.7f * cz, 1.0f, cz), XMFLOAT3(0.75f * cz, 2.0f, cz + 1.0f) }, true, false);
+            add({ XMFLOAT3(-1.0f, 2.0f + 0.45f * cz, cz), XMFLOAT3(1.0f, 2.0f + 0.5f * cz, cz + 1.0f) }, true, false);
+            // Straddling the wall's right edge.
+            add({ XMFLOAT3(0.45f * cz, 1.0f, cz), XMFLOAT3(0.55f * cz, 2.0f, cz + 1.0f) }, true, false);
+        }
+    }
+
+    void BuildCity(Scene& scene, int buildings, size_t boxCount)
+    {
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+        // Blocks of 8x8 with 4 wide streets, camera on a street at eye height.
+        const float pitch = 12.0f;
+        float half = buildings * pitch * 0.5f;
+
+        for (int z = 0; z < buildings; z++)
+        {
+            for (int x = 0; x < buildings; x++)
+            {
+                float x0 = x * pitch - half;
+                float z0 = z * pitch - half;
+                float height = 6.0f + 30.0f * unit(rng);
+                AddBoxMesh(scene, { XMFLOAT3(x0, 0.0f, z0), XMFLOAT3(x0 + 8.0f, height, z0 + 8.0f) });
+            }
+        }
+
+        scene.eye = XMFLOAT3(-half + 10.0f, 1.7f, -half + 10.0f);
+        scene.target = XMFLOAT3(half, 1.7f, half * 0.6f);
+
+        // Small boxes on the streets, anywhere in the city.
+        for (size_t i = 0; i < boxCount; i++)
+        {
+            float x = -half + unit(rng) * 2.0f * half;
+            float z = -half + unit(rng) * 2.0f * half;
+
+            // Snap into the street between blocks.
+            float sx = std::floor((x + half) / pitch) * pitch - half + 9.0f + 2.0f * unit(rng);
+            float size = 0.3f + unit(rng);
+            if (i & 1)
+                x = sx;
+            else
+                z = std::floor((z + half) / pitch) * pitch - half + 9.0f + 2.0f * unit(rng);
+
+            scene.boxes.push_back({ XMFLOAT3(x, 0.0f, z), XMFLOAT3(x + size, size, z + size) });
+            scene.mustBeVisible.push_back(0);
+            scene.mustBeHidden.push_back(0);
+        }
+    }
+
+    XMFLOAT4X4 ViewProjection(const Scene& scene, int width, int height)
+    {
+        XMMATRIX view = XMMatrixLookAtLH(
+            XMVectorSet(scene.eye.x, scene.eye.y, scene.eye.z, 1.0f),
+            XMVectorSet(scene.target.x, scene.target.y, scene.target.z, 1.0f),
+            XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f)
+        );
+        XMMATRIX projection = XMMatrixPerspectiveFovLH(1.0f, (float)width / height, 0.1f, 1000.0f);
+
+        XMFLOAT4X4 viewProj;
+        XMStoreFloat4x4(&viewProj, view * projection);
+        return viewProj;
+    }
+
+    // A culled box is wrong if a ray from the eye reaches any of its
+    // corners, face centers or a few random points on its faces that are
+    // on screen.
+    bool ReachesBox(const Bvh& bvh, const XMFLOAT3& eye, const XMFLOAT4X4& viewProj, const Box& box, std::mt19937& rng)
+    {
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        const float lo[3] = { box.min.x, box.min.y, box.min.z };
+        const float hi[3] = { box.max.x, box.max.y, box.max.z };
+
+        auto reaches = [&](const float* p)
+        {
+            const XMFLOAT4X4& m = viewProj;
+            float x = p[0] * m.m[0][0] + p[1] * m.m[1][0] + p[2] * m.m[2][0] + m.m[3][0];
+            float y = p[0] * m.m[0][1] + p[1] * m.m[1][1] + p[2] * m.m[2][1] + m.m[3][1];
+            float w = p[0] * m.m[0][3] + p[1] * m.m[1][3] + p[2] * m.m[2][3] + m.m[3][3];
+            if (w <= 0.0f || std::fabs(x) > w || std::fabs(y) > w)
+                return false;
+
+            Ray ray;
+            ray.origin = eye;
+            ray.direction = XMFLOAT3(p[0] - eye.x, p[1] - eye.y, p[2] - eye.z);
+            ray.tMax = 0.999f;
+            return !bvh.Occluded(ray);
+        };
+
+        for (int corner = 0; corner < 8; corner++)
+        {
+            float p[3] = { corner & 1 ? hi[0] : lo[0], corner & 2 ? hi[1] : lo[1], corner & 4 ? hi[2] : lo[2] };
+            if (reaches(p))
+                return true;
+        }
+
+        for (int face = 0; face < 6; face++)
+        {
+            for (int sample = 0; sample < 5; sample++)
+            {
+                float p[3];
+                for (int a = 0; a < 3; a++)
+                {
+                    float t = sample == 0 ? 0.5f : unit(rng);
+                    p[a] = lo[a] + (hi[a] - lo[a]) * t;
+                }
+                p[face % 3] = face < 3 ? lo[face % 3] : hi[face % 3];
+                if (reaches(p))
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    double Seconds(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bool RunScene(const char* name, const Scene& scene, int width, int height, int frames, JobSystem& jobs, bool& first)
+    {
+        OcclusionBuffer buffer;
+        if (!buffer.Initialize(width, height))
+        {
+            fprintf(stderr, "%s: bad size %dx%d\n", name, width, height);
+            return false;
+        }
+
+        XMFLOAT4X4 identity;
+        XMStoreFloat4x4(&identity, XMMatrixIdentity());
+        XMFLOAT4X4 viewProj = ViewProjection(scene, buffer.Width(), buffer.Height());
+
+        BoxBounds bounds;
+        for (const Box& box : scene.boxes)
+            bounds.Add(box.min, box.max);
+
+        std::vector<uint32_t> candidates(bounds.Size());
+        std::vector<uint32_t> visible(bounds.Size());
+        for (size_t i = 0; i < candidates.size(); i++)
+            candidates[i] = (uint32_t)i;
+
+        double rasterSeconds[2] = { 1e30, 1e30 };
+        double testSeconds[2] = { 1e30, 1e30 };
+        size_t visibleCount = 0;
+        size_t visibleCounts[2] = { 0, 0 };
+
+        for (int threaded = 0; threaded < 2; threaded++)
+        {
+            JobSystem* j = threaded ? &jobs : nullptr;
+            for (int f = 0; f < frames; f++)
+            {
+                auto start = std::chrono::steady_clock::now();
+                buffer.BeginFrame(viewProj);
+                buffer.AddOccluder(scene.vertices.data(), scene.vertices.size(), scene.indices.data(), scene.indices.size(), identity);
+                buffer.Rasterize(j);
+                rasterSeconds[threaded] = std::min(rasterSeconds[threaded], Seconds(start));
+
+                start = std::chrono::steady_clock::now();
+                visibleCount = buffer.CullBoxes(bounds, candidates.data(), candidates.size(), visible.data(), j);
+                testSeconds[threaded] = std::min(testSeconds[threaded], Seconds(start));
+            }
+            visibleCounts[threaded] = visibleCount;
+        }
+
+        // ===== checks =====
+        bool ok = visibleCounts[0] == visibleCounts[1];
+
+        std::vector<uint8_t> isVisible(bounds.Size(), 0);
+        for (size_t i = 0; i < visibleCount; i++)
+            isVisible[visible[i]] = 1;
+
+        size_t expectedWrong = 0;
+        for (size_t i = 0; i < bounds.Size(); i++)
+        {
+            if ((scene.mustBeVisible[i] && !isVisible[i]) || (scene.mustBeHidden[i] && isVisible[i]))
+                ++expectedWrong;
+        }
+        ok = ok && expectedWrong == 0;
+
+        Bvh bvh;
+        bvh.Build(scene.vertices.data(), scene.vertices.size(), scene.indices.data(), scene.indices.size());
+
+        std::mt19937 rng(11);
+        size_t falseOcclusions = 0;
+        for (size_t i = 0; i < bounds.Size(); i++)
+        {
+            if (!isVisible[i] && ReachesBox(bvh, scene.eye, viewProj, scene.boxes[i], rng))
+                ++falseOcclusions;
+        }
+        ok = ok && falseOcclusions == 0;
+
+        const OcclusionStats& stats = buffer.Stats();
+        printf("%s    {\"scene\": \"%s\", \"width\": %d, \"height\": %d, \"occluderTriangles\": %zu, "
+            "\"trianglesDrawn\": %zu, \"boxes\": %zu, \"culled\": %zu, "
+            "\"rasterSeconds\": %.6f, \"rasterSecondsJobs\": %.6f, \"testSeconds\": %.6f, \"testSecondsJobs\": %.6f, "
+            "\"expectationFailures\": %zu, \"falseOcclusions\": %zu}",
+            first ? "" : ",\n",
+            name,
+            buffer.Width(),
+            buffer.Height(),
+            stats.trianglesIn,
+            stats.trianglesDrawn,
+            bounds.Size(),
+            bounds.Size() - visibleCount,
+            rasterSeconds[0],
+            rasterSeconds[1],
+            testSeconds[0],
+            testSeconds[1],
+            expectedWrong,
+            falseOcclusions);
+        fflush(stdout);
+        first = false;
+        return ok;
+    }
+
+    bool ParseCount(const std::string& text, size_t& count)
+    {
+        char* end = nullptr;
+        double value = strtod(text.c_str(), &end);
+        if (end == text.c_str() || value <= 0.0)
+            return false;
+
+        switch (*end)
+        {
+        case 'k': case 'K': value *= 1e3; break;
+        case 'm': case 'M': value *= 1e6; break;
+        case '\0': break;
+        default: return false;
+        }
+
+        count = (size_t)value;
+        return true;
+    }
+
+    void PrintUsage()
+    {
+        fprintf(stderr,
+            "usage: occlusionbench [--width 320] [--height 180] [--buildings 32] [--boxes 10k]\n"
+            "                      [--frames 20] [--threads 0]\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int width = 320;
+    int height = 180;
+    int buildings = 32;
+    size_t boxCount = 10000;
+    int frames = 20;
+    unsigned threads = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--width" && hasValue)
+            width = atoi(argv[++i]);
+        else if (arg == "--height" && hasValue)
+            height = atoi(argv[++i]);
+        else if (arg == "--buildings" && hasValue)
+            buildings = std::max(1, atoi(argv[++i]));
+        else if (arg == "--boxes" && hasValue && ParseCount(argv[i + 1], boxCount))
+            ++i;
+        else if (arg == "--frames" && hasValue)
+            frames = std::max(1, atoi(argv[++i]));
+        else if (arg == "--threads" && hasValue)
+            threads = (unsigned)atoi(argv[++i]);
+        else
+        {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    JobSystem jobs;
+    jobs.Initialize(threads);
+
+    printf("{\n  \"threads\": %u,\n  \"results\": [\n", jobs.ThreadCount());
+
+    bool first = true;
+    bool ok = true;
+
+    Scene wall;
+    BuildWall(wall);
+    ok = RunScene("wall", wall, width, height, frames, jobs, first) && ok;
+
+    Scene city;
+    BuildCity(city, buildings, boxCount);
+    ok = RunScene("city", city, width, height, frames, jobs, first) && ok;
+
+    printf("\n  ]\n}\n");
+
+    if (!ok)
+        fprintf(stderr, "occlusion results failed their checks\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,286 @@
+// Measures what a PROFILE_ZONE costs the thread it times, alone and with
+// several threads recording at once, and what EndFrame spends collecting
+// each zone. Zones are recorded in batches below the thread buffer size
+// and collected between batches, outside the timed region, so nothing is
+// dropped. Results go out as JSON; the exit code is 1 when a zone costs
+// more than the budget or a zone goes missing.
+//
+// Linux build, from the repository root:
+//
+//   g++ -std=c++17 -O2 -pthread -Isrc -o profilerbench bench/profilerbench.cpp
+//       src/profiler.cpp
+//
+// Usage:
+//
+//   profilerbench [--zones 1m] [--threads 4] [--budget-ns 50]
+
+#include "profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // Well below ProfileThreadBuffer::CAPACITY, even with nested zones.
+    constexpr size_t BATCH = 4096;
+
+    using Clock = std::chrono::steady_clock;
+
+    double Seconds(Clock::time_point start, Clock::time_point end)
+    {
+        return std::chrono::duration<double>(end - start).count();
+    }
+
+    // Keeps the loop around an empty zone from being folded away.
+    inline void Barrier()
+    {
+#if defined(__GNUC__)
+        asm volatile("" ::: "memory");
+#else
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+    }
+
+    double TimeEmpty(size_t count)
+    {
+        auto start = Clock::now();
+        for (size_t i = 0; i < count; i++)
+            Barrier();
+        return Seconds(start, Clock::now());
+    }
+
+    double TimeFlat(size_t count)
+    {
+        auto start = Clock::now();
+        for (size_t i = 0; i < count; i++)
+        {
+            PROFILE_ZONE("Flat");
+            Barrier();
+        }
+        return Seconds(start, Clock::now());
+    }
+
+    // count zones, half of them nested in the other half.
+    double TimeNested(size_t count)
+    {
+        auto start = Clock::now();
+        for (size_t i = 0; i < count; i += 2)
+        {
+            PROFILE_ZONE("Outer");
+            {
+                PROFILE_ZONE("Inner");
+                Barrier();
+            }
+        }
+        return Seconds(start, Clock::now());
+    }
+
+    struct Timing
+    {
+        // Best batch, per zone.
+        double zoneNs = 1e30;
+        // EndFrame per collected zone, averaged.
+        double collectNs = 0.0;
+        size_t zones = 0;
+    };
+
+    // Runs total zones in batches on the calling thread, collecting after
+    // each; best of the batches, as the others include interrupts.
+    template <typename Fn>
+    Timing Measure(Fn fn, size_t total)
+    {
+        Profiler& profiler = Profiler::Get();
+        Timing timing;
+        double collect = 0.0;
+
+        // Registers the thread outside the timed region.
+        fn(2);
+        profiler.EndFrame();
+
+        for (size_t done = 0; done < total; done += BATCH)
+        {
+            double empty = TimeEmpty(BATCH);
+            double seconds = fn(BATCH);
+            timing.zoneNs = std::min(timing.zoneNs, std::max(seconds - empty, 0.0) * 1e9 / BATCH);
+
+            auto start = Clock::now();
+            profiler.EndFrame();
+            collect += Seconds(start, Clock::now());
+            timing.zones += BATCH;
+        }
+
+        timing.collectNs = collect * 1e9 / std::max<size_t>(timing.zones, 1);
+        return timing;
+    }
+
+    // threads record flat zones at once; the main thread collects between
+    // rounds while they wait. Worst thread's best batch, per zone.
+    Timing MeasureThreads(unsigned threads, size_t total)
+    {
+        Profiler& profiler = Profiler::Get();
+        std::atomic<unsigned> ready(0);
+        std::atomic<uint64_t> round(0);
+        std::atomic<bool> stop(false);
+        std::vector<double> best(threads, 1e30);
+
+        size_t rounds = std::max<size_t>(total / (BATCH * threads), 1);
+
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; t++)
+        {
+            workers.emplace_back([&, t]()
+            {
+                uint64_t seen = 0;
+                TimeFlat(2);
+                ready.fetch_add(1);
+
+                for (;;)
+                {
+                    uint64_t r;
+                    while ((r = round.load(std::memory_order_acquire)) == seen && !stop.load())
+                        std::this_thread::yield();
+                    if (stop.load())
+                        break;
+
+                    seen = r;
+                    double empty = TimeEmpty(BATCH);
+                    double seconds = TimeFlat(BATCH);
+                    best[t] = std::min(best[t], std::max(seconds - empty, 0.0) * 1e9 / BATCH);
+                    ready.fetch_add(1);
+                }
+            });
+        }
+
+        Timing timing;
+        double collect = 0.0;
+
+        for (size_t r = 0; r <= rounds; r++)
+        {
+            while (ready.load() < threads)
+                std::this_thread::yield();
+            ready.store(0);
+
+            auto start = Clock::now();
+            profiler.EndFrame();
+            collect += Seconds(start, Clock::now());
+
+            if (r < rounds)
+            {
+                timing.zones += BATCH * threads;
+                round.fetch_add(1, std::memory_order_release);
+            }
+        }
+
+        stop.store(true);
+        for (std::thread& worker : workers)
+            worker.join();
+
+        timing.zoneNs = *std::max_element(best.begin(), best.end());
+        timing.collectNs = collect * 1e9 / std::max<size_t>(timing.zones, 1);
+        return timing;
+    }
+
+    bool ParseCount(const std::string& text, size_t& count)
+    {
+        char* end = nullptr;
+        double value = strtod(text.c_str(), &end);
+        if (end == text.c_str() || value <= 0.0)
+            return false;
+
+        switch (*end)
+        {
+        case 'k': case 'K': value *= 1e3; break;
+        case 'm': case 'M': value *= 1e6; break;
+        case '\0': break;
+        default: return false;
+        }
+
+        count = (size_t)value;
+        return true;
+    }
+
+    void PrintUsage()
+    {
+        fprintf(stderr, "usage: profilerbench [--zones 1m] [--threads 4] [--budget-ns 50]\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t zones = 1000000;
+    unsigned threads = 4;
+    double budgetNs = 50.0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--zones" && hasValue && ParseCount(argv[i + 1], zones))
+            ++i;
+        else if (arg == "--threads" && hasValue)
+            threads = (unsigned)std::max(1, atoi(argv[++i]));
+        else if (arg == "--budget-ns" && hasValue)
+            budgetNs = atof(argv[++i]);
+        else
+        {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    Profiler& profiler = Profiler::Get();
+    profiler.SetThreadName("Main");
+
+    struct Result
+    {
+        const char* name;
+        unsigned threads;
+        Timing timing;
+    };
+
+    std::vector<Result> results;
+    results.push_back({ "flat", 1, Measure(TimeFlat, zones) });
+    results.push_back({ "nested", 1, Measure(TimeNested, zones) });
+
+    // Room for the rounding up to whole batches and the Frame events.
+    profiler.BeginCapture(zones + 2 * BATCH);
+    results.push_back({ "flat_capture", 1, Measure(TimeFlat, zones) });
+    profiler.EndCapture();
+    size_t captured = profiler.CapturedEventCount();
+
+    results.push_back({ "flat_threads", threads, MeasureThreads(threads, zones) });
+
+    uint64_t dropped = profiler.DroppedCount();
+    // The capture also holds the warm-up zones and one Frame per EndFrame.
+    bool complete = dropped == 0 && captured >= results[2].timing.zones;
+
+    bool pass = complete;
+    printf("{\n  \"budgetNs\": %.1f,\n  \"results\": [\n", budgetNs);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result& r = results[i];
+        bool within = r.timing.zoneNs <= budgetNs;
+        pass = pass && within;
+
+        printf("    {\"case\": \"%s\", \"threads\": %u, \"zones\": %zu, \"zoneNs\": %.2f, "
+            "\"collectNs\": %.2f, \"withinBudget\": %s}%s\n",
+            r.name,
+            r.threads,
+            r.timing.zones,
+            r.timing.zoneNs,
+            r.timing.collectNs,
+            within ? "true" : "false",
+            i + 1 < results.size() ? "," : "");
+    }
+    printf("  ],\n  \"dropped\": %llu,\n  \"captured\": %zu,\n  \"pass\": %s\n}\n",
+        (unsigned long long)dropped, captured, pass ? "true" : "false");
+
+    return pass ? 0 : 1;
+}
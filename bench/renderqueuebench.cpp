@@ -0,0 +1,259 @@
+// Benchmarks RenderQueue on a frame of random draw packets: Sort against
+// std::stable_sort and std::sort on the same packets, Sort of a queue that
+// is already sorted, and Execute into a sink that only counts. Every sort
+// must leave the packets in std::stable_sort order; a mismatch exits
+// with 1. Results go out as JSON.
+//
+// Linux build, from the repository root:
+//
+//   g++ -std=c++17 -O2 -Isrc -o renderqueuebench bench/renderqueuebench.cpp
+//       src/renderqueue.cpp
+//
+// Usage:
+//
+//   renderqueuebench [--packets 1m] [--pipelines 4] [--materials 64]
+//                    [--meshes 2000] [--repeat 5]
+
+#include "renderqueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double Seconds(Clock::time_point start, Clock::time_point end)
+    {
+        return std::chrono::duration<double>(end - start).count();
+    }
+
+    struct Result
+    {
+        std::string name;
+        double seconds = 1e30;
+        bool valid = true;
+        // Against std::stable_sort; Execute is not a sort.
+        bool sort = true;
+    };
+
+    // Stands in for a command list: counts, so Execute is measured and
+    // not the sink.
+    class CountingSink : public RenderStateSink
+    {
+    public:
+        void SetPipeline(uint32_t pipeline) override { mSum += pipeline; }
+        void SetMaterial(uint32_t material) override { mSum += material; }
+        void SetMesh(uint32_t mesh) override { mSum += mesh; }
+        void Draw(uint32_t payload) override { mSum += payload; }
+
+        uint64_t Sum() const { return mSum; }
+
+    private:
+        uint64_t mSum = 0;
+    };
+
+    bool KeyLess(const RenderPacket& a, const RenderPacket& b)
+    {
+        return a.key < b.key;
+    }
+
+    bool SamePackets(const std::vector<RenderPacket>& a, const std::vector<RenderPacket>& b)
+    {
+        if (a.size() != b.size())
+            return false;
+
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            if (a[i].key != b[i].key || a[i].payload != b[i].payload)
+                return false;
+        }
+        return true;
+    }
+
+    bool ParseCount(const std::string& text, size_t& count)
+    {
+        char* end = nullptr;
+        double value = strtod(text.c_str(), &end);
+        if (end == text.c_str() || value <= 0.0)
+            return false;
+
+        switch (*end)
+        {
+        case 'k': case 'K': value *= 1e3; break;
+        case 'm': case 'M': value *= 1e6; break;
+        case '\0': break;
+        default: return false;
+        }
+
+        count = (size_t)value;
+        return true;
+    }
+
+    void PrintUsage()
+    {
+        fprintf(stderr, "usage: renderqueuebench [--packets 1m] [--pipelines 4] [--materials 64] "
+            "[--meshes 2000] [--repeat 5]\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = 1000000;
+    size_t pipelines = 4;
+    size_t materials = 64;
+    size_t meshes = 2000;
+    unsigned repeat = 5;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--packets" && hasValue && ParseCount(argv[i + 1], count))
+            ++i;
+        else if (arg == "--pipelines" && hasValue && ParseCount(argv[i + 1], pipelines))
+            ++i;
+        else if (arg == "--materials" && hasValue && ParseCount(argv[i + 1], materials))
+            ++i;
+        else if (arg == "--meshes" && hasValue && ParseCount(argv[i + 1], meshes))
+            ++i;
+        else if (arg == "--repeat" && hasValue)
+            repeat = (unsigned)std::max(1, atoi(argv[++i]));
+        else
+        {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    // Draws in submission order, as scene traversal would produce them:
+    // random state and depth.
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> depth(0.1f, 1000.0f);
+
+    std::vector<RenderPacket> frame(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t pipeline = (uint32_t)(rng() % pipelines);
+        uint32_t material = (uint32_t)(rng() % materials);
+        uint32_t mesh = (uint32_t)(rng() % meshes);
+        frame[i] = { MakeSortKey(pipeline, material, mesh, QuantizeDepth(depth(rng), 0.1f, 1000.0f)), (uint32_t)i, 0 };
+    }
+
+    std::vector<RenderPacket> expected = frame;
+    std::stable_sort(expected.begin(), expected.end(), KeyLess);
+
+    RenderQueue queue;
+    queue.Reserve(count);
+
+    std::vector<Result> results;
+    Result radix{ "radixSort" };
+    Result resort{ "radixSortSorted" };
+    Result stable{ "stableSort" };
+    Result unstable{ "sort" };
+    Result execute{ "execute" };
+    execute.sort = false;
+    uint32_t passes = 0;
+    RenderQueueStats stats;
+    uint64_t sinkSum = 0;
+
+    for (unsigned r = 0; r < repeat; r++)
+    {
+        queue.Clear();
+        for (const RenderPacket& packet : frame)
+            queue.Submit(packet.key, packet.payload);
+
+        auto start = Clock::now();
+        queue.Sort();
+        radix.seconds = std::min(radix.seconds, Seconds(start, Clock::now()));
+        radix.valid = radix.valid && SamePackets(queue.Packets(), expected);
+        passes = queue.Stats().sortPasses;
+
+        start = Clock::now();
+        queue.Sort();
+        resort.seconds = std::min(resort.seconds, Seconds(start, Clock::now()));
+        resort.valid = resort.valid && SamePackets(queue.Packets(), expected) && queue.Stats().sortPasses == 0;
+
+        CountingSink sink;
+        start = Clock::now();
+        queue.Execute(sink);
+        execute.seconds = std::min(execute.seconds, Seconds(start, Clock::now()));
+        stats = queue.Stats();
+        sinkSum = sink.Sum();
+
+        std::vector<RenderPacket> packets = frame;
+        start = Clock::now();
+        std::stable_sort(packets.begin(), packets.end(), KeyLess);
+        stable.seconds = std::min(stable.seconds, Seconds(start, Clock::now()));
+
+        packets = frame;
+        start = Clock::now();
+        std::sort(packets.begin(), packets.end(), KeyLess);
+        unstable.seconds = std::min(unstable.seconds, Seconds(start, Clock::now()));
+
+        // std::sort is not stable: only the keys have to match.
+        for (size_t i = 0; i < count && unstable.valid; i++)
+            unstable.valid = packets[i].key == expected[i].key;
+    }
+
+    // Execute issued one change wherever a field differs from the previous
+    // draw, and every draw.
+    uint64_t changes = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        for (int field = 0; field < 3; field++)
+        {
+            uint32_t (*get)(uint64_t) = field == 0 ? SortKeyPipeline : field == 1 ? SortKeyMaterial : SortKeyMesh;
+            if (i == 0 || get(expected[i].key) != get(expected[i - 1].key))
+                changes++;
+        }
+    }
+    execute.valid = stats.draws == count &&
+        stats.pipelineChanges + stats.materialChanges + stats.meshChanges == changes &&
+        stats.redundantChanges == count * 3 - changes;
+
+    results.push_back(radix);
+    results.push_back(resort);
+    results.push_back(stable);
+    results.push_back(unstable);
+    results.push_back(execute);
+
+    bool pass = true;
+    printf("{\n  \"packets\": %zu,\n  \"pipelines\": %zu,\n  \"materials\": %zu,\n  \"meshes\": %zu,\n",
+        count, pipelines, materials, meshes);
+    printf("  \"sortPasses\": %u,\n  \"stateChanges\": %llu,\n  \"redundantChanges\": %llu,\n  \"sinkSum\": %llu,\n",
+        passes,
+        (unsigned long long)(stats.pipelineChanges + stats.materialChanges + stats.meshChanges),
+        (unsigned long long)stats.redundantChanges,
+        (unsigned long long)sinkSum);
+    printf("  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result& r = results[i];
+        pass = pass && r.valid;
+
+        char speedup[32] = "null";
+        if (r.sort)
+            snprintf(speedup, sizeof(speedup), "%.2f", r.seconds > 0.0 ? stable.seconds / r.seconds : 1.0);
+
+        printf("    {\"name\": \"%s\", \"ms\": %.3f, \"nsPerPacket\": %.2f, \"speedup\": %s, \"valid\": %s}%s\n",
+            r.name.c_str(),
+            r.seconds * 1e3,
+            r.seconds * 1e9 / (double)std::max<size_t>(count, 1),
+            speedup,
+            r.valid ? "true" : "false",
+            i + 1 < results.size() ? "," : "");
+    }
+    printf("  ],\n  \"pass\": %s\n}\n", pass ? "true" : "false");
+
+    if (!pass)
+        fprintf(stderr, "a sort or the Execute stats disagreed with std::stable_sort\n");
+
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,698 @@
+// Checks that large meshes go from disk to the GPU in bounded memory. A
+// grid mesh of several GB, with coarser grids over the same vertices as
+// its LODs, is written with MeshCacheWriter and cut into subsets by
+// SubmeshSplitter as it goes. It is then loaded the way the renderer's
+// warm start does: mapped, sent through StreamGeometry into a sink that
+// checks every vertex and index instead of uploading them, and handed to
+// BuildMeshQueryData. Meshlets, the picking BVH and the occluder are
+// checked against the grid. Peak resident memory of both passes is
+// measured against a budget; exceeding it, a subset over the limits or
+// any wrong result exits with 1. Results go out as JSON.
+//
+// The default grid is 4096 x 16384 vertices: a 2.5 GB vertex and a 2 GB
+// index section, cut into subsets of at most 2 GB.
+//
+// Linux build, from the repository root, with DirectXMath on the include
+// path:
+//
+//   g++ -std=c++17 -O2 -pthread -Isrc -o streambench bench/streambench.cpp
+//       src/meshstream.cpp src/meshcache.cpp src/mappedfile.cpp
+//       src/vertexpack.cpp src/hash.cpp src/meshlet.cpp src/culling.cpp
+//       src/bvh.cpp src/jobs.cpp
+//
+// Usage:
+//
+//   streambench [--width 4096] [--height 16384] [--format packed|full]
+//               [--chunk-mb 4] [--limit-mb 2048] [--budget-mb 64]
+//               [--tmp dir] [--keep] [--no-evict]
+
+#include "meshstream.h"
+#include "meshcache.h"
+#include "meshlet.h"
+#include "mappedfile.h"
+#include "vertexpack.h"
+#include "bvh.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+    const double MB = 1024.0 * 1024.0;
+
+    double Seconds(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // ===== resident memory =====
+
+    // Restarts the peak counter at the current RSS, where the kernel
+    // allows it; otherwise peaks are for the whole process.
+    void ResetPeakRss()
+    {
+        if (FILE* f = fopen("/proc/self/clear_refs", "w"))
+        {
+            fputs("5", f);
+            fclose(f);
+        }
+    }
+
+    uint64_t ReadStatus(const char* format)
+    {
+        unsigned long long kb = 0;
+        if (FILE* f = fopen("/proc/self/status", "r"))
+        {
+            char line[256];
+            while (fgets(line, sizeof(line), f))
+            {
+                if (sscanf(line, format, &kb) == 1)
+                    break;
+            }
+            fclose(f);
+        }
+        return kb * 1024;
+    }
+
+    uint64_t CurrentRss() { return ReadStatus("VmRSS: %llu kB"); }
+
+    uint64_t PeakRss()
+    {
+        if (uint64_t peak = ReadStatus("VmHWM: %llu kB"))
+            return peak;
+
+        rusage usage = {};
+        getrusage(RUSAGE_SELF, &usage);
+        return (uint64_t)usage.ru_maxrss * 1024;
+    }
+
+    // ===== the grid =====
+
+    // width x height vertices, row major, one unit apart. LOD k spans the
+    // same area with cells 2^k units wide: two triangles per cell, cells
+    // row major, LOD 0 first in the index buffer.
+    struct Grid
+    {
+        uint32_t width;
+        uint32_t height;
+
+        // First index of every LOD, one past the last at the end.
+        std::vector<uint64_t> lodOffsets;
+
+        // Coarser LODs until a cell would not fit.
+        void Initialize(uint32_t w, uint32_t h)
+        {
+            width = w;
+            height = h;
+            lodOffsets.assign(1, 0);
+            for (uint32_t stride = 1; stride < width && stride < height; stride *= 2)
+                lodOffsets.push_back(lodOffsets.back() + 6ull * CellsX(lodOffsets.size() - 1) * CellsY(lodOffsets.size() - 1));
+        }
+
+        size_t LodCount() const { return lodOffsets.size() - 1; }
+        uint32_t Stride(size_t lod) const { return 1u << lod; }
+        uint64_t CellsX(size_t lod) const { return (width - 1) / Stride(lod); }
+        uint64_t CellsY(size_t lod) const { return (height - 1) / Stride(lod); }
+        uint64_t LodIndexCount(size_t lod) const { return lodOffsets[lod + 1] - lodOffsets[lod]; }
+
+        uint64_t VertexCount() const { return (uint64_t)width * height; }
+        uint64_t IndexCount() const { return lodOffsets.back(); }
+
+        XMFLOAT3 Position(uint64_t vertex) const
+        {
+            return XMFLOAT3((float)(vertex % width), (float)(vertex / width), 0.0f);
+        }
+
+        uint32_t LodIndex(size_t lod, uint64_t position) const
+        {
+            uint64_t triangle = position / 3;
+            uint64_t cell = triangle / 2;
+            uint32_t stride = Stride(lod);
+            uint32_t v = (uint32_t)((cell / CellsX(lod) * width + cell % CellsX(lod)) * stride);
+
+            // Corners v, v + width, v + 1, v + width + 1, stride apart.
+            static const uint32_t corners[2][3] = { { 0, 1, 2 }, { 2, 1, 3 } };
+            uint32_t corner = corners[triangle % 2][position % 3];
+            return v + (corner & 1 ? width * stride : 0) + (corner & 2 ? stride : 0);
+        }
+
+        uint32_t Index(uint64_t position) const
+        {
+            size_t lod = 0;
+            while (position >= lodOffsets[lod + 1])
+                lod++;
+            return LodIndex(lod, position - lodOffsets[lod]);
+        }
+
+        std::vector<MeshLod> Lods() const
+        {
+            std::vector<MeshLod> lods;
+            for (size_t k = 0; k < LodCount(); k++)
+                lods.push_back({ (uint32_t)lodOffsets[k], (uint32_t)LodIndexCount(k), 0.0f });
+            return lods;
+        }
+
+        XMFLOAT3 BoundsMax() const { return XMFLOAT3((float)(width - 1), (float)(height - 1), 0.0f); }
+    };
+
+    // As the renderer's cold start: meshlets over LOD 0 only when the warm
+    // start will keep them. Small grids only, they are built in memory.
+    std::vector<Meshlet> BuildGridMeshlets(const Grid& grid)
+    {
+        if (grid.LodIndexCount(0) / 3 > MeshQueryOptions().meshletTriangles)
+            return std::vector<Meshlet>();
+
+        std::vector<Vertex> vertices((size_t)grid.VertexCount());
+        for (size_t i = 0; i < vertices.size(); i++)
+            vertices[i].position = grid.Position(i);
+
+        std::vector<uint32_t> indices((size_t)grid.LodIndexCount(0));
+        for (size_t i = 0; i < indices.size(); i++)
+            indices[i] = grid.LodIndex(0, i);
+
+        return BuildMeshlets(vertices.data(), vertices.size(), indices.data(), indices.size(), MeshletOptions()).meshlets;
+    }
+
+    struct PassResult
+    {
+        double seconds = 0.0;
+        uint64_t bytes = 0;
+        uint64_t peakGrowth = 0;
+        bool ok = false;
+    };
+
+    PassResult WriteGrid(
+        const Grid& grid,
+        const std::vector<Meshlet>& meshlets,
+        const std::string& path,
+        size_t chunkBytes,
+        const SubmeshLimits& limits,
+        std::vector<MeshSubset>& subsets)
+    {
+        PassResult result;
+        ResetPeakRss();
+        uint64_t baseline = CurrentRss();
+        auto start = std::chrono::steady_clock::now();
+
+        MeshCacheWriter writer;
+        SubmeshSplitter splitter(limits);
+        MeshCacheKey key = { 1, 2 };
+
+        if (!writer.Begin(path, key, grid.VertexCount(), grid.IndexCount()))
+            return result;
+
+        // ===== vertices =====
+        std::vector<Vertex> vertices(std::max<size_t>(chunkBytes / sizeof(Vertex), 1));
+        for (uint64_t first = 0; first < grid.VertexCount(); first += vertices.size())
+        {
+            size_t count = (size_t)std::min<uint64_t>(vertices.size(), grid.VertexCount() - first);
+            for (size_t i = 0; i < count; i++)
+            {
+                vertices[i].position = grid.Position(first + i);
+                vertices[i].color = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+                vertices[i].normal = XMFLOAT3(0.0f, 0.0f, -1.0f);
+            }
+
+            if (!writer.WriteVertices(vertices.data(), count))
+                return result;
+        }
+        vertices = std::vector<Vertex>();
+
+        // ===== indices, whole triangles per chunk =====
+        std::vector<uint32_t> indices(std::max<size_t>(chunkBytes / sizeof(uint32_t) / 6 * 6, 6));
+        for (uint64_t first = 0; first < grid.IndexCount(); first += indices.size())
+        {
+            size_t count = (size_t)std::min<uint64_t>(indices.size(), grid.IndexCount() - first);
+            for (size_t i = 0; i < count; i++)
+                indices[i] = grid.Index(first + i);
+
+            if (!splitter.Add(indices.data(), count) || !writer.WriteIndices(indices.data(), count))
+                return result;
+        }
+
+        splitter.Finish(subsets);
+
+        std::vector<MeshLod> lods = grid.Lods();
+        result.ok = writer.Finish(
+            subsets.data(), subsets.size(),
+            lods.data(), lods.size(),
+            meshlets.data(), meshlets.size(),
+            XMFLOAT3(0.0f, 0.0f, 0.0f), grid.BoundsMax()
+        );
+
+        result.seconds = Seconds(start);
+        result.bytes = std::filesystem::file_size(path);
+        result.peakGrowth = PeakRss() - baseline;
+        return result;
+    }
+
+    // Checks the stream against the grid instead of uploading it.
+    class VerifySink : public GeometrySink
+    {
+    public:
+        VerifySink(const Grid& grid, const MeshSubset* subsets, VertexFormat format)
+            : mGrid(grid),
+            mSubsets(subsets),
+            mFormat(format),
+            mStride(VertexStride(format)),
+            mSubset(0),
+            mVertexBytes(0),
+            mIndexBytes(0),
+            mVertexWritten(0),
+            mIndexWritten(0),
+            mVertexErrors(0),
+            mIndexErrors(0)
+        {
+        }
+
+        bool BeginSubmesh(size_t subset, uint64_t vertexBytes, uint64_t indexBytes) override
+        {
+            if (!Complete())
+                return false;
+
+            mSubset = subset;
+            mVertexBytes = vertexBytes;
+            mIndexBytes = indexBytes;
+            mVertexWritten = 0;
+            mIndexWritten = 0;
+
+            return
+                vertexBytes == mStride * mSubsets[subset].vertexCount &&
+                indexBytes == sizeof(uint32_t) * (uint64_t)mSubsets[subset].indexCount;
+        }
+
+        bool WriteVertices(uint64_t offset, const void* data, uint64_t size) override
+        {
+            if (offset != mVertexWritten || size % mStride != 0 || offset + size > mVertexBytes)
+                return false;
+
+            // Packed positions are exact to half a 16-bit step.
+            XMFLOAT3 boundsMax = mGrid.BoundsMax();
+            float tolerance = std::max(boundsMax.x, boundsMax.y) / 65535.0f;
+
+            uint64_t first = mSubsets[mSubset].vertexOffset + offset / mStride;
+            for (uint64_t i = 0; i < size / mStride; i++)
+            {
+                XMFLOAT3 expected = mGrid.Position(first + i);
+                XMFLOAT3 position;
+
+                if (mFormat == VertexFormat::Packed)
+                    position = UnpackVertex(((const PackedVertex*)data)[i], XMFLOAT3(0.0f, 0.0f, 0.0f), boundsMax).position;
+                else
+                    position = ((const Vertex*)data)[i].position;
+
+                if (std::fabs(position.x - expected.x) > tolerance ||
+                    std::fabs(position.y - expected.y) > tolerance ||
+                    std::fabs(position.z - expected.z) > tolerance)
+                {
+                    mVertexErrors++;
+                }
+            }
+
+            mVertexWritten += size;
+            return true;
+        }
+
+        bool WriteIndices(uint64_t offset, const void* data, uint64_t size) override
+        {
+            if (offset != mIndexWritten || size % sizeof(uint32_t) != 0 || offset + size > mIndexBytes)
+                return false;
+
+            const MeshSubset& subset = mSubsets[mSubset];
+            const uint32_t* indices = (const uint32_t*)data;
+
+            uint64_t first = subset.indexOffset + offset / sizeof(uint32_t);
+            for (uint64_t i = 0; i < size / sizeof(uint32_t); i++)
+            {
+                if (indices[i] >= subset.vertexCount || indices[i] + subset.vertexOffset != mGrid.Index(first + i))
+                    mIndexErrors++;
+            }
+
+            mIndexWritten += size;
+            return true;
+        }
+
+        bool Complete() const { return mVertexWritten == mVertexBytes && mIndexWritten == mIndexBytes; }
+        uint64_t Errors() const { return mVertexErrors + mIndexErrors; }
+
+    private:
+        const Grid& mGrid;
+        const MeshSubset* mSubsets;
+        VertexFormat mFormat;
+        uint64_t mStride;
+
+        size_t mSubset;
+        uint64_t mVertexBytes;
+        uint64_t mIndexBytes;
+        uint64_t mVertexWritten;
+        uint64_t mIndexWritten;
+
+        uint64_t mVertexErrors;
+        uint64_t mIndexErrors;
+    };
+
+    // The renderer's warm start, with the verifying sink in place of the
+    // D3D12 one.
+    PassResult LoadGrid(
+        const Grid& grid,
+        const std::string& path,
+        VertexFormat format,
+        size_t chunkBytes,
+        bool evict,
+        JobSystem& jobs,
+        GeometryStreamStats& stats,
+        MeshQueryData& queries,
+        uint64_t& errors)
+    {
+        PassResult result;
+        ResetPeakRss();
+        uint64_t baseline = CurrentRss();
+        auto start = std::chrono::steady_clock::now();
+
+        MeshCacheFile cache;
+        if (!cache.Open(path, MeshCacheKey{ 1, 2 }))
+            return result;
+
+        GeometryStreamOptions options;
+        options.format = format;
+        options.boundsMin = cache.BoundsMin();
+        options.boundsMax = cache.BoundsMax();
+        options.chunkBytes = chunkBytes;
+        options.source = evict ? &cache.File() : nullptr;
+
+        VerifySink sink(grid, cache.Subsets(), format);
+        result.ok =
+            StreamGeometry(
+                cache.Vertices(), cache.VertexCount(),
+                cache.Indices(), cache.IndexCount(),
+                cache.Subsets(), cache.SubsetCount(),
+                options, sink, &stats
+            ) &&
+            sink.Complete();
+
+        MeshQueryOptions queryOptions;
+        queryOptions.chunkBytes = chunkBytes;
+        queryOptions.source = options.source;
+        queryOptions.jobs = &jobs;
+
+        result.ok = result.ok && BuildMeshQueryData(
+            cache.Vertices(), cache.VertexCount(),
+            cache.Indices(), cache.IndexCount(),
+            cache.Lods(), cache.LodCount(),
+            cache.Meshlets(), cache.MeshletCount(),
+            queryOptions, queries
+        );
+
+        errors = sink.Errors();
+        result.seconds = Seconds(start);
+        result.bytes = stats.vertexBytes + stats.indexBytes;
+        result.peakGrowth = PeakRss() - baseline;
+        return result;
+    }
+
+    // ===== query checks =====
+
+    // Meshlets have to tile LOD 0 in order, each sphere around its
+    // triangles.
+    uint64_t CheckMeshlets(const Grid& grid, const MeshletData& data)
+    {
+        uint64_t errors = 0;
+        uint64_t next = 0;
+        for (const Meshlet& m : data.meshlets)
+        {
+            if (m.indexOffset != next)
+                errors++;
+
+            for (uint64_t i = m.indexOffset; i < m.indexOffset + 3ull * m.triangleCount && i < grid.LodIndexCount(0); i++)
+            {
+                XMFLOAT3 p = grid.Position(grid.LodIndex(0, i));
+                float dx = p.x - m.center.x;
+                float dy = p.y - m.center.y;
+                float dz = p.z - m.center.z;
+                if (std::sqrt(dx * dx + dy * dy + dz * dz) > m.radius * 1.0001f + 1e-4f)
+                    errors++;
+            }
+            next = m.indexOffset + 3ull * m.triangleCount;
+        }
+        return data.meshlets.empty() || next == grid.LodIndexCount(0) ? errors : errors + 1;
+    }
+
+    // Every occluder corner has to be the grid vertex of its LOD index.
+    uint64_t CheckOccluder(const Grid& grid, const MeshQueryData& queries)
+    {
+        if (queries.occluderLod >= grid.LodCount())
+            return 0;
+
+        if (queries.occluderIndices.size() != grid.LodIndexCount(queries.occluderLod))
+            return 1;
+
+        uint64_t errors = 0;
+        for (size_t i = 0; i < queries.occluderIndices.size(); i++)
+        {
+            uint32_t index = queries.occluderIndices[i];
+            XMFLOAT3 expected = grid.Position(grid.LodIndex(queries.occluderLod, i));
+            if (index >= queries.occluderVertices.size() ||
+                queries.occluderVertices[index].position.x != expected.x ||
+                queries.occluderVertices[index].position.y != expected.y)
+            {
+                errors++;
+            }
+        }
+        return errors;
+    }
+
+    // Rays straight down at the pick LOD's surface must hit it at z = 0, in
+    // a triangle whose cell holds the ray.
+    uint64_t CheckPicking(const Grid& grid, const MeshQueryData& queries, int rayCount)
+    {
+        if (queries.pickLod >= grid.LodCount())
+            return 0;
+
+        size_t lod = queries.pickLod;
+        if (queries.bvh.TriangleCount() != grid.LodIndexCount(lod) / 3)
+            return 1;
+
+        float sizeX = (float)(grid.CellsX(lod) * grid.Stride(lod));
+        float sizeY = (float)(grid.CellsY(lod) * grid.Stride(lod));
+
+        uint64_t errors = 0;
+        uint32_t seed = 12345;
+        for (int r = 0; r < rayCount; r++)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            float x = (seed >> 8) / 16777216.0f * sizeX;
+            seed = seed * 1664525u + 1013904223u;
+            float y = (seed >> 8) / 16777216.0f * sizeY;
+
+            Ray ray;
+            ray.origin = XMFLOAT3(x, y, -1.0f);
+            ray.direction = XMFLOAT3(0.0f, 0.0f, 1.0f);
+
+            RayHit hit;
+            if (!queries.bvh.Intersect(ray, hit) || std::fabs(hit.t - 1.0f) > 1e-5f)
+            {
+                errors++;
+                continue;
+            }
+
+            uint64_t cell = hit.triangle / 2;
+            float stride = (float)grid.Stride(lod);
+            float cellX = (float)(cell % grid.CellsX(lod)) * stride;
+            float cellY = (float)(cell / grid.CellsX(lod)) * stride;
+            if (x < cellX - 1e-3f || x > cellX + stride + 1e-3f ||
+                y < cellY - 1e-3f || y > cellY + stride + 1e-3f)
+            {
+                errors++;
+            }
+        }
+        return errors;
+    }
+
+    // Subsets have to cover the index buffer in order and stay inside the
+    // limits.
+    bool CheckSubsets(const std::vector<MeshSubset>& subsets, const Grid& grid, const SubmeshLimits& limits)
+    {
+        uint64_t next = 0;
+        for (const MeshSubset& subset : subsets)
+        {
+            if (subset.indexOffset != next ||
+                sizeof(Vertex) * (uint64_t)subset.vertexCount > limits.maxVertexBytes ||
+                sizeof(uint32_t) * (uint64_t)subset.indexCount > limits.maxIndexBytes)
+            {
+                return false;
+            }
+            next += subset.indexCount;
+        }
+        return next == grid.IndexCount();
+    }
+
+    void PrintPass(const char* name, const PassResult& pass, bool last)
+    {
+        printf(
+            "  \"%s\": { \"seconds\": %.2f, \"mb_per_second\": %.1f, \"peak_rss_growth_mb\": %.1f }%s\n",
+            name,
+            pass.seconds,
+            pass.seconds > 0.0 ? pass.bytes / MB / pass.seconds : 0.0,
+            pass.peakGrowth / MB,
+            last ? "" : ","
+        );
+    }
+
+    void PrintUsage()
+    {
+        fprintf(stderr,
+            "usage: streambench [--width 4096] [--height 16384] [--format packed|full]\n"
+            "                   [--chunk-mb 4] [--limit-mb 2048] [--budget-mb 64]\n"
+            "                   [--tmp dir] [--keep] [--no-evict]\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t width = 4096;
+    uint32_t height = 16384;
+    VertexFormat format = VertexFormat::Packed;
+    double chunkMb = 4.0;
+    double limitMb = 2048.0;
+    double budgetMb = 64.0;
+    std::string tmpDir = std::filesystem::temp_directory_path().string();
+    bool keep = false;
+    bool evict = true;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--width" && hasValue)
+            width = (uint32_t)std::max(2, atoi(argv[++i]));
+        else if (arg == "--height" && hasValue)
+            height = (uint32_t)std::max(2, atoi(argv[++i]));
+        else if (arg == "--format" && hasValue && (!strcmp(argv[i + 1], "packed") || !strcmp(argv[i + 1], "full")))
+            format = !strcmp(argv[++i], "packed") ? VertexFormat::Packed : VertexFormat::Full;
+        else if (arg == "--chunk-mb" && hasValue)
+            chunkMb = atof(argv[++i]);
+        else if (arg == "--limit-mb" && hasValue)
+            limitMb = atof(argv[++i]);
+        else if (arg == "--budget-mb" && hasValue)
+            budgetMb = atof(argv[++i]);
+        else if (arg == "--tmp" && hasValue)
+            tmpDir = argv[++i];
+        else if (arg == "--keep")
+            keep = true;
+        else if (arg == "--no-evict")
+            evict = false;
+        else
+        {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    Grid grid;
+    grid.Initialize(width, height);
+
+    if (grid.IndexCount() > UINT32_MAX || chunkMb <= 0.0 || limitMb <= 0.0)
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    size_t chunkBytes = (size_t)(chunkMb * MB);
+    SubmeshLimits limits;
+    limits.maxVertexBytes = (uint64_t)(limitMb * MB);
+    limits.maxIndexBytes = (uint64_t)(limitMb * MB);
+
+    std::string path = (std::filesystem::path(tmpDir) / "streambench.mesh").string();
+
+    std::vector<Meshlet> meshlets = BuildGridMeshlets(grid);
+
+    std::vector<MeshSubset> subsets;
+    PassResult write = WriteGrid(grid, meshlets, path, chunkBytes, limits, subsets);
+
+    JobSystem jobs;
+    jobs.Initialize();
+
+    GeometryStreamStats stats;
+    MeshQueryData queries;
+    uint64_t errors = 0;
+    PassResult load;
+    if (write.ok)
+        load = LoadGrid(grid, path, format, chunkBytes, evict, jobs, stats, queries, errors);
+
+    if (!keep)
+    {
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+    }
+
+    bool subsetsOk = CheckSubsets(subsets, grid, limits);
+    uint64_t budget = (uint64_t)(budgetMb * MB);
+    bool withinBudget = write.peakGrowth <= budget && load.peakGrowth <= budget;
+
+    // Each query part from the LOD its budget allows.
+    MeshQueryOptions queryOptions;
+    std::vector<MeshLod> lods = grid.Lods();
+    uint64_t queryErrors = 0;
+    if (load.ok)
+    {
+        queryErrors =
+            (queries.meshlets.meshlets.size() != meshlets.size()) +
+            (queries.pickLod != SelectLodWithin(lods.data(), lods.size(), queryOptions.pickTriangles)) +
+            (queries.occluderLod != SelectLodWithin(lods.data(), lods.size(), queryOptions.occluderTriangles)) +
+            CheckMeshlets(grid, queries.meshlets) +
+            CheckOccluder(grid, queries) +
+            CheckPicking(grid, queries, 10000);
+    }
+
+    printf("{\n");
+    printf("  \"vertices\": %llu,\n", (unsigned long long)grid.VertexCount());
+    printf("  \"indices\": %llu,\n", (unsigned long long)grid.IndexCount());
+    printf("  \"file_mb\": %.1f,\n", write.bytes / MB);
+    printf("  \"format\": \"%s\",\n", format == VertexFormat::Packed ? "packed" : "full");
+    printf("  \"chunk_mb\": %.1f,\n", chunkMb);
+    printf("  \"subsets\": %zu,\n", subsets.size());
+    printf("  \"uploaded_mb\": %.1f,\n", load.bytes / MB);
+    printf("  \"chunks\": %llu,\n", (unsigned long long)stats.chunks);
+    printf("  \"errors\": %llu,\n", (unsigned long long)errors);
+    printf("  \"lods\": %zu,\n", grid.LodCount());
+    printf("  \"meshlets\": %zu,\n", queries.meshlets.meshlets.size());
+    printf("  \"pick_lod\": %zu,\n", queries.pickLod);
+    printf("  \"pick_triangles\": %zu,\n", queries.bvh.TriangleCount());
+    printf("  \"occluder_lod\": %zu,\n", queries.occluderLod);
+    printf("  \"occluder_triangles\": %zu,\n", queries.occluderIndices.size() / 3);
+    printf("  \"query_errors\": %llu,\n", (unsigned long long)queryErrors);
+    printf("  \"budget_mb\": %.1f,\n", budgetMb);
+    PrintPass("write", write, false);
+    PrintPass("load", load, true);
+    printf("}\n");
+
+    if (!write.ok)
+        fprintf(stderr, "failed to write %s\n", path.c_str());
+    else if (!load.ok)
+        fprintf(stderr, "loading failed\n");
+    if (!subsetsOk)
+        fprintf(stderr, "subsets do not cover the mesh within the limits\n");
+    if (errors)
+        fprintf(stderr, "%llu wrong vertices or indices\n", (unsigned long long)errors);
+    if (queryErrors)
+        fprintf(stderr, "%llu wrong meshlets, occluder corners or ray hits\n", (unsigned long long)queryErrors);
+    if (!withinBudget)
+        fprintf(stderr, "peak memory over budget\n");
+
+    return write.ok && load.ok && subsetsOk && errors == 0 && queryErrors == 0 && withinBudget ? 0 : 1;
+}
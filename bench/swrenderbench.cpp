@@ -0,0 +1,320 @@
+// Benchmarks SoftwareRenderer on obj/african_head.obj with the D3D12
+// path's camera and light: frames and millions of triangles per second
+// at a given size, thread count and draws per frame. A small frame is rendered with one
+// thread and with all of them and checked against the golden image in
+// bench/golden; a frame that depends on the thread count, or that differs
+// from the golden image in more pixels than the tolerance, exits with 1.
+// Results go out as JSON.
+//
+// Linux build, from the repository root, with DirectXMath on the include
+// path:
+//
+//   g++ -std=c++17 -O2 -pthread -Isrc -o swrenderbench bench/swrenderbench.cpp
+//       src/swrenderer.cpp src/parcer.cpp src/mappedfile.cpp src/profiler.cpp
+//
+// Usage:
+//
+//   swrenderbench [--size 1920x1080] [--frames 20] [--draws 32] [--threads 0]
+//                 [--obj obj/african_head.obj]
+//                 [--golden bench/golden/african_head.ppm] [--write-golden]
+
+#include "swrenderer.h"
+#include "parcer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+    // The golden image is small so it stays cheap to keep in the tree.
+    constexpr int GOLDEN_WIDTH = 256;
+    constexpr int GOLDEN_HEIGHT = 256;
+
+    // Channels may drift by rounding between compilers and flags; pixels
+    // further off than CHANNEL_TOLERANCE count as different.
+    constexpr int CHANNEL_TOLERANCE = 2;
+    constexpr double PIXEL_TOLERANCE = 0.001;
+
+    using Clock = std::chrono::steady_clock;
+
+    double Seconds(Clock::time_point start, Clock::time_point end)
+    {
+        return std::chrono::duration<double>(end - start).count();
+    }
+
+    struct Mesh
+    {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+    };
+
+    // DX12Renderer::Initialize and Render: the head at the origin, seen
+    // from (0, 2, -5), lit from above.
+    void SetupScene(SoftwareRenderer& renderer, const Mesh& mesh, int width, int height)
+    {
+        XMMATRIX world = XMMatrixIdentity();
+        XMMATRIX view = XMMatrixLookAtLH(
+            XMVectorSet(0, 2, -5, 1),
+            XMVectorZero(),
+            XMVectorSet(0, 1, 0, 0)
+        );
+        XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, (float)width / height, 0.1f, 100.0f);
+
+        ObjectConstants obj = {};
+        obj.world = XMMatrixTranspose(world);
+        obj.view = XMMatrixTranspose(view);
+        obj.projection = XMMatrixTranspose(projection);
+        renderer.SetObjectConstants(obj);
+
+        LightConstants light = {};
+        light.lightDir = XMFLOAT3(0.5f, -1.0f, 0.5f);
+        light.ambientColor = XMFLOAT4(0.2f, 0.2f, 0.2f, 1.0f);
+        light.diffuseColor = XMFLOAT4(0.8f, 0.8f, 0.8f, 1.0f);
+        renderer.SetLightConstants(light);
+
+        renderer.SetVertexBuffer(mesh.vertices.data(), mesh.vertices.size());
+        renderer.SetIndexBuffer(mesh.indices.data(), mesh.indices.size());
+    }
+
+    // draws > 1 repeats the mesh in place, which keeps a frame triangle
+    // bound rather than bound by clearing and resolving the targets.
+    void DrawFrame(SoftwareRenderer& renderer, const Mesh& mesh, int draws)
+    {
+        const float clearColor[4] = { 0.1f, 0.1f, 0.3f, 1.0f };
+        renderer.Clear(clearColor);
+        for (int d = 0; d < draws; d++)
+            renderer.DrawIndexed((uint32_t)mesh.indices.size(), 0, 0);
+    }
+
+    bool RenderImage(const Mesh& mesh, int width, int height, unsigned threads, std::vector<uint32_t>& pixels)
+    {
+        SoftwareRenderer renderer;
+        if (!renderer.Initialize(width, height, threads))
+            return false;
+
+        SetupScene(renderer, mesh, width, height);
+        DrawFrame(renderer, mesh, 1);
+
+        const uint32_t* data = renderer.Pixels();
+        pixels.assign(data, data + (size_t)width * height);
+        return true;
+    }
+
+    // Binary PPM (P6), as SoftwareRenderer::WriteImage writes it.
+    bool ReadImage(const std::string& path, int& width, int& height, std::vector<uint8_t>& rgb)
+    {
+        FILE* f = fopen(path.c_str(), "rb");
+        if (!f)
+            return false;
+
+        int maxValue = 0;
+        bool ok = fscanf(f, "P6 %d %d %d", &width, &height, &maxValue) == 3 &&
+            maxValue == 255 && width > 0 && height > 0 && fgetc(f) != EOF;
+
+        if (ok)
+        {
+            rgb.resize((size_t)width * height * 3);
+            ok = fread(rgb.data(), 1, rgb.size(), f) == rgb.size();
+        }
+
+        fclose(f);
+        return ok;
+    }
+
+    bool WriteImage(const std::string& path, int width, int height, const std::vector<uint32_t>& pixels)
+    {
+        FILE* f = fopen(path.c_str(), "wb");
+        if (!f)
+            return false;
+
+        fprintf(f, "P6\n%d %d\n255\n", width, height);
+
+        std::vector<uint8_t> rgb(pixels.size() * 3);
+        for (size_t i = 0; i < pixels.size(); i++)
+        {
+            rgb[i * 3 + 0] = (uint8_t)(pixels[i]);
+            rgb[i * 3 + 1] = (uint8_t)(pixels[i] >> 8);
+            rgb[i * 3 + 2] = (uint8_t)(pixels[i] >> 16);
+        }
+
+        bool ok = fwrite(rgb.data(), 1, rgb.size(), f) == rgb.size();
+        return fclose(f) == 0 && ok;
+    }
+
+    // Pixels with a channel more than CHANNEL_TOLERANCE away from golden.
+    size_t CountDifferences(const std::vector<uint32_t>& pixels, const std::vector<uint8_t>& golden, int& maxDiff)
+    {
+        size_t different = 0;
+        maxDiff = 0;
+
+        for (size_t i = 0; i < pixels.size(); i++)
+        {
+            int worst = 0;
+            for (int c = 0; c < 3; c++)
+            {
+                int value = (int)((pixels[i] >> (c * 8)) & 0xFF);
+                worst = std::max(worst, std::abs(value - (int)golden[i * 3 + c]));
+            }
+
+            maxDiff = std::max(maxDiff, worst);
+            if (worst > CHANNEL_TOLERANCE)
+                different++;
+        }
+
+        return different;
+    }
+
+    bool ParseSize(const std::string& text, int& width, int& height)
+    {
+        return sscanf(text.c_str(), "%dx%d", &width, &height) == 2 && width > 0 && height > 0;
+    }
+
+    void PrintUsage()
+    {
+        fprintf(stderr,
+            "usage: swrenderbench [--size 1920x1080] [--frames 20] [--draws 32] [--threads 0]\n"
+            "                     [--obj obj/african_head.obj]\n"
+            "                     [--golden bench/golden/african_head.ppm] [--write-golden]\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int width = 1920;
+    int height = 1080;
+    int frames = 20;
+    int draws = 32;
+    unsigned threads = 0;
+    std::string objPath = "obj/african_head.obj";
+    std::string goldenPath = "bench/golden/african_head.ppm";
+    bool writeGolden = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--size" && hasValue && ParseSize(argv[i + 1], width, height))
+            ++i;
+        else if (arg == "--frames" && hasValue)
+            frames = std::max(1, atoi(argv[++i]));
+        else if (arg == "--draws" && hasValue)
+            draws = std::max(1, atoi(argv[++i]));
+        else if (arg == "--threads" && hasValue)
+            threads = (unsigned)std::max(0, atoi(argv[++i]));
+        else if (arg == "--obj" && hasValue)
+            objPath = argv[++i];
+        else if (arg == "--golden" && hasValue)
+            goldenPath = argv[++i];
+        else if (arg == "--write-golden")
+            writeGolden = true;
+        else
+        {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    Mesh mesh;
+    if (!LoadOBJ(objPath, mesh.vertices, mesh.indices))
+    {
+        fprintf(stderr, "failed to load %s\n", objPath.c_str());
+        return 1;
+    }
+
+    // ===== correctness: thread count independence and the golden image =====
+    std::vector<uint32_t> single;
+    std::vector<uint32_t> parallel;
+    if (!RenderImage(mesh, GOLDEN_WIDTH, GOLDEN_HEIGHT, 1, single) ||
+        !RenderImage(mesh, GOLDEN_WIDTH, GOLDEN_HEIGHT, threads, parallel))
+    {
+        fprintf(stderr, "failed to initialize the software renderer\n");
+        return 1;
+    }
+
+    bool deterministic = single == parallel;
+
+    if (writeGolden)
+    {
+        if (!WriteImage(goldenPath, GOLDEN_WIDTH, GOLDEN_HEIGHT, single))
+        {
+            fprintf(stderr, "failed to write %s\n", goldenPath.c_str());
+            return 1;
+        }
+        fprintf(stderr, "wrote %s\n", goldenPath.c_str());
+    }
+
+    int goldenWidth = 0;
+    int goldenHeight = 0;
+    std::vector<uint8_t> golden;
+    bool goldenLoaded = ReadImage(goldenPath, goldenWidth, goldenHeight, golden) &&
+        goldenWidth == GOLDEN_WIDTH && goldenHeight == GOLDEN_HEIGHT;
+    if (!goldenLoaded)
+        fprintf(stderr, "failed to read a %dx%d image from %s\n", GOLDEN_WIDTH, GOLDEN_HEIGHT, goldenPath.c_str());
+
+    int maxDiff = 0;
+    size_t different = goldenLoaded ? CountDifferences(single, golden, maxDiff) : single.size();
+    bool matchesGolden = goldenLoaded && different <= (size_t)(PIXEL_TOLERANCE * single.size());
+
+    // ===== timing =====
+    SoftwareRenderer renderer;
+    if (!renderer.Initialize(width, height, threads))
+    {
+        fprintf(stderr, "failed to initialize a %dx%d software renderer\n", width, height);
+        return 1;
+    }
+
+    SetupScene(renderer, mesh, width, height);
+
+    // Warms the bins and tiles outside the timed frames.
+    DrawFrame(renderer, mesh, draws);
+    renderer.Pixels();
+    renderer.ResetStats();
+
+    double best = 1e30;
+    double total = 0.0;
+    for (int f = 0; f < frames; f++)
+    {
+        auto start = Clock::now();
+        DrawFrame(renderer, mesh, draws);
+        renderer.Pixels();
+        double seconds = Seconds(start, Clock::now());
+
+        best = std::min(best, seconds);
+        total += seconds;
+    }
+
+    const SoftwareRenderStats& stats = renderer.Stats();
+    double triangles = (double)stats.trianglesIn / frames;
+    bool pass = deterministic && matchesGolden;
+
+    printf("{\n");
+    printf("  \"mesh\": \"%s\",\n  \"triangles\": %zu,\n", objPath.c_str(), mesh.indices.size() / 3);
+    printf("  \"width\": %d,\n  \"height\": %d,\n  \"threads\": %u,\n  \"frames\": %d,\n", width, height, threads, frames);
+    printf("  \"draws\": %d,\n", draws);
+    printf("  \"bestMs\": %.3f,\n  \"averageMs\": %.3f,\n", best * 1e3, total / frames * 1e3);
+    printf("  \"mtrisPerSecond\": %.2f,\n", triangles / best * 1e-6);
+    printf("  \"trianglesDrawn\": %.0f,\n  \"pixelsShaded\": %.0f,\n",
+        (double)stats.trianglesDrawn / frames, (double)stats.pixelsShaded / frames);
+    printf("  \"deterministic\": %s,\n", deterministic ? "true" : "false");
+    printf("  \"goldenDifferentPixels\": %zu,\n  \"goldenMaxChannelDiff\": %d,\n", different, maxDiff);
+    printf("  \"pass\": %s\n}\n", pass ? "true" : "false");
+
+    if (!deterministic)
+        fprintf(stderr, "the image depends on the thread count\n");
+    if (goldenLoaded && !matchesGolden)
+        fprintf(stderr, "the image differs from %s in %zu pixels\n", goldenPath.c_str(), different);
+
+    return pass ? 0 : 1;
+}
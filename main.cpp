@@ -1,9 +1,14 @@
 #include <Windows.h>
 #include "dx12app.h"
 
+#include <cstring>
+
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR pCmdLine, int nCmdShow)
 {
-    DX12App app(hInstance);
+    // --profile writes a trace of startup and the first frames.
+    bool profile = pCmdLine && strstr(pCmdLine, "--profile") != nullptr;
+
+    DX12App app(hInstance, profile);
 
     if (!app.Initialize(800, 600))
     {
@@ -0,0 +1,970 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BVH_X86 1
+#include <emmintrin.h>
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+    // Larger subtrees are built as jobs.
+    constexpr uint32_t PARALLEL_SUBTREE = 8192;
+    // Larger nodes are binned across workers.
+    constexpr uint32_t PARALLEL_BINNING = 65536;
+    constexpr size_t BINNING_GRAIN = 16384;
+
+    // Below this binary depth splits are SAH; deeper ones halve the node,
+    // which bounds the tree depth and the traversal stack.
+    constexpr uint32_t SAH_DEPTH = 48;
+    constexpr uint32_t MAX_BINS = 32;
+    constexpr size_t STACK_SIZE = 256;
+
+    struct Box
+    {
+        float min[3];
+        float max[3];
+
+        void Reset()
+        {
+            for (int a = 0; a < 3; a++)
+            {
+                min[a] = FLT_MAX;
+                max[a] = -FLT_MAX;
+            }
+        }
+
+        void Grow(const float* lo, const float* hi)
+        {
+            for (int a = 0; a < 3; a++)
+            {
+                min[a] = std::min(min[a], lo[a]);
+                max[a] = std::max(max[a], hi[a]);
+            }
+        }
+
+        void Grow(const Box& b) { Grow(b.min, b.max); }
+
+        // Half the surface area; only ratios matter.
+        float Area() const
+        {
+            float dx = max[0] - min[0];
+            float dy = max[1] - min[1];
+            float dz = max[2] - min[2];
+            if (dx < 0.0f || dy < 0.0f || dz < 0.0f)
+                return 0.0f;
+            return dx * dy + dy * dz + dz * dx;
+        }
+    };
+
+    struct PrimRef
+    {
+        Box bounds;
+        uint32_t triangle;
+
+        float Centroid(int axis) const { return (bounds.min[axis] + bounds.max[axis]) * 0.5f; }
+    };
+
+    struct Bin
+    {
+        Box bounds;
+        uint32_t count;
+    };
+
+    // Node and centroid bounds of a range plus its bins on every axis.
+    struct Binning
+    {
+        Box bounds;
+        Box centroids;
+        Bin bins[3][MAX_BINS];
+
+        void Reset(uint32_t binCount)
+        {
+            bounds.Reset();
+            centroids.Reset();
+            for (int a = 0; a < 3; a++)
+            {
+                for (uint32_t b = 0; b < binCount; b++)
+                {
+                    bins[a][b].bounds.Reset();
+                    bins[a][b].count = 0;
+                }
+            }
+        }
+
+        void Merge(const Binning& other, uint32_t binCount)
+        {
+            bounds.Grow(other.bounds);
+            centroids.Grow(other.centroids);
+            for (int a = 0; a < 3; a++)
+            {
+                for (uint32_t b = 0; b < binCount; b++)
+                {
+                    bins[a][b].bounds.Grow(other.bins[a][b].bounds);
+                    bins[a][b].count += other.bins[a][b].count;
+                }
+            }
+        }
+    };
+
+    // Maps centroids of one axis to bins.
+    struct BinMapping
+    {
+        float offset;
+        float scale;
+        uint32_t last;
+
+        BinMapping(const Box& centroids, int axis, uint32_t binCount)
+        {
+            float extent = centroids.max[axis] - centroids.min[axis];
+            offset = centroids.min[axis];
+            scale = extent > 0.0f ? binCount * 0.9999f / extent : 0.0f;
+            last = binCount - 1;
+        }
+
+        uint32_t operator()(float c) const
+        {
+            return std::min(last, (uint32_t)std::max(0.0f, (c - offset) * scale));
+        }
+    };
+
+    // Triangles are tested 4 at a time, so the SAH counts blocks.
+    inline float Blocks(uint32_t triangles)
+    {
+        return (float)((triangles + 3) / 4);
+    }
+
+    struct StackEntry
+    {
+        uint32_t child;
+        uint32_t blockCount;
+        float tNear;
+    };
+
+    // Ray in the form the box and triangle tests use.
+    struct RayData
+    {
+        float origin[3];
+        float direction[3];
+        float inverse[3];
+        // bounds row of the near and far plane per axis.
+        int nearRow[3];
+        int farRow[3];
+        float tMin;
+    };
+
+    RayData PrepareRay(const Ray& ray)
+    {
+        RayData r;
+        const float o[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+        const float d[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+
+        for (int a = 0; a < 3; a++)
+        {
+            r.origin[a] = o[a];
+            r.direction[a] = d[a];
+
+            // Finite even for axis-parallel rays, so no slab gives 0 * inf.
+            float safe = std::fabs(d[a]) > 1e-30f ? d[a] : std::copysign(1e-30f, d[a]);
+            r.inverse[a] = 1.0f / safe;
+
+            r.nearRow[a] = d[a] >= 0.0f ? a : a + 3;
+            r.farRow[a] = d[a] >= 0.0f ? a + 3 : a;
+        }
+
+        r.tMin = ray.tMin;
+        return r;
+    }
+}
+
+struct Bvh::BuildNode
+{
+    Box bounds;
+    // First child, the second is left + 1. Unused by leaves.
+    uint32_t left;
+    uint32_t first;
+    // Nonzero for leaves once built.
+    uint32_t count;
+    bool leaf;
+};
+
+// ===== binned SAH build =====
+
+class Bvh::Builder
+{
+public:
+    Builder(const BvhBuildOptions& options, JobSystem* jobs, std::vector<PrimRef>& refs, std::vector<BuildNode>& nodes)
+        : mOptions(options),
+        mJobs(jobs),
+        mRefs(refs),
+        mNodes(nodes),
+        mNodeCount(1)
+    {
+        mOptions.binCount = std::max(2u, std::min(mOptions.binCount, MAX_BINS));
+        mOptions.maxLeafTriangles = std::max(1u, mOptions.maxLeafTriangles);
+    }
+
+    uint32_t Build()
+    {
+        mNodes[0].first = 0;
+        mNodes[0].count = (uint32_t)mRefs.size();
+
+        Subtree(0, 0);
+        if (mJobs)
+            mJobs->Wait(mCounter);
+
+        return mNodeCount.load();
+    }
+
+private:
+    struct Task
+    {
+        uint32_t node;
+        uint32_t depth;
+    };
+
+    void Subtree(uint32_t root, uint32_t rootDepth)
+    {
+        std::vector<Task> stack;
+        stack.push_back({ root, rootDepth });
+
+        while (!stack.empty())
+        {
+            Task task = stack.back();
+            stack.pop_back();
+
+            BuildNode& node = mNodes[task.node];
+            uint32_t first = node.first;
+            uint32_t count = node.count;
+
+            Binning binning;
+            BinNode(first, count, binning);
+            node.bounds = binning.bounds;
+
+            uint32_t mid;
+            if (!Split(first, count, task.depth, binning, mid))
+            {
+                node.leaf = true;
+                continue;
+            }
+
+            uint32_t left = mNodeCount.fetch_add(2);
+            node.left = left;
+            node.leaf = false;
+
+            mNodes[left].first = first;
+            mNodes[left].count = mid - first;
+            mNodes[left + 1].first = mid;
+            mNodes[left + 1].count = first + count - mid;
+
+            uint32_t right = left + 1;
+            uint32_t depth = task.depth + 1;
+
+            if (mJobs && mNodes[right].count >= PARALLEL_SUBTREE)
+            {
+                Builder* self = this;
+                mJobs->Spawn(mCounter, [self, right, depth]() { self->Subtree(right, depth); });
+            }
+            else
+            {
+                stack.push_back({ right, depth });
+            }
+
+            stack.push_back({ left, depth });
+        }
+    }
+
+    void ComputeBounds(size_t begin, size_t end, Binning& binning) const
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            const PrimRef& ref = mRefs[i];
+            binning.bounds.Grow(ref.bounds);
+
+            float c[3] = { ref.Centroid(0), ref.Centroid(1), ref.Centroid(2) };
+            binning.centroids.Grow(c, c);
+        }
+    }
+
+    void FillBins(size_t begin, size_t end, const Box& centroids, Binning& binning) const
+    {
+        BinMapping map[3] = {
+            BinMapping(centroids, 0, mOptions.binCount),
+            BinMapping(centroids, 1, mOptions.binCount),
+            BinMapping(centroids, 2, mOptions.binCount),
+        };
+
+#ifdef BVH_X86
+        // Bin boxes live in registers as min / max xyz_ for the whole range;
+        // min and max are exact, so this matches the scalar loop below.
+        uint32_t binCount = mOptions.binCount;
+        __m128 lo[3][MAX_BINS];
+        __m128 hi[3][MAX_BINS];
+        for (int a = 0; a < 3; a++)
+        {
+            for (uint32_t b = 0; b < binCount; b++)
+            {
+                const Box& box = binning.bins[a][b].bounds;
+                lo[a][b] = _mm_setr_ps(box.min[0], box.min[1], box.min[2], 0.0f);
+                hi[a][b] = _mm_setr_ps(box.max[0], box.max[1], box.max[2], 0.0f);
+            }
+        }
+
+        const __m128 offset = _mm_setr_ps(map[0].offset, map[1].offset, map[2].offset, 0.0f);
+        const __m128 scale = _mm_setr_ps(map[0].scale, map[1].scale, map[2].scale, 0.0f);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 zero = _mm_setzero_ps();
+
+        for (size_t i = begin; i < end; i++)
+        {
+            const float* bounds = mRefs[i].bounds.min;
+            __m128 rmin = _mm_loadu_ps(bounds);
+            __m128 rmax = _mm_loadu_ps(bounds + 2);
+            rmax = _mm_shuffle_ps(rmax, rmax, _MM_SHUFFLE(3, 3, 2, 1));
+
+            // BinMapping on all three axes; max(x, 0) keeps NaN at bin 0.
+            __m128 c = _mm_mul_ps(_mm_add_ps(rmin, rmax), half);
+            __m128 f = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(c, offset), scale), zero);
+            alignas(16) int32_t bin[4];
+            _mm_store_si128((__m128i*)bin, _mm_cvttps_epi32(f));
+
+            for (int a = 0; a < 3; a++)
+            {
+                uint32_t b = std::min(map[a].last, (uint32_t)bin[a]);
+                lo[a][b] = _mm_min_ps(lo[a][b], rmin);
+                hi[a][b] = _mm_max_ps(hi[a][b], rmax);
+                ++binning.bins[a][b].count;
+            }
+        }
+
+        for (int a = 0; a < 3; a++)
+        {
+            for (uint32_t b = 0; b < binCount; b++)
+            {
+                alignas(16) float l[4];
+                alignas(16) float h[4];
+                _mm_store_ps(l, lo[a][b]);
+                _mm_store_ps(h, hi[a][b]);
+
+                Box& box = binning.bins[a][b].bounds;
+                memcpy(box.min, l, sizeof(box.min));
+                memcpy(box.max, h, sizeof(box.max));
+            }
+        }
+#else
+        // All three axes per reference, so each is read once.
+        for (size_t i = begin; i < end; i++)
+        {
+            const PrimRef& ref = mRefs[i];
+            for (int a = 0; a < 3; a++)
+            {
+                Bin& bin = binning.bins[a][map[a](ref.Centroid(a))];
+                bin.bounds.Grow(ref.bounds);
+                ++bin.count;
+            }
+        }
+#endif
+    }
+
+    // Bounds, then bins against the centroid bounds. Large ranges are
+    // split across workers and merged; min, max and sums do not depend on
+    // the split, so the result is the same.
+    void BinNode(uint32_t first, uint32_t count, Binning& binning)
+    {
+        binning.Reset(mOptions.binCount);
+
+        if (!mJobs || count < PARALLEL_BINNING)
+        {
+            ComputeBounds(first, first + count, binning);
+            FillBins(first, first + count, binning.centroids, binning);
+            return;
+        }
+
+        std::mutex mutex;
+        uint32_t binCount = mOptions.binCount;
+
+        mJobs->ParallelFor(count, BINNING_GRAIN, [&](size_t begin, size_t end)
+        {
+            Binning local;
+            local.Reset(binCount);
+            ComputeBounds(first + begin, first + end, local);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            binning.bounds.Grow(local.bounds);
+            binning.centroids.Grow(local.centroids);
+        });
+
+        mJobs->ParallelFor(count, BINNING_GRAIN, [&](size_t begin, size_t end)
+        {
+            Binning local;
+            local.Reset(binCount);
+            FillBins(first + begin, first + end, binning.centroids, local);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            for (int a = 0; a < 3; a++)
+            {
+                for (uint32_t b = 0; b < binCount; b++)
+                {
+                    binning.bins[a][b].bounds.Grow(local.bins[a][b].bounds);
+                    binning.bins[a][b].count += local.bins[a][b].count;
+                }
+            }
+        });
+    }
+
+    // Partitions [first, first + count) and returns the split in mid, or
+    // false to make a leaf.
+    bool Split(uint32_t first, uint32_t count, uint32_t depth, const Binning& binning, uint32_t& mid)
+    {
+        if (count <= 1)
+            return false;
+
+        int bestAxis = -1;
+        uint32_t bestBin = 0;
+        float bestCost = FLT_MAX;
+
+        if (depth < SAH_DEPTH)
+        {
+            uint32_t binCount = mOptions.binCount;
+            float rightArea[MAX_BINS];
+            uint32_t rightCount[MAX_BINS];
+
+            for (int a = 0; a < 3; a++)
+            {
+                if (binning.centroids.max[a] <= binning.centroids.min[a])
+                    continue;
+
+                // Right side of every split, swept from the end.
+                Box right;
+                right.Reset();
+                uint32_t n = 0;
+                for (uint32_t b = binCount - 1; b > 0; b--)
+                {
+                    right.Grow(binning.bins[a][b].bounds);
+                    n += binning.bins[a][b].count;
+                    rightArea[b - 1] = right.Area();
+                    rightCount[b - 1] = n;
+                }
+
+                Box left;
+                left.Reset();
+                n = 0;
+                for (uint32_t b = 0; b + 1 < binCount; b++)
+                {
+                    left.Grow(binning.bins[a][b].bounds);
+                    n += binning.bins[a][b].count;
+
+                    if (n == 0 || rightCount[b] == 0)
+                        continue;
+
+                    float cost = left.Area() * Blocks(n) + rightArea[b] * Blocks(rightCount[b]);
+                    if (cost < bestCost)
+                    {
+                        bestCost = cost;
+                        bestAxis = a;
+                        bestBin = b;
+                    }
+                }
+            }
+
+            float area = binning.bounds.Area();
+            float leafCost = mOptions.intersectionCost * Blocks(count);
+            float splitCost = mOptions.traversalCost +
+                (area > 0.0f ? mOptions.intersectionCost * bestCost / area : leafCost);
+
+            if (count <= mOptions.maxLeafTriangles && (bestAxis < 0 || leafCost <= splitCost))
+                return false;
+        }
+        else if (count <= mOptions.maxLeafTriangles)
+        {
+            return false;
+        }
+
+        PrimRef* begin = mRefs.data() + first;
+        PrimRef* end = begin + count;
+
+        if (bestAxis >= 0)
+        {
+            BinMapping map(binning.centroids, bestAxis, mOptions.binCount);
+            PrimRef* split = std::partition(begin, end, [&](const PrimRef& r)
+            {
+                return map(r.Centroid(bestAxis)) <= bestBin;
+            });
+
+            mid = first + (uint32_t)(split - begin);
+            if (mid != first && mid != first + count)
+                return true;
+        }
+
+        // No usable SAH split: halve along the widest centroid axis.
+        int axis = 0;
+        for (int a = 1; a < 3; a++)
+        {
+            if (binning.centroids.max[a] - binning.centroids.min[a] > binning.centroids.max[axis] - binning.centroids.min[axis])
+                axis = a;
+        }
+
+        mid = first + count / 2;
+        std::nth_element(begin, mRefs.data() + mid, end, [axis](const PrimRef& a, const PrimRef& b)
+        {
+            return a.Centroid(axis) < b.Centroid(axis);
+        });
+        return true;
+    }
+
+    BvhBuildOptions mOptions;
+    JobSystem* mJobs;
+    std::vector<PrimRef>& mRefs;
+    std::vector<BuildNode>& mNodes;
+    std::atomic<uint32_t> mNodeCount;
+    JobCounter mCounter;
+};
+
+Bvh::Bvh()
+    : mTriangleCount(0),
+    mBoundsMin(0.0f, 0.0f, 0.0f),
+    mBoundsMax(0.0f, 0.0f, 0.0f)
+{
+}
+
+void Bvh::Build(
+    const Vertex* vertices,
+    size_t vertexCount,
+    const uint32_t* indices,
+    size_t indexCount,
+    const BvhBuildOptions& options,
+    JobSystem* jobs)
+{
+    mNodes.clear();
+    mBlocks.clear();
+    mStats = BvhStats();
+    mTriangleCount = indexCount / 3;
+    mBoundsMin = XMFLOAT3(0.0f, 0.0f, 0.0f);
+    mBoundsMax = XMFLOAT3(0.0f, 0.0f, 0.0f);
+
+    // Triangles with an index past the vertex array are left out.
+    std::vector<PrimRef> refs;
+    refs.reserve(mTriangleCount);
+    for (size_t t = 0; t < mTriangleCount; t++)
+    {
+        const uint32_t* tri = indices + t * 3;
+        if (tri[0] >= vertexCount || tri[1] >= vertexCount || tri[2] >= vertexCount)
+            continue;
+
+        PrimRef ref;
+        ref.bounds.Reset();
+        for (int k = 0; k < 3; k++)
+        {
+            const XMFLOAT3& p = vertices[tri[k]].position;
+            float v[3] = { p.x, p.y, p.z };
+            ref.bounds.Grow(v, v);
+        }
+        ref.triangle = (uint32_t)t;
+        refs.push_back(ref);
+    }
+
+    if (refs.empty())
+        return;
+
+    std::vector<BuildNode> binary(refs.size() * 2);
+    Builder builder(options, jobs, refs, binary);
+    uint32_t binaryCount = builder.Build();
+
+    const Box& rootBounds = binary[0].bounds;
+    mBoundsMin = XMFLOAT3(rootBounds.min[0], rootBounds.min[1], rootBounds.min[2]);
+    mBoundsMax = XMFLOAT3(rootBounds.max[0], rootBounds.max[1], rootBounds.max[2]);
+
+    // SAH cost of the binary tree, relative to the root box.
+    float rootArea = rootBounds.Area();
+    if (rootArea > 0.0f)
+    {
+        double cost = 0.0;
+        for (uint32_t i = 0; i < binaryCount; i++)
+        {
+            const BuildNode& n = binary[i];
+            cost += n.leaf ?
+                options.intersectionCost * Blocks(n.count) * n.bounds.Area() :
+                options.traversalCost * n.bounds.Area();
+        }
+        mStats.sahCost = (float)(cost / rootArea);
+    }
+
+    // ===== collapse into 4-wide nodes =====
+    // Every node takes its children and pulls up grandchildren, largest
+    // first, until it has 4. Nodes and blocks come out depth first.
+    struct Collapse
+    {
+        uint32_t binary;
+        uint32_t node;
+        uint32_t depth;
+    };
+
+    std::vector<Collapse> stack;
+    mNodes.reserve(binaryCount / 2 + 1);
+    mBlocks.reserve(refs.size() / 2 + 1);
+
+    mNodes.emplace_back();
+    stack.push_back({ 0, 0, 1 });
+
+    while (!stack.empty())
+    {
+        Collapse task = stack.back();
+        stack.pop_back();
+
+        mStats.maxDepth = std::max(mStats.maxDepth, task.depth);
+
+        uint32_t children[4];
+        uint32_t childCount = 0;
+
+        if (binary[task.binary].leaf)
+        {
+            // A leaf root: one child.
+            children[childCount++] = task.binary;
+        }
+        else
+        {
+            children[childCount++] = binary[task.binary].left;
+            children[childCount++] = binary[task.binary].left + 1;
+
+            while (childCount < 4)
+            {
+                int largest = -1;
+                float largestArea = -1.0f;
+                for (uint32_t c = 0; c < childCount; c++)
+                {
+                    const BuildNode& n = binary[children[c]];
+                    if (!n.leaf && n.bounds.Area() > largestArea)
+                    {
+                        largestArea = n.bounds.Area();
+                        largest = (int)c;
+                    }
+                }
+
+                if (largest < 0)
+                    break;
+
+                uint32_t left = binary[children[largest]].left;
+                children[largest] = left;
+                children[childCount++] = left + 1;
+            }
+        }
+
+        for (uint32_t c = 0; c < 4; c++)
+        {
+            Node& node = mNodes[task.node];
+
+            if (c >= childCount)
+            {
+                for (int a = 0; a < 3; a++)
+                {
+                    node.bounds[a][c] = FLT_MAX;
+                    node.bounds[a + 3][c] = -FLT_MAX;
+                }
+                node.child[c] = EMPTY;
+                node.blockCount[c] = 0;
+                continue;
+            }
+
+            const BuildNode& n = binary[children[c]];
+            for (int a = 0; a < 3; a++)
+            {
+                node.bounds[a][c] = n.bounds.min[a];
+                node.bounds[a + 3][c] = n.bounds.max[a];
+            }
+
+            if (!n.leaf)
+            {
+                node.child[c] = (uint32_t)mNodes.size();
+                node.blockCount[c] = 0;
+                stack.push_back({ children[c], node.child[c], task.depth + 1 });
+                mNodes.emplace_back();
+                continue;
+            }
+
+            uint32_t firstBlock = (uint32_t)mBlocks.size();
+            uint32_t blockCount = (n.count + 3) / 4;
+            node.child[c] = LEAF_BIT | firstBlock;
+            node.blockCount[c] = blockCount;
+            ++mStats.leaves;
+
+            for (uint32_t b = 0; b < blockCount; b++)
+            {
+                TriangleBlock block;
+                memset(&block, 0, sizeof(block));
+
+                for (uint32_t lane = 0; lane < 4; lane++)
+                {
+                    uint32_t r = b * 4 + lane;
+                    if (r >= n.count)
+                    {
+                        block.triangle[lane] = BVH_INVALID;
+                        continue;
+                    }
+
+                    uint32_t t = refs[n.first + r].triangle;
+                    const XMFLOAT3& p0 = vertices[indices[t * 3 + 0]].position;
+                    const XMFLOAT3& p1 = vertices[indices[t * 3 + 1]].position;
+                    const XMFLOAT3& p2 = vertices[indices[t * 3 + 2]].position;
+
+                    block.v0[0][lane] = p0.x;
+                    block.v0[1][lane] = p0.y;
+                    block.v0[2][lane] = p0.z;
+                    block.e1[0][lane] = p1.x - p0.x;
+                    block.e1[1][lane] = p1.y - p0.y;
+                    block.e1[2][lane] = p1.z - p0.z;
+                    block.e2[0][lane] = p2.x - p0.x;
+                    block.e2[1][lane] = p2.y - p0.y;
+                    block.e2[2][lane] = p2.z - p0.z;
+                    block.triangle[lane] = t;
+                }
+
+                mBlocks.push_back(block);
+            }
+        }
+    }
+
+    mStats.nodes = mNodes.size();
+    mStats.triangleBlocks = mBlocks.size();
+}
+
+// ===== traversal =====
+
+namespace
+{
+#ifdef BVH_X86
+    // Slab test against the 4 boxes of a node; returns the hit mask and
+    // the entry distances.
+    inline unsigned IntersectBoxes(const float (&bounds)[6][4], const RayData& r, float tMax, float* tNear)
+    {
+        __m128 nx = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bounds[r.nearRow[0]]), _mm_set1_ps(r.origin[0])), _mm_set1_ps(r.inverse[0]));
+        __m128 ny = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bounds[r.nearRow[1]]), _mm_set1_ps(r.origin[1])), _mm_set1_ps(r.inverse[1]));
+        __m128 nz = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bounds[r.nearRow[2]]), _mm_set1_ps(r.origin[2])), _mm_set1_ps(r.inverse[2]));
+        __m128 fx = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bounds[r.farRow[0]]), _mm_set1_ps(r.origin[0])), _mm_set1_ps(r.inverse[0]));
+        __m128 fy = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bounds[r.farRow[1]]), _mm_set1_ps(r.origin[1])), _mm_set1_ps(r.inverse[1]));
+        __m128 fz = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bounds[r.farRow[2]]), _mm_set1_ps(r.origin[2])), _mm_set1_ps(r.inverse[2]));
+
+        __m128 enter = _mm_max_ps(_mm_max_ps(nx, ny), _mm_max_ps(nz, _mm_set1_ps(r.tMin)));
+        __m128 exit = _mm_min_ps(_mm_min_ps(fx, fy), _mm_min_ps(fz, _mm_set1_ps(tMax)));
+
+        _mm_storeu_ps(tNear, enter);
+        return (unsigned)_mm_movemask_ps(_mm_cmple_ps(enter, exit));
+    }
+
+    // Moller-Trumbore against 4 triangles, double sided.
+    inline unsigned IntersectTriangles(
+        const float (&v0)[3][4], const float (&e1)[3][4], const float (&e2)[3][4],
+        const RayData& r, float tMax, float* t, float* u, float* v)
+    {
+        __m128 dx = _mm_set1_ps(r.direction[0]);
+        __m128 dy = _mm_set1_ps(r.direction[1]);
+        __m128 dz = _mm_set1_ps(r.direction[2]);
+
+        __m128 e1x = _mm_load_ps(e1[0]);
+        __m128 e1y = _mm_load_ps(e1[1]);
+        __m128 e1z = _mm_load_ps(e1[2]);
+        __m128 e2x = _mm_load_ps(e2[0]);
+        __m128 e2y = _mm_load_ps(e2[1]);
+        __m128 e2z = _mm_load_ps(e2[2]);
+
+        __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+        __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+        __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+
+        __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+        __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+        __m128 tx = _mm_sub_ps(_mm_set1_ps(r.origin[0]), _mm_load_ps(v0[0]));
+        __m128 ty = _mm_sub_ps(_mm_set1_ps(r.origin[1]), _mm_load_ps(v0[1]));
+        __m128 tz = _mm_sub_ps(_mm_set1_ps(r.origin[2]), _mm_load_ps(v0[2]));
+
+        __m128 uu = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), invDet);
+
+        __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+        __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+        __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+
+        __m128 vv = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+        __m128 tt = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+        __m128 zero = _mm_setzero_ps();
+        __m128 hit = _mm_cmpneq_ps(det, zero);
+        hit = _mm_and_ps(hit, _mm_cmpge_ps(uu, zero));
+        hit = _mm_and_ps(hit, _mm_cmpge_ps(vv, zero));
+        hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(uu, vv), _mm_set1_ps(1.0f)));
+        hit = _mm_and_ps(hit, _mm_cmpge_ps(tt, _mm_set1_ps(r.tMin)));
+        hit = _mm_and_ps(hit, _mm_cmple_ps(tt, _mm_set1_ps(tMax)));
+
+        _mm_storeu_ps(t, tt);
+        _mm_storeu_ps(u, uu);
+        _mm_storeu_ps(v, vv);
+        return (unsigned)_mm_movemask_ps(hit);
+    }
+#else
+    // Same expressions as the SSE path, one lane at a time.
+    inline unsigned IntersectBoxes(const float (&bounds)[6][4], const RayData& r, float tMax, float* tNear)
+    {
+        unsigned mask = 0;
+        for (int lane = 0; lane < 4; lane++)
+        {
+            float n[3];
+            float f[3];
+            for (int a = 0; a < 3; a++)
+            {
+                n[a] = (bounds[r.nearRow[a]][lane] - r.origin[a]) * r.inverse[a];
+                f[a] = (bounds[r.farRow[a]][lane] - r.origin[a]) * r.inverse[a];
+            }
+
+            float enter = std::max(std::max(n[0], n[1]), std::max(n[2], r.tMin));
+            float exit = std::min(std::min(f[0], f[1]), std::min(f[2], tMax));
+
+            tNear[lane] = enter;
+            mask |= (unsigned)(enter <= exit) << lane;
+        }
+        return mask;
+    }
+
+    inline unsigned IntersectTriangles(
+        const float (&v0)[3][4], const float (&e1)[3][4], const float (&e2)[3][4],
+        const RayData& r, float tMax, float* t, float* u, float* v)
+    {
+        const float* d = r.direction;
+
+        unsigned mask = 0;
+        for (int lane = 0; lane < 4; lane++)
+        {
+            float px = d[1] * e2[2][lane] - d[2] * e2[1][lane];
+            float py = d[2] * e2[0][lane] - d[0] * e2[2][lane];
+            float pz = d[0] * e2[1][lane] - d[1] * e2[0][lane];
+
+            float det = e1[0][lane] * px + e1[1][lane] * py + e1[2][lane] * pz;
+            float invDet = 1.0f / det;
+
+            float tx = r.origin[0] - v0[0][lane];
+            float ty = r.origin[1] - v0[1][lane];
+            float tz = r.origin[2] - v0[2][lane];
+
+            float uu = (tx * px + ty * py + tz * pz) * invDet;
+
+            float qx = ty * e1[2][lane] - tz * e1[1][lane];
+            float qy = tz * e1[0][lane] - tx * e1[2][lane];
+            float qz = tx * e1[1][lane] - ty * e1[0][lane];
+
+            float vv = (d[0] * qx + d[1] * qy + d[2] * qz) * invDet;
+            float tt = (e2[0][lane] * qx + e2[1][lane] * qy + e2[2][lane] * qz) * invDet;
+
+            bool hit = det != 0.0f && uu >= 0.0f && vv >= 0.0f && uu + vv <= 1.0f && tt >= r.tMin && tt <= tMax;
+
+            t[lane] = tt;
+            u[lane] = uu;
+            v[lane] = vv;
+            mask |= (unsigned)hit << lane;
+        }
+        return mask;
+    }
+#endif
+}
+
+template <bool AnyHit>
+bool Bvh::Traverse(const Ray& ray, RayHit& hit) const
+{
+    if (mNodes.empty())
+        return false;
+
+    RayData r = PrepareRay(ray);
+    float tMax = ray.tMax;
+    bool found = false;
+
+    StackEntry stack[STACK_SIZE];
+    size_t top = 0;
+    stack[top++] = { 0, 0, r.tMin };
+
+    while (top > 0)
+    {
+        StackEntry entry = stack[--top];
+
+        // A closer hit since the entry was pushed.
+        if (entry.tNear > tMax)
+            continue;
+
+        if (entry.child & LEAF_BIT)
+        {
+            const TriangleBlock* block = mBlocks.data() + (entry.child & ~LEAF_BIT);
+            for (uint32_t b = 0; b < entry.blockCount; b++, block++)
+            {
+                alignas(16) float t[4];
+                alignas(16) float u[4];
+                alignas(16) float v[4];
+
+                unsigned mask = IntersectTriangles(block->v0, block->e1, block->e2, r, tMax, t, u, v);
+                if (!mask)
+                    continue;
+
+                if (AnyHit)
+                    return true;
+
+                for (int lane = 0; lane < 4; lane++)
+                {
+                    if ((mask >> lane) & 1 && t[lane] <= tMax)
+                    {
+                        tMax = t[lane];
+                        hit.t = t[lane];
+                        hit.u = u[lane];
+                        hit.v = v[lane];
+                        hit.triangle = block->triangle[lane];
+                        found = true;
+                    }
+                }
+            }
+            continue;
+        }
+
+        const Node& node = mNodes[entry.child];
+
+        alignas(16) float tNear[4];
+        unsigned mask = IntersectBoxes(node.bounds, r, tMax, tNear);
+        if (!mask)
+            continue;
+
+        // Hit children, farthest first, so the nearest is popped next.
+        StackEntry hits[4];
+        int hitCount = 0;
+        for (int c = 0; c < 4; c++)
+        {
+            if (!((mask >> c) & 1))
+                continue;
+
+            StackEntry e = { node.child[c], node.blockCount[c], tNear[c] };
+            int at = hitCount++;
+            while (at > 0 && hits[at - 1].tNear < e.tNear)
+            {
+                hits[at] = hits[at - 1];
+                --at;
+            }
+            hits[at] = e;
+        }
+
+        for (int i = 0; i < hitCount; i++)
+            stack[top++] = hits[i];
+    }
+
+    return found;
+}
+
+bool Bvh::Intersect(const Ray& ray, RayHit& hit) const
+{
+    hit = RayHit();
+    return Traverse<false>(ray, hit);
+}
+
+bool Bvh::Occluded(const Ray& ray) const
+{
+    RayHit hit;
+    return Traverse<true>(ray, hit);
+}
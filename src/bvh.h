@@ -0,0 +1,133 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+
+#include "vertex.h"
+#include "jobs.h"
+
+static const uint32_t BVH_INVALID = 0xFFFFFFFFu;
+
+// origin + t * direction for t in [tMin, tMax]; direction need not be
+// normalized, t is in its units.
+struct Ray
+{
+    DirectX::XMFLOAT3 origin = { 0.0f, 0.0f, 0.0f };
+    DirectX::XMFLOAT3 direction = { 0.0f, 0.0f, 1.0f };
+    float tMin = 0.0f;
+    float tMax = FLT_MAX;
+};
+
+struct RayHit
+{
+    float t = FLT_MAX;
+    // Barycentrics of the hit: point = (1 - u - v) * p0 + u * p1 + v * p2.
+    float u = 0.0f;
+    float v = 0.0f;
+    // Triangle index in the build input, BVH_INVALID on a miss.
+    uint32_t triangle = BVH_INVALID;
+
+    bool Valid() const { return triangle != BVH_INVALID; }
+};
+
+struct BvhBuildOptions
+{
+    // Split candidates per axis.
+    uint32_t binCount = 16;
+
+    // Nodes this small may become leaves when the SAH prefers it.
+    uint32_t maxLeafTriangles = 8;
+
+    // SAH costs of one node visit and one test of 4 triangles.
+    float traversalCost = 1.0f;
+    float intersectionCost = 1.0f;
+};
+
+struct BvhStats
+{
+    size_t nodes = 0;
+    size_t leaves = 0;
+    // 4-triangle leaf blocks, padding lanes included.
+    size_t triangleBlocks = 0;
+    uint32_t maxDepth = 0;
+    // Expected cost of a random ray, in the units of BvhBuildOptions.
+    float sahCost = 0.0f;
+};
+
+// Bounding volume hierarchy over the triangles of an indexed mesh, for
+// picking and ray queries.
+//
+// Built top down with binned SAH as a binary tree, large subtrees in
+// parallel, then collapsed into a 4-wide tree: every node holds the boxes
+// of its 4 children as SoA, and leaves hold triangles in SoA blocks of 4,
+// so one SSE test covers 4 boxes or 4 triangles. Triangles are copied into
+// the blocks; the vertex and index arrays are not needed after Build.
+class Bvh
+{
+public:
+    Bvh();
+
+    // With jobs, subtrees and the binning of large nodes run on workers;
+    // the tree is the same either way.
+    void Build(
+        const Vertex* vertices,
+        size_t vertexCount,
+        const uint32_t* indices,
+        size_t indexCount,
+        const BvhBuildOptions& options = BvhBuildOptions(),
+        JobSystem* jobs = nullptr
+    );
+
+    // Closest hit in [tMin, tMax]. Triangles are double sided.
+    bool Intersect(const Ray& ray, RayHit& hit) const;
+    // Any hit in [tMin, tMax]; for shadow and visibility rays.
+    bool Occluded(const Ray& ray) const;
+
+    bool Empty() const { return mNodes.empty(); }
+    size_t TriangleCount() const { return mTriangleCount; }
+    const BvhStats& Stats() const { return mStats; }
+
+    DirectX::XMFLOAT3 BoundsMin() const { return mBoundsMin; }
+    DirectX::XMFLOAT3 BoundsMax() const { return mBoundsMax; }
+
+private:
+    // Child slot encoding: a node index, or LEAF_BIT | first block with the
+    // block count in Node::blockCount.
+    static const uint32_t LEAF_BIT = 0x80000000u;
+    static const uint32_t EMPTY = BVH_INVALID;
+
+    // Two cache lines. Empty slots have inverted boxes and never hit.
+    struct alignas(64) Node
+    {
+        // bounds[0..2] = min x, y, z; bounds[3..5] = max x, y, z.
+        float bounds[6][4];
+        uint32_t child[4];
+        uint32_t blockCount[4];
+    };
+
+    // Triangles as v0 and two edges, the form the ray test wants. Padding
+    // lanes have zero edges and never hit.
+    struct alignas(16) TriangleBlock
+    {
+        float v0[3][4];
+        float e1[3][4];
+        float e2[3][4];
+        uint32_t triangle[4];
+    };
+
+    struct BuildNode;
+    class Builder;
+
+    template <bool AnyHit>
+    bool Traverse(const Ray& ray, RayHit& hit) const;
+
+    std::vector<Node> mNodes;
+    std::vector<TriangleBlock> mBlocks;
+
+    size_t mTriangleCount;
+    DirectX::XMFLOAT3 mBoundsMin;
+    DirectX::XMFLOAT3 mBoundsMax;
+    BvhStats mStats;
+};
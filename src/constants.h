@@ -0,0 +1,33 @@
+#pragma once
+#include <DirectXMath.h>
+
+// Constant buffer layouts, shared by the D3D12 and the software backends.
+// Matrices are stored transposed, the way HLSL reads them.
+
+struct alignas(256) ObjectConstants
+{
+    DirectX::XMMATRIX world;
+    DirectX::XMMATRIX view;
+    DirectX::XMMATRIX projection;
+
+    // Decode range for VertexFormat::Packed positions.
+    DirectX::XMFLOAT4 positionMin;
+    DirectX::XMFLOAT4 positionExtent;
+};
+
+struct alignas(256) LightConstants
+{
+    DirectX::XMFLOAT3 lightDir;
+    float padding;
+    DirectX::XMFLOAT4 ambientColor;
+    DirectX::XMFLOAT4 diffuseColor;
+};
+
+// Per-instance vertex stream (input slot 1) for the instanced shaders.
+struct InstanceData
+{
+    // Rows of the transposed world matrix, translation in w:
+    // world position = dot(world[i], float4(position, 1)).
+    DirectX::XMFLOAT4 world[3];
+    DirectX::XMFLOAT4 color;
+};
@@ -0,0 +1,529 @@
+#include "culling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CULL_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC accepts any intrinsic; GCC and Clang need the ISA on the function.
+#if defined(__GNUC__) || defined(__clang__)
+#define CULL_TARGET_SSE __attribute__((target("sse2")))
+#define CULL_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CULL_TARGET_SSE
+#define CULL_TARGET_AVX2
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+    // Below this many objects per worker a thread costs more than it saves.
+    constexpr size_t MIN_OBJECTS_PER_THREAD = 32768;
+
+    // ===== scalar =====
+
+    // The SIMD paths evaluate the same expressions in the same order, so
+    // results match bit for bit.
+    size_t CullSpheresScalar(const Frustum& f, const SphereBounds& b, size_t begin, size_t end, uint32_t* out)
+    {
+        size_t n = 0;
+        for (size_t i = begin; i < end; i++)
+        {
+            XMFLOAT3 center(b.centerX[i], b.centerY[i], b.centerZ[i]);
+            out[n] = (uint32_t)i;
+            n += SphereInFrustum(f, center, b.radius[i]);
+        }
+        return n;
+    }
+
+    size_t CullBoxesScalar(const Frustum& f, const BoxBounds& b, size_t begin, size_t end, uint32_t* out)
+    {
+        size_t n = 0;
+        for (size_t i = begin; i < end; i++)
+        {
+            XMFLOAT3 center(b.centerX[i], b.centerY[i], b.centerZ[i]);
+            XMFLOAT3 extent(b.extentX[i], b.extentY[i], b.extentZ[i]);
+            out[n] = (uint32_t)i;
+            n += BoxInFrustum(f, center, extent);
+        }
+        return n;
+    }
+
+#ifdef CULL_X86
+    // Writes base + lane for every set bit of mask without branching; the
+    // slot after the last visible index may be overwritten.
+    inline size_t CompactLanes(unsigned mask, unsigned lanes, uint32_t base, uint32_t* out)
+    {
+        size_t n = 0;
+        for (unsigned lane = 0; lane < lanes; lane++)
+        {
+            out[n] = base + lane;
+            n += (mask >> lane) & 1;
+        }
+        return n;
+    }
+
+    // ===== SSE: 4 objects per iteration =====
+    CULL_TARGET_SSE
+    size_t CullSpheresSSE(const Frustum& f, const SphereBounds& b, size_t begin, size_t end, uint32_t* out)
+    {
+        __m128 px[6], py[6], pz[6], pw[6];
+        for (int p = 0; p < 6; p++)
+        {
+            px[p] = _mm_set1_ps(f.planes[p].x);
+            py[p] = _mm_set1_ps(f.planes[p].y);
+            pz[p] = _mm_set1_ps(f.planes[p].z);
+            pw[p] = _mm_set1_ps(f.planes[p].w);
+        }
+
+        const __m128 signBit = _mm_set1_ps(-0.0f);
+
+        size_t n = 0;
+        size_t i = begin;
+        for (; i + 4 <= end; i += 4)
+        {
+            __m128 cx = _mm_loadu_ps(b.centerX.data() + i);
+            __m128 cy = _mm_loadu_ps(b.centerY.data() + i);
+            __m128 cz = _mm_loadu_ps(b.centerZ.data() + i);
+            __m128 negR = _mm_xor_ps(_mm_loadu_ps(b.radius.data() + i), signBit);
+
+            __m128 outside = _mm_setzero_ps();
+            for (int p = 0; p < 6; p++)
+            {
+                __m128 d = _mm_add_ps(
+                    _mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], cx), _mm_mul_ps(py[p], cy)), _mm_mul_ps(pz[p], cz)),
+                    pw[p]
+                );
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(d, negR));
+            }
+
+            unsigned visible = ~(unsigned)_mm_movemask_ps(outside) & 0xF;
+            if (visible)
+                n += CompactLanes(visible, 4, (uint32_t)i, out + n);
+        }
+
+        return n + CullSpheresScalar(f, b, i, end, out + n);
+    }
+
+    CULL_TARGET_SSE
+    size_t CullBoxesSSE(const Frustum& f, const BoxBounds& b, size_t begin, size_t end, uint32_t* out)
+    {
+        __m128 px[6], py[6], pz[6], pw[6];
+        __m128 ax[6], ay[6], az[6];
+        for (int p = 0; p < 6; p++)
+        {
+            px[p] = _mm_set1_ps(f.planes[p].x);
+            py[p] = _mm_set1_ps(f.planes[p].y);
+            pz[p] = _mm_set1_ps(f.planes[p].z);
+            pw[p] = _mm_set1_ps(f.planes[p].w);
+            ax[p] = _mm_set1_ps(std::fabs(f.planes[p].x));
+            ay[p] = _mm_set1_ps(std::fabs(f.planes[p].y));
+            az[p] = _mm_set1_ps(std::fabs(f.planes[p].z));
+        }
+
+        const __m128 signBit = _mm_set1_ps(-0.0f);
+
+        size_t n = 0;
+        size_t i = begin;
+        for (; i + 4 <= end; i += 4)
+        {
+            __m128 cx = _mm_loadu_ps(b.centerX.data() + i);
+            __m128 cy = _mm_loadu_ps(b.centerY.data() + i);
+            __m128 cz = _mm_loadu_ps(b.centerZ.data() + i);
+            __m128 ex = _mm_loadu_ps(b.extentX.data() + i);
+            __m128 ey = _mm_loadu_ps(b.extentY.data() + i);
+            __m128 ez = _mm_loadu_ps(b.extentZ.data() + i);
+
+            __m128 outside = _mm_setzero_ps();
+            for (int p = 0; p < 6; p++)
+            {
+                __m128 d = _mm_add_ps(
+                    _mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], cx), _mm_mul_ps(py[p], cy)), _mm_mul_ps(pz[p], cz)),
+                    pw[p]
+                );
+                __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p], ex), _mm_mul_ps(ay[p], ey)), _mm_mul_ps(az[p], ez));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(d, _mm_xor_ps(r, signBit)));
+            }
+
+            unsigned visible = ~(unsigned)_mm_movemask_ps(outside) & 0xF;
+            if (visible)
+                n += CompactLanes(visible, 4, (uint32_t)i, out + n);
+        }
+
+        return n + CullBoxesScalar(f, b, i, end, out + n);
+    }
+
+    // ===== AVX2: 8 objects per iteration =====
+    CULL_TARGET_AVX2
+    size_t CullSpheresAVX2(const Frustum& f, const SphereBounds& b, size_t begin, size_t end, uint32_t* out)
+    {
+        __m256 px[6], py[6], pz[6], pw[6];
+        for (int p = 0; p < 6; p++)
+        {
+            px[p] = _mm256_set1_ps(f.planes[p].x);
+            py[p] = _mm256_set1_ps(f.planes[p].y);
+            pz[p] = _mm256_set1_ps(f.planes[p].z);
+            pw[p] = _mm256_set1_ps(f.planes[p].w);
+        }
+
+        const __m256 signBit = _mm256_set1_ps(-0.0f);
+
+        size_t n = 0;
+        size_t i = begin;
+        for (; i + 8 <= end; i += 8)
+        {
+            __m256 cx = _mm256_loadu_ps(b.centerX.data() + i);
+            __m256 cy = _mm256_loadu_ps(b.centerY.data() + i);
+            __m256 cz = _mm256_loadu_ps(b.centerZ.data() + i);
+            __m256 negR = _mm256_xor_ps(_mm256_loadu_ps(b.radius.data() + i), signBit);
+
+            __m256 outside = _mm256_setzero_ps();
+            for (int p = 0; p < 6; p++)
+            {
+                __m256 d = _mm256_add_ps(
+                    _mm256_add_ps(
+                        _mm256_add_ps(_mm256_mul_ps(px[p], cx), _mm256_mul_ps(py[p], cy)),
+                        _mm256_mul_ps(pz[p], cz)
+                    ),
+                    pw[p]
+                );
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(d, negR, _CMP_LT_OQ));
+            }
+
+            unsigned visible = ~(unsigned)_mm256_movemask_ps(outside) & 0xFF;
+            if (visible)
+                n += CompactLanes(visible, 8, (uint32_t)i, out + n);
+        }
+
+        return n + CullSpheresScalar(f, b, i, end, out + n);
+    }
+
+    CULL_TARGET_AVX2
+    size_t CullBoxesAVX2(const Frustum& f, const BoxBounds& b, size_t begin, size_t end, uint32_t* out)
+    {
+        __m256 px[6], py[6], pz[6], pw[6];
+        __m256 ax[6], ay[6], az[6];
+        for (int p = 0; p < 6; p++)
+        {
+            px[p] = _mm256_set1_ps(f.planes[p].x);
+            py[p] = _mm256_set1_ps(f.planes[p].y);
+            pz[p] = _mm256_set1_ps(f.planes[p].z);
+            pw[p] = _mm256_set1_ps(f.planes[p].w);
+            ax[p] = _mm256_set1_ps(std::fabs(f.planes[p].x));
+            ay[p] = _mm256_set1_ps(std::fabs(f.planes[p].y));
+            az[p] = _mm256_set1_ps(std::fabs(f.planes[p].z));
+        }
+
+        const __m256 signBit = _mm256_set1_ps(-0.0f);
+
+        size_t n = 0;
+        size_t i = begin;
+        for (; i + 8 <= end; i += 8)
+        {
+            __m256 cx = _mm256_loadu_ps(b.centerX.data() + i);
+            __m256 cy = _mm256_loadu_ps(b.centerY.data() + i);
+            __m256 cz = _mm256_loadu_ps(b.centerZ.data() + i);
+            __m256 ex = _mm256_loadu_ps(b.extentX.data() + i);
+            __m256 ey = _mm256_loadu_ps(b.extentY.data() + i);
+            __m256 ez = _mm256_loadu_ps(b.extentZ.data() + i);
+
+            __m256 outside = _mm256_setzero_ps();
+            for (int p = 0; p < 6; p++)
+            {
+                __m256 d = _mm256_add_ps(
+                    _mm256_add_ps(
+                        _mm256_add_ps(_mm256_mul_ps(px[p], cx), _mm256_mul_ps(py[p], cy)),
+                        _mm256_mul_ps(pz[p], cz)
+                    ),
+                    pw[p]
+                );
+                __m256 r = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(ax[p], ex), _mm256_mul_ps(ay[p], ey)),
+                    _mm256_mul_ps(az[p], ez)
+                );
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(d, _mm256_xor_ps(r, signBit), _CMP_LT_OQ));
+            }
+
+            unsigned visible = ~(unsigned)_mm256_movemask_ps(outside) & 0xFF;
+            if (visible)
+                n += CompactLanes(visible, 8, (uint32_t)i, out + n);
+        }
+
+        return n + CullBoxesScalar(f, b, i, end, out + n);
+    }
+
+    bool CpuHasAvx2()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+
+        // AVX needs OS support for the YMM state as well.
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+            return false;
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+
+    CullPath ResolvePath(CullPath requested)
+    {
+        CullPath best = DetectCullPath();
+        if (requested == CullPath::Auto || requested > best)
+            return best;
+        return requested;
+    }
+#endif
+
+    template <typename Bounds>
+    using CullKernel = size_t (*)(const Frustum&, const Bounds&, size_t, size_t, uint32_t*);
+
+    // Every worker compacts into its own slice of out, the slices are then
+    // moved together.
+    template <typename Bounds>
+    size_t CullParallel(
+        const Frustum& frustum,
+        const Bounds& bounds,
+        uint32_t* out,
+        unsigned threadCount,
+        CullKernel<Bounds> kernel)
+    {
+        size_t count = bounds.Size();
+
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+        size_t workerCount = std::min<size_t>(threadCount, std::max<size_t>(1, count / MIN_OBJECTS_PER_THREAD));
+
+        if (workerCount == 1)
+            return kernel(frustum, bounds, 0, count, out);
+
+        std::vector<size_t> visible(workerCount);
+
+        auto work = [&](size_t w)
+        {
+            size_t begin = count * w / workerCount;
+            size_t end = count * (w + 1) / workerCount;
+            visible[w] = kernel(frustum, bounds, begin, end, out + begin);
+        };
+
+        std::vector<std::thread> workers;
+        workers.reserve(workerCount - 1);
+
+        for (size_t w = 1; w < workerCount; w++)
+            workers.emplace_back(work, w);
+
+        work(0);
+
+        for (auto& t : workers)
+            t.join();
+
+        size_t total = visible[0];
+        for (size_t w = 1; w < workerCount; w++)
+        {
+            size_t begin = count * w / workerCount;
+            memmove(out + total, out + begin, visible[w] * sizeof(uint32_t));
+            total += visible[w];
+        }
+
+        return total;
+    }
+}
+
+Frustum ExtractFrustum(const XMFLOAT4X4& m)
+{
+    // clip = v * m, so clip.x is the dot product with column 0 and so on.
+    auto column = [&](int c)
+    {
+        return XMFLOAT4(m.m[0][c], m.m[1][c], m.m[2][c], m.m[3][c]);
+    };
+
+    XMFLOAT4 cx = column(0);
+    XMFLOAT4 cy = column(1);
+    XMFLOAT4 cz = column(2);
+    XMFLOAT4 cw = column(3);
+
+    Frustum f;
+    f.planes[0] = XMFLOAT4(cw.x + cx.x, cw.y + cx.y, cw.z + cx.z, cw.w + cx.w);
+    f.planes[1] = XMFLOAT4(cw.x - cx.x, cw.y - cx.y, cw.z - cx.z, cw.w - cx.w);
+    f.planes[2] = XMFLOAT4(cw.x + cy.x, cw.y + cy.y, cw.z + cy.z, cw.w + cy.w);
+    f.planes[3] = XMFLOAT4(cw.x - cy.x, cw.y - cy.y, cw.z - cy.z, cw.w - cy.w);
+    f.planes[4] = cz;
+    f.planes[5] = XMFLOAT4(cw.x - cz.x, cw.y - cz.y, cw.z - cz.z, cw.w - cz.w);
+
+    for (XMFLOAT4& p : f.planes)
+    {
+        float len = std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+        if (len > 0.0f)
+        {
+            p.x /= len;
+            p.y /= len;
+            p.z /= len;
+            p.w /= len;
+        }
+    }
+
+    return f;
+}
+
+bool SphereInFrustum(const Frustum& frustum, const XMFLOAT3& center, float radius)
+{
+    for (const XMFLOAT4& p : frustum.planes)
+    {
+        if (p.x * center.x + p.y * center.y + p.z * center.z + p.w < -radius)
+            return false;
+    }
+    return true;
+}
+
+bool ConeBackfacing(
+    const XMFLOAT3& center,
+    float radius,
+    const XMFLOAT3& coneAxis,
+    float coneCutoff,
+    const XMFLOAT3& eye)
+{
+    float dx = center.x - eye.x;
+    float dy = center.y - eye.y;
+    float dz = center.z - eye.z;
+    float dist = std::sqrt(dx * dx + dy * dy + dz * dz);
+
+    return dx * coneAxis.x + dy * coneAxis.y + dz * coneAxis.z >= coneCutoff * dist + radius;
+}
+
+bool BoxInFrustum(const Frustum& frustum, const XMFLOAT3& center, const XMFLOAT3& extent)
+{
+    for (const XMFLOAT4& p : frustum.planes)
+    {
+        float d = p.x * center.x + p.y * center.y + p.z * center.z + p.w;
+        float r = std::fabs(p.x) * extent.x + std::fabs(p.y) * extent.y + std::fabs(p.z) * extent.z;
+        if (d < -r)
+            return false;
+    }
+    return true;
+}
+
+void SphereBounds::Add(const XMFLOAT3& center, float r)
+{
+    centerX.push_back(center.x);
+    centerY.push_back(center.y);
+    centerZ.push_back(center.z);
+    radius.push_back(r);
+}
+
+void SphereBounds::Clear()
+{
+    centerX.clear();
+    centerY.clear();
+    centerZ.clear();
+    radius.clear();
+}
+
+void BoxBounds::Add(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax)
+{
+    centerX.push_back((boundsMin.x + boundsMax.x) * 0.5f);
+    centerY.push_back((boundsMin.y + boundsMax.y) * 0.5f);
+    centerZ.push_back((boundsMin.z + boundsMax.z) * 0.5f);
+    extentX.push_back((boundsMax.x - boundsMin.x) * 0.5f);
+    extentY.push_back((boundsMax.y - boundsMin.y) * 0.5f);
+    extentZ.push_back((boundsMax.z - boundsMin.z) * 0.5f);
+}
+
+void BoxBounds::Add(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax, const XMFLOAT4X4& world)
+{
+    float c[3] = { (boundsMin.x + boundsMax.x) * 0.5f, (boundsMin.y + boundsMax.y) * 0.5f, (boundsMin.z + boundsMax.z) * 0.5f };
+    float e[3] = { (boundsMax.x - boundsMin.x) * 0.5f, (boundsMax.y - boundsMin.y) * 0.5f, (boundsMax.z - boundsMin.z) * 0.5f };
+
+    // Center transformed, extent through the absolute rotation and scale.
+    float center[3];
+    float extent[3];
+    for (int k = 0; k < 3; k++)
+    {
+        center[k] = c[0] * world.m[0][k] + c[1] * world.m[1][k] + c[2] * world.m[2][k] + world.m[3][k];
+        extent[k] = e[0] * std::fabs(world.m[0][k]) + e[1] * std::fabs(world.m[1][k]) + e[2] * std::fabs(world.m[2][k]);
+    }
+
+    centerX.push_back(center[0]);
+    centerY.push_back(center[1]);
+    centerZ.push_back(center[2]);
+    extentX.push_back(extent[0]);
+    extentY.push_back(extent[1]);
+    extentZ.push_back(extent[2]);
+}
+
+void BoxBounds::Clear()
+{
+    centerX.clear();
+    centerY.clear();
+    centerZ.clear();
+    extentX.clear();
+    extentY.clear();
+    extentZ.clear();
+}
+
+CullPath DetectCullPath()
+{
+#ifdef CULL_X86
+    static const CullPath path = CpuHasAvx2() ? CullPath::AVX2 : CullPath::SSE;
+    return path;
+#else
+    return CullPath::Scalar;
+#endif
+}
+
+size_t CullSpheres(
+    const Frustum& frustum,
+    const SphereBounds& bounds,
+    uint32_t* outVisible,
+    const CullOptions& options)
+{
+    CullKernel<SphereBounds> kernel = CullSpheresScalar;
+
+#ifdef CULL_X86
+    switch (ResolvePath(options.path))
+    {
+    case CullPath::AVX2: kernel = CullSpheresAVX2; break;
+    case CullPath::SSE: kernel = CullSpheresSSE; break;
+    default: break;
+    }
+#endif
+
+    return CullParallel(frustum, bounds, outVisible, options.threadCount, kernel);
+}
+
+size_t CullBoxes(
+    const Frustum& frustum,
+    const BoxBounds& bounds,
+    uint32_t* outVisible,
+    const CullOptions& options)
+{
+    CullKernel<BoxBounds> kernel = CullBoxesScalar;
+
+#ifdef CULL_X86
+    switch (ResolvePath(options.path))
+    {
+    case CullPath::AVX2: kernel = CullBoxesAVX2; break;
+    case CullPath::SSE: kernel = CullBoxesSSE; break;
+    default: break;
+    }
+#endif
+
+    return CullParallel(frustum, bounds, outVisible, options.threadCount, kernel);
+}
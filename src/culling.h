@@ -0,0 +1,103 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Six normalized planes (a, b, c, d) with a*x + b*y + c*z + d >= 0 inside.
+// Order: left, right, bottom, top, near, far.
+struct Frustum
+{
+    DirectX::XMFLOAT4 planes[6];
+};
+
+// Planes of the clip volume of a row-vector (DirectXMath) matrix with D3D
+// depth range [0, w]. Passing world * view * projection gives object space
+// planes.
+Frustum ExtractFrustum(const DirectX::XMFLOAT4X4& m);
+
+bool SphereInFrustum(const Frustum& frustum, const DirectX::XMFLOAT3& center, float radius);
+
+// True when every triangle of a cluster bounded by the sphere and whose
+// normals lie inside the cone (axis, cutoff) faces away from eye.
+bool ConeBackfacing(
+    const DirectX::XMFLOAT3& center,
+    float radius,
+    const DirectX::XMFLOAT3& coneAxis,
+    float coneCutoff,
+    const DirectX::XMFLOAT3& eye
+);
+
+// ===== batch culling =====
+
+// Bounding spheres of many objects, one array per component so the batch
+// paths can test 4 or 8 objects at once.
+struct SphereBounds
+{
+    std::vector<float> centerX;
+    std::vector<float> centerY;
+    std::vector<float> centerZ;
+    std::vector<float> radius;
+
+    size_t Size() const { return radius.size(); }
+    void Add(const DirectX::XMFLOAT3& center, float r);
+    void Clear();
+};
+
+// Axis-aligned boxes stored as center and half extent.
+struct BoxBounds
+{
+    std::vector<float> centerX;
+    std::vector<float> centerY;
+    std::vector<float> centerZ;
+    std::vector<float> extentX;
+    std::vector<float> extentY;
+    std::vector<float> extentZ;
+
+    size_t Size() const { return extentX.size(); }
+    void Add(const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax);
+    // The box around the object space box placed by world (row vectors).
+    void Add(const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax, const DirectX::XMFLOAT4X4& world);
+    void Clear();
+};
+
+enum class CullPath
+{
+    // Widest path the CPU supports.
+    Auto,
+    Scalar,
+    SSE,
+    AVX2
+};
+
+struct CullOptions
+{
+    // Paths the CPU lacks fall back to the next narrower one.
+    CullPath path = CullPath::Auto;
+
+    // 0 picks one worker per hardware thread. Small batches stay on the
+    // calling thread.
+    unsigned threadCount = 1;
+};
+
+// Path that CullPath::Auto resolves to on this CPU.
+CullPath DetectCullPath();
+
+bool BoxInFrustum(const Frustum& frustum, const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extent);
+
+// outVisible must hold Size() entries; it receives the indices of visible
+// objects in increasing order. Returns their count. Every path gives the
+// same result as the scalar one.
+size_t CullSpheres(
+    const Frustum& frustum,
+    const SphereBounds& bounds,
+    uint32_t* outVisible,
+    const CullOptions& options = CullOptions()
+);
+
+size_t CullBoxes(
+    const Frustum& frustum,
+    const BoxBounds& bounds,
+    uint32_t* outVisible,
+    const CullOptions& options = CullOptions()
+);
@@ -1,12 +1,16 @@
 #include "dx12app.h"
 #include "dx12renderer.h"
 #include "wc.h"
+#include "profiler.h"
 
 #include <Windows.h>
+#include <windowsx.h>
 #include <memory>
+#include <vector>
+#include <cstdio>
 
-DX12App::DX12App(HINSTANCE hInstance)
-    : mHInstance(hInstance), mHwnd(nullptr), mWidth(800), mHeight(600)
+DX12App::DX12App(HINSTANCE hInstance, bool profile)
+    : mHInstance(hInstance), mHwnd(nullptr), mWidth(800), mHeight(600), mProfile(profile)
 {
 }
 
@@ -29,42 +33,113 @@ bool DX12App::Initialize(int width, int height)
     if (!InitWindow(width, height))
         return false;
 
+    // Startup (OBJ load, shader compile) and the first frames end up in
+    // the trace.
+    Profiler::Get().SetThreadName("Main");
+    if (mProfile)
+        Profiler::Get().BeginCapture();
+
     mRenderer = std::make_unique<DX12Renderer>();
 
     return mRenderer->Initialize(mHwnd, width, height);
 }
 
-void DX12App::Update()
+void DX12App::Update(float dt)
 {
+    PROFILE_ZONE("Update");
+
     if (mRenderer)
-        mRenderer->Update();
+        mRenderer->Update(dt);
 }
 
-void DX12App::Render()
+void DX12App::Render(float alpha)
 {
     if (mRenderer)
-        mRenderer->Render();
+        mRenderer->Render(alpha);
+}
+
+void DX12App::Pick(int x, int y)
+{
+    RayHit hit;
+    if (!mRenderer || !mRenderer->Pick(x, y, hit))
+    {
+        OutputDebugStringA("Pick: no hit\n");
+        return;
+    }
+
+    char line[128];
+    snprintf(line, sizeof(line), "Pick: triangle %u at depth %.4f\n", hit.triangle, hit.t);
+    OutputDebugStringA(line);
 }
 
 int DX12App::Run()
 {
+    mFrameClock.Initialize(&mClock, SimulationStep);
+    mFramePacer.Initialize(&mClock, TargetFrameTime);
+
+    // Frames are held to one deadline: vsync on top of the pacer would
+    // wait again for a vertical blank out of phase with it.
+    mRenderer->SetSyncInterval(TargetFrameTime > 0 ? 0 : 1);
+
     MSG msg = {};
     while (msg.message != WM_QUIT)
     {
         if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
         {
+            if (msg.message == WM_LBUTTONDOWN)
+                Pick(GET_X_LPARAM(msg.lParam), GET_Y_LPARAM(msg.lParam));
+
             TranslateMessage(&msg);
             DispatchMessage(&msg);
         }
         else
         {
-            Update();
-            Render();
+            mFrameClock.Tick();
+            while (mFrameClock.StepSimulation())
+                Update((float)mFrameClock.FixedStepSeconds());
+
+            Render((float)mFrameClock.Alpha());
+
+            {
+                PROFILE_ZONE("Pace");
+                mFramePacer.Wait();
+            }
+
+            Profiler::Get().EndFrame();
+            if (mProfile && Profiler::Get().FrameCount() == ProfileCaptureFrames)
+                WriteProfile();
         }
     }
     return static_cast<int>(msg.wParam);
 }
 
+void DX12App::WriteProfile()
+{
+    Profiler& profiler = Profiler::Get();
+    profiler.EndCapture();
+
+    if (!profiler.WriteChromeTrace(ProfileTracePath))
+        OutputDebugStringA("Failed to write profile trace\n");
+
+    std::vector<ProfileZoneStats> stats;
+    profiler.GetStats(stats);
+
+    char line[256];
+    for (const ProfileZoneStats& zone : stats)
+    {
+        snprintf(
+            line, sizeof(line),
+            "%-24s min %7.3f  avg %7.3f  p99 %7.3f ms  x%.1f\n",
+            zone.name,
+            zone.minMs,
+            zone.avgMs,
+            zone.p99Ms,
+            zone.callsPerFrame
+        );
+        OutputDebugStringA(line);
+    }
+}
+
 LRESULT CALLBACK DX12App::WindowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
     switch (msg)
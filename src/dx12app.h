@@ -2,12 +2,16 @@
 #include <Windows.h>
 #include <memory>
 
+#include "frameclock.h"
+
 class DX12Renderer;
 
 class DX12App
 {
 public:
-    DX12App(HINSTANCE hInstance);
+    // With profile set, startup and the first ProfileCaptureFrames frames
+    // are traced to ProfileTracePath.
+    DX12App(HINSTANCE hInstance, bool profile = false);
     ~DX12App();
 
     bool Initialize(int width, int height);
@@ -15,8 +19,12 @@ public:
 
 private:
     bool InitWindow(int width, int height);
-    void Update();
-    void Render();
+    void Update(float dt);
+    void Render(float alpha);
+    // Reports the mesh triangle under a client pixel.
+    void Pick(int x, int y);
+    // Writes the startup trace and prints per-zone frame stats.
+    void WriteProfile();
 
     static LRESULT CALLBACK WindowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
@@ -27,5 +35,20 @@ private:
     int mWidth;
     int mHeight;
 
+    bool mProfile;
+
     std::unique_ptr<DX12Renderer> mRenderer;
+
+    // Simulation runs at a fixed rate whatever the frame rate; frames are
+    // paced by sleeping rather than spinning. TargetFrameTime 0 leaves
+    // pacing to vsync.
+    static const uint64_t SimulationStep = NANOSECONDS_PER_SECOND / 60;
+    static const uint64_t TargetFrameTime = NANOSECONDS_PER_SECOND / 60;
+
+    static const uint64_t ProfileCaptureFrames = 300;
+    static constexpr const char* ProfileTracePath = "profile.json";
+
+    SystemClock mClock;
+    FrameClock mFrameClock;
+    FramePacer mFramePacer;
 };
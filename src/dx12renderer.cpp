@@ -4,27 +4,446 @@
 #include <d3dcompiler.h>
 #include <stdexcept>
 #include <vector>
+#include <cstdio>
 
 #pragma comment(lib, "d3d12.lib")
 #pragma comment(lib, "dxgi.lib")
 #pragma comment(lib, "d3dcompiler.lib")
 
+// ===== D3D12FrameQueue =====
+
+D3D12FrameQueue::D3D12FrameQueue()
+    : mQueue(nullptr),
+    mEvent(nullptr)
+{
+}
+
+D3D12FrameQueue::~D3D12FrameQueue()
+{
+    if (mEvent)
+        CloseHandle(mEvent);
+}
+
+void D3D12FrameQueue::Initialize(ID3D12Device* device, ID3D12CommandQueue* queue)
+{
+    mQueue = queue;
+    device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&mFence));
+    mEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+}
+
+void D3D12FrameQueue::Signal(uint64_t value)
+{
+    mQueue->Signal(mFence.Get(), value);
+}
+
+uint64_t D3D12FrameQueue::CompletedValue()
+{
+    return mFence->GetCompletedValue();
+}
+
+void D3D12FrameQueue::Wait(uint64_t value)
+{
+    if (mFence->GetCompletedValue() >= value)
+        return;
+
+    mFence->SetEventOnCompletion(value, mEvent);
+    WaitForSingleObject(mEvent, INFINITE);
+}
+
+// ===== D3D12StagingBackend =====
+
+D3D12StagingBackend::D3D12StagingBackend()
+    : mDevice(nullptr),
+    mStaging(nullptr),
+    mRecording(false),
+    mEvent(nullptr)
+{
+}
+
+D3D12StagingBackend::~D3D12StagingBackend()
+{
+    if (mEvent)
+        CloseHandle(mEvent);
+}
+
+void D3D12StagingBackend::Initialize(ID3D12Device* device, ID3D12Resource* staging)
+{
+    mDevice = device;
+    mStaging = staging;
+
+    D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+    queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+    mDevice->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&mQueue));
+
+    mDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&mFence));
+    mEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+}
+
+void D3D12StagingBackend::RecordCopy(void* destination, uint64_t destinationOffset, uint64_t stagingOffset, uint64_t size)
+{
+    if (!mRecording)
+    {
+        // Reuse the oldest allocator once its batch has finished.
+        if (!mAllocators.empty() && mAllocators.front().fence <= mFence->GetCompletedValue())
+        {
+            mAllocator = mAllocators.front().allocator;
+            mAllocators.pop_front();
+            mAllocator->Reset();
+        }
+        else
+        {
+            mDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, IID_PPV_ARGS(&mAllocator));
+        }
+
+        if (mCommandList)
+            mCommandList->Reset(mAllocator.Get(), nullptr);
+        else
+            mDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, mAllocator.Get(), nullptr, IID_PPV_ARGS(&mCommandList));
+
+        mRecording = true;
+    }
+
+    mCommandList->CopyBufferRegion(
+        (ID3D12Resource*)destination, destinationOffset,
+        mStaging, stagingOffset,
+        size
+    );
+}
+
+void D3D12StagingBackend::Submit(uint64_t fence)
+{
+    if (mRecording)
+    {
+        mCommandList->Close();
+        ID3D12CommandList* lists[] = { mCommandList.Get() };
+        mQueue->ExecuteCommandLists(1, lists);
+
+        mAllocators.push_back({ mAllocator, fence });
+        mAllocator.Reset();
+        mRecording = false;
+    }
+
+    mQueue->Signal(mFence.Get(), fence);
+}
+
+uint64_t D3D12StagingBackend::CompletedValue()
+{
+    return mFence->GetCompletedValue();
+}
+
+void D3D12StagingBackend::Wait(uint64_t fence)
+{
+    if (mFence->GetCompletedValue() >= fence)
+        return;
+
+    mFence->SetEventOnCompletion(fence, mEvent);
+    WaitForSingleObject(mEvent, INFINITE);
+}
+
+// ===== D3D12GeometrySink =====
+
+D3D12GeometrySink::D3D12GeometrySink(StagingUploader* uploader)
+    : mUploader(uploader),
+    mCurrent(0)
+{
+}
+
+void D3D12GeometrySink::AddTarget(ID3D12Resource* vertices, ID3D12Resource* indices)
+{
+    mTargets.push_back({ vertices, indices });
+}
+
+bool D3D12GeometrySink::BeginSubmesh(size_t subset, uint64_t vertexBytes, uint64_t indexBytes)
+{
+    if (subset >= mTargets.size())
+        return false;
+
+    // The buffers were created for these sizes, possibly rounded up.
+    mCurrent = subset;
+    return
+        vertexBytes <= mTargets[subset].vertices->GetDesc().Width &&
+        indexBytes <= mTargets[subset].indices->GetDesc().Width;
+}
+
+bool D3D12GeometrySink::WriteVertices(uint64_t offset, const void* data, uint64_t size)
+{
+    mUploader->Upload(mTargets[mCurrent].vertices, offset, data, size);
+    return true;
+}
+
+bool D3D12GeometrySink::WriteIndices(uint64_t offset, const void* data, uint64_t size)
+{
+    mUploader->Upload(mTargets[mCurrent].indices, offset, data, size);
+    return true;
+}
+
+// ===== D3D12HeapBackend =====
+
+D3D12HeapBackend::D3D12HeapBackend()
+    : mDevice(nullptr),
+    mType(D3D12_HEAP_TYPE_DEFAULT),
+    mFlags(D3D12_HEAP_FLAG_NONE)
+{
+}
+
+void D3D12HeapBackend::Initialize(ID3D12Device* device, D3D12_HEAP_TYPE type, D3D12_HEAP_FLAGS flags)
+{
+    mDevice = device;
+    mType = type;
+    mFlags = flags;
+}
+
+bool D3D12HeapBackend::CreateHeap(uint32_t block, uint64_t size, uint64_t alignment)
+{
+    D3D12_HEAP_DESC desc = {};
+    desc.SizeInBytes = size;
+    desc.Properties.Type = mType;
+    desc.Alignment = alignment;
+    desc.Flags = mFlags;
+
+    ComPtr<ID3D12Heap> heap;
+    if (FAILED(mDevice->CreateHeap(&desc, IID_PPV_ARGS(&heap))))
+        return false;
+
+    if (block >= mHeaps.size())
+        mHeaps.resize(block + 1);
+    mHeaps[block] = heap;
+    return true;
+}
+
+void D3D12HeapBackend::DestroyHeap(uint32_t block)
+{
+    mHeaps[block].Reset();
+}
+
+// ===== D3D12TimestampBackend =====
+
+D3D12TimestampBackend::D3D12TimestampBackend()
+    : mQueriesPerSlot(0),
+    mCommandList(nullptr),
+    mGpuBase(0),
+    mCpuBase(0),
+    mNsPerGpuTick(1.0)
+{
+}
+
+void D3D12TimestampBackend::Initialize(ID3D12Device* device, ID3D12CommandQueue* queue, uint32_t slotCount, uint32_t queriesPerSlot)
+{
+    mQueriesPerSlot = queriesPerSlot;
+
+    D3D12_QUERY_HEAP_DESC heapDesc = {};
+    heapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+    heapDesc.Count = slotCount * queriesPerSlot;
+    device->CreateQueryHeap(&heapDesc, IID_PPV_ARGS(&mQueryHeap));
+
+    D3D12_HEAP_PROPERTIES heapProps = {};
+    heapProps.Type = D3D12_HEAP_TYPE_READBACK;
+
+    D3D12_RESOURCE_DESC desc = {};
+    desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    desc.Width = sizeof(UINT64) * heapDesc.Count;
+    desc.Height = 1;
+    desc.DepthOrArraySize = 1;
+    desc.MipLevels = 1;
+    desc.SampleDesc.Count = 1;
+    desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+
+    device->CreateCommittedResource(
+        &heapProps,
+        D3D12_HEAP_FLAG_NONE,
+        &desc,
+        D3D12_RESOURCE_STATE_COPY_DEST,
+        nullptr,
+        IID_PPV_ARGS(&mReadback)
+    );
+
+    // One GPU/QPC pair maps GPU ticks onto the CPU timeline, which is QPC
+    // based like steady_clock.
+    UINT64 frequency = 1;
+    UINT64 cpuTicks = 0;
+    LARGE_INTEGER qpcFrequency;
+    queue->GetTimestampFrequency(&frequency);
+    queue->GetClockCalibration(&mGpuBase, &cpuTicks);
+    QueryPerformanceFrequency(&qpcFrequency);
+
+    UINT64 qpf = (UINT64)qpcFrequency.QuadPart;
+    mCpuBase = cpuTicks / qpf * 1000000000ull + cpuTicks % qpf * 1000000000ull / qpf;
+    mNsPerGpuTick = 1e9 / (double)frequency;
+}
+
+void D3D12TimestampBackend::WriteTimestamp(uint32_t slot, uint32_t query)
+{
+    mCommandList->EndQuery(mQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, slot * mQueriesPerSlot + query);
+}
+
+void D3D12TimestampBackend::ResolveSlot(uint32_t slot, uint32_t count)
+{
+    UINT first = slot * mQueriesPerSlot;
+    mCommandList->ResolveQueryData(
+        mQueryHeap.Get(),
+        D3D12_QUERY_TYPE_TIMESTAMP,
+        first,
+        count,
+        mReadback.Get(),
+        sizeof(UINT64) * first
+    );
+}
+
+bool D3D12TimestampBackend::ReadSlot(uint32_t slot, uint32_t count, uint64_t* nanoseconds)
+{
+    SIZE_T first = sizeof(UINT64) * slot * mQueriesPerSlot;
+    D3D12_RANGE range = { first, first + sizeof(UINT64) * count };
+
+    void* data = nullptr;
+    if (FAILED(mReadback->Map(0, &range, &data)))
+        return false;
+
+    const UINT64* ticks = (const UINT64*)((const char*)data + first);
+    for (uint32_t i = 0; i < count; i++)
+        nanoseconds[i] = mCpuBase + (uint64_t)((double)(INT64)(ticks[i] - mGpuBase) * mNsPerGpuTick);
+
+    D3D12_RANGE written = { 0, 0 };
+    mReadback->Unmap(0, &written);
+    return true;
+}
+
+// ===== D3DShaderCompiler =====
+
+uint64_t D3DShaderCompiler::Version() const
+{
+    return D3D_COMPILER_VERSION;
+}
+
+bool D3DShaderCompiler::Compile(const ShaderSource& shader, std::vector<uint8_t>& bytecode, std::string& errors)
+{
+    std::vector<D3D_SHADER_MACRO> macros;
+    for (const ShaderDefine& define : shader.defines)
+        macros.push_back({ define.name.c_str(), define.value.c_str() });
+    macros.push_back({ nullptr, nullptr });
+
+    ComPtr<ID3DBlob> code;
+    ComPtr<ID3DBlob> error;
+
+    HRESULT hr = D3DCompile(
+        shader.source.c_str(),
+        shader.source.size(),
+        nullptr,
+        macros.data(),
+        nullptr,
+        shader.entryPoint.c_str(),
+        shader.profile.c_str(),
+        shader.flags,
+        0,
+        &code,
+        &error
+    );
+
+    if (error)
+        errors.assign((const char*)error->GetBufferPointer(), error->GetBufferSize());
+
+    if (FAILED(hr))
+        return false;
+
+    const uint8_t* data = (const uint8_t*)code->GetBufferPointer();
+    bytecode.assign(data, data + code->GetBufferSize());
+    return true;
+}
+
+// ===== D3D12DrawSink =====
+
+D3D12DrawSink::D3D12DrawSink()
+    : mCommandList(nullptr)
+{
+}
+
+uint32_t D3D12DrawSink::AddPipeline(ID3D12PipelineState* pipeline)
+{
+    mPipelines.push_back(pipeline);
+    return (uint32_t)(mPipelines.size() - 1);
+}
+
+uint32_t D3D12DrawSink::AddMesh(const D3D12_VERTEX_BUFFER_VIEW& vertices, const D3D12_INDEX_BUFFER_VIEW& indices)
+{
+    mMeshes.push_back({ vertices, indices });
+    return (uint32_t)(mMeshes.size() - 1);
+}
+
+void D3D12DrawSink::BeginFrame(ID3D12GraphicsCommandList* commandList)
+{
+    mCommandList = commandList;
+    mMaterials.clear();
+    mDraws.clear();
+}
+
+uint32_t D3D12DrawSink::AddMaterial(D3D12_GPU_VIRTUAL_ADDRESS object, D3D12_GPU_VIRTUAL_ADDRESS light)
+{
+    mMaterials.push_back({ object, light });
+    return (uint32_t)(mMaterials.size() - 1);
+}
+
+uint32_t D3D12DrawSink::AddDraw(const D3D12DrawPacket& draw)
+{
+    mDraws.push_back(draw);
+    return (uint32_t)(mDraws.size() - 1);
+}
+
+void D3D12DrawSink::SetPipeline(uint32_t pipeline)
+{
+    mCommandList->SetPipelineState(mPipelines[pipeline]);
+}
+
+void D3D12DrawSink::SetMaterial(uint32_t material)
+{
+    mCommandList->SetGraphicsRootConstantBufferView(0, mMaterials[material].object);
+    mCommandList->SetGraphicsRootConstantBufferView(1, mMaterials[material].light);
+}
+
+void D3D12DrawSink::SetMesh(uint32_t mesh)
+{
+    mCommandList->IASetVertexBuffers(0, 1, &mMeshes[mesh].vertices);
+    mCommandList->IASetIndexBuffer(&mMeshes[mesh].indices);
+}
+
+void D3D12DrawSink::Draw(uint32_t payload)
+{
+    const D3D12DrawPacket& draw = mDraws[payload];
+    mCommandList->DrawIndexedInstanced(
+        draw.indexCount,
+        draw.instanceCount,
+        draw.startIndex,
+        draw.baseVertex,
+        draw.firstInstance
+    );
+}
+
+// ===== DX12Renderer =====
+
 DX12Renderer::DX12Renderer()
-    : mFenceValue(0),
-    mCurrentBackBuffer(0),
-    mObjectCBMapped(nullptr),
-    mLightCBMapped(nullptr)
+    : mCurrentBackBuffer(0),
+    mSyncInterval(1),
+    mGeometryTicket(0),
+    mMainPipeline(0),
+    mInstancedPipeline(0),
+    mMesh(0),
+    mVertexFormat(VertexFormat::Packed),
+    mBoundsMin(0.0f, 0.0f, 0.0f),
+    mBoundsMax(0.0f, 0.0f, 0.0f),
+    mModelNode(TRANSFORM_NONE),
+    mAngle(0.0f),
+    mPreviousAngle(0.0f)
 {
 }
 
 DX12Renderer::~DX12Renderer()
 {
-    WaitForGPU();
-    CloseHandle(mFenceEvent);
+    mStagingUploader.WaitIdle();
+    mFrameRing.Flush();
 }
 
 bool DX12Renderer::Initialize(HWND hwnd, int width, int height)
 {
+    mJobs.Initialize();
+
     CreateDevice();
     CreateCommandObjects();
     CreateSwapChain(hwnd);
@@ -32,16 +451,37 @@ bool DX12Renderer::Initialize(HWND hwnd, int width, int height)
     CreateRenderTargets();
     CreateDepthStencil();
     CreateFence();
+    CreateStagingUploader();
+    CreateGeometryPool();
+    CreateProfiler();
 
     BuildRootSignature();
     BuildShadersAndPSO();
     //BuildCubeGeometry();
     BuildObj("sponza.obj");
-    BuildConstantBuffers();
+
+    mMainPipeline = mDrawSink.AddPipeline(mPipelineState.Get());
+    mInstancedPipeline = mDrawSink.AddPipeline(mInstancedPipelineState.Get());
+    for (GeometryBuffers& geometry : mGeometry)
+        geometry.mesh = mDrawSink.AddMesh(geometry.vertexView, geometry.indexView);
+
+    // LOD 0 only; instances are not LOD selected.
+    mMesh = mInstances.RegisterMesh({
+        mLods.empty() ? mIndexCount : mLods[0].indexCount,
+        mLods.empty() ? 0 : mLods[0].indexOffset,
+        0
+    });
+    BuildUploadRing();
 
     mViewport = { 0.0f, 0.0f, (float)width, (float)height, 0.0f, 1.0f };
     mScissorRect = { 0, 0, width, height };
 
+    // Same aspect as the viewport, so the buffer sees what the GPU draws.
+    int occlusionHeight = OcclusionWidth * height / width;
+    if (!mOcclusion.Initialize(OcclusionWidth, occlusionHeight > 0 ? occlusionHeight : 1))
+        throw std::runtime_error("Failed to create occlusion buffer");
+
+    mModelNode = mTransforms.Create();
     mWorld = XMMatrixIdentity();
     mView = XMMatrixLookAtLH(
         XMVectorSet(0, 2, -5, 1),
@@ -58,23 +498,20 @@ bool DX12Renderer::Initialize(HWND hwnd, int width, int height)
     return true;
 }
 
-void DX12Renderer::Update()
+void DX12Renderer::DrawInstance(MeshHandle mesh, const XMMATRIX& world, const XMFLOAT4& color)
 {
-    static float angle = 0.0f;
-    angle += 0.01f;
-    mWorld = XMMatrixRotationY(angle);
+    XMFLOAT4X4 matrix;
+    XMStoreFloat4x4(&matrix, world);
+    mInstances.Add(mesh, matrix, color);
+}
 
-    ObjectConstants obj;
-    obj.world = XMMatrixTranspose(mWorld);
-    obj.view = XMMatrixTranspose(mView);
-    obj.projection = XMMatrixTranspose(mProjection);
-    *mObjectCBMapped = obj;
+void DX12Renderer::Update(float dt)
+{
+    mPreviousAngle = mAngle;
+    mAngle += RotationSpeed * dt;
 
-    LightConstants light;
-    light.lightDir = XMFLOAT3(0.5f, -1.0f, 0.5f);
-    light.ambientColor = XMFLOAT4(0.2f, 0.2f, 0.2f, 1.0f);
-    light.diffuseColor = XMFLOAT4(0.8f, 0.8f, 0.8f, 1.0f);
-    *mLightCBMapped = light;
+    // Constants are uploaded by Render into fresh ring space; earlier
+    // frames may still be read by the GPU.
 }
 
 
@@ -104,15 +541,19 @@ void DX12Renderer::CreateCommandObjects()
     queueDesc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
 
     mDevice->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&mCommandQueue));
-    mDevice->CreateCommandAllocator(
-        D3D12_COMMAND_LIST_TYPE_DIRECT,
-        IID_PPV_ARGS(&mCommandAllocator)
-    );
+
+    for (UINT i = 0; i < FrameCount; i++)
+    {
+        mDevice->CreateCommandAllocator(
+            D3D12_COMMAND_LIST_TYPE_DIRECT,
+            IID_PPV_ARGS(&mCommandAllocators[i])
+        );
+    }
 
     mDevice->CreateCommandList(
         0,
         D3D12_COMMAND_LIST_TYPE_DIRECT,
-        mCommandAllocator.Get(),
+        mCommandAllocators[0].Get(),
         nullptr,
         IID_PPV_ARGS(&mCommandList)
     );
@@ -220,16 +661,53 @@ void DX12Renderer::CreateDepthStencil()
     );
 }
 
+void DX12Renderer::CreateProfiler()
+{
+    mTimestamps.Initialize(mDevice.Get(), mCommandQueue.Get(), FrameCount, GpuProfileZones * 2);
+    mGpuProfiler.Initialize(&mTimestamps, FrameCount, GpuProfileZones);
+}
+
 void DX12Renderer::CreateFence()
 {
-    mDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&mFence));
-    mFenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    mFrameQueue.Initialize(mDevice.Get(), mCommandQueue.Get());
+    mFrameRing.Initialize(&mFrameQueue, FrameCount);
 }
 
-void DX12Renderer::Render()
+void DX12Renderer::Render(float alpha)
 {
-    mCommandAllocator->Reset();
-    mCommandList->Reset(mCommandAllocator.Get(), mPipelineState.Get());
+    PROFILE_ZONE("Render");
+
+    float angle = mPreviousAngle + (mAngle - mPreviousAngle) * alpha;
+
+    XMFLOAT4 rotation;
+    XMStoreFloat4(&rotation, XMQuaternionRotationRollPitchYaw(0.0f, angle, 0.0f));
+    mTransforms.SetRotation(mModelNode, rotation);
+    {
+        PROFILE_ZONE("Update transforms");
+
+        TransformUpdateOptions options;
+        options.jobs = &mJobs;
+        mTransforms.Update(options);
+    }
+
+    XMFLOAT4X4 world = mTransforms.World(mModelNode);
+    mWorld = XMLoadFloat4x4(&world);
+
+    // Blocks only if this slot's previous frame is still on the GPU.
+    UINT frame;
+    {
+        PROFILE_ZONE("Wait for frame slot");
+        frame = mFrameRing.BeginFrame();
+    }
+    mUploadRing.BeginFrame(mFrameRing.CompletedFenceValue());
+
+    mCommandAllocators[frame]->Reset();
+    mCommandList->Reset(mCommandAllocators[frame].Get(), mPipelineState.Get());
+
+    // The slot's previous frame is retired, so its timestamps are readable.
+    mTimestamps.SetCommandList(mCommandList.Get());
+    mGpuProfiler.BeginFrame(frame);
+    uint32_t gpuFrame = mGpuProfiler.BeginZone("GPU frame");
 
     mCommandList->RSSetViewports(1, &mViewport);
     mCommandList->RSSetScissorRects(1, &mScissorRect);
@@ -258,45 +736,181 @@ void DX12Renderer::Render()
     obj.world = XMMatrixTranspose(mWorld);
     obj.view = XMMatrixTranspose(mView);
     obj.projection = XMMatrixTranspose(mProjection);
-    *mObjectCBMapped = obj;
+    obj.positionMin = XMFLOAT4(mBoundsMin.x, mBoundsMin.y, mBoundsMin.z, 0.0f);
+    obj.positionExtent = XMFLOAT4(
+        mBoundsMax.x - mBoundsMin.x,
+        mBoundsMax.y - mBoundsMin.y,
+        mBoundsMax.z - mBoundsMin.z,
+        0.0f
+    );
 
     LightConstants light;
     light.lightDir = XMFLOAT3(0.5f, -1.0f, 0.5f);
     light.ambientColor = XMFLOAT4(0.2f, 0.2f, 0.2f, 1.0f);
     light.diffuseColor = XMFLOAT4(0.8f, 0.8f, 0.8f, 1.0f);
-    *mLightCBMapped = light;
-
-    mCommandList->SetGraphicsRootConstantBufferView(0, mObjectCB->GetGPUVirtualAddress());
-    mCommandList->SetGraphicsRootConstantBufferView(1, mLightCB->GetGPUVirtualAddress());
 
+    mDrawSink.BeginFrame(mCommandList.Get());
+    mRenderQueue.Clear();
 
+    uint32_t material = mDrawSink.AddMaterial(
+        UploadConstants(&obj, sizeof(obj)),
+        UploadConstants(&light, sizeof(light))
+    );
 
     mCommandList->IASetPrimitiveTopology(
         D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST
     );
-    mCommandList->IASetVertexBuffers(0, 1, &mVertexBufferView);
-    mCommandList->IASetIndexBuffer(&mIndexBufferView);
 
-    mCommandList->DrawIndexedInstanced(mIndexCount, 1, 0, 0, 0);
+    // Whole mesh off screen: nothing to draw.
+    bool meshVisible = CullMeshAndInstances();
+
+    if (meshVisible && mLods.empty())
+    {
+        SubmitIndexRange(mMainPipeline, material, mIndexCount, 0, 0, 1, 0);
+    }
+    else if (meshVisible)
+    {
+        // ===== LOD selection and cluster culling in mesh space =====
+        XMMATRIX worldView = mWorld * mView;
+
+        XMFLOAT4X4 worldViewProj;
+        XMStoreFloat4x4(&worldViewProj, worldView * mProjection);
+
+        XMFLOAT3 eye;
+        XMStoreFloat3(&eye, XMMatrixInverse(nullptr, worldView).r[3]);
+
+        Frustum frustum = ExtractFrustum(worldViewProj);
+
+        // Distance to the bounding sphere; both it and the LOD errors are in
+        // mesh units, so a uniform world scale cancels out.
+        XMVECTOR boundsMin = XMLoadFloat3(&mBoundsMin);
+        XMVECTOR boundsMax = XMLoadFloat3(&mBoundsMax);
+        XMVECTOR center = (boundsMin + boundsMax) * 0.5f;
+        float radius = XMVectorGetX(XMVector3Length(boundsMax - center));
+        float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&eye) - center)) - radius;
+
+        size_t lod = SelectLod(
+            mLods,
+            distance,
+            XMVectorGetY(mProjection.r[1]),
+            mViewport.Height,
+            LodPixelError
+        );
+
+        if (lod == 0 && !mQueries.meshlets.meshlets.empty())
+        {
+            mDrawRanges.clear();
+            CullMeshlets(mQueries.meshlets, frustum, eye, mDrawRanges, mMeshletVisible);
+
+            for (const DrawRange& range : mDrawRanges)
+                SubmitIndexRange(mMainPipeline, material, range.indexCount, range.indexOffset, 0, 1, 0);
+        }
+        else
+        {
+            SubmitIndexRange(mMainPipeline, material, mLods[lod].indexCount, mLods[lod].indexOffset, 0, 1, 0);
+        }
+    }
+
+    // ===== instances: one draw per mesh =====
+    if (mInstances.InstanceCount() > 0)
+    {
+        UploadAllocation allocation;
+        if (!mUploadContext.Allocate(mInstances.InstanceBytes(), sizeof(InstanceData), allocation))
+            throw std::runtime_error("Upload ring is full");
+
+        mInstances.Build((InstanceData*)allocation.cpu, mInstanceDraws, &mJobs);
+        mInstances.Clear();
+
+        D3D12_VERTEX_BUFFER_VIEW instanceView;
+        instanceView.BufferLocation = allocation.gpu;
+        instanceView.SizeInBytes = (UINT)allocation.size;
+        instanceView.StrideInBytes = sizeof(InstanceData);
+
+        // Slot 1 is ignored by the non-instanced layout.
+        mCommandList->IASetVertexBuffers(1, 1, &instanceView);
+
+        for (const InstanceDraw& draw : mInstanceDraws)
+        {
+            const InstancedMesh& mesh = mInstances.Mesh(draw.mesh);
+            SubmitIndexRange(
+                mInstancedPipeline, material,
+                mesh.indexCount,
+                mesh.startIndex,
+                mesh.baseVertex,
+                draw.instanceCount,
+                draw.firstInstance
+            );
+        }
+    }
+
+    {
+        PROFILE_ZONE("Sort and record draws");
+        GpuProfileZone gpuDraws(mGpuProfiler, "GPU draws");
+
+        mRenderQueue.Sort();
+        mRenderQueue.Execute(mDrawSink);
+    }
+
+    mGpuProfiler.EndZone(gpuFrame);
+    mGpuProfiler.EndFrame();
 
     mCommandList->Close();
-    ID3D12CommandList* lists[] = { mCommandList.Get() };
-    mCommandQueue->ExecuteCommandLists(1, lists);
 
-    mSwapChain->Present(1, 0);
-    WaitForGPU();
+    // Geometry copies run on the copy queue; the first frame after them
+    // waits on the GPU, the CPU never does.
+    if (mGeometryTicket != 0)
+    {
+        mCommandQueue->Wait(mStagingBackend.Fence(), mGeometryTicket);
+        mGeometryTicket = 0;
+    }
+
+    {
+        PROFILE_ZONE("ExecuteCommandLists");
+        ID3D12CommandList* lists[] = { mCommandList.Get() };
+        mCommandQueue->ExecuteCommandLists(1, lists);
+    }
+
+    {
+        PROFILE_ZONE("Present");
+        mSwapChain->Present(mSyncInterval, 0);
+    }
+    mUploadRing.EndFrame(mFrameRing.CurrentFenceValue());
+    mFrameRing.EndFrame();
     mCurrentBackBuffer = mSwapChain->GetCurrentBackBufferIndex();
 }
 
-void DX12Renderer::WaitForGPU()
+void DX12Renderer::SubmitIndexRange(
+    uint32_t pipeline,
+    uint32_t material,
+    uint32_t indexCount,
+    uint32_t startIndex,
+    INT baseVertex,
+    uint32_t instanceCount,
+    uint32_t firstInstance)
 {
-    mFenceValue++;
-    mCommandQueue->Signal(mFence.Get(), mFenceValue);
+    uint64_t end = (uint64_t)startIndex + indexCount;
 
-    if (mFence->GetCompletedValue() < mFenceValue)
+    // Subsets are in index order; most meshes have just one.
+    for (const GeometryBuffers& geometry : mGeometry)
     {
-        mFence->SetEventOnCompletion(mFenceValue, mFenceEvent);
-        WaitForSingleObject(mFenceEvent, INFINITE);
+        uint64_t first = geometry.subset.indexOffset;
+        uint64_t last = first + geometry.subset.indexCount;
+        if (first >= end)
+            break;
+
+        uint64_t begin = startIndex > first ? startIndex : first;
+        uint64_t finish = end < last ? end : last;
+        if (begin >= finish)
+            continue;
+
+        uint64_t key = MakeSortKey(pipeline, material, geometry.mesh, 0);
+        mRenderQueue.Submit(key, mDrawSink.AddDraw({
+            (UINT)(finish - begin),
+            instanceCount,
+            (UINT)(begin - first),
+            baseVertex,
+            firstInstance
+        }));
     }
 }
 
@@ -335,26 +949,34 @@ void DX12Renderer::BuildRootSignature()
     );
 }
 
+D3D12_SHADER_BYTECODE DX12Renderer::CompileShader(const std::string& source, const char* profile)
+{
+    ShaderSource shader;
+    shader.source = source;
+    shader.profile = profile;
+
+    ShaderBytecode bytecode;
+    std::string errors;
+    if (!mShaderCache.Get(shader, mShaderCompiler, bytecode, errors))
+    {
+        OutputDebugStringA(errors.c_str());
+        throw std::runtime_error("Shader compilation failed");
+    }
+
+    return { bytecode.data, bytecode.size };
+}
+
 void DX12Renderer::BuildShadersAndPSO()
 {
-    ComPtr<ID3DBlob> vs;
-    ComPtr<ID3DBlob> ps;
+    // A missing cache is fine: everything compiles and Save creates it.
+    mShaderCache.Load(ShaderCachePath);
 
-    D3DCompile(
-        Shaders::VertexShader.c_str(),
-        Shaders::VertexShader.size(),
-        nullptr, nullptr, nullptr,
-        "main", "vs_5_0",
-        0, 0, &vs, nullptr
-    );
+    const std::string& vertexShader = mVertexFormat == VertexFormat::Packed
+        ? Shaders::PackedVertexShader
+        : Shaders::VertexShader;
 
-    D3DCompile(
-        Shaders::PixelShader.c_str(),
-        Shaders::PixelShader.size(),
-        nullptr, nullptr, nullptr,
-        "main", "ps_5_0",
-        0, 0, &ps, nullptr
-    );
+    D3D12_SHADER_BYTECODE vs = CompileShader(vertexShader, "vs_5_0");
+    D3D12_SHADER_BYTECODE ps = CompileShader(Shaders::PixelShader, "ps_5_0");
 
     D3D12_INPUT_ELEMENT_DESC layout[] =
     {
@@ -368,11 +990,22 @@ void DX12Renderer::BuildShadersAndPSO()
           D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
     };
 
+    D3D12_INPUT_ELEMENT_DESC packedLayout[] =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0,
+          D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+
+        { "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 8,
+          D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+    };
+
     D3D12_GRAPHICS_PIPELINE_STATE_DESC pso = {};
-    pso.InputLayout = { layout, _countof(layout) };
+    pso.InputLayout = mVertexFormat == VertexFormat::Packed
+        ? D3D12_INPUT_LAYOUT_DESC{ packedLayout, _countof(packedLayout) }
+        : D3D12_INPUT_LAYOUT_DESC{ layout, _countof(layout) };
     pso.pRootSignature = mRootSignature.Get();
-    pso.VS = { vs->GetBufferPointer(), vs->GetBufferSize() };
-    pso.PS = { ps->GetBufferPointer(), ps->GetBufferSize() };
+    pso.VS = vs;
+    pso.PS = ps;
     pso.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
     pso.NumRenderTargets = 1;
     pso.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
@@ -412,6 +1045,47 @@ void DX12Renderer::BuildShadersAndPSO()
         &pso,
         IID_PPV_ARGS(&mPipelineState)
     );
+
+    // ===== instanced: same state, per-instance stream in slot 1 =====
+    const std::string& instancedVertexShader = mVertexFormat == VertexFormat::Packed
+        ? Shaders::InstancedPackedVertexShader
+        : Shaders::InstancedVertexShader;
+
+    D3D12_SHADER_BYTECODE instancedVs = CompileShader(instancedVertexShader, "vs_5_0");
+    D3D12_SHADER_BYTECODE instancedPs = CompileShader(Shaders::InstancedPixelShader, "ps_5_0");
+
+    D3D12_INPUT_ELEMENT_DESC instanceElements[] =
+    {
+        { "WORLD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0,
+          D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+
+        { "WORLD", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16,
+          D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+
+        { "WORLD", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32,
+          D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+
+        { "INSTANCECOLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48,
+          D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 }
+    };
+
+    std::vector<D3D12_INPUT_ELEMENT_DESC> instancedLayout(
+        pso.InputLayout.pInputElementDescs,
+        pso.InputLayout.pInputElementDescs + pso.InputLayout.NumElements
+    );
+    instancedLayout.insert(instancedLayout.end(), instanceElements, instanceElements + _countof(instanceElements));
+
+    pso.InputLayout = { instancedLayout.data(), (UINT)instancedLayout.size() };
+    pso.VS = instancedVs;
+    pso.PS = instancedPs;
+
+    mDevice->CreateGraphicsPipelineState(
+        &pso,
+        IID_PPV_ARGS(&mInstancedPipelineState)
+    );
+
+    if (!mShaderCache.Save())
+        OutputDebugStringA("Failed to write shader cache\n");
 }
 
 void DX12Renderer::BuildCubeGeometry()
@@ -449,7 +1123,7 @@ void DX12Renderer::BuildCubeGeometry()
         {{ 1,-1,1},{1,1,0,1},{0,-1,0}},
     };
 
-    uint16_t indices[] =
+    uint32_t indices[] =
     {
         0,1,2, 0,2,3,
         4,5,6, 4,6,7,
@@ -459,145 +1133,405 @@ void DX12Renderer::BuildCubeGeometry()
         20,21,22, 20,22,23
     };
 
-    mIndexCount = _countof(indices);
+    mBoundsMin = XMFLOAT3(-1.0f, -1.0f, -1.0f);
+    mBoundsMax = XMFLOAT3(1.0f, 1.0f, 1.0f);
 
-    UINT vbSize = sizeof(vertices);
-    UINT ibSize = sizeof(indices);
+    MeshSubset subset = { 0, _countof(indices), 0, _countof(vertices) };
+    UploadGeometry(vertices, _countof(vertices), indices, _countof(indices), &subset, 1);
+}
 
-    D3D12_HEAP_PROPERTIES heap = {};
-    heap.Type = D3D12_HEAP_TYPE_UPLOAD;
+#include "parcer.h"
+#include "meshopt.h"
+#include "meshcache.h"
 
-    D3D12_RESOURCE_DESC buf = {};
-    buf.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-    buf.Width = vbSize;
-    buf.Height = 1;
-    buf.DepthOrArraySize = 1;
-    buf.MipLevels = 1;
-    buf.SampleDesc.Count = 1;
-    buf.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+void DX12Renderer::BuildObj(const std::string& path)
+{
+    PROFILE_ZONE("BuildObj");
 
-    mDevice->CreateCommittedResource(
-        &heap, D3D12_HEAP_FLAG_NONE,
-        &buf, D3D12_RESOURCE_STATE_GENERIC_READ,
-        nullptr, IID_PPV_ARGS(&mVertexBuffer)
+    OBJLoadOptions loadOptions;
+    MeshOptimizeOptions optimizeOptions;
+    LodChainOptions lodOptions;
+
+    // ===== warm start: mapped .mesh straight into staging =====
+    MeshCacheKey key;
+    if (!ComputeMeshCacheKey(path, loadOptions, optimizeOptions, lodOptions, key))
+        throw std::runtime_error("Failed to load OBJ");
+
+    std::string cachePath = MeshCachePath(path);
+
+    {
+        MeshCacheFile cache;
+        if (cache.Open(cachePath, key))
+        {
+            mBoundsMin = cache.BoundsMin();
+            mBoundsMax = cache.BoundsMax();
+            mLods.assign(cache.Lods(), cache.Lods() + cache.LodCount());
+            UploadGeometry(
+                cache.Vertices(), cache.VertexCount(),
+                cache.Indices(), cache.IndexCount(),
+                cache.Subsets(), cache.SubsetCount(),
+                &cache.File()
+            );
+
+            // Stored meshlets and compact copies of small LODs: LOD 0 is
+            // not read again.
+            BuildMeshQueries(
+                cache.Vertices(), cache.VertexCount(),
+                cache.Indices(), cache.IndexCount(),
+                cache.Meshlets(), cache.MeshletCount(),
+                &cache.File()
+            );
+            return;
+        }
+    }
+
+    // ===== cold start: parse, optimize, store =====
+    MeshData mesh;
+
+    OBJLoadStats stats;
+    if (!LoadOBJ(path, mesh.vertices, mesh.indices, loadOptions, &stats))
+        throw std::runtime_error("Failed to load OBJ");
+
+    char report[256];
+    snprintf(
+        report, sizeof(report),
+        "%s: %zu corners -> %zu vertices (-%.1f%%), VB %.2f MB saved\n",
+        path.c_str(),
+        stats.cornerCount,
+        stats.vertexCount,
+        100.0 * (stats.cornerCount - stats.vertexCount) / stats.cornerCount,
+        stats.VertexBytesSaved() / (1024.0 * 1024.0)
     );
+    OutputDebugStringA(report);
 
-    void* data;
-    mVertexBuffer->Map(0, nullptr, &data);
-    memcpy(data, vertices, vbSize);
-    mVertexBuffer->Unmap(0, nullptr);
+    {
+        PROFILE_ZONE("OptimizeMesh");
+        OptimizeMesh(mesh.vertices, mesh.indices, optimizeOptions);
+    }
 
-    mVertexBufferView = { mVertexBuffer->GetGPUVirtualAddress(), vbSize, sizeof(Vertex) };
+    {
+        PROFILE_ZONE("BuildLodChain");
+        mesh.lods = mLods = BuildLodChain(mesh.vertices.data(), mesh.vertices.size(), mesh.indices, lodOptions);
+    }
 
-    buf.Width = ibSize;
+    for (size_t i = 0; i < mLods.size(); ++i)
+    {
+        snprintf(
+            report, sizeof(report),
+            "LOD %zu: %u triangles, error %g\n",
+            i,
+            mLods[i].indexCount / 3,
+            mLods[i].error
+        );
+        OutputDebugStringA(report);
+    }
 
-    mDevice->CreateCommittedResource(
-        &heap, D3D12_HEAP_FLAG_NONE,
-        &buf, D3D12_RESOURCE_STATE_GENERIC_READ,
-        nullptr, IID_PPV_ARGS(&mIndexBuffer)
+    mesh.boundsMin = mBoundsMin = stats.boundsMin;
+    mesh.boundsMax = mBoundsMax = stats.boundsMax;
+
+    // The cache keeps meshlets only where the warm start will use them.
+    if (mLods[0].indexCount / 3 <= MeshQueryOptions().meshletTriangles)
+    {
+        PROFILE_ZONE("BuildMeshlets");
+        mesh.meshlets = BuildMeshlets(
+            mesh.vertices.data(), mesh.vertices.size(),
+            mesh.indices.data() + mLods[0].indexOffset, mLods[0].indexCount,
+            MeshletOptions()
+        ).meshlets;
+    }
+
+    // Over the whole index buffer: LODs are drawn through the subsets too.
+    if (!SplitSubmeshes(mesh.indices.data(), mesh.indices.size(), SubmeshLimits(), mesh.subsets))
+        throw std::runtime_error("Mesh cannot be split within buffer limits");
+
+    if (!WriteMeshCache(cachePath, key, mesh))
+        OutputDebugStringA("Failed to write mesh cache\n");
+
+    UploadGeometry(
+        mesh.vertices.data(), mesh.vertices.size(),
+        mesh.indices.data(), mesh.indices.size(),
+        mesh.subsets.data(), mesh.subsets.size()
     );
 
-    mIndexBuffer->Map(0, nullptr, &data);
-    memcpy(data, indices, ibSize);
-    mIndexBuffer->Unmap(0, nullptr);
+    BuildMeshQueries(
+        mesh.vertices.data(), mesh.vertices.size(),
+        mesh.indices.data(), mesh.indices.size(),
+        mesh.meshlets.data(), mesh.meshlets.size()
+    );
+}
 
-    mIndexBufferView = { mIndexBuffer->GetGPUVirtualAddress(), ibSize, DXGI_FORMAT_R16_UINT };
+void DX12Renderer::BuildMeshQueries(
+    const Vertex* vertices,
+    size_t vertexCount,
+    const uint32_t* indices,
+    size_t indexCount,
+    const Meshlet* meshlets,
+    size_t meshletCount,
+    const MappedFile* source)
+{
+    PROFILE_ZONE("BuildMeshQueries");
+
+    MeshQueryOptions options;
+    options.source = source;
+    options.jobs = &mJobs;
+
+    if (!BuildMeshQueryData(
+        vertices, vertexCount,
+        indices, indexCount,
+        mLods.data(), mLods.size(),
+        meshlets, meshletCount,
+        options, mQueries))
+    {
+        throw std::runtime_error("Mesh LODs out of range");
+    }
 
+    // Simplification keeps a subset of the original vertices, so the
+    // occluder stays inside the mesh bounds; it may still bulge slightly
+    // past concave parts of the surface, by at most the LOD error.
+    char report[192];
+    snprintf(
+        report, sizeof(report),
+        "Queries: %zu meshlets, BVH over LOD %zu (%zu triangles), occluder LOD %zu (%zu triangles, %zu vertices)\n",
+        mQueries.meshlets.meshlets.size(),
+        mQueries.pickLod,
+        mQueries.bvh.TriangleCount(),
+        mQueries.occluderLod,
+        mQueries.occluderIndices.size() / 3,
+        mQueries.occluderVertices.size()
+    );
+    OutputDebugStringA(report);
 }
 
-#include "parcer.h"
+bool DX12Renderer::CullMeshAndInstances()
+{
+    PROFILE_ZONE("Frustum and occlusion culling");
 
-void DX12Renderer::BuildObj(const std::string& path)
+    XMFLOAT4X4 viewProj;
+    XMStoreFloat4x4(&viewProj, mView * mProjection);
+
+    XMFLOAT4X4 world;
+    XMStoreFloat4x4(&world, mWorld);
+
+    // Only the loaded mesh has known bounds: its own box first, then one
+    // world box per instance of it.
+    const std::vector<InstanceData>& instances = mInstances.Instances(mMesh);
+
+    mCullBounds.Clear();
+    mCullBounds.Add(mBoundsMin, mBoundsMax, world);
+
+    for (const InstanceData& instance : instances)
+    {
+        // Back from the transposed rows to a row-vector matrix.
+        const XMFLOAT4& r0 = instance.world[0];
+        const XMFLOAT4& r1 = instance.world[1];
+        const XMFLOAT4& r2 = instance.world[2];
+        XMFLOAT4X4 matrix(
+            r0.x, r1.x, r2.x, 0.0f,
+            r0.y, r1.y, r2.y, 0.0f,
+            r0.z, r1.z, r2.z, 0.0f,
+            r0.w, r1.w, r2.w, 1.0f
+        );
+
+        mCullBounds.Add(mBoundsMin, mBoundsMax, matrix);
+    }
+
+    mCullVisible.resize(mCullBounds.Size());
+    size_t visibleCount = CullBoxes(ExtractFrustum(viewProj), mCullBounds, mCullVisible.data());
+
+    bool meshVisible = visibleCount > 0 && mCullVisible[0] == 0;
+
+    if (instances.empty())
+        return meshVisible;
+
+    // Instances in view, still indexed from 1.
+    uint32_t* candidates = mCullVisible.data() + (meshVisible ? 1 : 0);
+    size_t candidateCount = visibleCount - (meshVisible ? 1 : 0);
+
+    if (candidateCount > 0 && !mQueries.occluderIndices.empty())
+    {
+        mOcclusion.BeginFrame(viewProj);
+        mOcclusion.AddOccluder(
+            mQueries.occluderVertices.data(), mQueries.occluderVertices.size(),
+            mQueries.occluderIndices.data(), mQueries.occluderIndices.size(),
+            world
+        );
+        mOcclusion.Rasterize(&mJobs);
+
+        candidateCount = mOcclusion.CullBoxes(mCullBounds, candidates, candidateCount, candidates, &mJobs);
+    }
+
+    mInstanceVisible.assign(instances.size(), 0);
+    for (size_t i = 0; i < candidateCount; i++)
+        mInstanceVisible[candidates[i] - 1] = 1;
+
+    size_t index = 0;
+    mInstances.Filter([this, &index](MeshHandle mesh, const InstanceData&)
+    {
+        if (mesh != mMesh)
+            return true;
+
+        return mInstanceVisible[index++] != 0;
+    });
+
+    return meshVisible;
+}
+
+bool DX12Renderer::Pick(int x, int y, RayHit& hit) const
 {
-    std::vector<Vertex> vertices;
-    std::vector<uint32_t> indices;
+    if (mQueries.bvh.Empty() || mViewport.Width <= 0.0f || mViewport.Height <= 0.0f)
+        return false;
 
-    if (!LoadOBJ(path, vertices, indices))
-        throw std::runtime_error("Failed to load OBJ");
+    // Pixel center to NDC, then both clip planes back into mesh space.
+    float ndcX = 2.0f * (x + 0.5f - mViewport.TopLeftX) / mViewport.Width - 1.0f;
+    float ndcY = 1.0f - 2.0f * (y + 0.5f - mViewport.TopLeftY) / mViewport.Height;
 
-    mIndexCount = (UINT)indices.size();
+    XMMATRIX inverse = XMMatrixInverse(nullptr, mWorld * mView * mProjection);
+    XMVECTOR nearPoint = XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 0.0f, 1.0f), inverse);
+    XMVECTOR farPoint = XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 1.0f, 1.0f), inverse);
 
-    UINT vbSize = sizeof(Vertex) * (UINT)vertices.size();
-    UINT ibSize = sizeof(uint32_t) * (UINT)indices.size();
+    Ray ray;
+    XMStoreFloat3(&ray.origin, nearPoint);
+    XMStoreFloat3(&ray.direction, XMVectorSubtract(farPoint, nearPoint));
+    ray.tMax = 1.0f;
 
-    // === HEAP ===
-    D3D12_HEAP_PROPERTIES heap = {};
-    heap.Type = D3D12_HEAP_TYPE_UPLOAD;
+    return mQueries.bvh.Intersect(ray, hit);
+}
 
-    // === VERTEX BUFFER ===
-    D3D12_RESOURCE_DESC vbDesc = {};
-    vbDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-    vbDesc.Width = vbSize;
-    vbDesc.Height = 1;
-    vbDesc.DepthOrArraySize = 1;
-    vbDesc.MipLevels = 1;
-    vbDesc.SampleDesc.Count = 1;
-    vbDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+void DX12Renderer::UploadGeometry(
+    const Vertex* vertices,
+    size_t vertexCount,
+    const uint32_t* indices,
+    size_t indexCount,
+    const MeshSubset* subsets,
+    size_t subsetCount,
+    const MappedFile* source)
+{
+    // Draw arguments and subset offsets count indices in 32 bits; byte
+    // sizes below are 64-bit throughout.
+    if (indexCount > UINT32_MAX)
+        throw std::runtime_error("Too many indices");
 
-    mDevice->CreateCommittedResource(
-        &heap,
-        D3D12_HEAP_FLAG_NONE,
-        &vbDesc,
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        nullptr,
-        IID_PPV_ARGS(&mVertexBuffer)
-    );
+    mIndexCount = (UINT)indexCount;
 
-    void* data = nullptr;
-    mVertexBuffer->Map(0, nullptr, &data);
-    memcpy(data, vertices.data(), vbSize);
-    mVertexBuffer->Unmap(0, nullptr);
+    UINT64 vertexStride = VertexStride(mVertexFormat);
 
-    mVertexBufferView.BufferLocation = mVertexBuffer->GetGPUVirtualAddress();
-    mVertexBufferView.SizeInBytes = vbSize;
-    mVertexBufferView.StrideInBytes = sizeof(Vertex);
+    // === DEFAULT HEAP BUFFERS, filled on the copy queue ===
+    // Only called while loading, before any frame uses the old buffers.
+    for (GeometryBuffers& geometry : mGeometry)
+    {
+        geometry.vertexBuffer.Reset();
+        geometry.indexBuffer.Reset();
+        mGeometryPool.Free(geometry.vertexAllocation);
+        mGeometryPool.Free(geometry.indexAllocation);
+    }
+    mGeometry.clear();
+    mGeometry.resize(subsetCount);
 
-    // === INDEX BUFFER ===
-    D3D12_RESOURCE_DESC ibDesc = vbDesc;
-    ibDesc.Width = ibSize;
+    D3D12GeometrySink sink(&mStagingUploader);
+    UINT64 vbTotal = 0;
 
-    mDevice->CreateCommittedResource(
-        &heap,
-        D3D12_HEAP_FLAG_NONE,
-        &ibDesc,
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        nullptr,
-        IID_PPV_ARGS(&mIndexBuffer)
-    );
+    for (size_t i = 0; i < subsetCount; i++)
+    {
+        GeometryBuffers& geometry = mGeometry[i];
+        geometry.subset = subsets[i];
+        geometry.mesh = 0;
+
+        UINT64 vbSize = vertexStride * geometry.subset.vertexCount;
+        UINT64 ibSize = sizeof(uint32_t) * (UINT64)geometry.subset.indexCount;
+
+        // Views hold 32-bit sizes; SubmeshLimits keeps subsets well below.
+        if (vbSize > UINT32_MAX || ibSize > UINT32_MAX)
+            throw std::runtime_error("Subset exceeds buffer view limits");
 
-    mIndexBuffer->Map(0, nullptr, &data);
-    memcpy(data, indices.data(), ibSize);
-    mIndexBuffer->Unmap(0, nullptr);
+        geometry.vertexBuffer = CreateDefaultBuffer(vbSize, geometry.vertexAllocation);
+        geometry.indexBuffer = CreateDefaultBuffer(ibSize, geometry.indexAllocation);
+        sink.AddTarget(geometry.vertexBuffer.Get(), geometry.indexBuffer.Get());
 
-    mIndexBufferView.BufferLocation = mIndexBuffer->GetGPUVirtualAddress();
-    mIndexBufferView.SizeInBytes = ibSize;
-    mIndexBufferView.Format = DXGI_FORMAT_R32_UINT;
+        geometry.vertexView.BufferLocation = geometry.vertexBuffer->GetGPUVirtualAddress();
+        geometry.vertexView.SizeInBytes = (UINT)vbSize;
+        geometry.vertexView.StrideInBytes = (UINT)vertexStride;
+
+        geometry.indexView.BufferLocation = geometry.indexBuffer->GetGPUVirtualAddress();
+        geometry.indexView.SizeInBytes = (UINT)ibSize;
+        geometry.indexView.Format = DXGI_FORMAT_R32_UINT;
+
+        vbTotal += vbSize;
+    }
+
+    // Packing and rebasing go through one small buffer; the staging
+    // uploader copies each piece out before the next one is made.
+    GeometryStreamOptions options;
+    options.format = mVertexFormat;
+    options.boundsMin = mBoundsMin;
+    options.boundsMax = mBoundsMax;
+    options.source = source;
+
+    if (!StreamGeometry(vertices, vertexCount, indices, indexCount, subsets, subsetCount, options, sink))
+        throw std::runtime_error("Failed to upload geometry");
+
+    mGeometryTicket = mStagingUploader.Flush();
+
+    char report[128];
+    snprintf(
+        report, sizeof(report),
+        "VB: %u -> %u bytes per vertex, %.2f MB in %zu subsets\n",
+        (UINT)sizeof(Vertex),
+        (UINT)vertexStride,
+        vbTotal / (1024.0 * 1024.0),
+        subsetCount
+    );
+    OutputDebugStringA(report);
 }
 
 
-struct ObjectCB
+ComPtr<ID3D12Resource> DX12Renderer::CreateDefaultBuffer(UINT64 size, GpuAllocation& allocation)
 {
-    XMMATRIX world;
-    XMMATRIX view;
-    XMMATRIX proj;
-};
+    D3D12_RESOURCE_DESC buf = {};
+    buf.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    buf.Width = size;
+    buf.Height = 1;
+    buf.DepthOrArraySize = 1;
+    buf.MipLevels = 1;
+    buf.SampleDesc.Count = 1;
+    buf.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+
+    // Buffers in COMMON are promoted to COPY_DEST on the copy queue and to
+    // vertex/index reads on the direct queue without barriers.
+    D3D12_RESOURCE_ALLOCATION_INFO info = mDevice->GetResourceAllocationInfo(0, 1, &buf);
+    if (!mGeometryPool.Allocate(info.SizeInBytes, info.Alignment, allocation))
+        throw std::runtime_error("Out of geometry heap memory");
+
+    ComPtr<ID3D12Resource> buffer;
+    mDevice->CreatePlacedResource(
+        mGeometryHeaps.Heap(allocation.block),
+        allocation.Offset(),
+        &buf,
+        D3D12_RESOURCE_STATE_COMMON,
+        nullptr,
+        IID_PPV_ARGS(&buffer)
+    );
 
-struct LightCB
+    return buffer;
+}
+
+void DX12Renderer::CreateGeometryPool()
 {
-    XMFLOAT3 lightDir;
-    float pad;
-    XMFLOAT4 ambient;
-    XMFLOAT4 diffuse;
-};
+    mGeometryHeaps.Initialize(mDevice.Get(), D3D12_HEAP_TYPE_DEFAULT, D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS);
+
+    // Buffers only need the 64KB class.
+    GpuPoolOptions options;
+    options.heapAlignment = GPU_HEAP_ALIGNMENT_64KB;
+    mGeometryPool.Initialize(&mGeometryHeaps, options);
+}
 
-void DX12Renderer::BuildConstantBuffers()
+void DX12Renderer::CreateStagingUploader()
 {
     D3D12_HEAP_PROPERTIES heap = {};
     heap.Type = D3D12_HEAP_TYPE_UPLOAD;
 
     D3D12_RESOURCE_DESC buf = {};
     buf.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-    buf.Width = 256;
+    buf.Width = StagingBufferSize;
     buf.Height = 1;
     buf.DepthOrArraySize = 1;
     buf.MipLevels = 1;
@@ -607,16 +1541,50 @@ void DX12Renderer::BuildConstantBuffers()
     mDevice->CreateCommittedResource(
         &heap, D3D12_HEAP_FLAG_NONE,
         &buf, D3D12_RESOURCE_STATE_GENERIC_READ,
-        nullptr, IID_PPV_ARGS(&mObjectCB)
+        nullptr, IID_PPV_ARGS(&mStagingBuffer)
     );
 
-    mObjectCB->Map(0, nullptr, (void**)&mObjectCBMapped);
+    void* data = nullptr;
+    mStagingBuffer->Map(0, nullptr, &data);
+
+    mStagingBackend.Initialize(mDevice.Get(), mStagingBuffer.Get());
+    mStagingUploader.Initialize(&mStagingBackend, data, StagingBufferSize);
+}
+
+void DX12Renderer::BuildUploadRing()
+{
+    D3D12_HEAP_PROPERTIES heap = {};
+    heap.Type = D3D12_HEAP_TYPE_UPLOAD;
+
+    D3D12_RESOURCE_DESC buf = {};
+    buf.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    buf.Width = UploadRingSize;
+    buf.Height = 1;
+    buf.DepthOrArraySize = 1;
+    buf.MipLevels = 1;
+    buf.SampleDesc.Count = 1;
+    buf.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
 
     mDevice->CreateCommittedResource(
         &heap, D3D12_HEAP_FLAG_NONE,
         &buf, D3D12_RESOURCE_STATE_GENERIC_READ,
-        nullptr, IID_PPV_ARGS(&mLightCB)
+        nullptr, IID_PPV_ARGS(&mUploadBuffer)
     );
 
-    mLightCB->Map(0, nullptr, (void**)&mLightCBMapped);
+    // Stays mapped for the lifetime of the buffer.
+    void* data = nullptr;
+    mUploadBuffer->Map(0, nullptr, &data);
+
+    mUploadRing.Initialize(data, mUploadBuffer->GetGPUVirtualAddress(), UploadRingSize);
+    mUploadContext.Initialize(&mUploadRing);
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS DX12Renderer::UploadConstants(const void* data, size_t size)
+{
+    UploadAllocation allocation;
+    if (!mUploadContext.AllocateConstants(size, allocation))
+        throw std::runtime_error("Upload ring is full");
+
+    memcpy(allocation.cpu, data, size);
+    return allocation.gpu;
 }
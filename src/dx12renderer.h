@@ -5,30 +5,218 @@
 #include <dxgi1_6.h>
 #include <DirectXMath.h>
 #include <string>
+#include <vector>
+#include <deque>
+
+#include "vertex.h"
+#include "constants.h"
+#include "vertexpack.h"
+#include "meshlet.h"
+#include "simplify.h"
+#include "framering.h"
+#include "uploadring.h"
+#include "staging.h"
+#include "meshstream.h"
+#include "gpuheap.h"
+#include "instancing.h"
+#include "jobs.h"
+#include "renderqueue.h"
+#include "shadercache.h"
+#include "profiler.h"
+#include "transforms.h"
+#include "bvh.h"
+#include "occlusion.h"
 
 using namespace DirectX;
 using Microsoft::WRL::ComPtr;
 
-struct Vertex
+// Frame ring fence on a D3D12 queue.
+class D3D12FrameQueue : public FrameQueue
+{
+public:
+    D3D12FrameQueue();
+    ~D3D12FrameQueue();
+
+    void Initialize(ID3D12Device* device, ID3D12CommandQueue* queue);
+
+    void Signal(uint64_t value) override;
+    uint64_t CompletedValue() override;
+    void Wait(uint64_t value) override;
+
+private:
+    ID3D12CommandQueue* mQueue;
+    ComPtr<ID3D12Fence> mFence;
+    HANDLE mEvent;
+};
+
+// ID3D12Heap blocks for a GpuMemoryPool.
+class D3D12HeapBackend : public GpuHeapBackend
+{
+public:
+    D3D12HeapBackend();
+
+    void Initialize(ID3D12Device* device, D3D12_HEAP_TYPE type, D3D12_HEAP_FLAGS flags);
+
+    bool CreateHeap(uint32_t block, uint64_t size, uint64_t alignment) override;
+    void DestroyHeap(uint32_t block) override;
+
+    ID3D12Heap* Heap(uint32_t block) const { return mHeaps[block].Get(); }
+
+private:
+    ID3D12Device* mDevice;
+    D3D12_HEAP_TYPE mType;
+    D3D12_HEAP_FLAGS mFlags;
+
+    std::vector<ComPtr<ID3D12Heap>> mHeaps;
+};
+
+// Staging copies on a dedicated copy queue with its own fence.
+class D3D12StagingBackend : public StagingBackend
+{
+public:
+    D3D12StagingBackend();
+    ~D3D12StagingBackend();
+
+    void Initialize(ID3D12Device* device, ID3D12Resource* staging);
+
+    void RecordCopy(void* destination, uint64_t destinationOffset, uint64_t stagingOffset, uint64_t size) override;
+    void Submit(uint64_t fence) override;
+    uint64_t CompletedValue() override;
+    void Wait(uint64_t fence) override;
+
+    // For other queues to wait on uploads.
+    ID3D12Fence* Fence() const { return mFence.Get(); }
+
+private:
+    struct PendingAllocator
+    {
+        ComPtr<ID3D12CommandAllocator> allocator;
+        uint64_t fence;
+    };
+
+    ID3D12Device* mDevice;
+    ID3D12Resource* mStaging;
+
+    ComPtr<ID3D12CommandQueue> mQueue;
+    ComPtr<ID3D12GraphicsCommandList> mCommandList;
+    ComPtr<ID3D12CommandAllocator> mAllocator;
+    std::deque<PendingAllocator> mAllocators;
+    bool mRecording;
+
+    ComPtr<ID3D12Fence> mFence;
+    HANDLE mEvent;
+};
+
+// Streams geometry into default heap buffers through the staging
+// uploader, one vertex and index buffer pair per subset.
+class D3D12GeometrySink : public GeometrySink
 {
-    XMFLOAT3 position;
-    XMFLOAT4 color;
-    XMFLOAT3 normal;
+public:
+    explicit D3D12GeometrySink(StagingUploader* uploader);
+
+    void AddTarget(ID3D12Resource* vertices, ID3D12Resource* indices);
+
+    bool BeginSubmesh(size_t subset, uint64_t vertexBytes, uint64_t indexBytes) override;
+    bool WriteVertices(uint64_t offset, const void* data, uint64_t size) override;
+    bool WriteIndices(uint64_t offset, const void* data, uint64_t size) override;
+
+private:
+    struct Target
+    {
+        ID3D12Resource* vertices;
+        ID3D12Resource* indices;
+    };
+
+    StagingUploader* mUploader;
+    std::vector<Target> mTargets;
+    size_t mCurrent;
 };
 
-struct alignas(256) ObjectConstants
+// Timestamp queries for the GpuProfiler: one query heap and readback
+// buffer split into a slot per frame in flight.
+class D3D12TimestampBackend : public GpuTimestampBackend
 {
-    XMMATRIX world;
-    XMMATRIX view;
-    XMMATRIX projection;
+public:
+    D3D12TimestampBackend();
+
+    void Initialize(ID3D12Device* device, ID3D12CommandQueue* queue, uint32_t slotCount, uint32_t queriesPerSlot);
+    // Queries go into this list until the next call.
+    void SetCommandList(ID3D12GraphicsCommandList* commandList) { mCommandList = commandList; }
+
+    void WriteTimestamp(uint32_t slot, uint32_t query) override;
+    void ResolveSlot(uint32_t slot, uint32_t count) override;
+    bool ReadSlot(uint32_t slot, uint32_t count, uint64_t* nanoseconds) override;
+
+private:
+    ComPtr<ID3D12QueryHeap> mQueryHeap;
+    ComPtr<ID3D12Resource> mReadback;
+    uint32_t mQueriesPerSlot;
+
+    ID3D12GraphicsCommandList* mCommandList;
+
+    // GPU ticks to ProfilerNow nanoseconds.
+    UINT64 mGpuBase;
+    uint64_t mCpuBase;
+    double mNsPerGpuTick;
 };
 
-struct alignas(256) LightConstants
+// D3DCompile behind the shader cache.
+class D3DShaderCompiler : public ShaderCompiler
 {
-    XMFLOAT3 lightDir;
-    float padding;
-    XMFLOAT4 ambientColor;
-    XMFLOAT4 diffuseColor;
+public:
+    uint64_t Version() const override;
+    bool Compile(const ShaderSource& shader, std::vector<uint8_t>& bytecode, std::string& errors) override;
+};
+
+struct D3D12DrawPacket
+{
+    UINT indexCount;
+    UINT instanceCount;
+    UINT startIndex;
+    INT baseVertex;
+    UINT firstInstance;
+};
+
+// Replays a sorted RenderQueue into a command list. Key ids index the
+// pipelines, materials (root constant buffers) and meshes (vertex and index
+// buffers) added here; payloads index the draws.
+class D3D12DrawSink : public RenderStateSink
+{
+public:
+    D3D12DrawSink();
+
+    uint32_t AddPipeline(ID3D12PipelineState* pipeline);
+    uint32_t AddMesh(const D3D12_VERTEX_BUFFER_VIEW& vertices, const D3D12_INDEX_BUFFER_VIEW& indices);
+
+    // Per frame: drops the frame's materials and draws.
+    void BeginFrame(ID3D12GraphicsCommandList* commandList);
+    uint32_t AddMaterial(D3D12_GPU_VIRTUAL_ADDRESS object, D3D12_GPU_VIRTUAL_ADDRESS light);
+    uint32_t AddDraw(const D3D12DrawPacket& draw);
+
+    void SetPipeline(uint32_t pipeline) override;
+    void SetMaterial(uint32_t material) override;
+    void SetMesh(uint32_t mesh) override;
+    void Draw(uint32_t payload) override;
+
+private:
+    struct Material
+    {
+        D3D12_GPU_VIRTUAL_ADDRESS object;
+        D3D12_GPU_VIRTUAL_ADDRESS light;
+    };
+
+    struct Mesh
+    {
+        D3D12_VERTEX_BUFFER_VIEW vertices;
+        D3D12_INDEX_BUFFER_VIEW indices;
+    };
+
+    ID3D12GraphicsCommandList* mCommandList;
+
+    std::vector<ID3D12PipelineState*> mPipelines;
+    std::vector<Mesh> mMeshes;
+    std::vector<Material> mMaterials;
+    std::vector<D3D12DrawPacket> mDraws;
 };
 
 class DX12Renderer
@@ -38,20 +226,42 @@ public:
     ~DX12Renderer();
 
     bool Initialize(HWND hwnd, int width, int height);
-    void Render();
-    void Update();
+    // alpha blends the last two simulation states, see FrameClock::Alpha.
+    void Render(float alpha);
+    // Vertical blanks Present waits for. 0 presents at once, for callers
+    // that pace frames themselves.
+    void SetSyncInterval(UINT interval) { mSyncInterval = interval; }
+    // Advances the simulation by one fixed step of dt seconds.
+    void Update(float dt);
+
+    // Queues a copy of mesh for this frame; all copies of a mesh go out in
+    // one instanced draw.
+    void DrawInstance(MeshHandle mesh, const XMMATRIX& world, const XMFLOAT4& color);
+    MeshHandle LoadedMesh() const { return mMesh; }
+
+    // Closest triangle under client pixel (x, y) as last rendered, numbered
+    // within the picking LOD: LOD 0 unless the mesh is past the budget.
+    // hit.t runs from the near plane (0) to the far plane (1).
+    bool Pick(int x, int y, RayHit& hit) const;
 private:
     // ===== DX12 core =====
     ComPtr<ID3D12Device> mDevice;
     ComPtr<IDXGIFactory4> mFactory;
 
     ComPtr<ID3D12CommandQueue> mCommandQueue;
-    ComPtr<ID3D12CommandAllocator> mCommandAllocator;
     ComPtr<ID3D12GraphicsCommandList> mCommandList;
 
     ComPtr<IDXGISwapChain3> mSwapChain;
     static const UINT FrameCount = 2;
 
+    // ===== frames in flight =====
+    // One slot per swap chain buffer: each has its own allocator, reused
+    // once the GPU has retired the slot's fence.
+    ComPtr<ID3D12CommandAllocator> mCommandAllocators[FrameCount];
+
+    D3D12FrameQueue mFrameQueue;
+    FrameRing mFrameRing;
+
     ComPtr<ID3D12Resource> mRenderTargets[FrameCount];
     ComPtr<ID3D12Resource> mDepthStencil;
 
@@ -60,27 +270,132 @@ private:
 
     UINT mRtvDescriptorSize;
     UINT mCurrentBackBuffer;
-
-    ComPtr<ID3D12Fence> mFence;
-    UINT64 mFenceValue;
-    HANDLE mFenceEvent;
+    UINT mSyncInterval;
 
     ComPtr<ID3D12RootSignature> mRootSignature;
     ComPtr<ID3D12PipelineState> mPipelineState;
+    ComPtr<ID3D12PipelineState> mInstancedPipelineState;
+
+    // ===== geometry uploads =====
+    static const UINT64 StagingBufferSize = 16 * 1024 * 1024;
+
+    ComPtr<ID3D12Resource> mStagingBuffer;
+    D3D12StagingBackend mStagingBackend;
+    StagingUploader mStagingUploader;
+
+    // Copy fence the next frame has to wait for, 0 if none.
+    UINT64 mGeometryTicket;
 
-    ComPtr<ID3D12Resource> mVertexBuffer;
-    ComPtr<ID3D12Resource> mIndexBuffer;
+    // Placed in pooled default heaps, written only by the copy queue.
+    D3D12HeapBackend mGeometryHeaps;
+    GpuMemoryPool mGeometryPool;
 
-    D3D12_VERTEX_BUFFER_VIEW mVertexBufferView;
-    D3D12_INDEX_BUFFER_VIEW  mIndexBufferView;
+    // One buffer pair per subset, so no buffer or view outgrows the API
+    // limits; indices are rebased to the subset's first vertex.
+    struct GeometryBuffers
+    {
+        MeshSubset subset;
+
+        ComPtr<ID3D12Resource> vertexBuffer;
+        ComPtr<ID3D12Resource> indexBuffer;
+        GpuAllocation vertexAllocation;
+        GpuAllocation indexAllocation;
+
+        D3D12_VERTEX_BUFFER_VIEW vertexView;
+        D3D12_INDEX_BUFFER_VIEW indexView;
+
+        // Draw sink mesh.
+        uint32_t mesh;
+    };
+
+    std::vector<GeometryBuffers> mGeometry;
 
     UINT mIndexCount;
 
-    ComPtr<ID3D12Resource> mObjectCB;
-    ComPtr<ID3D12Resource> mLightCB;
+    // Largest on-screen LOD error, in pixels.
+    static constexpr float LodPixelError = 1.0f;
+
+    // Index ranges of the whole mesh, drawn through the subset buffers; LOD 0
+    // first.
+    std::vector<MeshLod> mLods;
+
+    // Meshlets over LOD 0, a BVH for ray queries in mesh space and the
+    // occluder, each within its MeshQueryOptions budget so that loading a
+    // mesh larger than memory takes no more than a small one.
+    MeshQueryData mQueries;
+
+    // ===== profiling =====
+    static const uint32_t GpuProfileZones = 16;
+
+    D3D12TimestampBackend mTimestamps;
+    GpuProfiler mGpuProfiler;
+
+    // ===== shaders =====
+    // Compiled bytecode is reused across launches; only edited shaders
+    // are compiled again.
+    static constexpr const char* ShaderCachePath = "shaders.cache";
+
+    ShaderCache mShaderCache;
+    D3DShaderCompiler mShaderCompiler;
+
+    // ===== draw submission =====
+    // Draws are queued with sort keys and replayed in key order, binding
+    // only the state that changed.
+    RenderQueue mRenderQueue;
+    D3D12DrawSink mDrawSink;
+    uint32_t mMainPipeline;
+    uint32_t mInstancedPipeline;
+
+    // ===== CPU jobs =====
+    // The render thread is worker 0.
+    JobSystem mJobs;
 
-    ObjectConstants* mObjectCBMapped;
-    LightConstants* mLightCBMapped;
+    // ===== instancing =====
+    InstanceBatcher mInstances;
+    std::vector<InstanceDraw> mInstanceDraws;
+    MeshHandle mMesh;
+
+    std::vector<DrawRange> mDrawRanges;
+    std::vector<uint32_t> mMeshletVisible;
+
+    // ===== frustum culling =====
+    // World space boxes of the loaded mesh (entry 0) and of its instances,
+    // culled in one CullBoxes batch; mCullVisible holds the survivors.
+    BoxBounds mCullBounds;
+    std::vector<uint32_t> mCullVisible;
+    std::vector<uint8_t> mInstanceVisible;
+
+    // ===== occlusion culling =====
+    // The loaded mesh is rasterized into a small CPU depth buffer every
+    // frame; instances behind it are dropped before upload. It occludes
+    // through mQueries' occluder.
+    static const int OcclusionWidth = 320;
+
+    OcclusionBuffer mOcclusion;
+
+    VertexFormat mVertexFormat;
+    XMFLOAT3 mBoundsMin;
+    XMFLOAT3 mBoundsMax;
+
+    // ===== per-frame upload memory =====
+    // Constants and other dynamic data, reclaimed by frame fence.
+    // Room for ~100k instances per frame with frames in flight.
+    static const UINT64 UploadRingSize = 32 * 1024 * 1024;
+
+    ComPtr<ID3D12Resource> mUploadBuffer;
+    UploadRing mUploadRing;
+    UploadContext mUploadContext;
+
+    // ===== scene =====
+    // World matrices come from the hierarchy, recomputed once per frame.
+    TransformHierarchy mTransforms;
+    TransformHandle mModelNode;
+
+    // Radians per second.
+    static constexpr float RotationSpeed = 0.6f;
+
+    float mAngle;
+    float mPreviousAngle;
 
     XMMATRIX mWorld;
     XMMATRIX mView;
@@ -96,12 +411,51 @@ private:
     void CreateRenderTargets();
     void CreateDepthStencil();
     void CreateFence();
+    void CreateStagingUploader();
+    void CreateGeometryPool();
+    void CreateProfiler();
+    ComPtr<ID3D12Resource> CreateDefaultBuffer(UINT64 size, GpuAllocation& allocation);
 
     void BuildRootSignature();
     void BuildShadersAndPSO();
+    D3D12_SHADER_BYTECODE CompileShader(const std::string& source, const char* profile);
     void BuildCubeGeometry();
     void BuildObj(const std::string& path);
-    void BuildConstantBuffers();
-
-    void WaitForGPU();
+    // source, if set, is the mapping the arrays live in.
+    void UploadGeometry(
+        const Vertex* vertices,
+        size_t vertexCount,
+        const uint32_t* indices,
+        size_t indexCount,
+        const MeshSubset* subsets,
+        size_t subsetCount,
+        const MappedFile* source = nullptr
+    );
+    // Queues an index range of the whole mesh, as one draw per subset it
+    // overlaps.
+    void SubmitIndexRange(
+        uint32_t pipeline,
+        uint32_t material,
+        uint32_t indexCount,
+        uint32_t startIndex,
+        INT baseVertex,
+        uint32_t instanceCount,
+        uint32_t firstInstance
+    );
+    // Fills mQueries from the loaded mesh; source as for UploadGeometry.
+    void BuildMeshQueries(
+        const Vertex* vertices,
+        size_t vertexCount,
+        const uint32_t* indices,
+        size_t indexCount,
+        const Meshlet* meshlets,
+        size_t meshletCount,
+        const MappedFile* source = nullptr
+    );
+    // Culls the loaded mesh and its instances against the view frustum,
+    // then the instances against the occluder. Returns whether the mesh
+    // itself is in view; hidden instances are dropped from mInstances.
+    bool CullMeshAndInstances();
+    void BuildUploadRing();
+    D3D12_GPU_VIRTUAL_ADDRESS UploadConstants(const void* data, size_t size);
 };
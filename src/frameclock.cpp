@@ -0,0 +1,179 @@
+#include "frameclock.h"
+
+#include <chrono>
+#include <thread>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#endif
+
+namespace
+{
+    // Yielded before a deadline even with a perfect timer.
+    constexpr uint64_t MIN_SLEEP_MARGIN = 200000;
+    // Sleeps shorter than this are not worth a timer.
+    constexpr uint64_t MIN_SLEEP = 500000;
+}
+
+// ===== SystemClock =====
+
+SystemClock::SystemClock()
+#if defined(_WIN32)
+    : mTimer(nullptr)
+#endif
+{
+#if defined(_WIN32) && defined(CREATE_WAITABLE_TIMER_HIGH_RESOLUTION)
+    mTimer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+#endif
+}
+
+SystemClock::~SystemClock()
+{
+#if defined(_WIN32)
+    if (mTimer)
+        CloseHandle(mTimer);
+#endif
+}
+
+uint64_t SystemClock::Now()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void SystemClock::SleepFor(uint64_t nanoseconds)
+{
+#if defined(_WIN32)
+    if (mTimer)
+    {
+        // Relative due time, in 100ns units.
+        LARGE_INTEGER due;
+        due.QuadPart = -(LONGLONG)(nanoseconds / 100);
+        if (SetWaitableTimerEx(mTimer, &due, 0, nullptr, nullptr, nullptr, 0))
+        {
+            WaitForSingleObject(mTimer, INFINITE);
+            return;
+        }
+    }
+#endif
+    std::this_thread::sleep_for(std::chrono::nanoseconds(nanoseconds));
+}
+
+void SystemClock::Pause()
+{
+    std::this_thread::yield();
+}
+
+// ===== FrameClock =====
+
+FrameClock::FrameClock()
+    : mClock(nullptr),
+    mFixedStep(NANOSECONDS_PER_SECOND / 60),
+    mMaxFrameTime(NANOSECONDS_PER_SECOND / 4),
+    mLastTick(0),
+    mFrameTime(0),
+    mAccumulator(0),
+    mSimulationTime(0),
+    mFrameCount(0)
+{
+}
+
+void FrameClock::Initialize(Clock* clock, uint64_t fixedStep, uint64_t maxFrameTime)
+{
+    mClock = clock;
+    mFixedStep = fixedStep > 0 ? fixedStep : 1;
+    mMaxFrameTime = maxFrameTime;
+
+    mLastTick = mClock->Now();
+    mFrameTime = 0;
+    mAccumulator = 0;
+    mSimulationTime = 0;
+    mFrameCount = 0;
+}
+
+void FrameClock::Tick()
+{
+    uint64_t now = mClock->Now();
+    mFrameTime = now - mLastTick;
+    mLastTick = now;
+
+    mAccumulator += mFrameTime < mMaxFrameTime ? mFrameTime : mMaxFrameTime;
+    ++mFrameCount;
+}
+
+bool FrameClock::StepSimulation()
+{
+    if (mAccumulator < mFixedStep)
+        return false;
+
+    mAccumulator -= mFixedStep;
+    mSimulationTime += mFixedStep;
+    return true;
+}
+
+// ===== FramePacer =====
+
+FramePacer::FramePacer()
+    : mClock(nullptr),
+    mTargetFrameTime(0),
+    mDeadline(0),
+    mSleepMargin(MIN_SLEEP_MARGIN)
+{
+}
+
+void FramePacer::Initialize(Clock* clock, uint64_t targetFrameTime)
+{
+    mClock = clock;
+    mTargetFrameTime = targetFrameTime;
+    mDeadline = mClock->Now() + targetFrameTime;
+    mSleepMargin = MIN_SLEEP_MARGIN;
+    mStats = FramePacerStats();
+}
+
+void FramePacer::Wait()
+{
+    if (mTargetFrameTime == 0)
+        return;
+
+    ++mStats.frames;
+
+    uint64_t now = mClock->Now();
+    if (now >= mDeadline)
+    {
+        ++mStats.missed;
+        mDeadline = now + mTargetFrameTime;
+        return;
+    }
+
+    uint64_t remaining = mDeadline - now;
+    if (remaining > mSleepMargin + MIN_SLEEP)
+    {
+        uint64_t request = remaining - mSleepMargin;
+        mClock->SleepFor(request);
+
+        uint64_t woke = mClock->Now();
+        uint64_t slept = woke - now;
+        mStats.sleepTime += slept;
+
+        // Jump up to a worse oversleep at once, decay slowly when the timer
+        // does better.
+        uint64_t oversleep = slept > request ? slept - request : 0;
+        uint64_t margin = oversleep + MIN_SLEEP_MARGIN;
+        if (margin > mSleepMargin)
+            mSleepMargin = margin;
+        else
+            mSleepMargin -= (mSleepMargin - margin) / 16;
+
+        now = woke;
+    }
+
+    uint64_t spinStart = now;
+    while (now < mDeadline)
+    {
+        mClock->Pause();
+        now = mClock->Now();
+    }
+    mStats.spinTime += now - spinStart;
+
+    mDeadline += mTargetFrameTime;
+}
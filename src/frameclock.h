@@ -0,0 +1,116 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Monotonic time in nanoseconds, and a way to give up the CPU.
+class Clock
+{
+public:
+    virtual ~Clock() {}
+
+    virtual uint64_t Now() = 0;
+    // May return late, never early.
+    virtual void SleepFor(uint64_t nanoseconds) = 0;
+    // Called while waiting out the last moments before a deadline.
+    virtual void Pause() = 0;
+};
+
+// steady_clock (QPC on Windows). Sleeps on a high-resolution waitable
+// timer where the OS has one.
+class SystemClock : public Clock
+{
+public:
+    SystemClock();
+    ~SystemClock();
+
+    SystemClock(const SystemClock&) = delete;
+    SystemClock& operator=(const SystemClock&) = delete;
+
+    uint64_t Now() override;
+    void SleepFor(uint64_t nanoseconds) override;
+    void Pause() override;
+
+private:
+#if defined(_WIN32)
+    void* mTimer;
+#endif
+};
+
+static const uint64_t NANOSECONDS_PER_SECOND = 1000000000ull;
+
+// Frame timing with a fixed simulation step: Tick once per frame, run
+// StepSimulation in a loop to consume the elapsed time in whole steps,
+// then render blending the last two states by Alpha().
+class FrameClock
+{
+public:
+    FrameClock();
+
+    // A frame longer than maxFrameTime counts as maxFrameTime, so a stall
+    // does not trigger a burst of catch-up steps.
+    void Initialize(Clock* clock, uint64_t fixedStep = NANOSECONDS_PER_SECOND / 60, uint64_t maxFrameTime = NANOSECONDS_PER_SECOND / 4);
+
+    void Tick();
+    bool StepSimulation();
+
+    // Fraction of a step left in the accumulator, in [0, 1).
+    double Alpha() const { return (double)mAccumulator / mFixedStep; }
+
+    uint64_t FrameTime() const { return mFrameTime; }
+    uint64_t FixedStep() const { return mFixedStep; }
+    double FrameSeconds() const { return (double)mFrameTime / NANOSECONDS_PER_SECOND; }
+    double FixedStepSeconds() const { return (double)mFixedStep / NANOSECONDS_PER_SECOND; }
+    // Simulated time, whole steps only.
+    double SimulationSeconds() const { return (double)mSimulationTime / NANOSECONDS_PER_SECOND; }
+    uint64_t FrameCount() const { return mFrameCount; }
+
+private:
+    Clock* mClock;
+
+    uint64_t mFixedStep;
+    uint64_t mMaxFrameTime;
+
+    uint64_t mLastTick;
+    uint64_t mFrameTime;
+    uint64_t mAccumulator;
+    uint64_t mSimulationTime;
+    uint64_t mFrameCount;
+};
+
+struct FramePacerStats
+{
+    uint64_t frames = 0;
+    // Deadlines already gone when Wait was called.
+    uint64_t missed = 0;
+    uint64_t sleepTime = 0;
+    uint64_t spinTime = 0;
+};
+
+// Holds frames to a target period by sleeping instead of spinning. It
+// sleeps until shortly before each deadline and yields for the rest. The
+// margin follows the observed oversleep, so sleep accuracy adapts to the OS
+// timer.
+class FramePacer
+{
+public:
+    FramePacer();
+
+    // targetFrameTime 0 disables pacing.
+    void Initialize(Clock* clock, uint64_t targetFrameTime);
+
+    // Returns at the next deadline. Deadlines are a fixed grid, so timing
+    // error does not accumulate; after a miss the grid restarts from now.
+    void Wait();
+
+    uint64_t TargetFrameTime() const { return mTargetFrameTime; }
+    uint64_t SleepMargin() const { return mSleepMargin; }
+    const FramePacerStats& Stats() const { return mStats; }
+
+private:
+    Clock* mClock;
+    uint64_t mTargetFrameTime;
+    uint64_t mDeadline;
+    uint64_t mSleepMargin;
+
+    FramePacerStats mStats;
+};
@@ -0,0 +1,51 @@
+#include "framering.h"
+
+// ===== FrameRing =====
+
+FrameRing::FrameRing()
+    : mQueue(nullptr),
+    mFenceValue(0),
+    mFrameIndex(0),
+    mFrameNumber(0),
+    mStallCount(0)
+{
+}
+
+void FrameRing::Initialize(FrameQueue* queue, uint32_t frameCount)
+{
+    mQueue = queue;
+    mSlotFence.assign(frameCount > 0 ? frameCount : 1, 0);
+    mFenceValue = queue->CompletedValue();
+    mFrameIndex = 0;
+    mFrameNumber = 0;
+    mStallCount = 0;
+}
+
+uint32_t FrameRing::BeginFrame()
+{
+    mFrameIndex = (uint32_t)(mFrameNumber % mSlotFence.size());
+
+    uint64_t fence = mSlotFence[mFrameIndex];
+    if (mQueue->CompletedValue() < fence)
+    {
+        ++mStallCount;
+        mQueue->Wait(fence);
+    }
+
+    return mFrameIndex;
+}
+
+void FrameRing::EndFrame()
+{
+    ++mFenceValue;
+    mQueue->Signal(mFenceValue);
+
+    mSlotFence[mFrameIndex] = mFenceValue;
+    ++mFrameNumber;
+}
+
+void FrameRing::Flush()
+{
+    if (mQueue && mQueue->CompletedValue() < mFenceValue)
+        mQueue->Wait(mFenceValue);
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// The part of a GPU queue the frame ring needs: a monotonically increasing
+// fence signaled behind submitted work.
+class FrameQueue
+{
+public:
+    virtual ~FrameQueue() {}
+
+    // Signals value once all work submitted so far has finished.
+    virtual void Signal(uint64_t value) = 0;
+    virtual uint64_t CompletedValue() = 0;
+    // Blocks until CompletedValue() >= value.
+    virtual void Wait(uint64_t value) = 0;
+};
+
+// N frames in flight over one queue. Every frame slot remembers the fence
+// value signaled when it was submitted; BeginFrame only blocks when that
+// slot comes around again before the GPU has retired it.
+class FrameRing
+{
+public:
+    FrameRing();
+
+    void Initialize(FrameQueue* queue, uint32_t frameCount);
+
+    // Waits for the next slot to be free and returns its index.
+    uint32_t BeginFrame();
+    // Signals the fence for the current slot, after its work is submitted.
+    void EndFrame();
+    // Waits for every submitted frame.
+    void Flush();
+
+    uint32_t FrameIndex() const { return mFrameIndex; }
+    uint32_t FrameCount() const { return (uint32_t)mSlotFence.size(); }
+    uint64_t FrameNumber() const { return mFrameNumber; }
+
+    // Fence value EndFrame will signal for the frame being recorded.
+    uint64_t CurrentFenceValue() const { return mFenceValue + 1; }
+    uint64_t CompletedFenceValue() const { return mQueue->CompletedValue(); }
+
+    // Times BeginFrame had to block on the GPU.
+    uint64_t StallCount() const { return mStallCount; }
+
+private:
+    FrameQueue* mQueue;
+
+    std::vector<uint64_t> mSlotFence;
+    uint64_t mFenceValue;
+
+    uint32_t mFrameIndex;
+    uint64_t mFrameNumber;
+    uint64_t mStallCount;
+};
@@ -0,0 +1,206 @@
+#include "gpuheap.h"
+
+#include <algorithm>
+
+GpuMemoryPool::GpuMemoryPool()
+    : mBackend(nullptr)
+{
+}
+
+GpuMemoryPool::~GpuMemoryPool()
+{
+    Shutdown();
+}
+
+void GpuMemoryPool::Initialize(GpuHeapBackend* backend, const GpuPoolOptions& options)
+{
+    Shutdown();
+
+    mBackend = backend;
+    mOptions = options;
+
+    // Blocks must hold whole alignment classes.
+    if (mOptions.blockSize < mOptions.heapAlignment)
+        mOptions.blockSize = mOptions.heapAlignment;
+    mOptions.blockSize = mOptions.blockSize / mOptions.heapAlignment * mOptions.heapAlignment;
+}
+
+void GpuMemoryPool::Shutdown()
+{
+    for (uint32_t i = 0; i < (uint32_t)mBlocks.size(); i++)
+    {
+        if (mBlocks[i].alive)
+            mBackend->DestroyHeap(i);
+    }
+
+    mBlocks.clear();
+}
+
+bool GpuMemoryPool::AllocateFrom(uint32_t block, uint64_t size, uint64_t alignment, GpuAllocation& allocation)
+{
+    if (!mBlocks[block].alive || !mBlocks[block].allocator.Allocate(size, alignment, allocation.range))
+        return false;
+
+    allocation.block = block;
+    return true;
+}
+
+bool GpuMemoryPool::AddBlock(uint64_t size, uint32_t& block)
+{
+    // Reuse a released slot so block indices stay small.
+    block = (uint32_t)mBlocks.size();
+    for (uint32_t i = 0; i < (uint32_t)mBlocks.size(); i++)
+    {
+        if (!mBlocks[i].alive)
+        {
+            block = i;
+            break;
+        }
+    }
+
+    if (!mBackend->CreateHeap(block, size, mOptions.heapAlignment))
+        return false;
+
+    if (block == mBlocks.size())
+        mBlocks.emplace_back();
+
+    mBlocks[block].allocator.Initialize(size, mOptions.granularity);
+    mBlocks[block].alive = true;
+    return true;
+}
+
+bool GpuMemoryPool::Allocate(uint64_t size, uint64_t alignment, GpuAllocation& allocation)
+{
+    if (size == 0 || alignment > mOptions.heapAlignment)
+        return false;
+
+    // Oversized: a dedicated block, released again on Free.
+    if (size > mOptions.blockSize)
+    {
+        uint64_t dedicated = (size + mOptions.heapAlignment - 1) / mOptions.heapAlignment * mOptions.heapAlignment;
+
+        uint32_t block;
+        return AddBlock(dedicated, block) && AllocateFrom(block, size, alignment, allocation);
+    }
+
+    for (uint32_t i = 0; i < (uint32_t)mBlocks.size(); i++)
+    {
+        if (AllocateFrom(i, size, alignment, allocation))
+            return true;
+    }
+
+    uint32_t block;
+    return AddBlock(mOptions.blockSize, block) && AllocateFrom(block, size, alignment, allocation);
+}
+
+void GpuMemoryPool::Free(GpuAllocation& allocation)
+{
+    if (!allocation.Valid())
+        return;
+
+    mBlocks[allocation.block].allocator.Free(allocation.range);
+    allocation = GpuAllocation();
+
+    ReleaseEmptyBlocks();
+}
+
+void GpuMemoryPool::ReleaseEmptyBlocks()
+{
+    uint32_t empty = 0;
+    for (uint32_t i = 0; i < (uint32_t)mBlocks.size(); i++)
+    {
+        Block& b = mBlocks[i];
+        if (!b.alive || b.allocator.AllocationCount() != 0)
+            continue;
+
+        // Dedicated blocks always go; regular ones past the spare count.
+        if (b.allocator.Size() == mOptions.blockSize && empty < mOptions.maxEmptyBlocks)
+        {
+            ++empty;
+            continue;
+        }
+
+        mBackend->DestroyHeap(i);
+        b.alive = false;
+    }
+}
+
+GpuPoolStats GpuMemoryPool::Stats() const
+{
+    GpuPoolStats stats;
+    for (const Block& b : mBlocks)
+    {
+        if (!b.alive)
+            continue;
+
+        ++stats.blockCount;
+        stats.reservedBytes += b.allocator.Size();
+        stats.usedBytes += b.allocator.UsedBytes();
+        stats.allocationCount += b.allocator.AllocationCount();
+        stats.freeRegionCount += b.allocator.FreeRegionCount();
+        stats.largestFreeRegion = std::max(stats.largestFreeRegion, b.allocator.LargestFreeRegion());
+    }
+
+    return stats;
+}
+
+// ===== defragmentation =====
+
+size_t GpuMemoryPool::PlanDefragment(uint64_t maxBytes, std::vector<GpuDefragMove>& moves)
+{
+    moves.clear();
+
+    std::vector<uint32_t> order;
+    for (uint32_t i = 0; i < (uint32_t)mBlocks.size(); i++)
+    {
+        if (mBlocks[i].alive && mBlocks[i].allocator.AllocationCount() > 0)
+            order.push_back(i);
+    }
+
+    // Sparsest first: cheapest to empty.
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+    {
+        return mBlocks[a].allocator.UsedBytes() < mBlocks[b].allocator.UsedBytes();
+    });
+
+    std::vector<TlsfAllocation> allocations;
+    std::vector<bool> received(mBlocks.size(), false);
+    uint64_t planned = 0;
+
+    // Sources come off the front, destinations from the back; a block that
+    // took moves is not emptied again.
+    for (size_t s = 0; s + 1 < order.size() && !received[order[s]]; s++)
+    {
+        uint32_t source = order[s];
+        mBlocks[source].allocator.GetAllocations(allocations);
+
+        for (const TlsfAllocation& range : allocations)
+        {
+            if (planned + range.size > maxBytes)
+                return moves.size();
+
+            GpuDefragMove move;
+            move.source.block = source;
+            move.source.range = range;
+
+            bool placed = false;
+            for (size_t d = order.size(); d-- > s + 1 && !placed;)
+                placed = AllocateFrom(order[d], range.size, range.alignment, move.destination);
+
+            if (!placed)
+                continue;
+
+            received[move.destination.block] = true;
+            moves.push_back(move);
+            planned += range.size;
+        }
+    }
+
+    return moves.size();
+}
+
+void GpuMemoryPool::CompleteMove(const GpuDefragMove& move)
+{
+    GpuAllocation source = move.source;
+    Free(source);
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "tlsf.h"
+
+// D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT and the MSAA one.
+static const uint64_t GPU_HEAP_ALIGNMENT_64KB = 64ull * 1024;
+static const uint64_t GPU_HEAP_ALIGNMENT_4MB = 4ull * 1024 * 1024;
+
+// Creates and destroys the memory blocks a GpuMemoryPool places into
+// (ID3D12Heap for D3D12). Blocks are identified by index.
+class GpuHeapBackend
+{
+public:
+    virtual ~GpuHeapBackend() {}
+
+    virtual bool CreateHeap(uint32_t block, uint64_t size, uint64_t alignment) = 0;
+    virtual void DestroyHeap(uint32_t block) = 0;
+};
+
+struct GpuPoolOptions
+{
+    uint64_t blockSize = 64ull * 1024 * 1024;
+    // Smallest unit handed out; placed buffers need 64KB anyway.
+    uint64_t granularity = GPU_HEAP_ALIGNMENT_64KB;
+    // Largest alignment class the pool serves; heaps are created with it.
+    uint64_t heapAlignment = GPU_HEAP_ALIGNMENT_4MB;
+    // Empty blocks kept around instead of released.
+    uint32_t maxEmptyBlocks = 1;
+};
+
+struct GpuAllocation
+{
+    uint32_t block = TLSF_INVALID;
+    TlsfAllocation range;
+
+    uint64_t Offset() const { return range.offset; }
+    uint64_t Size() const { return range.size; }
+    bool Valid() const { return block != TLSF_INVALID; }
+};
+
+struct GpuPoolStats
+{
+    uint32_t blockCount = 0;
+    uint64_t reservedBytes = 0;
+    uint64_t usedBytes = 0;
+    uint32_t allocationCount = 0;
+    uint32_t freeRegionCount = 0;
+    uint64_t largestFreeRegion = 0;
+
+    // 0 when all free space is one region, towards 1 as it scatters.
+    double Fragmentation() const
+    {
+        uint64_t freeBytes = reservedBytes - usedBytes;
+        return freeBytes > 0 ? 1.0 - (double)largestFreeRegion / freeBytes : 0.0;
+    }
+};
+
+// A move planned by GpuMemoryPool::PlanDefragment: destination is already
+// reserved. The caller recreates the resource there, copies the data, then
+// calls CompleteMove and switches its handle to destination.
+struct GpuDefragMove
+{
+    GpuAllocation source;
+    GpuAllocation destination;
+};
+
+// Sub-allocates resources out of large heap blocks, one TLSF allocator per
+// block. Requests bigger than a block get a dedicated block of their own.
+class GpuMemoryPool
+{
+public:
+    GpuMemoryPool();
+    ~GpuMemoryPool();
+
+    void Initialize(GpuHeapBackend* backend, const GpuPoolOptions& options = GpuPoolOptions());
+    // Destroys every block; outstanding allocations become invalid.
+    void Shutdown();
+
+    bool Allocate(uint64_t size, uint64_t alignment, GpuAllocation& allocation);
+    void Free(GpuAllocation& allocation);
+
+    GpuPoolStats Stats() const;
+
+    // Plans moves that empty the sparsest blocks into fuller ones, up to
+    // maxBytes of copies. Never creates blocks to do so.
+    size_t PlanDefragment(uint64_t maxBytes, std::vector<GpuDefragMove>& moves);
+    void CompleteMove(const GpuDefragMove& move);
+
+private:
+    struct Block
+    {
+        TlsfAllocator allocator;
+        bool alive = false;
+    };
+
+    bool AllocateFrom(uint32_t block, uint64_t size, uint64_t alignment, GpuAllocation& allocation);
+    bool AddBlock(uint64_t size, uint32_t& block);
+    void ReleaseEmptyBlocks();
+
+    GpuHeapBackend* mBackend;
+    GpuPoolOptions mOptions;
+
+    std::vector<Block> mBlocks;
+};
@@ -0,0 +1,116 @@
+#include "hash.h"
+
+#include <cstring>
+
+namespace
+{
+    constexpr uint64_t P1 = 0x9E3779B185EBCA87ull;
+    constexpr uint64_t P2 = 0xC2B2AE3D27D4EB4Full;
+    constexpr uint64_t P3 = 0x165667B19E3779F9ull;
+    constexpr uint64_t P4 = 0x85EBCA77C2B2AE63ull;
+    constexpr uint64_t P5 = 0x27D4EB2F165667C5ull;
+
+    inline uint64_t Rotl(uint64_t x, int r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    inline uint64_t Read64(const uint8_t* p)
+    {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint32_t Read32(const uint8_t* p)
+    {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint64_t Round(uint64_t acc, uint64_t input)
+    {
+        acc += input * P2;
+        acc = Rotl(acc, 31);
+        return acc * P1;
+    }
+
+    inline uint64_t MergeRound(uint64_t acc, uint64_t val)
+    {
+        acc ^= Round(0, val);
+        return acc * P1 + P4;
+    }
+}
+
+uint64_t Hash64(const void* data, size_t size, uint64_t seed)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    const uint8_t* end = p + size;
+    uint64_t h;
+
+    // ===== 32-byte stripes, four independent lanes =====
+    if (size >= 32)
+    {
+        uint64_t v1 = seed + P1 + P2;
+        uint64_t v2 = seed + P2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - P1;
+
+        const uint8_t* limit = end - 32;
+        do
+        {
+            v1 = Round(v1, Read64(p));
+            v2 = Round(v2, Read64(p + 8));
+            v3 = Round(v3, Read64(p + 16));
+            v4 = Round(v4, Read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) + Rotl(v4, 18);
+        h = MergeRound(h, v1);
+        h = MergeRound(h, v2);
+        h = MergeRound(h, v3);
+        h = MergeRound(h, v4);
+    }
+    else
+    {
+        h = seed + P5;
+    }
+
+    h += (uint64_t)size;
+
+    // ===== tail =====
+    while (p + 8 <= end)
+    {
+        h ^= Round(0, Read64(p));
+        h = Rotl(h, 27) * P1 + P4;
+        p += 8;
+    }
+
+    if (p + 4 <= end)
+    {
+        h ^= (uint64_t)Read32(p) * P1;
+        h = Rotl(h, 23) * P2 + P3;
+        p += 4;
+    }
+
+    while (p < end)
+    {
+        h ^= (uint64_t)(*p) * P5;
+        h = Rotl(h, 11) * P1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t HashCombine(uint64_t hash, uint64_t value)
+{
+    return Hash64(&value, sizeof(value), hash);
+}
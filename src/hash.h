@@ -0,0 +1,9 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// 64-bit non-cryptographic content hash (XXH64).
+uint64_t Hash64(const void* data, size_t size, uint64_t seed = 0);
+
+// Folds a value into a running hash, for hashing option structs field by field.
+uint64_t HashCombine(uint64_t hash, uint64_t value);
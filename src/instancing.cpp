@@ -0,0 +1,87 @@
+#include "instancing.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace DirectX;
+
+InstanceBatcher::InstanceBatcher()
+    : mInstanceCount(0)
+{
+}
+
+MeshHandle InstanceBatcher::RegisterMesh(const InstancedMesh& mesh)
+{
+    mMeshes.push_back(mesh);
+    mInstances.emplace_back();
+    return (MeshHandle)(mMeshes.size() - 1);
+}
+
+void InstanceBatcher::Reserve(MeshHandle mesh, size_t instanceCount)
+{
+    mInstances[mesh].reserve(instanceCount);
+}
+
+void InstanceBatcher::Clear()
+{
+    for (std::vector<InstanceData>& instances : mInstances)
+        instances.clear();
+
+    mInstanceCount = 0;
+}
+
+void InstanceBatcher::Add(MeshHandle mesh, const XMFLOAT4X4& world, const XMFLOAT4& color)
+{
+    std::vector<InstanceData>& instances = mInstances[mesh];
+    instances.emplace_back();
+    InstanceData& instance = instances.back();
+
+    // Row-vector matrices, as the shaders use them: column i is row i of
+    // the transpose.
+    for (int i = 0; i < 3; i++)
+        instance.world[i] = XMFLOAT4(world.m[0][i], world.m[1][i], world.m[2][i], world.m[3][i]);
+    instance.color = color;
+
+    ++mInstanceCount;
+}
+
+void InstanceBatcher::Build(InstanceData* dst, std::vector<InstanceDraw>& draws, JobSystem* jobs)
+{
+    draws.clear();
+
+    uint32_t first = 0;
+    for (size_t m = 0; m < mMeshes.size(); m++)
+    {
+        const std::vector<InstanceData>& instances = mInstances[m];
+        if (instances.empty())
+            continue;
+
+        draws.push_back({ (MeshHandle)m, first, (uint32_t)instances.size() });
+        first += (uint32_t)instances.size();
+    }
+
+    if (!jobs)
+    {
+        for (const InstanceDraw& draw : draws)
+            memcpy(dst + draw.firstInstance, mInstances[draw.mesh].data(), draw.instanceCount * sizeof(InstanceData));
+        return;
+    }
+
+    // Chunks over the whole output, so one big mesh still splits.
+    jobs->ParallelFor(mInstanceCount, BuildGrain, [&](size_t begin, size_t end)
+    {
+        auto it = std::upper_bound(draws.begin(), draws.end(), begin, [](size_t i, const InstanceDraw& draw)
+        {
+            return i < draw.firstInstance;
+        }) - 1;
+
+        while (begin < end)
+        {
+            size_t offset = begin - it->firstInstance;
+            size_t count = std::min<size_t>(end - begin, it->instanceCount - offset);
+            memcpy(dst + begin, mInstances[it->mesh].data() + offset, count * sizeof(InstanceData));
+            begin += count;
+            ++it;
+        }
+    });
+}
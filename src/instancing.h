@@ -0,0 +1,91 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "constants.h"
+#include "jobs.h"
+
+typedef uint32_t MeshHandle;
+
+// Index range of a registered mesh inside the shared buffers.
+struct InstancedMesh
+{
+    uint32_t indexCount;
+    uint32_t startIndex;
+    int32_t baseVertex;
+};
+
+// One DrawIndexedInstanced: count instances of mesh starting at
+// firstInstance in the instance buffer.
+struct InstanceDraw
+{
+    MeshHandle mesh;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+};
+
+// Collects instances for one frame, one list per mesh, so every mesh is
+// drawn with a single call however many copies there are. Lists keep their
+// storage between frames; once a frame's count has been seen Add does not
+// allocate.
+class InstanceBatcher
+{
+public:
+    InstanceBatcher();
+
+    MeshHandle RegisterMesh(const InstancedMesh& mesh);
+    const InstancedMesh& Mesh(MeshHandle mesh) const { return mMeshes[mesh]; }
+    size_t MeshCount() const { return mMeshes.size(); }
+
+    void Reserve(MeshHandle mesh, size_t instanceCount);
+    void Clear();
+
+    void Add(MeshHandle mesh, const DirectX::XMFLOAT4X4& world, const DirectX::XMFLOAT4& color);
+
+    size_t InstanceCount() const { return mInstanceCount; }
+    // The instances of mesh added this frame, in order.
+    const std::vector<InstanceData>& Instances(MeshHandle mesh) const { return mInstances[mesh]; }
+    size_t InstanceBytes() const { return mInstanceCount * sizeof(InstanceData); }
+
+    // Writes InstanceCount() instances into dst, mesh after mesh in
+    // registration order, and the matching draws. With jobs the copy is
+    // split across workers.
+    void Build(InstanceData* dst, std::vector<InstanceDraw>& draws, JobSystem* jobs = nullptr);
+
+    // Drops the instances for which keep(mesh, instance) is false, keeping
+    // the order of the rest. Returns how many were dropped.
+    template <typename Fn>
+    size_t Filter(Fn keep);
+
+private:
+    // Instances per copy job; 256KB.
+    static const size_t BuildGrain = 4096;
+
+    std::vector<InstancedMesh> mMeshes;
+    std::vector<std::vector<InstanceData>> mInstances;
+    size_t mInstanceCount;
+};
+
+template <typename Fn>
+size_t InstanceBatcher::Filter(Fn keep)
+{
+    size_t dropped = 0;
+    for (size_t m = 0; m < mInstances.size(); m++)
+    {
+        std::vector<InstanceData>& instances = mInstances[m];
+
+        size_t n = 0;
+        for (size_t i = 0; i < instances.size(); i++)
+        {
+            if (keep((MeshHandle)m, instances[i]))
+                instances[n++] = instances[i];
+        }
+
+        dropped += instances.size() - n;
+        instances.resize(n);
+    }
+
+    mInstanceCount -= dropped;
+    return dropped;
+}
@@ -0,0 +1,451 @@
+#include "jobs.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define JOBS_PAUSE() _mm_pause()
+#else
+#define JOBS_PAUSE() std::this_thread::yield()
+#endif
+
+namespace
+{
+    // Failed searches before a worker goes to sleep.
+    constexpr int IDLE_SPINS = 64;
+
+    struct ThreadWorker
+    {
+        const JobSystem* system = nullptr;
+        unsigned index = 0;
+    };
+
+    thread_local ThreadWorker tWorker;
+}
+
+// ===== JobCounter =====
+
+JobCounter::~JobCounter()
+{
+    // Left only by a counter destroyed while jobs were pending.
+    while (mContinuations)
+    {
+        JobContinuation* next = mContinuations->next;
+        delete mContinuations;
+        mContinuations = next;
+    }
+}
+
+// ===== WorkDeque =====
+
+JobSystem::WorkDeque::WorkDeque()
+    : mTop(0),
+    mBottom(0)
+{
+    for (int64_t i = 0; i < CAPACITY; i++)
+        mItems[i].store(nullptr, std::memory_order_relaxed);
+}
+
+// Owner only.
+bool JobSystem::WorkDeque::Push(Job* job)
+{
+    int64_t b = mBottom.load(std::memory_order_relaxed);
+    int64_t t = mTop.load(std::memory_order_acquire);
+    if (b - t >= CAPACITY)
+        return false;
+
+    // A release store rather than a fence, which thread sanitizers see.
+    mItems[b & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+    mBottom.store(b + 1, std::memory_order_release);
+    return true;
+}
+
+// Owner only; races thieves for the last item.
+JobSystem::Job* JobSystem::WorkDeque::Pop()
+{
+    int64_t b = mBottom.load(std::memory_order_relaxed) - 1;
+    mBottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = mTop.load(std::memory_order_relaxed);
+
+    if (t > b)
+    {
+        mBottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job* job = mItems[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (t == b)
+    {
+        if (!mTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            job = nullptr;
+        mBottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    return job;
+}
+
+// Any thread.
+JobSystem::Job* JobSystem::WorkDeque::Steal()
+{
+    int64_t t = mTop.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = mBottom.load(std::memory_order_acquire);
+    if (t >= b)
+        return nullptr;
+
+    Job* job = mItems[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (!mTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+
+    return job;
+}
+
+// ===== JobSystem =====
+
+JobSystem::JobSystem()
+    : mExternalCount(0),
+    mWork(0),
+    mSleeping(0),
+    mRunning(false)
+{
+}
+
+JobSystem::~JobSystem()
+{
+    Shutdown();
+}
+
+void JobSystem::Initialize(unsigned threadCount)
+{
+    Shutdown();
+
+    if (threadCount == 0)
+        threadCount = std::thread::hardware_concurrency();
+    if (threadCount == 0)
+        threadCount = 1;
+
+    mWorkers.clear();
+    for (unsigned i = 0; i < threadCount; i++)
+    {
+        mWorkers.push_back(std::make_unique<Worker>());
+        mWorkers[i]->random = 0x9E3779B9u * (i + 1);
+        for (Job& job : mWorkers[i]->jobs)
+            job.busy.store(false, std::memory_order_relaxed);
+    }
+
+    mRunning.store(true);
+
+    tWorker.system = this;
+    tWorker.index = 0;
+
+    for (unsigned i = 1; i < threadCount; i++)
+        mWorkers[i]->thread = std::thread(&JobSystem::WorkerMain, this, i);
+}
+
+void JobSystem::Shutdown()
+{
+    if (!mRunning.exchange(false))
+        return;
+
+    WakeWorkers();
+
+    for (std::unique_ptr<Worker>& worker : mWorkers)
+    {
+        if (worker->thread.joinable())
+            worker->thread.join();
+    }
+
+    if (tWorker.system == this)
+        tWorker = ThreadWorker();
+
+    mWorkers.clear();
+    mExternal.clear();
+    mExternalCount.store(0);
+}
+
+unsigned JobSystem::CurrentWorker() const
+{
+    return tWorker.system == this ? tWorker.index : ThreadCount();
+}
+
+void JobSystem::Submit(JobCounter& counter, void (*run)(const void*), const void* payload, size_t size)
+{
+    counter.mState.fetch_add(1, std::memory_order_relaxed);
+    Enqueue(counter, run, payload, size);
+}
+
+void JobSystem::Enqueue(JobCounter& counter, void (*run)(const void*), const void* payload, size_t size)
+{
+    unsigned index = CurrentWorker();
+    if (index < ThreadCount())
+    {
+        Worker& worker = *mWorkers[index];
+
+        // A ring slot still running means the worker is far ahead of the
+        // rest; run inline instead of waiting for it.
+        Job* job = &worker.jobs[worker.nextJob & (WorkDeque::CAPACITY - 1)];
+        if (job->busy.load(std::memory_order_acquire))
+        {
+            ++worker.inlined;
+            run(payload);
+            Complete(counter);
+            return;
+        }
+
+        job->run = run;
+        job->counter = &counter;
+        job->busy.store(true, std::memory_order_relaxed);
+        memcpy(job->payload, payload, size);
+
+        if (!worker.deque.Push(job))
+        {
+            ++worker.inlined;
+            Execute(job, index);
+            return;
+        }
+
+        ++worker.nextJob;
+    }
+    else
+    {
+        ExternalJob job;
+        job.run = run;
+        job.counter = &counter;
+        memcpy(job.payload, payload, size);
+
+        std::lock_guard<std::mutex> lock(mExternalMutex);
+        mExternal.push_back(job);
+        mExternalCount.fetch_add(1, std::memory_order_release);
+    }
+
+    mWork.fetch_add(1, std::memory_order_release);
+    if (mSleeping.load(std::memory_order_acquire) > 0)
+    {
+        std::lock_guard<std::mutex> lock(mSleepMutex);
+        mSleepCondition.notify_one();
+    }
+}
+
+void JobSystem::Complete(JobCounter& counter)
+{
+    uint64_t state = counter.mState.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        if ((state & JobCounter::PENDING_MASK) != 1)
+        {
+            if (counter.mState.compare_exchange_weak(state, state - 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+                return;
+            continue;
+        }
+
+        // The last job: lock, take the continuations, and unlock with the
+        // count at zero in one step. A job spawned meanwhile keeps the
+        // counter alive; put the list back and go around again.
+        if (state & JobCounter::LOCKED)
+        {
+            JOBS_PAUSE();
+            state = counter.mState.load(std::memory_order_relaxed);
+            continue;
+        }
+
+        if (!counter.mState.compare_exchange_weak(state, state | JobCounter::LOCKED, std::memory_order_acquire, std::memory_order_relaxed))
+            continue;
+
+        JobContinuation* continuations = counter.mContinuations;
+        counter.mContinuations = nullptr;
+
+        uint64_t locked = state | JobCounter::LOCKED;
+        if (counter.mState.compare_exchange_strong(locked, 0, std::memory_order_acq_rel, std::memory_order_relaxed))
+        {
+            while (continuations)
+            {
+                JobContinuation* next = continuations->next;
+                Enqueue(*continuations->counter, continuations->run, continuations->payload, JOB_PAYLOAD);
+                delete continuations;
+                continuations = next;
+            }
+            return;
+        }
+
+        counter.mContinuations = continuations;
+        state = counter.mState.fetch_and(~JobCounter::LOCKED, std::memory_order_release) & ~JobCounter::LOCKED;
+    }
+}
+
+bool JobSystem::AddContinuation(JobCounter& dependency, JobContinuation* continuation)
+{
+    uint64_t state = dependency.mState.load(std::memory_order_acquire);
+    for (;;)
+    {
+        if ((state & JobCounter::PENDING_MASK) == 0)
+            return false;
+
+        if (state & JobCounter::LOCKED)
+        {
+            JOBS_PAUSE();
+            state = dependency.mState.load(std::memory_order_acquire);
+            continue;
+        }
+
+        if (dependency.mState.compare_exchange_weak(state, state | JobCounter::LOCKED, std::memory_order_acquire, std::memory_order_acquire))
+            break;
+    }
+
+    continuation->next = dependency.mContinuations;
+    dependency.mContinuations = continuation;
+    dependency.mState.fetch_and(~JobCounter::LOCKED, std::memory_order_release);
+    return true;
+}
+
+void JobSystem::Execute(Job* job, unsigned worker)
+{
+    JobCounter* counter = job->counter;
+    job->run(job->payload);
+    job->busy.store(false, std::memory_order_release);
+
+    if (worker < ThreadCount())
+        ++mWorkers[worker]->executed;
+
+    Complete(*counter);
+}
+
+bool JobSystem::RunOne(unsigned worker)
+{
+    unsigned count = ThreadCount();
+
+    if (worker < count)
+    {
+        if (Job* job = mWorkers[worker]->deque.Pop())
+        {
+            Execute(job, worker);
+            return true;
+        }
+    }
+
+    if (mExternalCount.load(std::memory_order_acquire) > 0)
+    {
+        ExternalJob job;
+        bool found = false;
+        {
+            std::lock_guard<std::mutex> lock(mExternalMutex);
+            if (!mExternal.empty())
+            {
+                job = mExternal.front();
+                mExternal.pop_front();
+                mExternalCount.fetch_sub(1, std::memory_order_relaxed);
+                found = true;
+            }
+        }
+
+        if (found)
+        {
+            job.run(job.payload);
+            if (worker < count)
+                ++mWorkers[worker]->executed;
+            Complete(*job.counter);
+            return true;
+        }
+    }
+
+    // Steal, starting from a random victim.
+    uint32_t start = 0;
+    if (worker < count)
+    {
+        uint32_t& random = mWorkers[worker]->random;
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        start = random;
+    }
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        unsigned victim = (start + i) % count;
+        if (victim == worker)
+            continue;
+
+        if (Job* job = mWorkers[victim]->deque.Steal())
+        {
+            if (worker < count)
+                ++mWorkers[worker]->steals;
+            Execute(job, worker);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+    unsigned worker = CurrentWorker();
+    while (!counter.Done())
+    {
+        if (!RunOne(worker))
+            JOBS_PAUSE();
+    }
+}
+
+void JobSystem::WorkerMain(unsigned worker)
+{
+    tWorker.system = this;
+    tWorker.index = worker;
+
+    int idle = 0;
+    while (mRunning.load(std::memory_order_acquire))
+    {
+        uint64_t work = mWork.load(std::memory_order_acquire);
+
+        if (RunOne(worker))
+        {
+            idle = 0;
+            continue;
+        }
+
+        if (++idle < IDLE_SPINS)
+        {
+            JOBS_PAUSE();
+            continue;
+        }
+
+        // Sleep until something is spawned after the search above began.
+        std::unique_lock<std::mutex> lock(mSleepMutex);
+        mSleeping.fetch_add(1, std::memory_order_acq_rel);
+        mSleepCondition.wait(lock, [&]
+        {
+            return mWork.load(std::memory_order_acquire) != work || !mRunning.load(std::memory_order_acquire);
+        });
+        mSleeping.fetch_sub(1, std::memory_order_acq_rel);
+        idle = 0;
+    }
+
+    tWorker = ThreadWorker();
+}
+
+void JobSystem::WakeWorkers()
+{
+    std::lock_guard<std::mutex> lock(mSleepMutex);
+    mWork.fetch_add(1, std::memory_order_release);
+    mSleepCondition.notify_all();
+}
+
+JobStats JobSystem::Stats() const
+{
+    JobStats stats;
+    for (const std::unique_ptr<Worker>& worker : mWorkers)
+    {
+        stats.executed += worker->executed.load(std::memory_order_relaxed);
+        stats.steals += worker->steals.load(std::memory_order_relaxed);
+        stats.inlined += worker->inlined.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+void JobSystem::ResetStats()
+{
+    for (std::unique_ptr<Worker>& worker : mWorkers)
+    {
+        worker->executed.store(0, std::memory_order_relaxed);
+        worker->steals.store(0, std::memory_order_relaxed);
+        worker->inlined.store(0, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,255 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+struct JobContinuation;
+
+// Jobs left to finish; Spawn adds one, completion removes it. Jobs queued
+// by SpawnAfter wait on the counter itself and are submitted by whichever
+// job brings it to zero. A counter must outlive its continuations.
+class JobCounter
+{
+public:
+    JobCounter() : mState(0), mContinuations(nullptr) {}
+    ~JobCounter();
+
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    bool Done() const { return (mState.load(std::memory_order_acquire) & PENDING_MASK) == 0; }
+
+private:
+    friend class JobSystem;
+
+    // The pending count, and a lock bit over mContinuations. The job that
+    // takes the count to zero clears both in one step, so it never touches
+    // a counter that a waiter may already have destroyed.
+    static constexpr uint64_t PENDING_MASK = 0xFFFFFFFFull;
+    static constexpr uint64_t LOCKED = 1ull << 32;
+
+    std::atomic<uint64_t> mState;
+    JobContinuation* mContinuations;
+};
+
+struct JobStats
+{
+    uint64_t executed = 0;
+    // Jobs taken from another worker's deque.
+    uint64_t steals = 0;
+    // Spawns that ran inline because the worker's queue was full.
+    uint64_t inlined = 0;
+};
+
+// Work-stealing scheduler. Every worker owns a Chase-Lev deque: it pushes
+// and pops at the bottom, idle workers steal from the top. Jobs are small
+// trivially copyable callables stored in a per-worker ring, so spawning
+// does not allocate. Waiting on a counter runs other jobs instead of
+// blocking, which also makes nested waits inside jobs safe.
+//
+// The thread that calls Initialize is worker 0. Other threads may spawn and
+// wait too; their jobs go through a shared queue.
+class JobSystem
+{
+public:
+    static const size_t JOB_PAYLOAD = 48;
+
+    JobSystem();
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // threadCount 0 picks one worker per hardware thread.
+    void Initialize(unsigned threadCount = 0);
+    void Shutdown();
+
+    unsigned ThreadCount() const { return (unsigned)mWorkers.size(); }
+    // Worker index of the calling thread, or ThreadCount() for others.
+    unsigned CurrentWorker() const;
+
+    template <typename Fn>
+    void Spawn(JobCounter& counter, Fn fn);
+
+    // Runs fn once dependency is done, as a job counted by counter. Nothing
+    // waits: fn is kept on dependency, allocated, until its last job ends.
+    // A dependency already done submits fn right away.
+    template <typename Fn>
+    void SpawnAfter(JobCounter& dependency, JobCounter& counter, Fn fn);
+
+    // Executes other jobs until counter is done.
+    void Wait(JobCounter& counter);
+
+    // fn(begin, end) over [0, count) in chunks of at least grain.
+    template <typename Fn>
+    void ParallelFor(size_t count, size_t grain, Fn fn);
+
+    JobStats Stats() const;
+    void ResetStats();
+
+private:
+    struct alignas(64) Job
+    {
+        void (*run)(const void* payload);
+        JobCounter* counter;
+        // Ring slot in use; cleared once the job has run.
+        std::atomic<bool> busy;
+        alignas(16) unsigned char payload[JOB_PAYLOAD];
+    };
+
+    // Chase-Lev deque of fixed capacity.
+    class WorkDeque
+    {
+    public:
+        static const int64_t CAPACITY = 1024;
+
+        WorkDeque();
+
+        bool Push(Job* job);
+        Job* Pop();
+        Job* Steal();
+
+    private:
+        std::atomic<int64_t> mTop;
+        std::atomic<int64_t> mBottom;
+        std::atomic<Job*> mItems[CAPACITY];
+    };
+
+    struct alignas(64) Worker
+    {
+        WorkDeque deque;
+        Job jobs[WorkDeque::CAPACITY];
+        uint32_t nextJob = 0;
+        uint32_t random = 0;
+
+        std::atomic<uint64_t> executed{ 0 };
+        std::atomic<uint64_t> steals{ 0 };
+        std::atomic<uint64_t> inlined{ 0 };
+
+        std::thread thread;
+    };
+
+    // Jobs from threads that are not workers, by value.
+    struct ExternalJob
+    {
+        void (*run)(const void* payload);
+        JobCounter* counter;
+        alignas(16) unsigned char payload[JOB_PAYLOAD];
+    };
+
+    template <typename Fn>
+    static void Run(const void* payload)
+    {
+        (*(const Fn*)payload)();
+    }
+
+    void Submit(JobCounter& counter, void (*run)(const void*), const void* payload, size_t size);
+    // Submit for a job counter already counts.
+    void Enqueue(JobCounter& counter, void (*run)(const void*), const void* payload, size_t size);
+    // Ends one job of counter, submitting its continuations at zero.
+    void Complete(JobCounter& counter);
+    // False when dependency is already done.
+    bool AddContinuation(JobCounter& dependency, JobContinuation* continuation);
+    void Execute(Job* job, unsigned worker);
+    bool RunOne(unsigned worker);
+    void WorkerMain(unsigned worker);
+    void WakeWorkers();
+
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+
+    std::mutex mExternalMutex;
+    std::deque<ExternalJob> mExternal;
+    std::atomic<size_t> mExternalCount;
+
+    // Idle workers sleep until mWork changes.
+    std::mutex mSleepMutex;
+    std::condition_variable mSleepCondition;
+    std::atomic<uint64_t> mWork;
+    std::atomic<unsigned> mSleeping;
+    std::atomic<bool> mRunning;
+};
+
+// A SpawnAfter job parked on its dependency.
+struct JobContinuation
+{
+    void (*run)(const void* payload);
+    JobCounter* counter;
+    JobContinuation* next;
+    alignas(16) unsigned char payload[JobSystem::JOB_PAYLOAD];
+};
+
+template <typename Fn>
+void JobSystem::Spawn(JobCounter& counter, Fn fn)
+{
+    static_assert(sizeof(Fn) <= JOB_PAYLOAD, "Job captures too much, capture a pointer instead");
+    static_assert(alignof(Fn) <= 16, "Job capture alignment too large");
+    static_assert(std::is_trivially_copyable<Fn>::value, "Jobs are copied bytewise, captures must be trivially copyable");
+
+    Submit(counter, &Run<Fn>, &fn, sizeof(Fn));
+}
+
+template <typename Fn>
+void JobSystem::SpawnAfter(JobCounter& dependency, JobCounter& counter, Fn fn)
+{
+    static_assert(sizeof(Fn) <= JOB_PAYLOAD, "Job captures too much, capture a pointer instead");
+    static_assert(alignof(Fn) <= 16, "Job capture alignment too large");
+    static_assert(std::is_trivially_copyable<Fn>::value, "Jobs are copied bytewise, captures must be trivially copyable");
+
+    // Counted from here, so waiting on counter covers the time parked.
+    counter.mState.fetch_add(1, std::memory_order_relaxed);
+
+    JobContinuation* continuation = new JobContinuation;
+    continuation->run = &Run<Fn>;
+    continuation->counter = &counter;
+    continuation->next = nullptr;
+    memcpy(continuation->payload, &fn, sizeof(Fn));
+
+    if (!AddContinuation(dependency, continuation))
+    {
+        Enqueue(counter, continuation->run, continuation->payload, sizeof(Fn));
+        delete continuation;
+    }
+}
+
+template <typename Fn>
+void JobSystem::ParallelFor(size_t count, size_t grain, Fn fn)
+{
+    if (count == 0)
+        return;
+
+    if (grain == 0)
+        grain = 1;
+
+    // A few chunks per worker leaves room to balance by stealing.
+    size_t chunks = (size_t)ThreadCount() * 4;
+    size_t chunk = (count + chunks - 1) / chunks;
+    if (chunk < grain)
+        chunk = grain;
+
+    if (chunk >= count || ThreadCount() <= 1)
+    {
+        fn((size_t)0, count);
+        return;
+    }
+
+    const Fn* body = &fn;
+    JobCounter counter;
+
+    for (size_t begin = chunk; begin < count; begin += chunk)
+    {
+        size_t end = begin + chunk < count ? begin + chunk : count;
+        Spawn(counter, [body, begin, end]() { (*body)(begin, end); });
+    }
+
+    // The first chunk runs here, then this thread helps with the rest.
+    fn((size_t)0, chunk);
+    Wait(counter);
+}
@@ -0,0 +1,196 @@
+#include "mappedfile.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+    : mData(nullptr),
+    mSize(0)
+#if defined(_WIN32)
+    , mFile(INVALID_HANDLE_VALUE),
+    mMapping(nullptr)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+#if defined(_WIN32)
+
+bool MappedFile::Open(const std::string& path)
+{
+    Close();
+
+    mFile = CreateFileA(
+        path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+        nullptr
+    );
+
+    if (mFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size = {};
+    if (!GetFileSizeEx(mFile, &size))
+    {
+        Close();
+        return false;
+    }
+
+    mSize = (size_t)size.QuadPart;
+
+    // ===== empty files cannot be mapped =====
+    if (mSize == 0)
+        return true;
+
+    mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mMapping)
+    {
+        Close();
+        return false;
+    }
+
+    mData = (const char*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+    if (!mData)
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (mData)
+        UnmapViewOfFile(mData);
+
+    if (mMapping)
+        CloseHandle(mMapping);
+
+    if (mFile != INVALID_HANDLE_VALUE)
+        CloseHandle(mFile);
+
+    mData = nullptr;
+    mSize = 0;
+    mMapping = nullptr;
+    mFile = INVALID_HANDLE_VALUE;
+}
+
+void MappedFile::Evict(const void* data, size_t size) const
+{
+    const char* begin = (const char*)data;
+    const char* end = begin + size;
+    if (begin < mData)
+        begin = mData;
+    if (end > mData + mSize)
+        end = mData + mSize;
+    if (begin >= end)
+        return;
+
+    // Unlocking pages that were never locked removes them from the
+    // working set; the call then reports an error, which is expected.
+    VirtualUnlock((LPVOID)begin, (SIZE_T)(end - begin));
+}
+
+#else
+
+bool MappedFile::Open(const std::string& path)
+{
+    Close();
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st = {};
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    mSize = (size_t)st.st_size;
+
+    // ===== empty files cannot be mapped =====
+    if (mSize == 0)
+    {
+        close(fd);
+        return true;
+    }
+
+    void* data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        mSize = 0;
+        return false;
+    }
+
+    madvise(data, mSize, MADV_SEQUENTIAL);
+    mData = (const char*)data;
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (mData)
+        munmap((void*)mData, mSize);
+
+    mData = nullptr;
+    mSize = 0;
+}
+
+void MappedFile::Evict(const void* data, size_t size) const
+{
+    const char* begin = (const char*)data;
+    const char* end = begin + size;
+    if (begin < mData)
+        begin = mData;
+    if (end > mData + mSize)
+        end = mData + mSize;
+    if (begin >= end)
+        return;
+
+    // The mapping is private and never written, so dropped pages come
+    // back from the file unchanged.
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t first = (uintptr_t)begin & ~(page - 1);
+    uintptr_t last = ((uintptr_t)end + page - 1) & ~(page - 1);
+    madvise((void*)first, last - first, MADV_DONTNEED);
+}
+
+#endif
+
+std::string TemporaryPath(const std::string& path)
+{
+    static std::atomic<uint32_t> sequence(0);
+
+#if defined(_WIN32)
+    unsigned long pid = GetCurrentProcessId();
+#else
+    unsigned long pid = (unsigned long)getpid();
+#endif
+
+    char suffix[48];
+    snprintf(suffix, sizeof(suffix), ".%lu.%u.tmp", pid, sequence.fetch_add(1, std::memory_order_relaxed));
+    return path + suffix;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// A name next to path to write a file under before renaming it over path.
+// Unique per process and call, so concurrent writers never share one.
+std::string TemporaryPath(const std::string& path);
+
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const std::string& path);
+    void Close();
+
+    const char* Data() const { return mData; }
+    size_t Size() const { return mSize; }
+
+    // Drops the pages under [data, data + size) from the working set; they
+    // are read back from the file when touched again. Pages the range only
+    // partly covers go too. Parts outside the mapping are ignored.
+    void Evict(const void* data, size_t size) const;
+
+private:
+    const char* mData;
+    size_t mSize;
+
+#if defined(_WIN32)
+    void* mFile;
+    void* mMapping;
+#endif
+};
@@ -0,0 +1,428 @@
+#include "meshcache.h"
+#include "parcer.h"
+#include "meshopt.h"
+#include "meshstream.h"
+#include "hash.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+using namespace DirectX;
+
+namespace
+{
+    constexpr char MESH_MAGIC[4] = { 'M', 'E', 'S', 'H' };
+
+    // Bump whenever the file layout or the loader output changes.
+    constexpr uint32_t MESH_VERSION = 4;
+
+    constexpr uint64_t SECTION_ALIGNMENT = 4096;
+
+    struct Section
+    {
+        uint64_t offset;
+        uint64_t count;
+    };
+
+    struct MeshFileHeader
+    {
+        char magic[4];
+        uint32_t version;
+
+        uint64_t sourceHash;
+        uint64_t optionsHash;
+
+        uint32_t vertexStride;
+        uint32_t indexStride;
+
+        float boundsMin[3];
+        float boundsMax[3];
+
+        Section vertices;
+        Section indices;
+        Section subsets;
+        Section lods;
+        Section meshlets;
+
+        uint64_t fileSize;
+    };
+
+    uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    bool SectionFits(const Section& s, uint64_t stride, uint64_t fileSize)
+    {
+        if (s.offset % SECTION_ALIGNMENT != 0 || s.offset > fileSize)
+            return false;
+        return s.count <= (fileSize - s.offset) / stride;
+    }
+}
+
+std::string MeshCachePath(const std::string& sourcePath)
+{
+    return sourcePath + ".mesh";
+}
+
+bool ComputeMeshCacheKey(
+    const std::string& sourcePath,
+    const OBJLoadOptions& loadOptions,
+    const MeshOptimizeOptions& optimizeOptions,
+    const LodChainOptions& lodOptions,
+    MeshCacheKey& outKey)
+{
+    MappedFile source;
+    if (!source.Open(sourcePath))
+        return false;
+
+    outKey.sourceHash = Hash64(source.Data(), source.Size());
+
+    // threadCount is left out: it never changes the output.
+    uint64_t h = HashCombine(MESH_VERSION, sizeof(Vertex));
+    h = HashCombine(h, (uint64_t)loadOptions.weld);
+    h = Hash64(&loadOptions.weldEpsilon, sizeof(float), h);
+
+    h = HashCombine(h, optimizeOptions.vertexCache);
+    h = HashCombine(h, optimizeOptions.overdraw);
+    h = HashCombine(h, optimizeOptions.vertexFetch);
+    h = HashCombine(h, optimizeOptions.cacheSize);
+    h = Hash64(&optimizeOptions.overdrawThreshold, sizeof(float), h);
+
+    h = Hash64(lodOptions.ratios.data(), sizeof(float) * lodOptions.ratios.size(), h);
+    h = Hash64(&lodOptions.simplify.normalWeight, sizeof(float), h);
+    h = HashCombine(h, lodOptions.simplify.lockBorders);
+    h = Hash64(&lodOptions.simplify.maxError, sizeof(float), h);
+    h = HashCombine(h, lodOptions.cacheSize);
+
+    // Subsets are cut at these.
+    SubmeshLimits limits;
+    h = HashCombine(h, limits.maxVertexBytes);
+    h = HashCombine(h, limits.maxIndexBytes);
+
+    // Stored meshlets are built with these.
+    MeshletOptions meshletOptions;
+    h = HashCombine(h, meshletOptions.maxVertices);
+    h = HashCombine(h, meshletOptions.maxTriangles);
+
+    outKey.optionsHash = h;
+    return true;
+}
+
+bool WriteMeshCache(const std::string& path, const MeshCacheKey& key, const MeshData& mesh)
+{
+    MeshCacheWriter writer;
+    return
+        writer.Begin(path, key, mesh.vertices.size(), mesh.indices.size()) &&
+        writer.WriteVertices(mesh.vertices.data(), mesh.vertices.size()) &&
+        writer.WriteIndices(mesh.indices.data(), mesh.indices.size()) &&
+        writer.Finish(
+            mesh.subsets.data(), mesh.subsets.size(),
+            mesh.lods.data(), mesh.lods.size(),
+            mesh.meshlets.data(), mesh.meshlets.size(),
+            mesh.boundsMin, mesh.boundsMax
+        );
+}
+
+// ===== MeshCacheWriter =====
+
+MeshCacheWriter::MeshCacheWriter()
+    : mFile(nullptr),
+    mVertexCount(0),
+    mIndexCount(0),
+    mVerticesWritten(0),
+    mIndicesWritten(0),
+    mWritten(0),
+    mWriting(false)
+{
+}
+
+MeshCacheWriter::~MeshCacheWriter()
+{
+    Abort();
+}
+
+bool MeshCacheWriter::Begin(const std::string& path, const MeshCacheKey& key, uint64_t vertexCount, uint64_t indexCount)
+{
+    Abort();
+
+    mPath = path;
+    mTmpPath = TemporaryPath(path);
+    mKey = key;
+    mVertexCount = vertexCount;
+    mIndexCount = indexCount;
+    mVerticesWritten = 0;
+    mIndicesWritten = 0;
+    mWritten = 0;
+
+    mFile = fopen(mTmpPath.c_str(), "wb");
+    if (!mFile)
+        return false;
+
+    // The header goes in last, once every section is placed.
+    mWriting = true;
+    return Pad(SECTION_ALIGNMENT);
+}
+
+bool MeshCacheWriter::WriteVertices(const Vertex* vertices, size_t count)
+{
+    if (!mWriting || count > mVertexCount - mVerticesWritten)
+        return false;
+
+    uint64_t bytes = sizeof(Vertex) * (uint64_t)count;
+    if (count && fwrite(vertices, 1, (size_t)bytes, mFile) != bytes)
+    {
+        mWriting = false;
+        return false;
+    }
+
+    mVerticesWritten += count;
+    mWritten += bytes;
+    return true;
+}
+
+bool MeshCacheWriter::WriteIndices(const uint32_t* indices, size_t count)
+{
+    if (!mWriting || mVerticesWritten != mVertexCount || count > mIndexCount - mIndicesWritten)
+        return false;
+
+    if (mIndicesWritten == 0 && !Pad(SECTION_ALIGNMENT + AlignUp(sizeof(Vertex) * mVertexCount, SECTION_ALIGNMENT)))
+        return false;
+
+    uint64_t bytes = sizeof(uint32_t) * (uint64_t)count;
+    if (count && fwrite(indices, 1, (size_t)bytes, mFile) != bytes)
+    {
+        mWriting = false;
+        return false;
+    }
+
+    mIndicesWritten += count;
+    mWritten += bytes;
+    return true;
+}
+
+bool MeshCacheWriter::Finish(
+    const MeshSubset* subsets,
+    size_t subsetCount,
+    const MeshLod* lods,
+    size_t lodCount,
+    const Meshlet* meshlets,
+    size_t meshletCount,
+    const XMFLOAT3& boundsMin,
+    const XMFLOAT3& boundsMax)
+{
+    if (!mWriting || mVerticesWritten != mVertexCount || mIndicesWritten != mIndexCount)
+    {
+        Abort();
+        return false;
+    }
+
+    MeshFileHeader header = {};
+    memcpy(header.magic, MESH_MAGIC, sizeof(header.magic));
+    header.version = MESH_VERSION;
+    header.sourceHash = mKey.sourceHash;
+    header.optionsHash = mKey.optionsHash;
+    header.vertexStride = sizeof(Vertex);
+    header.indexStride = sizeof(uint32_t);
+
+    header.boundsMin[0] = boundsMin.x;
+    header.boundsMin[1] = boundsMin.y;
+    header.boundsMin[2] = boundsMin.z;
+    header.boundsMax[0] = boundsMax.x;
+    header.boundsMax[1] = boundsMax.y;
+    header.boundsMax[2] = boundsMax.z;
+
+    uint64_t vbBytes = sizeof(Vertex) * mVertexCount;
+    uint64_t ibBytes = sizeof(uint32_t) * mIndexCount;
+    uint64_t subsetBytes = sizeof(MeshSubset) * (uint64_t)subsetCount;
+    uint64_t lodBytes = sizeof(MeshLod) * (uint64_t)lodCount;
+    uint64_t meshletBytes = sizeof(Meshlet) * (uint64_t)meshletCount;
+
+    header.vertices = { SECTION_ALIGNMENT, mVertexCount };
+    header.indices = { header.vertices.offset + AlignUp(vbBytes, SECTION_ALIGNMENT), mIndexCount };
+    header.subsets = { header.indices.offset + AlignUp(ibBytes, SECTION_ALIGNMENT), subsetCount };
+    header.lods = { header.subsets.offset + AlignUp(subsetBytes, SECTION_ALIGNMENT), lodCount };
+    header.meshlets = { header.lods.offset + AlignUp(lodBytes, SECTION_ALIGNMENT), meshletCount };
+    header.fileSize = header.meshlets.offset + AlignUp(meshletBytes, SECTION_ALIGNMENT);
+
+    bool ok =
+        Pad(header.subsets.offset) &&
+        (subsetBytes == 0 || fwrite(subsets, 1, (size_t)subsetBytes, mFile) == subsetBytes);
+    mWritten += subsetBytes;
+
+    ok = ok &&
+        Pad(header.lods.offset) &&
+        (lodBytes == 0 || fwrite(lods, 1, (size_t)lodBytes, mFile) == lodBytes);
+    mWritten += lodBytes;
+
+    ok = ok &&
+        Pad(header.meshlets.offset) &&
+        (meshletBytes == 0 || fwrite(meshlets, 1, (size_t)meshletBytes, mFile) == meshletBytes);
+    mWritten += meshletBytes;
+
+    ok = ok &&
+        Pad(header.fileSize) &&
+        fseek(mFile, 0, SEEK_SET) == 0 &&
+        fwrite(&header, 1, sizeof(header), mFile) == sizeof(header);
+
+    ok = fclose(mFile) == 0 && ok;
+    mFile = nullptr;
+    mWriting = false;
+
+    std::error_code ec;
+    if (ok)
+        std::filesystem::rename(mTmpPath, mPath, ec);
+
+    if (!ok || ec)
+    {
+        std::filesystem::remove(mTmpPath, ec);
+        return false;
+    }
+
+    return true;
+}
+
+bool MeshCacheWriter::Pad(uint64_t offset)
+{
+    static const char zeros[SECTION_ALIGNMENT] = {};
+
+    if (!mWriting || mWritten > offset)
+    {
+        mWriting = false;
+        return false;
+    }
+
+    while (mWritten < offset)
+    {
+        size_t size = (size_t)std::min<uint64_t>(offset - mWritten, SECTION_ALIGNMENT);
+        if (fwrite(zeros, 1, size, mFile) != size)
+        {
+            mWriting = false;
+            return false;
+        }
+        mWritten += size;
+    }
+
+    return true;
+}
+
+void MeshCacheWriter::Abort()
+{
+    if (!mFile)
+        return;
+
+    fclose(mFile);
+    mFile = nullptr;
+
+    std::error_code ec;
+    std::filesystem::remove(mTmpPath, ec);
+    mWriting = false;
+}
+
+MeshCacheFile::MeshCacheFile()
+    : mVertices(nullptr),
+    mVertexCount(0),
+    mIndices(nullptr),
+    mIndexCount(0),
+    mSubsets(nullptr),
+    mSubsetCount(0),
+    mLods(nullptr),
+    mLodCount(0),
+    mMeshlets(nullptr),
+    mMeshletCount(0),
+    mBoundsMin(0.0f, 0.0f, 0.0f),
+    mBoundsMax(0.0f, 0.0f, 0.0f)
+{
+}
+
+bool MeshCacheFile::Open(const std::string& path, const MeshCacheKey& key)
+{
+    if (!mFile.Open(path))
+        return false;
+
+    // Release the mapping on any mismatch so the file can be replaced.
+    if (!Validate(key))
+    {
+        mFile.Close();
+        return false;
+    }
+
+    return true;
+}
+
+bool MeshCacheFile::Validate(const MeshCacheKey& key)
+{
+    if (mFile.Size() < sizeof(MeshFileHeader))
+        return false;
+
+    MeshFileHeader header;
+    memcpy(&header, mFile.Data(), sizeof(header));
+
+    // ===== format =====
+    if (memcmp(header.magic, MESH_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != MESH_VERSION ||
+        header.vertexStride != sizeof(Vertex) ||
+        header.indexStride != sizeof(uint32_t) ||
+        header.fileSize != mFile.Size())
+    {
+        return false;
+    }
+
+    // ===== staleness =====
+    if (header.sourceHash != key.sourceHash || header.optionsHash != key.optionsHash)
+        return false;
+
+    if (!SectionFits(header.vertices, sizeof(Vertex), header.fileSize) ||
+        !SectionFits(header.indices, sizeof(uint32_t), header.fileSize) ||
+        !SectionFits(header.subsets, sizeof(MeshSubset), header.fileSize) ||
+        !SectionFits(header.lods, sizeof(MeshLod), header.fileSize) ||
+        !SectionFits(header.meshlets, sizeof(Meshlet), header.fileSize) ||
+        header.lods.count == 0)
+    {
+        return false;
+    }
+
+    // Subsets size the GPU buffers; they have to stay inside the arrays.
+    const MeshSubset* subsets = (const MeshSubset*)(mFile.Data() + header.subsets.offset);
+    for (uint64_t i = 0; i < header.subsets.count; i++)
+    {
+        if ((uint64_t)subsets[i].vertexOffset + subsets[i].vertexCount > header.vertices.count ||
+            (uint64_t)subsets[i].indexOffset + subsets[i].indexCount > header.indices.count)
+        {
+            return false;
+        }
+    }
+
+    // So are the LODs and meshlets, which index ranges get drawn.
+    const MeshLod* lods = (const MeshLod*)(mFile.Data() + header.lods.offset);
+    for (uint64_t i = 0; i < header.lods.count; i++)
+    {
+        if ((uint64_t)lods[i].indexOffset + lods[i].indexCount > header.indices.count)
+            return false;
+    }
+
+    const Meshlet* meshlets = (const Meshlet*)(mFile.Data() + header.meshlets.offset);
+    for (uint64_t i = 0; i < header.meshlets.count; i++)
+    {
+        if ((uint64_t)meshlets[i].indexOffset + 3ull * meshlets[i].triangleCount > lods[0].indexCount)
+            return false;
+    }
+
+    mVertices = (const Vertex*)(mFile.Data() + header.vertices.offset);
+    mVertexCount = (size_t)header.vertices.count;
+    mIndices = (const uint32_t*)(mFile.Data() + header.indices.offset);
+    mIndexCount = (size_t)header.indices.count;
+    mSubsets = (const MeshSubset*)(mFile.Data() + header.subsets.offset);
+    mSubsetCount = (size_t)header.subsets.count;
+    mLods = (const MeshLod*)(mFile.Data() + header.lods.offset);
+    mLodCount = (size_t)header.lods.count;
+    mMeshlets = meshlets;
+    mMeshletCount = (size_t)header.meshlets.count;
+
+    mBoundsMin = XMFLOAT3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+    mBoundsMax = XMFLOAT3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+
+    return true;
+}
@@ -0,0 +1,163 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+
+#include "vertex.h"
+#include "simplify.h"
+#include "meshlet.h"
+#include "mappedfile.h"
+
+struct OBJLoadOptions;
+struct MeshOptimizeOptions;
+
+// Contiguous index range drawn from its own window of vertices; indices
+// stay relative to the whole mesh.
+struct MeshSubset
+{
+    uint32_t indexOffset;
+    uint32_t indexCount;
+    uint32_t vertexOffset;
+    uint32_t vertexCount;
+};
+
+struct MeshCacheKey
+{
+    // Hash of the source file contents.
+    uint64_t sourceHash = 0;
+    // Hash of every option that changes the processed geometry.
+    uint64_t optionsHash = 0;
+};
+
+// Geometry ready for upload, as stored in a .mesh file.
+struct MeshData
+{
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<MeshSubset> subsets;
+    std::vector<MeshLod> lods;
+    // Bounds and index ranges over LOD 0; may be empty.
+    std::vector<Meshlet> meshlets;
+
+    DirectX::XMFLOAT3 boundsMin = { 0.0f, 0.0f, 0.0f };
+    DirectX::XMFLOAT3 boundsMax = { 0.0f, 0.0f, 0.0f };
+};
+
+// "model.obj" -> "model.obj.mesh"
+std::string MeshCachePath(const std::string& sourcePath);
+
+bool ComputeMeshCacheKey(
+    const std::string& sourcePath,
+    const OBJLoadOptions& loadOptions,
+    const MeshOptimizeOptions& optimizeOptions,
+    const LodChainOptions& lodOptions,
+    MeshCacheKey& outKey
+);
+
+// Writes to a temporary file and renames it over the target, so readers
+// never see a partially written cache.
+bool WriteMeshCache(const std::string& path, const MeshCacheKey& key, const MeshData& mesh);
+
+// Writes a .mesh file a piece at a time, for meshes that do not fit in
+// memory. Vertices come first, then indices, in as many calls as needed;
+// Finish adds the small sections and publishes the file as WriteMeshCache
+// does. Destroying an unfinished writer removes the temporary file.
+class MeshCacheWriter
+{
+public:
+    MeshCacheWriter();
+    ~MeshCacheWriter();
+
+    MeshCacheWriter(const MeshCacheWriter&) = delete;
+    MeshCacheWriter& operator=(const MeshCacheWriter&) = delete;
+
+    bool Begin(const std::string& path, const MeshCacheKey& key, uint64_t vertexCount, uint64_t indexCount);
+
+    bool WriteVertices(const Vertex* vertices, size_t count);
+    bool WriteIndices(const uint32_t* indices, size_t count);
+
+    // Fails unless every vertex and index announced to Begin was written.
+    bool Finish(
+        const MeshSubset* subsets,
+        size_t subsetCount,
+        const MeshLod* lods,
+        size_t lodCount,
+        const Meshlet* meshlets,
+        size_t meshletCount,
+        const DirectX::XMFLOAT3& boundsMin,
+        const DirectX::XMFLOAT3& boundsMax
+    );
+
+private:
+    bool Pad(uint64_t offset);
+    void Abort();
+
+    std::string mPath;
+    std::string mTmpPath;
+    FILE* mFile;
+
+    MeshCacheKey mKey;
+    uint64_t mVertexCount;
+    uint64_t mIndexCount;
+    uint64_t mVerticesWritten;
+    uint64_t mIndicesWritten;
+    uint64_t mWritten;
+    // Between Begin and Finish, until the first error.
+    bool mWriting;
+};
+
+// Read-only view of a mapped .mesh file. Every section is page aligned and
+// can be copied straight into an upload heap.
+class MeshCacheFile
+{
+public:
+    MeshCacheFile();
+
+    // Fails on a missing file, a format mismatch or a stale key.
+    bool Open(const std::string& path, const MeshCacheKey& key);
+
+    const Vertex* Vertices() const { return mVertices; }
+    size_t VertexCount() const { return mVertexCount; }
+
+    const uint32_t* Indices() const { return mIndices; }
+    size_t IndexCount() const { return mIndexCount; }
+
+    const MeshSubset* Subsets() const { return mSubsets; }
+    size_t SubsetCount() const { return mSubsetCount; }
+
+    const MeshLod* Lods() const { return mLods; }
+    size_t LodCount() const { return mLodCount; }
+
+    const Meshlet* Meshlets() const { return mMeshlets; }
+    size_t MeshletCount() const { return mMeshletCount; }
+
+    DirectX::XMFLOAT3 BoundsMin() const { return mBoundsMin; }
+    DirectX::XMFLOAT3 BoundsMax() const { return mBoundsMax; }
+
+    // For streaming out of the mapping, see GeometryStreamOptions::source.
+    const MappedFile& File() const { return mFile; }
+
+private:
+    bool Validate(const MeshCacheKey& key);
+
+    MappedFile mFile;
+
+    const Vertex* mVertices;
+    size_t mVertexCount;
+
+    const uint32_t* mIndices;
+    size_t mIndexCount;
+
+    const MeshSubset* mSubsets;
+    size_t mSubsetCount;
+
+    const MeshLod* mLods;
+    size_t mLodCount;
+
+    const Meshlet* mMeshlets;
+    size_t mMeshletCount;
+
+    DirectX::XMFLOAT3 mBoundsMin;
+    DirectX::XMFLOAT3 mBoundsMax;
+};
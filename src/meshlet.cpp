@@ -0,0 +1,215 @@
+#include "meshlet.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+    // Below this the cone spans (almost) a hemisphere and never culls.
+    constexpr float MIN_CONE_SPREAD = 0.1f;
+
+    void ComputeBounds(
+        Meshlet& m,
+        const MeshletData& data,
+        const Vertex* vertices,
+        const std::vector<XMFLOAT3>& triangleNormals)
+    {
+        const uint32_t* local = data.vertices.data() + m.vertexOffset;
+
+        // ===== bounding sphere around the AABB center =====
+        XMFLOAT3 minP = vertices[local[0]].position;
+        XMFLOAT3 maxP = minP;
+
+        for (uint32_t i = 1; i < m.vertexCount; i++)
+        {
+            const XMFLOAT3& p = vertices[local[i]].position;
+            minP.x = std::min(minP.x, p.x);
+            minP.y = std::min(minP.y, p.y);
+            minP.z = std::min(minP.z, p.z);
+            maxP.x = std::max(maxP.x, p.x);
+            maxP.y = std::max(maxP.y, p.y);
+            maxP.z = std::max(maxP.z, p.z);
+        }
+
+        m.center = XMFLOAT3(
+            (minP.x + maxP.x) * 0.5f,
+            (minP.y + maxP.y) * 0.5f,
+            (minP.z + maxP.z) * 0.5f
+        );
+
+        float radiusSq = 0.0f;
+        for (uint32_t i = 0; i < m.vertexCount; i++)
+        {
+            const XMFLOAT3& p = vertices[local[i]].position;
+            float dx = p.x - m.center.x;
+            float dy = p.y - m.center.y;
+            float dz = p.z - m.center.z;
+            radiusSq = std::max(radiusSq, dx * dx + dy * dy + dz * dz);
+        }
+        m.radius = std::sqrt(radiusSq);
+
+        // ===== normal cone =====
+        XMFLOAT3 axis(0.0f, 0.0f, 0.0f);
+        for (uint32_t t = 0; t < m.triangleCount; t++)
+        {
+            const XMFLOAT3& n = triangleNormals[t];
+            axis.x += n.x;
+            axis.y += n.y;
+            axis.z += n.z;
+        }
+
+        float len = std::sqrt(axis.x * axis.x + axis.y * axis.y + axis.z * axis.z);
+        if (len > 0.0f)
+        {
+            axis.x /= len;
+            axis.y /= len;
+            axis.z /= len;
+        }
+
+        float minDot = len > 0.0f ? 1.0f : -1.0f;
+        for (uint32_t t = 0; t < m.triangleCount; t++)
+        {
+            const XMFLOAT3& n = triangleNormals[t];
+            minDot = std::min(minDot, n.x * axis.x + n.y * axis.y + n.z * axis.z);
+        }
+
+        m.coneAxis = axis;
+        m.coneCutoff = minDot < MIN_CONE_SPREAD ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+    }
+
+    // Facing direction for D3D clockwise front faces in a left-handed space.
+    XMFLOAT3 TriangleNormal(const XMFLOAT3& a, const XMFLOAT3& b, const XMFLOAT3& c)
+    {
+        float ux = b.x - a.x, uy = b.y - a.y, uz = b.z - a.z;
+        float vx = c.x - a.x, vy = c.y - a.y, vz = c.z - a.z;
+
+        XMFLOAT3 n(uy * vz - uz * vy, uz * vx - ux * vz, ux * vy - uy * vx);
+        float len = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+        if (len > 0.0f)
+        {
+            n.x /= len;
+            n.y /= len;
+            n.z /= len;
+        }
+        return n;
+    }
+}
+
+MeshletData BuildMeshlets(
+    const Vertex* vertices,
+    size_t vertexCount,
+    const uint32_t* indices,
+    size_t indexCount,
+    const MeshletOptions& options)
+{
+    const uint32_t maxVertices = std::min<uint32_t>(std::max<uint32_t>(options.maxVertices, 3), 256);
+    const uint32_t maxTriangles = std::max<uint32_t>(options.maxTriangles, 1);
+
+    MeshletData data;
+    size_t triangleCount = indexCount / 3;
+
+    data.meshlets.reserve(triangleCount / maxTriangles + 1);
+    data.vertices.reserve(triangleCount + triangleCount / 2);
+    data.triangles.reserve(triangleCount * 3);
+
+    std::vector<uint32_t> localIndex(vertexCount, UINT32_MAX);
+    std::vector<XMFLOAT3> triangleNormals;
+    triangleNormals.reserve(maxTriangles);
+
+    Meshlet current = {};
+
+    auto flush = [&]()
+    {
+        if (current.triangleCount == 0)
+            return;
+
+        ComputeBounds(current, data, vertices, triangleNormals);
+        data.meshlets.push_back(current);
+        data.bounds.Add(current.center, current.radius);
+
+        for (uint32_t i = 0; i < current.vertexCount; i++)
+            localIndex[data.vertices[current.vertexOffset + i]] = UINT32_MAX;
+
+        Meshlet next = {};
+        next.vertexOffset = (uint32_t)data.vertices.size();
+        next.triangleOffset = (uint32_t)(data.triangles.size() / 3);
+        next.indexOffset = current.indexOffset + current.triangleCount * 3;
+        current = next;
+        triangleNormals.clear();
+    };
+
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        const uint32_t* tri = indices + t * 3;
+
+        uint32_t newVertices =
+            (localIndex[tri[0]] == UINT32_MAX) +
+            (localIndex[tri[1]] == UINT32_MAX && tri[1] != tri[0]) +
+            (localIndex[tri[2]] == UINT32_MAX && tri[2] != tri[0] && tri[2] != tri[1]);
+
+        if (current.vertexCount + newVertices > maxVertices || current.triangleCount == maxTriangles)
+            flush();
+
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t& local = localIndex[tri[k]];
+            if (local == UINT32_MAX)
+            {
+                local = current.vertexCount++;
+                data.vertices.push_back(tri[k]);
+            }
+            data.triangles.push_back((uint8_t)local);
+        }
+
+        triangleNormals.push_back(TriangleNormal(
+            vertices[tri[0]].position,
+            vertices[tri[1]].position,
+            vertices[tri[2]].position
+        ));
+
+        current.triangleCount++;
+    }
+
+    flush();
+    return data;
+}
+
+void UpdateMeshletBounds(MeshletData& data)
+{
+    data.bounds.Clear();
+    for (const Meshlet& m : data.meshlets)
+        data.bounds.Add(m.center, m.radius);
+}
+
+void CullMeshlets(
+    const MeshletData& data,
+    const Frustum& frustum,
+    const XMFLOAT3& eye,
+    std::vector<DrawRange>& outRanges,
+    std::vector<uint32_t>& visible)
+{
+    visible.resize(data.bounds.Size());
+    size_t visibleCount = CullSpheres(frustum, data.bounds, visible.data());
+
+    for (size_t i = 0; i < visibleCount; i++)
+    {
+        const Meshlet& m = data.meshlets[visible[i]];
+
+        if (ConeBackfacing(m.center, m.radius, m.coneAxis, m.coneCutoff, eye))
+            continue;
+
+        uint32_t count = m.triangleCount * 3;
+
+        if (!outRanges.empty() &&
+            outRanges.back().indexOffset + outRanges.back().indexCount == m.indexOffset)
+        {
+            outRanges.back().indexCount += count;
+        }
+        else
+        {
+            outRanges.push_back({ m.indexOffset, count });
+        }
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "vertex.h"
+#include "culling.h"
+
+struct MeshletOptions
+{
+    // At most 256, local indices are bytes.
+    uint32_t maxVertices = 64;
+    uint32_t maxTriangles = 124;
+};
+
+struct Meshlet
+{
+    // Local vertex remap table: MeshletData::vertices[vertexOffset ...]
+    uint32_t vertexOffset;
+    uint32_t vertexCount;
+
+    // Local triangles: 3 bytes each in MeshletData::triangles[triangleOffset * 3 ...]
+    uint32_t triangleOffset;
+    uint32_t triangleCount;
+
+    // The same triangles as a range of the source index buffer.
+    uint32_t indexOffset;
+
+    DirectX::XMFLOAT3 center;
+    float radius;
+
+    // Backface cone, coneCutoff >= 1 disables cone culling.
+    DirectX::XMFLOAT3 coneAxis;
+    float coneCutoff;
+};
+
+struct MeshletData
+{
+    std::vector<Meshlet> meshlets;
+    std::vector<uint32_t> vertices;
+    std::vector<uint8_t> triangles;
+
+    // The meshlet spheres again, laid out for CullSpheres.
+    SphereBounds bounds;
+};
+
+struct DrawRange
+{
+    uint32_t indexOffset;
+    uint32_t indexCount;
+};
+
+// Splits the index buffer into clusters of consecutive triangles, so run it
+// after OptimizeVertexCache for tight clusters.
+MeshletData BuildMeshlets(
+    const Vertex* vertices,
+    size_t vertexCount,
+    const uint32_t* indices,
+    size_t indexCount,
+    const MeshletOptions& options
+);
+
+// Refills data.bounds from data.meshlets, for meshlets that did not come
+// from BuildMeshlets.
+void UpdateMeshletBounds(MeshletData& data);
+
+// Appends index ranges of meshlets that pass the frustum and backface cone
+// tests, merging neighbours. frustum and eye are in mesh space. The frustum
+// test runs on data.bounds through CullSpheres; visible holds its output
+// and keeps its storage between calls.
+void CullMeshlets(
+    const MeshletData& data,
+    const Frustum& frustum,
+    const DirectX::XMFLOAT3& eye,
+    std::vector<DrawRange>& outRanges,
+    std::vector<uint32_t>& visible
+);
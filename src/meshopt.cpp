@@ -0,0 +1,365 @@
+#include "meshopt.h"
+
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+    // Soft cluster splits below this size only add sorting noise.
+    constexpr uint32_t MIN_CLUSTER_TRIANGLES = 16;
+
+    // Triangles around every vertex, CSR layout.
+    struct Adjacency
+    {
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> triangles;
+    };
+
+    // Whole triangles only; a trailing partial one has no triangle slot.
+    Adjacency BuildAdjacency(const std::vector<uint32_t>& indices, size_t vertexCount)
+    {
+        size_t indexCount = indices.size() / 3 * 3;
+
+        Adjacency adj;
+        adj.offsets.assign(vertexCount + 1, 0);
+        adj.triangles.resize(indexCount);
+
+        for (size_t i = 0; i < indexCount; i++)
+            adj.offsets[indices[i] + 1]++;
+
+        for (size_t i = 0; i < vertexCount; i++)
+            adj.offsets[i + 1] += adj.offsets[i];
+
+        std::vector<uint32_t> cursor(adj.offsets.begin(), adj.offsets.end() - 1);
+
+        for (size_t i = 0; i < indexCount; i++)
+            adj.triangles[cursor[indices[i]]++] = (uint32_t)(i / 3);
+
+        return adj;
+    }
+
+    // FIFO cache simulation, misses per triangle.
+    class CacheSim
+    {
+    public:
+        CacheSim(size_t vertexCount, unsigned cacheSize)
+            : mStamps(vertexCount, 0), mTime(cacheSize + 1), mSize(cacheSize)
+        {
+        }
+
+        unsigned Triangle(const uint32_t* tri)
+        {
+            unsigned misses = 0;
+            for (int k = 0; k < 3; k++)
+            {
+                if (mTime - mStamps[tri[k]] > mSize)
+                {
+                    mStamps[tri[k]] = mTime++;
+                    misses++;
+                }
+            }
+            return misses;
+        }
+
+        // Evicts everything without touching the per-vertex stamps.
+        void Flush()
+        {
+            mTime += mSize + 1;
+        }
+
+    private:
+        std::vector<uint32_t> mStamps;
+        uint32_t mTime;
+        uint32_t mSize;
+    };
+}
+
+float AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, unsigned cacheSize)
+{
+    if (indices.size() < 3)
+        return 0.0f;
+
+    CacheSim cache(vertexCount, cacheSize);
+    size_t misses = 0;
+
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        misses += cache.Triangle(&indices[i]);
+
+    return (float)misses / (float)(indices.size() / 3);
+}
+
+void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, unsigned cacheSize)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0 || vertexCount == 0)
+        return;
+
+    Adjacency adj = BuildAdjacency(indices, vertexCount);
+
+    std::vector<uint32_t> live(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        live[v] = adj.offsets[v + 1] - adj.offsets[v];
+
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    std::vector<uint8_t> emitted(triangleCount, 0);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+
+    std::vector<uint32_t> result;
+    result.reserve(triangleCount * 3);
+
+    uint32_t time = cacheSize + 1;
+    uint32_t cursor = 0;
+    int64_t fan = 0;
+
+    while (fan >= 0)
+    {
+        candidates.clear();
+
+        // ===== emit every remaining triangle around the fanning vertex =====
+        for (uint32_t a = adj.offsets[fan]; a < adj.offsets[fan + 1]; a++)
+        {
+            uint32_t t = adj.triangles[a];
+            if (emitted[t])
+                continue;
+
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t v = indices[t * 3 + k];
+
+                result.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+
+                if (time - cacheTime[v] > cacheSize)
+                    cacheTime[v] = time++;
+            }
+
+            emitted[t] = 1;
+        }
+
+        // ===== next fan: the oldest candidate that stays cached for its fan =====
+        int64_t best = -1;
+        int bestPriority = -1;
+
+        for (uint32_t v : candidates)
+        {
+            if (live[v] == 0)
+                continue;
+
+            int age = (int)(time - cacheTime[v]);
+            int priority = age + 2 * (int)live[v] <= (int)cacheSize ? age : 0;
+
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                best = v;
+            }
+        }
+
+        // ===== dead end: recently used vertex, then any live vertex =====
+        while (best < 0 && !deadEnd.empty())
+        {
+            uint32_t v = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[v] > 0)
+                best = v;
+        }
+
+        while (best < 0 && cursor < vertexCount)
+        {
+            if (live[cursor] > 0)
+                best = cursor;
+            cursor++;
+        }
+
+        fan = best;
+    }
+
+    // Trailing indices that do not form a triangle are kept as they were.
+    result.insert(result.end(), indices.begin() + triangleCount * 3, indices.end());
+    indices.swap(result);
+}
+
+void OptimizeOverdraw(
+    std::vector<uint32_t>& indices,
+    const std::vector<Vertex>& vertices,
+    unsigned cacheSize,
+    float threshold)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // ===== hard boundaries: triangles where the cache starts over =====
+    std::vector<uint32_t> hard;
+    {
+        CacheSim cache(vertices.size(), cacheSize);
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            if (cache.Triangle(&indices[t * 3]) == 3)
+                hard.push_back((uint32_t)t);
+        }
+    }
+
+    if (hard.empty() || hard[0] != 0)
+        hard.insert(hard.begin(), 0);
+
+    // ===== soft boundaries: split where the prefix is already as cache friendly =====
+    std::vector<uint32_t> clusters;
+    {
+        CacheSim cache(vertices.size(), cacheSize);
+
+        for (size_t h = 0; h < hard.size(); h++)
+        {
+            uint32_t begin = hard[h];
+            uint32_t end = h + 1 < hard.size() ? hard[h + 1] : (uint32_t)triangleCount;
+
+            size_t clusterMisses = 0;
+            cache.Flush();
+            for (uint32_t t = begin; t < end; t++)
+                clusterMisses += cache.Triangle(&indices[t * 3]);
+
+            float limit = threshold * (float)clusterMisses / (float)(end - begin);
+
+            clusters.push_back(begin);
+            cache.Flush();
+
+            size_t misses = 0;
+            uint32_t start = begin;
+
+            for (uint32_t t = begin; t + 1 < end; t++)
+            {
+                misses += cache.Triangle(&indices[t * 3]);
+
+                uint32_t count = t - start + 1;
+                if (count >= MIN_CLUSTER_TRIANGLES && (float)misses / (float)count <= limit)
+                {
+                    clusters.push_back(t + 1);
+                    start = t + 1;
+                    misses = 0;
+                    cache.Flush();
+                }
+            }
+        }
+    }
+
+    // ===== sort clusters: facing away from the mesh centroid first =====
+    XMFLOAT3 centroid(0.0f, 0.0f, 0.0f);
+    for (uint32_t v : indices)
+    {
+        centroid.x += vertices[v].position.x;
+        centroid.y += vertices[v].position.y;
+        centroid.z += vertices[v].position.z;
+    }
+
+    float inv = 1.0f / (float)(triangleCount * 3);
+    centroid.x *= inv;
+    centroid.y *= inv;
+    centroid.z *= inv;
+
+    std::vector<float> sortKey(clusters.size());
+
+    for (size_t c = 0; c < clusters.size(); c++)
+    {
+        uint32_t begin = clusters[c];
+        uint32_t end = c + 1 < clusters.size() ? clusters[c + 1] : (uint32_t)triangleCount;
+
+        XMFLOAT3 center(0.0f, 0.0f, 0.0f);
+        XMFLOAT3 normal(0.0f, 0.0f, 0.0f);
+        float area = 0.0f;
+
+        for (uint32_t t = begin; t < end; t++)
+        {
+            const XMFLOAT3& a = vertices[indices[t * 3 + 0]].position;
+            const XMFLOAT3& b = vertices[indices[t * 3 + 1]].position;
+            const XMFLOAT3& c2 = vertices[indices[t * 3 + 2]].position;
+
+            float ux = b.x - a.x, uy = b.y - a.y, uz = b.z - a.z;
+            float vx = c2.x - a.x, vy = c2.y - a.y, vz = c2.z - a.z;
+
+            // Area weighted normal, the length is twice the area.
+            float nx = uy * vz - uz * vy;
+            float ny = uz * vx - ux * vz;
+            float nz = ux * vy - uy * vx;
+            float w = std::sqrt(nx * nx + ny * ny + nz * nz);
+
+            center.x += (a.x + b.x + c2.x) * (w / 3.0f);
+            center.y += (a.y + b.y + c2.y) * (w / 3.0f);
+            center.z += (a.z + b.z + c2.z) * (w / 3.0f);
+
+            normal.x += nx;
+            normal.y += ny;
+            normal.z += nz;
+            area += w;
+        }
+
+        float invArea = area > 0.0f ? 1.0f / area : 0.0f;
+        float len = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+        float invLen = len > 0.0f ? 1.0f / len : 0.0f;
+
+        sortKey[c] =
+            (center.x * invArea - centroid.x) * normal.x * invLen +
+            (center.y * invArea - centroid.y) * normal.y * invLen +
+            (center.z * invArea - centroid.z) * normal.z * invLen;
+    }
+
+    std::vector<uint32_t> order(clusters.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+    {
+        return sortKey[a] > sortKey[b];
+    });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+
+    for (uint32_t c : order)
+    {
+        uint32_t begin = clusters[c];
+        uint32_t end = c + 1 < clusters.size() ? clusters[c + 1] : (uint32_t)triangleCount;
+        result.insert(result.end(), indices.begin() + begin * 3, indices.begin() + end * 3);
+    }
+
+    result.insert(result.end(), indices.begin() + triangleCount * 3, indices.end());
+    indices.swap(result);
+}
+
+void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+    std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+    std::vector<Vertex> result;
+    result.reserve(vertices.size());
+
+    for (uint32_t& index : indices)
+    {
+        uint32_t& target = remap[index];
+        if (target == UINT32_MAX)
+        {
+            target = (uint32_t)result.size();
+            result.push_back(vertices[index]);
+        }
+        index = target;
+    }
+
+    vertices.swap(result);
+}
+
+void OptimizeMesh(
+    std::vector<Vertex>& vertices,
+    std::vector<uint32_t>& indices,
+    const MeshOptimizeOptions& options)
+{
+    if (options.vertexCache)
+        OptimizeVertexCache(indices, vertices.size(), options.cacheSize);
+
+    if (options.overdraw)
+        OptimizeOverdraw(indices, vertices, options.cacheSize, options.overdrawThreshold);
+
+    if (options.vertexFetch)
+        OptimizeVertexFetch(vertices, indices);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+#include "vertex.h"
+
+struct MeshOptimizeOptions
+{
+    bool vertexCache = true;
+    bool overdraw = true;
+    bool vertexFetch = true;
+
+    // Post-transform cache size the triangle order is tuned for.
+    unsigned cacheSize = 16;
+
+    // How much cache efficiency the overdraw pass may give up (1.05 = 5%).
+    float overdrawThreshold = 1.05f;
+};
+
+// Average cache miss ratio: vertex shader invocations per triangle for a
+// FIFO cache of the given size. 0.5 is the practical optimum, 3 the worst.
+float AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, unsigned cacheSize);
+
+// Reorders triangles for post-transform cache reuse (Tipsify, Sander et al. 2007).
+void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, unsigned cacheSize);
+
+// Splits a cache-optimized triangle list into clusters and sorts them so
+// outward-facing clusters are drawn first, keeping cache efficiency within threshold.
+void OptimizeOverdraw(
+    std::vector<uint32_t>& indices,
+    const std::vector<Vertex>& vertices,
+    unsigned cacheSize,
+    float threshold
+);
+
+// Renumbers vertices in order of first use by the index buffer and drops
+// unreferenced ones.
+void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+void OptimizeMesh(
+    std::vector<Vertex>& vertices,
+    std::vector<uint32_t>& indices,
+    const MeshOptimizeOptions& options
+);
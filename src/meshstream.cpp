@@ -0,0 +1,376 @@
+#include "meshstream.h"
+#include "mappedfile.h"
+
+#include <algorithm>
+
+// ===== SubmeshSplitter =====
+
+SubmeshSplitter::SubmeshSplitter(const SubmeshLimits& limits)
+    : mMaxVertices(limits.maxVertexBytes / sizeof(Vertex)),
+    mMaxIndices(limits.maxIndexBytes / sizeof(uint32_t) / 3 * 3),
+    mIndexCount(0),
+    mFirst(0),
+    mMin(0),
+    mMax(0)
+{
+    // A subset holds at least one triangle.
+    if (mMaxIndices < 3)
+        mMaxIndices = 3;
+}
+
+bool SubmeshSplitter::Add(const uint32_t* indices, size_t indexCount)
+{
+    if (indexCount % 3 != 0 || indexCount > UINT32_MAX - mIndexCount)
+        return false;
+
+    for (size_t i = 0; i < indexCount; i += 3)
+    {
+        uint32_t a = indices[i + 0];
+        uint32_t b = indices[i + 1];
+        uint32_t c = indices[i + 2];
+
+        uint32_t lo = std::min(a, std::min(b, c));
+        uint32_t hi = std::max(a, std::max(b, c));
+        if ((uint64_t)hi - lo + 1 > mMaxVertices)
+            return false;
+
+        if (mFirst == mIndexCount)
+        {
+            mMin = lo;
+            mMax = hi;
+        }
+        else
+        {
+            uint32_t newMin = std::min(mMin, lo);
+            uint32_t newMax = std::max(mMax, hi);
+
+            if ((uint64_t)newMax - newMin + 1 > mMaxVertices || mIndexCount + 3 - mFirst > mMaxIndices)
+            {
+                Close();
+                newMin = lo;
+                newMax = hi;
+            }
+
+            mMin = newMin;
+            mMax = newMax;
+        }
+
+        mIndexCount += 3;
+    }
+
+    return true;
+}
+
+void SubmeshSplitter::Close()
+{
+    if (mFirst == mIndexCount)
+        return;
+
+    MeshSubset subset;
+    subset.indexOffset = (uint32_t)mFirst;
+    subset.indexCount = (uint32_t)(mIndexCount - mFirst);
+    subset.vertexOffset = mMin;
+    subset.vertexCount = mMax - mMin + 1;
+    mSubsets.push_back(subset);
+
+    mFirst = mIndexCount;
+}
+
+void SubmeshSplitter::Finish(std::vector<MeshSubset>& out)
+{
+    Close();
+    out.insert(out.end(), mSubsets.begin(), mSubsets.end());
+
+    mSubsets.clear();
+    mIndexCount = 0;
+    mFirst = 0;
+}
+
+bool SplitSubmeshes(
+    const uint32_t* indices,
+    size_t indexCount,
+    const SubmeshLimits& limits,
+    std::vector<MeshSubset>& out)
+{
+    SubmeshSplitter splitter(limits);
+    if (!splitter.Add(indices, indexCount))
+        return false;
+
+    splitter.Finish(out);
+    return true;
+}
+
+// ===== streaming =====
+
+namespace
+{
+    // Drops the source pages of one section as it is read. Each call also
+    // covers the previous piece: faulting in a piece can map a few pages
+    // before it, which would otherwise stay resident for good.
+    class SectionEvictor
+    {
+    public:
+        explicit SectionEvictor(const MappedFile* source)
+            : mSource(source),
+            mPrevious(nullptr)
+        {
+        }
+
+        void Consumed(const void* data, uint64_t size)
+        {
+            if (!mSource)
+                return;
+
+            const char* begin = mPrevious ? mPrevious : (const char*)data;
+            const char* end = (const char*)data + size;
+            mSource->Evict(begin, (size_t)(end - begin));
+            mPrevious = (const char*)data;
+        }
+
+    private:
+        const MappedFile* mSource;
+        const char* mPrevious;
+    };
+}
+
+bool StreamGeometry(
+    const Vertex* vertices,
+    size_t vertexCount,
+    const uint32_t* indices,
+    size_t indexCount,
+    const MeshSubset* subsets,
+    size_t subsetCount,
+    const GeometryStreamOptions& options,
+    GeometrySink& sink,
+    GeometryStreamStats* stats)
+{
+    bool packed = options.format == VertexFormat::Packed;
+    uint64_t stride = VertexStride(options.format);
+
+    uint64_t chunkVertices = std::max<uint64_t>(options.chunkBytes / stride, 1);
+    uint64_t chunkIndices = std::max<uint64_t>(options.chunkBytes / sizeof(uint32_t), 1);
+
+    // Full vertices go to the sink as they are; only packing and rebasing
+    // need room.
+    std::vector<uint8_t> scratch((size_t)std::max(
+        packed ? chunkVertices * sizeof(PackedVertex) : 0,
+        chunkIndices * sizeof(uint32_t)
+    ));
+
+    GeometryStreamStats local;
+
+    for (size_t s = 0; s < subsetCount; s++)
+    {
+        const MeshSubset& subset = subsets[s];
+
+        if ((uint64_t)subset.vertexOffset + subset.vertexCount > vertexCount ||
+            (uint64_t)subset.indexOffset + subset.indexCount > indexCount)
+        {
+            return false;
+        }
+
+        uint64_t vbBytes = stride * subset.vertexCount;
+        uint64_t ibBytes = sizeof(uint32_t) * (uint64_t)subset.indexCount;
+        if (!sink.BeginSubmesh(s, vbBytes, ibBytes))
+            return false;
+
+        // ===== vertices =====
+        SectionEvictor vertexPages(options.source);
+        for (uint64_t first = 0; first < subset.vertexCount; first += chunkVertices)
+        {
+            uint64_t count = std::min<uint64_t>(chunkVertices, subset.vertexCount - first);
+            const Vertex* src = vertices + subset.vertexOffset + first;
+
+            const void* data = src;
+            if (packed)
+            {
+                PackVertices(src, (size_t)count, options.boundsMin, options.boundsMax, (PackedVertex*)scratch.data());
+                data = scratch.data();
+            }
+
+            if (!sink.WriteVertices(first * stride, data, count * stride))
+                return false;
+
+            vertexPages.Consumed(src, count * sizeof(Vertex));
+            local.chunks++;
+        }
+
+        // ===== indices, rebased =====
+        SectionEvictor indexPages(options.source);
+        for (uint64_t first = 0; first < subset.indexCount; first += chunkIndices)
+        {
+            uint64_t count = std::min<uint64_t>(chunkIndices, subset.indexCount - first);
+            const uint32_t* src = indices + subset.indexOffset + first;
+            uint32_t* dst = (uint32_t*)scratch.data();
+
+            // Indices below the window wrap around and fail as well.
+            bool outside = false;
+            for (uint64_t i = 0; i < count; i++)
+            {
+                dst[i] = src[i] - subset.vertexOffset;
+                outside |= dst[i] >= subset.vertexCount;
+            }
+
+            if (outside || !sink.WriteIndices(first * sizeof(uint32_t), dst, count * sizeof(uint32_t)))
+                return false;
+
+            indexPages.Consumed(src, count * sizeof(uint32_t));
+            local.chunks++;
+        }
+
+        local.vertexBytes += vbBytes;
+        local.indexBytes += ibBytes;
+    }
+
+    if (stats)
+        *stats = local;
+
+    return true;
+}
+
+// ===== CPU-side copies =====
+
+size_t SelectLodWithin(const MeshLod* lods, size_t lodCount, uint64_t maxTriangles)
+{
+    for (size_t i = 0; i < lodCount; i++)
+    {
+        if (lods[i].indexCount / 3 <= maxTriangles)
+            return i;
+    }
+    return lodCount;
+}
+
+bool ExtractSubmesh(
+    const Vertex* vertices,
+    size_t vertexCount,
+    const uint32_t* indices,
+    size_t indexCount,
+    const MappedFile* source,
+    size_t chunkBytes,
+    std::vector<Vertex>& outVertices,
+    std::vector<uint32_t>& outIndices)
+{
+    outVertices.clear();
+    outIndices.clear();
+    chunkBytes = std::max<size_t>(chunkBytes, sizeof(Vertex));
+
+    // ===== indices =====
+    outIndices.reserve(indexCount);
+    SectionEvictor indexPages(source);
+    size_t chunkIndices = chunkBytes / sizeof(uint32_t);
+    for (size_t first = 0; first < indexCount; first += chunkIndices)
+    {
+        size_t count = std::min(chunkIndices, indexCount - first);
+        outIndices.insert(outIndices.end(), indices + first, indices + first + count);
+        indexPages.Consumed(indices + first, count * sizeof(uint32_t));
+    }
+
+    std::vector<uint32_t> used(outIndices);
+    std::sort(used.begin(), used.end());
+    used.erase(std::unique(used.begin(), used.end()), used.end());
+
+    if (!used.empty() && used.back() >= vertexCount)
+    {
+        outIndices.clear();
+        return false;
+    }
+
+    // ===== vertices, in address order =====
+    outVertices.resize(used.size());
+    SectionEvictor vertexPages(source);
+    const char* pending = used.empty() ? nullptr : (const char*)(vertices + used[0]);
+
+    for (size_t i = 0; i < used.size(); i++)
+    {
+        const Vertex* v = vertices + used[i];
+        outVertices[i] = *v;
+
+        const char* end = (const char*)(v + 1);
+        if ((size_t)(end - pending) >= chunkBytes || i + 1 == used.size())
+        {
+            vertexPages.Consumed(pending, (uint64_t)(end - pending));
+            pending = end;
+        }
+    }
+
+    for (uint32_t& index : outIndices)
+        index = (uint32_t)(std::lower_bound(used.begin(), used.end(), index) - used.begin());
+
+    return true;
+}
+
+bool BuildMeshQueryData(
+    const Vertex* vertices,
+    size_t vertexCount,
+    const uint32_t* indices,
+    size_t indexCount,
+    const MeshLod* lods,
+    size_t lodCount,
+    const Meshlet* meshlets,
+    size_t meshletCount,
+    const MeshQueryOptions& options,
+    MeshQueryData& out)
+{
+    out.meshlets = MeshletData();
+    out.bvh = Bvh();
+    out.pickLod = lodCount;
+    out.occluderVertices.clear();
+    out.occluderIndices.clear();
+    out.occluderLod = lodCount;
+
+    for (size_t i = 0; i < lodCount; i++)
+    {
+        if ((uint64_t)lods[i].indexOffset + lods[i].indexCount > indexCount)
+            return false;
+    }
+
+    // ===== meshlets =====
+    if (lodCount > 0 && lods[0].indexCount / 3 <= options.meshletTriangles)
+    {
+        out.meshlets.meshlets.assign(meshlets, meshlets + meshletCount);
+        UpdateMeshletBounds(out.meshlets);
+        if (options.source && meshletCount > 0)
+            options.source->Evict(meshlets, meshletCount * sizeof(Meshlet));
+    }
+
+    // ===== BVH =====
+    size_t lod = SelectLodWithin(lods, lodCount, options.pickTriangles);
+    if (lod < lodCount)
+    {
+        // The BVH copies the triangles; the extracted mesh goes right after.
+        std::vector<Vertex> lodVertices;
+        std::vector<uint32_t> lodIndices;
+        if (!ExtractSubmesh(
+            vertices, vertexCount,
+            indices + lods[lod].indexOffset, lods[lod].indexCount,
+            options.source, options.chunkBytes,
+            lodVertices, lodIndices))
+        {
+            return false;
+        }
+
+        out.bvh.Build(
+            lodVertices.data(), lodVertices.size(),
+            lodIndices.data(), lodIndices.size(),
+            BvhBuildOptions(), options.jobs
+        );
+        out.pickLod = lod;
+    }
+
+    // ===== occluder =====
+    lod = SelectLodWithin(lods, lodCount, options.occluderTriangles);
+    if (lod < lodCount)
+    {
+        if (!ExtractSubmesh(
+            vertices, vertexCount,
+            indices + lods[lod].indexOffset, lods[lod].indexCount,
+            options.source, options.chunkBytes,
+            out.occluderVertices, out.occluderIndices))
+        {
+            return false;
+        }
+        out.occluderLod = lod;
+    }
+
+    return true;
+}
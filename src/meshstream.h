@@ -0,0 +1,188 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "vertex.h"
+#include "vertexpack.h"
+#include "meshcache.h"
+#include "meshlet.h"
+#include "bvh.h"
+
+class MappedFile;
+
+// Largest vertex and index buffer a subset may need. D3D12 views address
+// at most 4 GB, and 2 GB is the largest buffer every device has to accept.
+// Sizes are taken at sizeof(Vertex), so they hold for every VertexFormat.
+struct SubmeshLimits
+{
+    uint64_t maxVertexBytes = 2ull * 1024 * 1024 * 1024;
+    uint64_t maxIndexBytes = 2ull * 1024 * 1024 * 1024;
+};
+
+// Cuts an index buffer into MeshSubsets, each drawn from its own pair of
+// buffers within the limits. Triangles stay in order; a subset grows until
+// the window of vertices it references, or its indices, would not fit.
+// Subsets cover the whole buffer, so every index range, LODs included,
+// maps onto consecutive subsets.
+//
+// Indices may come in pieces of whole triangles, so the buffer never has
+// to be in memory at once. A mesh that fits the limits stays one subset.
+class SubmeshSplitter
+{
+public:
+    explicit SubmeshSplitter(const SubmeshLimits& limits = SubmeshLimits());
+
+    // Continues where the last call ended. Fails when a single triangle
+    // spans more vertices than a buffer holds, or past 2^32 indices.
+    bool Add(const uint32_t* indices, size_t indexCount);
+
+    // Appends the subsets to out and starts over.
+    void Finish(std::vector<MeshSubset>& out);
+
+private:
+    void Close();
+
+    uint64_t mMaxVertices;
+    uint64_t mMaxIndices;
+
+    std::vector<MeshSubset> mSubsets;
+    uint64_t mIndexCount;
+
+    // The open subset, empty while mFirst == mIndexCount.
+    uint64_t mFirst;
+    uint32_t mMin;
+    uint32_t mMax;
+};
+
+bool SplitSubmeshes(
+    const uint32_t* indices,
+    size_t indexCount,
+    const SubmeshLimits& limits,
+    std::vector<MeshSubset>& out
+);
+
+// Receives the buffers of each subset, in order, a piece at a time. Data
+// is only valid during the call.
+class GeometrySink
+{
+public:
+    virtual ~GeometrySink() {}
+
+    // Sizes of the two buffers of the subset, in bytes.
+    virtual bool BeginSubmesh(size_t subset, uint64_t vertexBytes, uint64_t indexBytes) = 0;
+    virtual bool WriteVertices(uint64_t offset, const void* data, uint64_t size) = 0;
+    virtual bool WriteIndices(uint64_t offset, const void* data, uint64_t size) = 0;
+};
+
+struct GeometryStreamOptions
+{
+    VertexFormat format = VertexFormat::Full;
+    // Packed positions are relative to these.
+    DirectX::XMFLOAT3 boundsMin = { 0.0f, 0.0f, 0.0f };
+    DirectX::XMFLOAT3 boundsMax = { 0.0f, 0.0f, 0.0f };
+
+    // Largest piece handed to the sink, and the only memory the stream
+    // allocates.
+    size_t chunkBytes = 4 * 1024 * 1024;
+
+    // Mapping the arrays live in. Pages are dropped from the working set
+    // once read, so resident memory stays flat for files larger than RAM.
+    const MappedFile* source = nullptr;
+};
+
+struct GeometryStreamStats
+{
+    uint64_t vertexBytes = 0;
+    uint64_t indexBytes = 0;
+    uint64_t chunks = 0;
+};
+
+// Converts the subsets to the stream format and writes them to sink:
+// vertices packed if asked, indices rebased to the subset's first vertex.
+// Fails on a subset or index outside the arrays, or when the sink fails.
+bool StreamGeometry(
+    const Vertex* vertices,
+    size_t vertexCount,
+    const uint32_t* indices,
+    size_t indexCount,
+    const MeshSubset* subsets,
+    size_t subsetCount,
+    const GeometryStreamOptions& options,
+    GeometrySink& sink,
+    GeometryStreamStats* stats = nullptr
+);
+
+// ===== CPU-side copies =====
+
+// Most detailed of the LODs with at most maxTriangles, lodCount when none
+// has so few.
+size_t SelectLodWithin(const MeshLod* lods, size_t lodCount, uint64_t maxTriangles);
+
+// Copies an index range into a mesh of its own that holds only the
+// vertices it uses, in their original order. Vertices are read in one
+// sweep up the array, so with a source their pages are dropped a chunk
+// behind it. Besides the output, takes 4 bytes per index. Fails on an
+// index past the vertex array.
+bool ExtractSubmesh(
+    const Vertex* vertices,
+    size_t vertexCount,
+    const uint32_t* indices,
+    size_t indexCount,
+    const MappedFile* source,
+    size_t chunkBytes,
+    std::vector<Vertex>& outVertices,
+    std::vector<uint32_t>& outIndices
+);
+
+// What the CPU keeps of a mesh for culling and ray queries. Each part is
+// built from the most detailed LOD within its budget and left empty when
+// no LOD fits, so memory does not grow with the mesh.
+struct MeshQueryOptions
+{
+    // Meshlets, 52 bytes per 124 triangles at best, are kept for a LOD 0
+    // of at most this many triangles.
+    uint64_t meshletTriangles = 1 << 22;
+    // The BVH takes up to 150 bytes per triangle while building.
+    uint64_t pickTriangles = 1 << 18;
+    uint64_t occluderTriangles = 1 << 14;
+
+    size_t chunkBytes = 4 * 1024 * 1024;
+
+    // As GeometryStreamOptions::source.
+    const MappedFile* source = nullptr;
+    JobSystem* jobs = nullptr;
+};
+
+struct MeshQueryData
+{
+    // Bounds and index ranges only; culling needs nothing else.
+    MeshletData meshlets;
+
+    // Triangles are numbered within pickLod.
+    Bvh bvh;
+    size_t pickLod = 0;
+
+    // Compacted to the vertices the LOD uses.
+    std::vector<Vertex> occluderVertices;
+    std::vector<uint32_t> occluderIndices;
+    size_t occluderLod = 0;
+};
+
+// Builds the query data of a mesh in memory or in a mapped .mesh file.
+// meshlets cover LOD 0 and are kept as given; pass none to go without.
+// Fails on a LOD outside the index buffer or an index outside the vertex
+// array.
+bool BuildMeshQueryData(
+    const Vertex* vertices,
+    size_t vertexCount,
+    const uint32_t* indices,
+    size_t indexCount,
+    const MeshLod* lods,
+    size_t lodCount,
+    const Meshlet* meshlets,
+    size_t meshletCount,
+    const MeshQueryOptions& options,
+    MeshQueryData& out
+);
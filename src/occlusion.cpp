@@ -0,0 +1,641 @@
+#include "occlusion.h"
+#include "rastersetup.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_SSE 1
+#include <emmintrin.h>
+#endif
+
+using namespace DirectX;
+using namespace RasterSetup;
+
+namespace
+{
+    // Subtiles are 8x4 pixels, one bit of the coverage mask each.
+    constexpr int SUBTILE_WIDTH = 8;
+    constexpr int SUBTILE_HEIGHT = 4;
+    constexpr uint32_t FULL_MASK = 0xFFFFFFFFu;
+
+    // Screen tiles of 8x8 subtiles (64x32 pixels) are the unit of parallel
+    // rasterization.
+    constexpr int TILE_SUBTILES_X = 8;
+    constexpr int TILE_SUBTILES_Y = 8;
+
+    // Keeps edge functions within 32 bits.
+    constexpr int MAX_DIMENSION = 1024;
+
+    constexpr size_t VERTEX_GRAIN = 4096;
+    constexpr size_t SETUP_GRAIN = 2048;
+    constexpr size_t TEST_GRAIN = 1024;
+
+    // Box tests read at most this many texels per axis.
+    constexpr int TEST_TEXELS = 4;
+
+    inline void Multiply(const XMFLOAT4X4& a, const XMFLOAT4X4& b, XMFLOAT4X4& out)
+    {
+        XMStoreFloat4x4(&out, XMMatrixMultiply(XMLoadFloat4x4(&a), XMLoadFloat4x4(&b)));
+    }
+
+    // Coverage of the 8x4 pixels of a subtile, bit y * 8 + x. e holds the
+    // edge values at the top-left pixel center; stepping one pixel adds
+    // SUBPIXEL * A across and SUBPIXEL * B down.
+    inline uint32_t CoverageMask(const int32_t* e, const int32_t* A, const int32_t* B)
+    {
+#ifdef OCCLUSION_SSE
+        __m128i left[3];
+        __m128i right[3];
+        __m128i down[3];
+        for (int k = 0; k < 3; k++)
+        {
+            int32_t dx = A[k] * SUBPIXEL;
+            left[k] = _mm_add_epi32(_mm_set1_epi32(e[k]), _mm_setr_epi32(0, dx, 2 * dx, 3 * dx));
+            right[k] = _mm_add_epi32(left[k], _mm_set1_epi32(4 * dx));
+            down[k] = _mm_set1_epi32(B[k] * SUBPIXEL);
+        }
+
+        uint32_t mask = 0;
+        for (int row = 0; row < SUBTILE_HEIGHT; row++)
+        {
+            // A pixel is inside when no edge value is negative.
+            __m128i outLeft = _mm_or_si128(_mm_or_si128(left[0], left[1]), left[2]);
+            __m128i outRight = _mm_or_si128(_mm_or_si128(right[0], right[1]), right[2]);
+
+            uint32_t outside = (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(outLeft)) |
+                (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(outRight)) << 4;
+            mask |= (~outside & 0xFFu) << (row * SUBTILE_WIDTH);
+
+            for (int k = 0; k < 3; k++)
+            {
+                left[k] = _mm_add_epi32(left[k], down[k]);
+                right[k] = _mm_add_epi32(right[k], down[k]);
+            }
+        }
+        return mask;
+#else
+        uint32_t mask = 0;
+        for (int row = 0; row < SUBTILE_HEIGHT; row++)
+        {
+            for (int x = 0; x < SUBTILE_WIDTH; x++)
+            {
+                int32_t e0 = e[0] + (A[0] * x + B[0] * row) * SUBPIXEL;
+                int32_t e1 = e[1] + (A[1] * x + B[1] * row) * SUBPIXEL;
+                int32_t e2 = e[2] + (A[2] * x + B[2] * row) * SUBPIXEL;
+                mask |= (uint32_t)((e0 | e1 | e2) >= 0) << (row * SUBTILE_WIDTH + x);
+            }
+        }
+        return mask;
+#endif
+    }
+}
+
+OcclusionBuffer::OcclusionBuffer()
+    : mWidth(0),
+    mHeight(0),
+    mSubtilesX(0),
+    mSubtilesY(0),
+    mTilesX(0),
+    mTilesY(0),
+    mViewProj(),
+    mVertexCount(0),
+    mTriangleCount(0)
+{
+}
+
+bool OcclusionBuffer::Initialize(int width, int height)
+{
+    if (width <= 0 || height <= 0 || width > MAX_DIMENSION || height > MAX_DIMENSION)
+        return false;
+
+    mSubtilesX = (width + SUBTILE_WIDTH - 1) / SUBTILE_WIDTH;
+    mSubtilesY = (height + SUBTILE_HEIGHT - 1) / SUBTILE_HEIGHT;
+    mWidth = mSubtilesX * SUBTILE_WIDTH;
+    mHeight = mSubtilesY * SUBTILE_HEIGHT;
+    mTilesX = (mSubtilesX + TILE_SUBTILES_X - 1) / TILE_SUBTILES_X;
+    mTilesY = (mSubtilesY + TILE_SUBTILES_Y - 1) / TILE_SUBTILES_Y;
+
+    mSubtiles.assign((size_t)mSubtilesX * mSubtilesY, Subtile());
+
+    mLevels.clear();
+    int w = mSubtilesX;
+    int h = mSubtilesY;
+    for (;;)
+    {
+        mLevels.push_back({ w, h, std::vector<float>((size_t)w * h, 1.0f) });
+        if (w == 1 && h == 1)
+            break;
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+
+    XMStoreFloat4x4(&mViewProj, XMMatrixIdentity());
+    BeginFrame(mViewProj);
+    return true;
+}
+
+void OcclusionBuffer::BeginFrame(const XMFLOAT4X4& viewProj)
+{
+    mViewProj = viewProj;
+
+    mOccluders.clear();
+    mVertexCount = 0;
+    mTriangleCount = 0;
+    mStats = OcclusionStats();
+
+    std::fill(mSubtiles.begin(), mSubtiles.end(), Subtile{ 1.0f, 0.0f, 0 });
+    for (Level& level : mLevels)
+        std::fill(level.depth.begin(), level.depth.end(), 1.0f);
+}
+
+void OcclusionBuffer::AddOccluder(
+    const Vertex* vertices,
+    size_t vertexCount,
+    const uint32_t* indices,
+    size_t indexCount,
+    const XMFLOAT4X4& world)
+{
+    size_t triangleCount = indexCount / 3;
+    if (!vertices || !indices || vertexCount == 0 || triangleCount == 0)
+        return;
+
+    Occluder occluder;
+    occluder.vertices = vertices;
+    occluder.indices = indices;
+    Multiply(world, mViewProj, occluder.transform);
+    occluder.firstVertex = mVertexCount;
+    occluder.vertexCount = vertexCount;
+    occluder.firstTriangle = mTriangleCount;
+    mOccluders.push_back(occluder);
+
+    mVertexCount += vertexCount;
+    mTriangleCount += triangleCount;
+}
+
+void OcclusionBuffer::Rasterize(JobSystem* jobs)
+{
+    mStats.trianglesIn = mTriangleCount;
+    if (mOccluders.empty() || mSubtiles.empty())
+        return;
+
+    // ===== vertices to clip space =====
+    mTransformed.resize(mVertexCount);
+    if (jobs)
+        jobs->ParallelFor(mVertexCount, VERTEX_GRAIN, [this](size_t begin, size_t end) { TransformVertices(begin, end); });
+    else
+        TransformVertices(0, mVertexCount);
+
+    // ===== triangle setup and binning, fixed ranges so bins keep order =====
+    size_t chunkCount = (mTriangleCount + SETUP_GRAIN - 1) / SETUP_GRAIN;
+    if (mChunks.size() < chunkCount)
+        mChunks.resize(chunkCount);
+
+    size_t tileCount = (size_t)mTilesX * mTilesY;
+    for (size_t c = 0; c < chunkCount; c++)
+    {
+        mChunks[c].triangles.clear();
+        mChunks[c].bins.resize(tileCount);
+        for (std::vector<uint32_t>& bin : mChunks[c].bins)
+            bin.clear();
+        mChunks[c].drawn = 0;
+    }
+
+    auto setup = [this](size_t begin, size_t end)
+    {
+        for (size_t c = begin; c < end; c++)
+            SetupTriangles(mChunks[c], c * SETUP_GRAIN, std::min(mTriangleCount, (c + 1) * SETUP_GRAIN));
+    };
+
+    // ===== rasterization, one screen tile at a time =====
+    auto raster = [this, chunkCount](size_t begin, size_t end)
+    {
+        for (size_t tile = begin; tile < end; tile++)
+            RasterizeTile((uint32_t)tile, chunkCount);
+    };
+
+    if (jobs)
+    {
+        jobs->ParallelFor(chunkCount, 1, setup);
+        jobs->ParallelFor(tileCount, 1, raster);
+    }
+    else
+    {
+        setup(0, chunkCount);
+        raster(0, tileCount);
+    }
+
+    for (size_t c = 0; c < chunkCount; c++)
+        mStats.trianglesDrawn += mChunks[c].drawn;
+
+    BuildPyramid();
+}
+
+void OcclusionBuffer::TransformVertices(size_t begin, size_t end)
+{
+    auto it = std::upper_bound(mOccluders.begin(), mOccluders.end(), begin, [](size_t i, const Occluder& o)
+    {
+        return i < o.firstVertex;
+    }) - 1;
+
+    for (; begin < end; ++it)
+    {
+        const XMFLOAT4X4& m = it->transform;
+        size_t last = std::min(end, it->firstVertex + it->vertexCount);
+        const Vertex* src = it->vertices - it->firstVertex;
+
+        for (size_t i = begin; i < last; i++)
+        {
+            const XMFLOAT3& p = src[i].position;
+            ClipVertex& v = mTransformed[i];
+
+            v.x = p.x * m.m[0][0] + p.y * m.m[1][0] + p.z * m.m[2][0] + m.m[3][0];
+            v.y = p.x * m.m[0][1] + p.y * m.m[1][1] + p.z * m.m[2][1] + m.m[3][1];
+            v.z = p.x * m.m[0][2] + p.y * m.m[1][2] + p.z * m.m[2][2] + m.m[3][2];
+            v.w = p.x * m.m[0][3] + p.y * m.m[1][3] + p.z * m.m[2][3] + m.m[3][3];
+        }
+        begin = last;
+    }
+}
+
+void OcclusionBuffer::SetupTriangles(Chunk& chunk, size_t firstTriangle, size_t endTriangle)
+{
+    auto it = std::upper_bound(mOccluders.begin(), mOccluders.end(), firstTriangle, [](size_t i, const Occluder& o)
+    {
+        return i < o.firstTriangle;
+    }) - 1;
+
+    for (size_t t = firstTriangle; t < endTriangle; t++)
+    {
+        while (it + 1 != mOccluders.end() && t >= (it + 1)->firstTriangle)
+            ++it;
+
+        const uint32_t* tri = it->indices + (t - it->firstTriangle) * 3;
+        if (tri[0] >= it->vertexCount || tri[1] >= it->vertexCount || tri[2] >= it->vertexCount)
+            continue;
+
+        const ClipVertex& a = mTransformed[it->firstVertex + tri[0]];
+        const ClipVertex& b = mTransformed[it->firstVertex + tri[1]];
+        const ClipVertex& c = mTransformed[it->firstVertex + tri[2]];
+
+        ClipTriangle(a, b, c, [&](const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2)
+        {
+            AddTriangle(chunk, v0, v1, v2);
+        });
+    }
+}
+
+void OcclusionBuffer::AddTriangle(Chunk& chunk, const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2)
+{
+    SnappedTriangle s;
+    if (!SnapTriangle(v0, v1, v2, mWidth, mHeight, s))
+        return;
+
+    float z[3] = {
+        std::min(std::max(v0.z * s.invW[0], 0.0f), 1.0f),
+        std::min(std::max(v1.z * s.invW[1], 0.0f), 1.0f),
+        std::min(std::max(v2.z * s.invW[2], 0.0f), 1.0f)
+    };
+
+    Triangle t;
+    t.minX = s.minX / SUBTILE_WIDTH;
+    t.maxX = s.maxX / SUBTILE_WIDTH;
+    t.minY = s.minY / SUBTILE_HEIGHT;
+    t.maxY = s.maxY / SUBTILE_HEIGHT;
+    SetupEdges(s, t.A, t.B, t.C);
+
+    // ===== depth plane, per pixel around the origin =====
+    double scale = (double)SUBPIXEL / (double)s.area;
+    double d1 = (double)z[1] - z[0];
+    double d2 = (double)z[2] - z[0];
+    double dzdx = (t.A[1] * d1 + t.A[2] * d2) * scale;
+    double dzdy = (t.B[1] * d1 + t.B[2] * d2) * scale;
+
+    t.z0 = (float)(z[0] - dzdx * ((double)s.X[0] / SUBPIXEL) - dzdy * ((double)s.Y[0] / SUBPIXEL));
+    t.dzdx = (float)dzdx;
+    t.dzdy = (float)dzdy;
+    t.zMax = std::max({ z[0], z[1], z[2] });
+
+    // ===== binning =====
+    uint32_t index = (uint32_t)chunk.triangles.size();
+    chunk.triangles.push_back(t);
+
+    for (int ty = t.minY / TILE_SUBTILES_Y; ty <= t.maxY / TILE_SUBTILES_Y; ty++)
+    {
+        for (int tx = t.minX / TILE_SUBTILES_X; tx <= t.maxX / TILE_SUBTILES_X; tx++)
+            chunk.bins[(size_t)ty * mTilesX + tx].push_back(index);
+    }
+
+    chunk.drawn++;
+}
+
+void OcclusionBuffer::RasterizeTile(uint32_t tile, size_t chunkCount)
+{
+    int tileX = (int)(tile % mTilesX) * TILE_SUBTILES_X;
+    int tileY = (int)(tile / mTilesX) * TILE_SUBTILES_Y;
+    int tileMaxX = std::min(tileX + TILE_SUBTILES_X, mSubtilesX) - 1;
+    int tileMaxY = std::min(tileY + TILE_SUBTILES_Y, mSubtilesY) - 1;
+
+    // Chunks hold consecutive triangle ranges, so this is submission order.
+    for (size_t c = 0; c < chunkCount; c++)
+    {
+        const Chunk& chunk = mChunks[c];
+        for (uint32_t index : chunk.bins[tile])
+        {
+            const Triangle& t = chunk.triangles[index];
+
+            int x0 = std::max(t.minX, tileX);
+            int x1 = std::min(t.maxX, tileMaxX);
+            int y0 = std::max(t.minY, tileY);
+            int y1 = std::min(t.maxY, tileMaxY);
+
+            for (int sy = y0; sy <= y1; sy++)
+            {
+                for (int sx = x0; sx <= x1; sx++)
+                {
+                    Subtile& s = mSubtiles[(size_t)sy * mSubtilesX + sx];
+
+                    // Farthest depth of the triangle over the subtile: the
+                    // plane at the far corner, never past its vertices.
+                    float px = (float)(sx * SUBTILE_WIDTH);
+                    float py = (float)(sy * SUBTILE_HEIGHT);
+                    float z = t.z0 +
+                        std::max(t.dzdx * px, t.dzdx * (px + SUBTILE_WIDTH)) +
+                        std::max(t.dzdy * py, t.dzdy * (py + SUBTILE_HEIGHT));
+                    z = std::min(z, t.zMax);
+
+                    // Behind everything already here.
+                    if (z >= s.zMax0)
+                        continue;
+
+                    int64_t cx = (int64_t)sx * SUBTILE_WIDTH * SUBPIXEL + SUBPIXEL / 2;
+                    int64_t cy = (int64_t)sy * SUBTILE_HEIGHT * SUBPIXEL + SUBPIXEL / 2;
+
+                    int32_t e[3];
+                    for (int k = 0; k < 3; k++)
+                        e[k] = (int32_t)(t.A[k] * cx + t.B[k] * cy + t.C[k]);
+
+                    uint32_t coverage = CoverageMask(e, t.A, t.B);
+                    if (coverage == 0)
+                        continue;
+
+                    if (coverage == FULL_MASK)
+                    {
+                        s.zMax0 = std::min(s.zMax0, z);
+                        continue;
+                    }
+
+                    // Merging would push the working layer back further than
+                    // the reference is behind the triangle: start it over.
+                    if (s.mask == 0 || z - s.zMax1 > s.zMax0 - z)
+                    {
+                        s.zMax1 = z;
+                        s.mask = coverage;
+                    }
+                    else
+                    {
+                        s.zMax1 = std::max(s.zMax1, z);
+                        s.mask |= coverage;
+                    }
+
+                    if (s.mask == FULL_MASK)
+                    {
+                        s.zMax0 = std::min(s.zMax0, s.zMax1);
+                        s.zMax1 = 0.0f;
+                        s.mask = 0;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void OcclusionBuffer::BuildPyramid()
+{
+    std::vector<float>& base = mLevels[0].depth;
+    for (size_t i = 0; i < mSubtiles.size(); i++)
+        base[i] = mSubtiles[i].zMax0;
+
+    for (size_t l = 1; l < mLevels.size(); l++)
+    {
+        const Level& src = mLevels[l - 1];
+        Level& dst = mLevels[l];
+
+        for (int y = 0; y < dst.height; y++)
+        {
+            int y0 = y * 2;
+            int y1 = std::min(y0 + 1, src.height - 1);
+            for (int x = 0; x < dst.width; x++)
+            {
+                int x0 = x * 2;
+                int x1 = std::min(x0 + 1, src.width - 1);
+                dst.depth[(size_t)y * dst.width + x] = std::max(
+                    std::max(src.depth[(size_t)y0 * src.width + x0], src.depth[(size_t)y0 * src.width + x1]),
+                    std::max(src.depth[(size_t)y1 * src.width + x0], src.depth[(size_t)y1 * src.width + x1])
+                );
+            }
+        }
+    }
+}
+
+bool OcclusionBuffer::IsVisible(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax) const
+{
+    return IsVisibleClip(boundsMin, boundsMax, mViewProj);
+}
+
+bool OcclusionBuffer::IsVisible(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax, const XMFLOAT4X4& world) const
+{
+    XMFLOAT4X4 m;
+    Multiply(world, mViewProj, m);
+    return IsVisibleClip(boundsMin, boundsMax, m);
+}
+
+bool OcclusionBuffer::IsVisibleClip(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax, const XMFLOAT4X4& m) const
+{
+    if (mLevels.empty())
+        return true;
+
+    float minX = FLT_MAX;
+    float minY = FLT_MAX;
+    float maxX = -FLT_MAX;
+    float maxY = -FLT_MAX;
+    float minZ = FLT_MAX;
+
+#ifdef OCCLUSION_SSE
+    // Corners 0..3 and 4..7, one per lane, same expressions as below.
+    __m128 px = _mm_setr_ps(boundsMin.x, boundsMax.x, boundsMin.x, boundsMax.x);
+    __m128 py = _mm_setr_ps(boundsMin.y, boundsMin.y, boundsMax.y, boundsMax.y);
+
+    __m128 vMinX = _mm_set1_ps(FLT_MAX);
+    __m128 vMinY = _mm_set1_ps(FLT_MAX);
+    __m128 vMaxX = _mm_set1_ps(-FLT_MAX);
+    __m128 vMaxY = _mm_set1_ps(-FLT_MAX);
+    __m128 vMinZ = _mm_set1_ps(FLT_MAX);
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 width = _mm_set1_ps((float)mWidth);
+    const __m128 height = _mm_set1_ps((float)mHeight);
+
+    for (int group = 0; group < 2; group++)
+    {
+        __m128 pz = _mm_set1_ps(group ? boundsMax.z : boundsMin.z);
+
+        __m128 clip[4];
+        for (int c = 0; c < 4; c++)
+        {
+            clip[c] = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(px, _mm_set1_ps(m.m[0][c])),
+                _mm_mul_ps(py, _mm_set1_ps(m.m[1][c]))),
+                _mm_mul_ps(pz, _mm_set1_ps(m.m[2][c]))),
+                _mm_set1_ps(m.m[3][c]));
+        }
+
+        if (_mm_movemask_ps(_mm_or_ps(_mm_cmple_ps(clip[3], zero), _mm_cmple_ps(clip[2], zero))))
+            return true;
+
+        __m128 invW = _mm_div_ps(_mm_set1_ps(1.0f), clip[3]);
+        __m128 sx = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(clip[0], invW), half), half), width);
+        __m128 sy = _mm_mul_ps(_mm_sub_ps(half, _mm_mul_ps(_mm_mul_ps(clip[1], invW), half)), height);
+
+        vMinX = _mm_min_ps(vMinX, sx);
+        vMaxX = _mm_max_ps(vMaxX, sx);
+        vMinY = _mm_min_ps(vMinY, sy);
+        vMaxY = _mm_max_ps(vMaxY, sy);
+        vMinZ = _mm_min_ps(vMinZ, _mm_mul_ps(clip[2], invW));
+    }
+
+    alignas(16) float lanes[5][4];
+    _mm_store_ps(lanes[0], vMinX);
+    _mm_store_ps(lanes[1], vMaxX);
+    _mm_store_ps(lanes[2], vMinY);
+    _mm_store_ps(lanes[3], vMaxY);
+    _mm_store_ps(lanes[4], vMinZ);
+
+    for (int lane = 0; lane < 4; lane++)
+    {
+        minX = std::min(minX, lanes[0][lane]);
+        maxX = std::max(maxX, lanes[1][lane]);
+        minY = std::min(minY, lanes[2][lane]);
+        maxY = std::max(maxY, lanes[3][lane]);
+        minZ = std::min(minZ, lanes[4][lane]);
+    }
+#else
+    for (int corner = 0; corner < 8; corner++)
+    {
+        float px = corner & 1 ? boundsMax.x : boundsMin.x;
+        float py = corner & 2 ? boundsMax.y : boundsMin.y;
+        float pz = corner & 4 ? boundsMax.z : boundsMin.z;
+
+        float x = px * m.m[0][0] + py * m.m[1][0] + pz * m.m[2][0] + m.m[3][0];
+        float y = px * m.m[0][1] + py * m.m[1][1] + pz * m.m[2][1] + m.m[3][1];
+        float z = px * m.m[0][2] + py * m.m[1][2] + pz * m.m[2][2] + m.m[3][2];
+        float w = px * m.m[0][3] + py * m.m[1][3] + pz * m.m[2][3] + m.m[3][3];
+
+        // Crossing the near plane: the projected rectangle is unbounded.
+        if (w <= 0.0f || z <= 0.0f)
+            return true;
+
+        float invW = 1.0f / w;
+        float sx = (x * invW * 0.5f + 0.5f) * mWidth;
+        float sy = (0.5f - y * invW * 0.5f) * mHeight;
+
+        minX = std::min(minX, sx);
+        maxX = std::max(maxX, sx);
+        minY = std::min(minY, sy);
+        maxY = std::max(maxY, sy);
+        minZ = std::min(minZ, z * invW);
+    }
+#endif
+
+    return TestRect(minX, minY, maxX, maxY, minZ);
+}
+
+bool OcclusionBuffer::TestRect(float minX, float minY, float maxX, float maxY, float minZ) const
+{
+    // Off screen: nothing to test against, leave it to the frustum.
+    if (!(maxX > 0.0f && maxY > 0.0f && minX < (float)mWidth && minY < (float)mHeight))
+        return true;
+
+    // Pixels whose centers the rectangle may touch, widened by one so
+    // rounding of the corners never loses a pixel.
+    int x0 = std::max(0, (int)std::floor(minX) - 1);
+    int y0 = std::max(0, (int)std::floor(minY) - 1);
+    int x1 = std::min(mWidth - 1, (int)std::floor(maxX) + 1);
+    int y1 = std::min(mHeight - 1, (int)std::floor(maxY) + 1);
+
+    x0 /= SUBTILE_WIDTH;
+    x1 /= SUBTILE_WIDTH;
+    y0 /= SUBTILE_HEIGHT;
+    y1 /= SUBTILE_HEIGHT;
+
+    // Coarsest level that still resolves the rectangle in a few texels.
+    size_t level = 0;
+    while (level + 1 < mLevels.size() && (x1 - x0 >= TEST_TEXELS || y1 - y0 >= TEST_TEXELS))
+    {
+        x0 >>= 1;
+        x1 >>= 1;
+        y0 >>= 1;
+        y1 >>= 1;
+        level++;
+    }
+
+    const Level& l = mLevels[level];
+    for (int y = y0; y <= y1; y++)
+    {
+        const float* row = l.depth.data() + (size_t)y * l.width;
+        for (int x = x0; x <= x1; x++)
+        {
+            if (minZ <= row[x])
+                return true;
+        }
+    }
+    return false;
+}
+
+size_t OcclusionBuffer::CullBoxes(
+    const BoxBounds& bounds,
+    const uint32_t* candidates,
+    size_t candidateCount,
+    uint32_t* outVisible,
+    JobSystem* jobs) const
+{
+    auto test = [&](size_t i)
+    {
+        uint32_t b = candidates[i];
+        XMFLOAT3 lo(bounds.centerX[b] - bounds.extentX[b], bounds.centerY[b] - bounds.extentY[b], bounds.centerZ[b] - bounds.extentZ[b]);
+        XMFLOAT3 hi(bounds.centerX[b] + bounds.extentX[b], bounds.centerY[b] + bounds.extentY[b], bounds.centerZ[b] + bounds.extentZ[b]);
+        return IsVisibleClip(lo, hi, mViewProj);
+    };
+
+    if (!jobs || candidateCount < 2 * TEST_GRAIN)
+    {
+        size_t n = 0;
+        for (size_t i = 0; i < candidateCount; i++)
+        {
+            uint32_t b = candidates[i];
+            if (test(i))
+                outVisible[n++] = b;
+        }
+        return n;
+    }
+
+    // Flags first, then an ordered compaction, so outVisible may alias
+    // candidates.
+    std::vector<uint8_t> visible(candidateCount);
+    jobs->ParallelFor(candidateCount, TEST_GRAIN, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+            visible[i] = test(i);
+    });
+
+    size_t n = 0;
+    for (size_t i = 0; i < candidateCount; i++)
+    {
+        uint32_t b = candidates[i];
+        if (visible[i])
+            outVisible[n++] = b;
+    }
+    return n;
+}
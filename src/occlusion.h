@@ -0,0 +1,187 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "vertex.h"
+#include "culling.h"
+#include "jobs.h"
+
+struct OcclusionStats
+{
+    // Triangles queued by AddOccluder.
+    size_t trianglesIn = 0;
+    // Front facing triangles left after clipping, as rasterized.
+    size_t trianglesDrawn = 0;
+};
+
+// Low resolution depth for occlusion culling on the CPU, in the masked
+// form of Andersson et al., "Masked Software Occlusion Culling": the target
+// is split into 8x4 pixel subtiles, each holding a coverage mask and two
+// farthest depths instead of 32 depth values. Every pixel lies in front of
+// the subtile's reference depth; masked pixels also lie in front of the
+// working depth, which becomes the reference once the mask is full.
+//
+// Occluders are binned into screen tiles and rasterized one tile per job,
+// 4 pixels per SSE instruction. The reference depths then form level 0 of
+// a max Hi-Z pyramid that box tests read from the coarsest level covering
+// a box with a few texels.
+//
+// Depth follows the D3D12 path: z / w in [0, 1], LESS test, clockwise
+// front faces. Every answer is conservative: a box is reported hidden only
+// when each pixel it covers has occluder geometry strictly in front of it.
+class OcclusionBuffer
+{
+public:
+    OcclusionBuffer();
+
+    // Sizes are rounded up to whole subtiles.
+    bool Initialize(int width, int height);
+
+    // Clears depth and drops queued occluders; viewProj maps world space to
+    // clip space (row vectors).
+    void BeginFrame(const DirectX::XMFLOAT4X4& viewProj);
+
+    // Queues the triangles of an occluder placed by world. The arrays are
+    // read by Rasterize and must stay valid until then.
+    void AddOccluder(
+        const Vertex* vertices,
+        size_t vertexCount,
+        const uint32_t* indices,
+        size_t indexCount,
+        const DirectX::XMFLOAT4X4& world
+    );
+
+    // Renders the queued occluders and builds the Hi-Z pyramid. With jobs,
+    // vertices, triangle setup and screen tiles are split across workers;
+    // the result is the same either way.
+    void Rasterize(JobSystem* jobs = nullptr);
+
+    // False when the box, in world space or in the object space of world,
+    // is hidden behind the occluders. Boxes crossing the near plane or
+    // leaving the screen count as visible.
+    bool IsVisible(const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax) const;
+    bool IsVisible(
+        const DirectX::XMFLOAT3& boundsMin,
+        const DirectX::XMFLOAT3& boundsMax,
+        const DirectX::XMFLOAT4X4& world
+    ) const;
+
+    // Keeps the visible boxes among candidates, for example the output of
+    // CullBoxes, in their order. outVisible may be candidates. Returns the
+    // count kept.
+    size_t CullBoxes(
+        const BoxBounds& bounds,
+        const uint32_t* candidates,
+        size_t candidateCount,
+        uint32_t* outVisible,
+        JobSystem* jobs = nullptr
+    ) const;
+
+    int Width() const { return mWidth; }
+    int Height() const { return mHeight; }
+
+    // Hi-Z level 0 has one texel per subtile; every further level halves
+    // both sizes. Texels hold the farthest depth below them.
+    size_t LevelCount() const { return mLevels.size(); }
+    int LevelWidth(size_t level) const { return mLevels[level].width; }
+    int LevelHeight(size_t level) const { return mLevels[level].height; }
+    const float* LevelDepth(size_t level) const { return mLevels[level].depth.data(); }
+
+    const OcclusionStats& Stats() const { return mStats; }
+
+private:
+    struct Occluder
+    {
+        const Vertex* vertices;
+        const uint32_t* indices;
+        // world * viewProj.
+        DirectX::XMFLOAT4X4 transform;
+        // Offsets into the per-frame vertex and triangle ranges.
+        size_t firstVertex;
+        size_t vertexCount;
+        size_t firstTriangle;
+    };
+
+    struct ClipVertex
+    {
+        float x, y, z, w;
+    };
+
+    struct Triangle
+    {
+        // Edge k is opposite vertex k; E = A * x + B * y + C in sub-pixel
+        // units is >= 0 inside, top-left bias folded into C.
+        int32_t A[3];
+        int32_t B[3];
+        int64_t C[3];
+
+        // Covered subtiles, inclusive.
+        int minX;
+        int minY;
+        int maxX;
+        int maxY;
+
+        // Depth plane in pixels around (0, 0) and its farthest vertex.
+        float z0;
+        float dzdx;
+        float dzdy;
+        float zMax;
+    };
+
+    // Setup output of one range of triangles, binned per screen tile.
+    struct Chunk
+    {
+        std::vector<Triangle> triangles;
+        std::vector<std::vector<uint32_t>> bins;
+        size_t drawn;
+    };
+
+    struct Subtile
+    {
+        float zMax0;
+        float zMax1;
+        uint32_t mask;
+    };
+
+    struct Level
+    {
+        int width;
+        int height;
+        std::vector<float> depth;
+    };
+
+    void TransformVertices(size_t begin, size_t end);
+    void SetupTriangles(Chunk& chunk, size_t firstTriangle, size_t endTriangle);
+    void AddTriangle(Chunk& chunk, const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2);
+    void RasterizeTile(uint32_t tile, size_t chunkCount);
+    void BuildPyramid();
+
+    bool TestRect(float minX, float minY, float maxX, float maxY, float minZ) const;
+    bool IsVisibleClip(const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax, const DirectX::XMFLOAT4X4& m) const;
+
+    int mWidth;
+    int mHeight;
+    // Subtiles per row and column.
+    int mSubtilesX;
+    int mSubtilesY;
+    // Screen tiles, the unit of parallel rasterization.
+    int mTilesX;
+    int mTilesY;
+
+    DirectX::XMFLOAT4X4 mViewProj;
+
+    std::vector<Occluder> mOccluders;
+    size_t mVertexCount;
+    size_t mTriangleCount;
+
+    std::vector<ClipVertex> mTransformed;
+    std::vector<Chunk> mChunks;
+
+    // Row major by subtile.
+    std::vector<Subtile> mSubtiles;
+    std::vector<Level> mLevels;
+
+    OcclusionStats mStats;
+};
@@ -1,129 +1,766 @@
 #include "parcer.h"
-#include "dx12renderer.h"
+#include "mappedfile.h"
+#include "profiler.h"
 
-#include <fstream>
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <cmath>
+#include <thread>
 
 using namespace DirectX;
 
-bool LoadOBJ(
-    const std::string& filename,
-    std::vector<Vertex>& outVertices,
-    std::vector<uint32_t>& outIndices)
+namespace
 {
-    std::ifstream file(filename);
-    if (!file.is_open())
-        return false;
-
     constexpr float OBJ_SCALE = 5.0f;
 
-    std::vector<XMFLOAT3> positions;
-    std::vector<XMFLOAT3> normals;
+    // Smaller chunks are not worth a thread.
+    constexpr size_t MIN_CHUNK_BYTES = 1 << 20;
+
+    constexpr uint32_t NO_NORMAL = UINT32_MAX;
 
-    positions.reserve(500000);
-    normals.reserve(500000);
-    outVertices.reserve(500000);
-    outIndices.reserve(1000000);
+    struct OBJCounts
+    {
+        size_t positions = 0;
+        size_t normals = 0;
+        size_t texcoords = 0;
+        size_t faces = 0;
+    };
 
-    std::string line;
+    struct Corner
+    {
+        uint32_t position;
+        uint32_t normal;
+    };
+
+    // One line-aligned slice of the file and everything parsed from it.
+    struct Chunk
+    {
+        const char* begin = nullptr;
+        const char* end = nullptr;
+
+        OBJCounts counts;
+
+        // Global index of the first v / vn record of this chunk.
+        size_t positionBase = 0;
+        size_t normalBase = 0;
+
+        std::vector<Corner> corners;
+    };
 
-    while (std::getline(file, line))
+    // Contiguous run of output vertices written by one worker.
+    struct EmitRange
     {
-        // ===== vertex position =====
-        if (line.rfind("v ", 0) == 0)
+        const Corner* corners = nullptr;
+        size_t count = 0;
+        size_t vertexBase = 0;
+
+        XMFLOAT3 minP;
+        XMFLOAT3 maxP;
+    };
+
+    // Open addressing with linear probing, UINT64_MAX marks an empty slot.
+    class IndexTable
+    {
+    public:
+        explicit IndexTable(size_t expected)
         {
-            XMFLOAT3 p;
-            sscanf_s(line.c_str(), "v %f %f %f", &p.x, &p.y, &p.z);
+            size_t capacity = 16;
+            while (capacity < expected * 2)
+                capacity <<= 1;
+            Rehash(capacity);
+        }
+
+        // Returns the value stored under key, adding 'value' if it is new.
+        uint32_t& FindOrAdd(uint64_t key, uint32_t value, bool& added)
+        {
+            if ((mCount + 1) * 2 > mSlots.size())
+                Rehash(mSlots.size() * 2);
 
-            p.x *= OBJ_SCALE;
-            p.y *= OBJ_SCALE;
-            p.z *= OBJ_SCALE;
+            size_t i = Hash(key) & mMask;
+            while (mSlots[i].key != EMPTY)
+            {
+                if (mSlots[i].key == key)
+                {
+                    added = false;
+                    return mSlots[i].value;
+                }
+                i = (i + 1) & mMask;
+            }
 
-            positions.push_back(p);
+            mSlots[i] = { key, value };
+            mCount++;
+            added = true;
+            return mSlots[i].value;
         }
-        // ===== vertex normal =====
-        else if (line.rfind("vn ", 0) == 0)
+
+        const uint32_t* Find(uint64_t key) const
         {
-            XMFLOAT3 n;
-            sscanf_s(line.c_str(), "vn %f %f %f", &n.x, &n.y, &n.z);
-            normals.push_back(n);
+            size_t i = Hash(key) & mMask;
+            while (mSlots[i].key != EMPTY)
+            {
+                if (mSlots[i].key == key)
+                    return &mSlots[i].value;
+                i = (i + 1) & mMask;
+            }
+            return nullptr;
         }
-        // ===== face =====
-        else if (line.rfind("f ", 0) == 0)
+
+    private:
+        static constexpr uint64_t EMPTY = UINT64_MAX;
+
+        struct Slot
         {
-            int pi[3]{}, ni[3]{};
+            uint64_t key;
+            uint32_t value;
+        };
 
-            // : v//n  v/vt/n
-            int matched = sscanf_s(
-                line.c_str(),
-                "f %d//%d %d//%d %d//%d",
-                &pi[0], &ni[0],
-                &pi[1], &ni[1],
-                &pi[2], &ni[2]
-            );
+        static size_t Hash(uint64_t key)
+        {
+            key ^= key >> 33;
+            key *= 0xff51afd7ed558ccdull;
+            key ^= key >> 33;
+            return (size_t)key;
+        }
 
-            if (matched != 6)
+        void Rehash(size_t capacity)
+        {
+            std::vector<Slot> old = std::move(mSlots);
+            mSlots.assign(capacity, Slot{ EMPTY, 0 });
+            mMask = capacity - 1;
+
+            for (const Slot& s : old)
             {
-                matched = sscanf_s(
-                    line.c_str(),
-                    "f %d/%*d/%d %d/%*d/%d %d/%*d/%d",
-                    &pi[0], &ni[0],
-                    &pi[1], &ni[1],
-                    &pi[2], &ni[2]
-                );
+                if (s.key == EMPTY)
+                    continue;
+
+                size_t i = Hash(s.key) & mMask;
+                while (mSlots[i].key != EMPTY)
+                    i = (i + 1) & mMask;
+                mSlots[i] = s;
             }
+        }
 
-            if (matched != 6)
-                continue;
+        std::vector<Slot> mSlots;
+        size_t mMask = 0;
+        size_t mCount = 0;
+    };
+
+    inline bool IsBlank(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+    inline const char* SkipBlanks(const char* p, const char* end)
+    {
+        while (p < end && IsBlank(*p))
+            p++;
+        return p;
+    }
+
+    inline const char* LineEnd(const char* p, const char* end)
+    {
+        const char* nl = (const char*)memchr(p, '\n', end - p);
+        return nl ? nl : end;
+    }
+
+    inline bool ParseFloat(const char*& p, const char* end, float& out)
+    {
+        p = SkipBlanks(p, end);
+        if (p < end && *p == '+')
+            p++;
+
+        auto res = std::from_chars(p, end, out);
+        if (res.ec != std::errc())
+            return false;
+
+        p = res.ptr;
+        return true;
+    }
+
+    inline bool ParseInt(const char*& p, const char* end, int& out)
+    {
+        if (p < end && *p == '+')
+            p++;
+
+        auto res = std::from_chars(p, end, out);
+        if (res.ec != std::errc())
+            return false;
+
+        p = res.ptr;
+        return true;
+    }
+
+    // "x y z" after the record tag; missing components stay zero
+    inline XMFLOAT3 ParseFloat3(const char* p, const char* end)
+    {
+        XMFLOAT3 v(0.0f, 0.0f, 0.0f);
+        if (ParseFloat(p, end, v.x) && ParseFloat(p, end, v.y))
+            ParseFloat(p, end, v.z);
+        return v;
+    }
+
+    // v//n or v/vt/n, every corner of the face must use the same form
+    bool ParseFace(const char* p, const char* end, int (&pi)[3], int (&ni)[3])
+    {
+        bool withTexcoord = false;
 
-            for (int i = 0; i < 3; i++)
+        for (int i = 0; i < 3; i++)
+        {
+            p = SkipBlanks(p, end);
+            if (!ParseInt(p, end, pi[i]))
+                return false;
+
+            if (p >= end || *p++ != '/')
+                return false;
+
+            if (i == 0)
+                withTexcoord = p < end && *p != '/';
+
+            if (withTexcoord)
             {
-                int posIndex = pi[i] - 1;
-                int normIndex = ni[i] - 1;
+                int ti;
+                if (!ParseInt(p, end, ti))
+                    return false;
+            }
 
-                if (posIndex < 0 || posIndex >= (int)positions.size())
-                    continue;
+            if (p >= end || *p++ != '/')
+                return false;
+
+            if (!ParseInt(p, end, ni[i]))
+                return false;
+        }
+
+        return true;
+    }
+
+    // 1-based OBJ index, negative values count back from the last record seen.
+    // Returns false for anything outside the records defined so far.
+    inline bool ResolveIndex(int index, size_t definedSoFar, uint32_t& out)
+    {
+        long long resolved = index > 0
+            ? (long long)index - 1
+            : (long long)definedSoFar + index;
+
+        if (index == 0 || resolved < 0 || resolved >= (long long)definedSoFar)
+            return false;
+
+        out = (uint32_t)resolved;
+        return true;
+    }
+
+    OBJCounts CountRecords(const char* p, const char* end)
+    {
+        OBJCounts counts;
+
+        while (p < end)
+        {
+            const char* eol = LineEnd(p, end);
+            size_t len = eol - p;
+
+            if (len >= 2 && p[0] == 'v' && p[1] == ' ')
+                counts.positions++;
+            else if (len >= 3 && p[0] == 'v' && p[1] == 'n' && p[2] == ' ')
+                counts.normals++;
+            else if (len >= 3 && p[0] == 'v' && p[1] == 't' && p[2] == ' ')
+                counts.texcoords++;
+            else if (len >= 2 && p[0] == 'f' && p[1] == ' ')
+                counts.faces++;
+
+            p = eol + 1;
+        }
+
+        return counts;
+    }
+
+    // Positions and normals go straight to their global slots; faces are
+    // resolved against the global record counts at the point they appear.
+    void ParseChunk(
+        Chunk& chunk,
+        std::vector<XMFLOAT3>& positions,
+        std::vector<XMFLOAT3>& normals)
+    {
+        size_t positionCount = chunk.positionBase;
+        size_t normalCount = chunk.normalBase;
+
+        chunk.corners.reserve(chunk.counts.faces * 3);
+
+        const char* p = chunk.begin;
+        const char* end = chunk.end;
+
+        while (p < end)
+        {
+            const char* eol = LineEnd(p, end);
+            size_t len = eol - p;
+
+            // ===== vertex position =====
+            if (len >= 2 && p[0] == 'v' && p[1] == ' ')
+            {
+                XMFLOAT3 pos = ParseFloat3(p + 2, eol);
+
+                pos.x *= OBJ_SCALE;
+                pos.y *= OBJ_SCALE;
+                pos.z *= OBJ_SCALE;
+
+                positions[positionCount++] = pos;
+            }
+            // ===== vertex normal =====
+            else if (len >= 3 && p[0] == 'v' && p[1] == 'n' && p[2] == ' ')
+            {
+                normals[normalCount++] = ParseFloat3(p + 3, eol);
+            }
+            // ===== face =====
+            else if (len >= 2 && p[0] == 'f' && p[1] == ' ')
+            {
+                int pi[3]{}, ni[3]{};
+
+                // : v//n  v/vt/n
+                if (ParseFace(p + 2, eol, pi, ni))
+                {
+                    // All three corners or none, so corners stay in
+                    // whole triangles.
+                    Corner c[3];
+                    bool valid = true;
+                    for (int i = 0; i < 3; i++)
+                    {
+                        valid = valid && ResolveIndex(pi[i], positionCount, c[i].position);
+
+                        if (!ResolveIndex(ni[i], normalCount, c[i].normal))
+                            c[i].normal = NO_NORMAL;
+                    }
+
+                    if (valid)
+                        chunk.corners.insert(chunk.corners.end(), c, c + 3);
+                }
+            }
+
+            p = eol + 1;
+        }
+    }
+
+    void EmitVertices(
+        EmitRange& range,
+        const std::vector<XMFLOAT3>& positions,
+        const std::vector<XMFLOAT3>& normals,
+        Vertex* dst)
+    {
+        XMFLOAT3 minP = positions[range.corners[0].position];
+        XMFLOAT3 maxP = minP;
+
+        for (size_t i = 0; i < range.count; i++)
+        {
+            const Corner& c = range.corners[i];
+
+            Vertex v{};
+            v.position = positions[c.position];
+            v.normal = c.normal != NO_NORMAL
+                ? normals[c.normal]
+                : XMFLOAT3(0.0f, 1.0f, 0.0f);
+            v.color = XMFLOAT4(1, 1, 1, 1);
+
+            minP.x = std::min(v.position.x, minP.x);
+            minP.y = std::min(v.position.y, minP.y);
+            minP.z = std::min(v.position.z, minP.z);
+
+            maxP.x = std::max(v.position.x, maxP.x);
+            maxP.y = std::max(v.position.y, maxP.y);
+            maxP.z = std::max(v.position.z, maxP.z);
+
+            dst[i] = v;
+        }
+
+        range.minP = minP;
+        range.maxP = maxP;
+    }
+
+    // Maps every position record to the first earlier record within
+    // epsilon of it (itself if there is none). Positions are bucketed on an
+    // epsilon grid so only the 27 surrounding cells need to be searched.
+    std::vector<uint32_t> WeldPositions(const std::vector<XMFLOAT3>& positions, float epsilon)
+    {
+        std::vector<uint32_t> remap(positions.size());
+        std::vector<uint32_t> next(positions.size(), UINT32_MAX);
+        IndexTable cells(positions.size());
+
+        const float invCell = epsilon > 0.0f ? 1.0f / epsilon : 0.0f;
+        const float epsilonSq = epsilon * epsilon;
+        const int reach = epsilon > 0.0f ? 1 : 0;
+
+        auto cellCoord = [&](float v) -> int64_t
+        {
+            if (epsilon > 0.0f)
+                return (int64_t)std::floor(v * invCell);
+
+            uint32_t bits;
+            memcpy(&bits, &v, sizeof(bits));
+            return bits == 0x80000000u ? 0 : bits;
+        };
+
+        auto cellKey = [](int64_t x, int64_t y, int64_t z) -> uint64_t
+        {
+            constexpr uint64_t MASK = (1ull << 21) - 1;
+            return ((uint64_t)x & MASK) | (((uint64_t)y & MASK) << 21) | (((uint64_t)z & MASK) << 42);
+        };
 
-                Vertex v{};
-                v.position = positions[posIndex];
+        for (uint32_t i = 0; i < (uint32_t)positions.size(); i++)
+        {
+            const XMFLOAT3& p = positions[i];
+            int64_t cx = cellCoord(p.x);
+            int64_t cy = cellCoord(p.y);
+            int64_t cz = cellCoord(p.z);
+
+            uint32_t match = UINT32_MAX;
 
-                if (!normals.empty() &&
-                    normIndex >= 0 &&
-                    normIndex < (int)normals.size())
+            for (int dz = -reach; dz <= reach; dz++)
+            for (int dy = -reach; dy <= reach; dy++)
+            for (int dx = -reach; dx <= reach; dx++)
+            {
+                const uint32_t* head = cells.Find(cellKey(cx + dx, cy + dy, cz + dz));
+
+                for (uint32_t j = head ? *head : UINT32_MAX; j != UINT32_MAX; j = next[j])
                 {
-                    v.normal = normals[normIndex];
+                    const XMFLOAT3& q = positions[j];
+                    float ex = p.x - q.x;
+                    float ey = p.y - q.y;
+                    float ez = p.z - q.z;
+
+                    if (ex * ex + ey * ey + ez * ez <= epsilonSq && j < match)
+                        match = j;
                 }
-                else
+            }
+
+            if (match != UINT32_MAX)
+            {
+                remap[i] = match;
+                continue;
+            }
+
+            // ===== new representative, push to the front of its cell =====
+            bool added;
+            uint32_t& head = cells.FindOrAdd(cellKey(cx, cy, cz), i, added);
+            if (!added)
+            {
+                next[i] = head;
+                head = i;
+            }
+            remap[i] = i;
+        }
+
+        return remap;
+    }
+
+    // Runs fn(i) for i in [0, count), one thread per item.
+    template <typename Fn>
+    void ForEachChunk(size_t count, Fn fn)
+    {
+        if (count == 1)
+        {
+            fn(0);
+            return;
+        }
+
+        std::vector<std::thread> workers;
+        workers.reserve(count - 1);
+
+        for (size_t i = 1; i < count; i++)
+            workers.emplace_back(fn, i);
+
+        fn(0);
+
+        for (auto& w : workers)
+            w.join();
+    }
+
+    // Collapses corners with the same (position, normal) pair into one
+    // vertex, numbered in order of first use. Writes one index per corner.
+    std::vector<Corner> WeldCorners(
+        const std::vector<Chunk>& chunks,
+        const std::vector<uint32_t>& positionRemap,
+        size_t positionCount,
+        uint32_t indexBase,
+        uint32_t* dstIndices)
+    {
+        auto cornerKey = [](const Corner& c)
+        {
+            return ((uint64_t)c.position << 32) | c.normal;
+        };
+
+        std::vector<size_t> firstCorner(chunks.size());
+        for (size_t i = 1; i < chunks.size(); i++)
+            firstCorner[i] = firstCorner[i - 1] + chunks[i - 1].corners.size();
+
+        // ===== weld every chunk on its own, chunk-local vertex ids =====
+        std::vector<std::vector<Corner>> local(chunks.size());
+
+        ForEachChunk(chunks.size(), [&](size_t i)
+        {
+            IndexTable table(chunks[i].counts.positions);
+            uint32_t* dst = dstIndices + firstCorner[i];
+
+            for (Corner c : chunks[i].corners)
+            {
+                if (!positionRemap.empty())
+                    c.position = positionRemap[c.position];
+
+                bool added;
+                uint32_t vertex = table.FindOrAdd(cornerKey(c), (uint32_t)local[i].size(), added);
+                if (added)
+                    local[i].push_back(c);
+
+                *dst++ = vertex;
+            }
+        });
+
+        // ===== merge the chunk vertices in file order =====
+        // A vertex keeps the number the first chunk using it gives it, and
+        // every chunk lists its vertices in order of first use, so this is
+        // the numbering of a single pass over all corners. Only the chunk
+        // vertices go through here, not every corner.
+        std::vector<Corner> unique = std::move(local[0]);
+        std::vector<std::vector<uint32_t>> remap(chunks.size());
+
+        if (chunks.size() > 1)
+        {
+            unique.reserve(positionCount);
+            IndexTable table(positionCount);
+
+            bool added;
+            for (uint32_t v = 0; v < (uint32_t)unique.size(); v++)
+                table.FindOrAdd(cornerKey(unique[v]), v, added);
+
+            for (size_t i = 1; i < chunks.size(); i++)
+            {
+                remap[i].resize(local[i].size());
+
+                for (size_t v = 0; v < local[i].size(); v++)
                 {
-                    v.normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+                    remap[i][v] = table.FindOrAdd(cornerKey(local[i][v]), (uint32_t)unique.size(), added);
+                    if (added)
+                        unique.push_back(local[i][v]);
                 }
 
-                v.color = XMFLOAT4(1, 1, 1, 1);
+                local[i].clear();
+                local[i].shrink_to_fit();
+            }
+        }
+
+        // ===== chunk-local ids to output indices =====
+        ForEachChunk(chunks.size(), [&](size_t i)
+        {
+            uint32_t* dst = dstIndices + firstCorner[i];
+            size_t count = chunks[i].corners.size();
 
-                outVertices.push_back(v);
-                outIndices.push_back((uint32_t)(outVertices.size() - 1));
+            if (i == 0)
+            {
+                for (size_t k = 0; k < count; k++)
+                    dst[k] += indexBase;
             }
+            else
+            {
+                for (size_t k = 0; k < count; k++)
+                    dst[k] = indexBase + remap[i][dst[k]];
+            }
+        });
+
+        return unique;
+    }
+
+    std::vector<Chunk> SplitIntoChunks(const char* begin, const char* end, unsigned threadCount)
+    {
+        size_t size = end - begin;
+
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+        size_t count = std::min<size_t>(threadCount, std::max<size_t>(1, size / MIN_CHUNK_BYTES));
+
+        std::vector<Chunk> chunks(count);
+        const char* p = begin;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            const char* split = i + 1 == count ? end : begin + size * (i + 1) / count;
+
+            // ===== move the split just past the next line break =====
+            if (split < p)
+                split = p;
+            if (split < end)
+                split = LineEnd(split, end) + 1;
+            if (split > end)
+                split = end;
+
+            chunks[i].begin = p;
+            chunks[i].end = split;
+            p = split;
         }
+
+        return chunks;
+    }
+}
+
+bool LoadOBJ(
+    const std::string& filename,
+    std::vector<Vertex>& outVertices,
+    std::vector<uint32_t>& outIndices)
+{
+    return LoadOBJ(filename, outVertices, outIndices, OBJLoadOptions());
+}
+
+bool LoadOBJ(
+    const std::string& filename,
+    std::vector<Vertex>& outVertices,
+    std::vector<uint32_t>& outIndices,
+    const OBJLoadOptions& options,
+    OBJLoadStats* stats)
+{
+    PROFILE_ZONE("LoadOBJ");
+
+    MappedFile file;
+    if (!file.Open(filename))
+        return false;
+
+    const char* begin = file.Data();
+    const char* end = begin + file.Size();
+
+    std::vector<Chunk> chunks = SplitIntoChunks(begin, end, options.threadCount);
+
+    // ===== pass 1: count records per chunk =====
+    ForEachChunk(chunks.size(), [&](size_t i)
+    {
+        chunks[i].counts = CountRecords(chunks[i].begin, chunks[i].end);
+    });
+
+    size_t positionCount = 0;
+    size_t normalCount = 0;
+
+    for (auto& chunk : chunks)
+    {
+        chunk.positionBase = positionCount;
+        chunk.normalBase = normalCount;
+        positionCount += chunk.counts.positions;
+        normalCount += chunk.counts.normals;
     }
 
-    if (outVertices.empty())
+    std::vector<XMFLOAT3> positions(positionCount);
+    std::vector<XMFLOAT3> normals(normalCount);
+
+    // ===== pass 2: parse records, resolve face indices =====
+    ForEachChunk(chunks.size(), [&](size_t i)
+    {
+        ParseChunk(chunks[i], positions, normals);
+    });
+
+    size_t cornerCount = 0;
+
+    for (const auto& chunk : chunks)
+        cornerCount += chunk.corners.size();
+
+    if (cornerCount == 0)
         return false;
 
+    size_t vertexBase = outVertices.size();
+    size_t indexBase = outIndices.size();
+    outIndices.resize(indexBase + cornerCount);
+
+    // ===== pass 3: weld corners into shared vertices =====
+    std::vector<Corner> unique;
+    std::vector<EmitRange> ranges;
+
+    if (options.weld != OBJWeldMode::None)
+    {
+        std::vector<uint32_t> positionRemap;
+        if (options.weld == OBJWeldMode::Position)
+            positionRemap = WeldPositions(positions, options.weldEpsilon * OBJ_SCALE);
+
+        unique = WeldCorners(
+            chunks,
+            positionRemap,
+            positionCount,
+            (uint32_t)vertexBase,
+            outIndices.data() + indexBase
+        );
+
+        for (auto& chunk : chunks)
+        {
+            chunk.corners.clear();
+            chunk.corners.shrink_to_fit();
+        }
+
+        size_t workers = chunks.size();
+        ranges.resize(workers);
+
+        for (size_t i = 0; i < workers; i++)
+        {
+            size_t first = unique.size() * i / workers;
+            size_t last = unique.size() * (i + 1) / workers;
+
+            ranges[i].corners = unique.data() + first;
+            ranges[i].count = last - first;
+            ranges[i].vertexBase = first;
+        }
+    }
+    else
+    {
+        size_t emitted = 0;
+
+        for (const auto& chunk : chunks)
+        {
+            EmitRange range;
+            range.corners = chunk.corners.data();
+            range.count = chunk.corners.size();
+            range.vertexBase = emitted;
+            ranges.push_back(range);
+
+            emitted += range.count;
+        }
+    }
+
+    size_t vertexCount = ranges.back().vertexBase + ranges.back().count;
+
+    // ===== pass 4: emit vertices in order =====
+    outVertices.resize(vertexBase + vertexCount);
+
+    ForEachChunk(ranges.size(), [&](size_t i)
+    {
+        EmitRange& range = ranges[i];
+        if (range.count == 0)
+            return;
+
+        EmitVertices(range, positions, normals, outVertices.data() + vertexBase + range.vertexBase);
+
+        if (options.weld == OBJWeldMode::None)
+        {
+            uint32_t* dst = outIndices.data() + indexBase + range.vertexBase;
+            for (size_t k = 0; k < range.count; k++)
+                dst[k] = (uint32_t)(vertexBase + range.vertexBase + k);
+        }
+    });
+
+    if (stats)
+    {
+        stats->cornerCount = cornerCount;
+        stats->vertexCount = vertexCount;
+        stats->indexCount = cornerCount;
+    }
+
     // =====   [-1;1] =====
-    XMFLOAT3 minP = outVertices[0].position;
-    XMFLOAT3 maxP = outVertices[0].position;
+    XMFLOAT3 minP = outVertices[vertexBase].position;
+    XMFLOAT3 maxP = minP;
 
-    for (const auto& v : outVertices)
+    for (const auto& range : ranges)
     {
-        minP.x = min(minP.x, v.position.x);
-        minP.y = min(minP.y, v.position.y);
-        minP.z = min(minP.z, v.position.z);
+        if (range.count == 0)
+            continue;
 
-        maxP.x = max(maxP.x, v.position.x);
-        maxP.y = max(maxP.y, v.position.y);
-        maxP.z = max(maxP.z, v.position.z);
+        minP.x = std::min(range.minP.x, minP.x);
+        minP.y = std::min(range.minP.y, minP.y);
+        minP.z = std::min(range.minP.z, minP.z);
+
+        maxP.x = std::max(range.maxP.x, maxP.x);
+        maxP.y = std::max(range.maxP.y, maxP.y);
+        maxP.z = std::max(range.maxP.z, maxP.z);
     }
 
     XMFLOAT3 center =
@@ -133,24 +770,43 @@ bool LoadOBJ(
         (minP.z + maxP.z) * 0.5f
     };
 
-    float maxExtent = max(
-        maxP.x - minP.x,
-        max(
-            maxP.y - minP.y,
-            maxP.z - minP.z
-        )
+    float maxExtent = std::max(
+        std::max(
+            maxP.z - minP.z,
+            maxP.y - minP.y
+        ),
+        maxP.x - minP.x
     );
 
     if (maxExtent > 0.0f)
     {
         float scale = OBJ_SCALE / maxExtent;
 
-        for (auto& v : outVertices)
+        minP.x = (minP.x - center.x) * scale;
+        minP.y = (minP.y - center.y) * scale;
+        minP.z = (minP.z - center.z) * scale;
+
+        maxP.x = (maxP.x - center.x) * scale;
+        maxP.y = (maxP.y - center.y) * scale;
+        maxP.z = (maxP.z - center.z) * scale;
+
+        ForEachChunk(ranges.size(), [&](size_t i)
         {
-            v.position.x = (v.position.x - center.x) * scale;
-            v.position.y = (v.position.y - center.y) * scale;
-            v.position.z = (v.position.z - center.z) * scale;
-        }
+            Vertex* v = outVertices.data() + vertexBase + ranges[i].vertexBase;
+
+            for (size_t k = 0; k < ranges[i].count; k++, v++)
+            {
+                v->position.x = (v->position.x - center.x) * scale;
+                v->position.y = (v->position.y - center.y) * scale;
+                v->position.z = (v->position.z - center.z) * scale;
+            }
+        });
+    }
+
+    if (stats)
+    {
+        stats->boundsMin = minP;
+        stats->boundsMax = maxP;
     }
 
     return true;
@@ -1,12 +1,59 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <cstdint>
 #include <DirectXMath.h>
 
-struct Vertex;
+#include "vertex.h"
+
+enum class OBJWeldMode
+{
+    // One vertex per face corner, indices are 0..N-1.
+    None,
+    // Corners sharing the same position and normal records share a vertex.
+    // Texcoords are not part of the key: Vertex has none, so corners that
+    // differ only in their vt record are welded too.
+    Indices,
+    // As Indices, but position records closer than weldEpsilon are merged first.
+    Position
+};
+
+struct OBJLoadOptions
+{
+    // 0 picks one worker per hardware thread, 1 parses on the calling thread.
+    // The result is identical for every value.
+    unsigned threadCount = 0;
+
+    OBJWeldMode weld = OBJWeldMode::Indices;
+
+    // In file units, only used by OBJWeldMode::Position.
+    float weldEpsilon = 1e-6f;
+};
+
+struct OBJLoadStats
+{
+    size_t cornerCount = 0;
+    size_t vertexCount = 0;
+    size_t indexCount = 0;
+
+    // Bounds of the normalized output.
+    DirectX::XMFLOAT3 boundsMin = { 0.0f, 0.0f, 0.0f };
+    DirectX::XMFLOAT3 boundsMax = { 0.0f, 0.0f, 0.0f };
+
+    // Vertex buffer bytes saved by welding compared to one vertex per corner.
+    size_t VertexBytesSaved() const { return (cornerCount - vertexCount) * sizeof(Vertex); }
+};
 
 bool LoadOBJ(
     const std::string& filename,
     std::vector<Vertex>& outVertices,
     std::vector<uint32_t>& outIndices
 );
+
+bool LoadOBJ(
+    const std::string& filename,
+    std::vector<Vertex>& outVertices,
+    std::vector<uint32_t>& outIndices,
+    const OBJLoadOptions& options,
+    OBJLoadStats* stats = nullptr
+);
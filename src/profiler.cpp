@@ -0,0 +1,359 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+thread_local ProfileThreadBuffer* tProfileBuffer = nullptr;
+
+namespace
+{
+    // Refine the tick rate once the baseline is at least this long.
+    constexpr uint64_t CALIBRATION_INTERVAL = 100000000;
+
+    void WriteEscaped(FILE* f, const char* s)
+    {
+        for (; *s; s++)
+        {
+            if (*s == '"' || *s == '\\')
+                fputc('\\', f);
+            if ((unsigned char)*s >= 0x20)
+                fputc(*s, f);
+        }
+    }
+}
+
+uint64_t ProfilerNow()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ProfileThreadBuffer::ProfileThreadBuffer(uint32_t thread)
+    : mThread(thread),
+    mHead(0),
+    mTail(0),
+    mDropped(0)
+{
+}
+
+// ===== Profiler =====
+
+Profiler& Profiler::Get()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler()
+    : mFrameTrack(0),
+    mBaseTicks(0),
+    mBaseNs(0),
+    mNsPerTick(1.0),
+    mFrameCount(0),
+    mFrameStart(0),
+    mCapturing(false),
+    mMaxCapture(0)
+{
+    mBaseTicks = ProfilerTicks();
+    mBaseNs = ProfilerNow();
+
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+    // A first estimate of the TSC rate; EndFrame refines it.
+    uint64_t ns;
+    do
+    {
+        ns = ProfilerNow();
+    } while (ns - mBaseNs < 1000000);
+    mNsPerTick = (double)(ns - mBaseNs) / (double)(ProfilerTicks() - mBaseTicks);
+#endif
+
+    mFrameTrack = AddTrackLocked("Frames");
+    mFrameStart = ProfilerNow();
+}
+
+uint32_t Profiler::AddTrackLocked(const std::string& name)
+{
+    mTracks.push_back(name);
+    return (uint32_t)(mTracks.size() - 1);
+}
+
+uint32_t Profiler::AddTrack(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return AddTrackLocked(name);
+}
+
+ProfileThreadBuffer* Profiler::RegisterThread()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    uint32_t id = AddTrackLocked("Thread " + std::to_string(mThreads.size()));
+    mThreads.push_back(std::make_unique<ProfileThreadBuffer>(id));
+
+    tProfileBuffer = mThreads.back().get();
+    return tProfileBuffer;
+}
+
+void Profiler::SetThreadName(const std::string& name)
+{
+    ProfileThreadBuffer* buffer = tProfileBuffer ? tProfileBuffer : RegisterThread();
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mTracks[buffer->Thread()] = name;
+}
+
+void Profiler::AddEvent(uint32_t track, const char* name, uint64_t start, uint64_t end)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPendingEvents.push_back({ name, start, end, track });
+}
+
+uint64_t Profiler::ToNanoseconds(uint64_t ticks) const
+{
+    return mBaseNs + (uint64_t)((double)(int64_t)(ticks - mBaseTicks) * mNsPerTick);
+}
+
+void Profiler::Calibrate()
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+    uint64_t ticks = ProfilerTicks();
+    uint64_t ns = ProfilerNow();
+    if (ns - mBaseNs >= CALIBRATION_INTERVAL && ticks > mBaseTicks)
+        mNsPerTick = (double)(ns - mBaseNs) / (double)(ticks - mBaseTicks);
+#endif
+}
+
+void Profiler::Collect(const ProfileEvent& event)
+{
+    ZoneHistory& history = mHistory[event.name];
+    if (history.totals.empty())
+    {
+        history.totals.assign(HistoryFrames, 0);
+        history.calls.assign(HistoryFrames, 0);
+        history.lastFrame = mFrameCount;
+    }
+
+    // Frames the zone skipped count as not run.
+    if (history.lastFrame != mFrameCount)
+    {
+        uint64_t first = std::max(history.lastFrame + 1, mFrameCount >= HistoryFrames ? mFrameCount - HistoryFrames + 1 : 0);
+        for (uint64_t f = first; f <= mFrameCount; f++)
+        {
+            history.totals[f % HistoryFrames] = 0;
+            history.calls[f % HistoryFrames] = 0;
+        }
+        history.lastFrame = mFrameCount;
+    }
+
+    history.totals[mFrameCount % HistoryFrames] += event.end - event.start;
+    history.calls[mFrameCount % HistoryFrames] += 1;
+
+    if (mCapturing && mCapture.size() < mMaxCapture)
+        mCapture.push_back(event);
+}
+
+void Profiler::EndFrame()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    Calibrate();
+
+    for (std::unique_ptr<ProfileThreadBuffer>& thread : mThreads)
+    {
+        uint32_t id = thread->Thread();
+        thread->Drain([&](const ProfileThreadBuffer::Record& record)
+        {
+            Collect({ record.name, ToNanoseconds(record.start), ToNanoseconds(record.end), id });
+        });
+    }
+
+    for (const ProfileEvent& event : mPendingEvents)
+        Collect(event);
+    mPendingEvents.clear();
+
+    uint64_t now = ProfilerNow();
+    Collect({ "Frame", mFrameStart, now, mFrameTrack });
+    mFrameStart = now;
+
+    ++mFrameCount;
+}
+
+void Profiler::BeginCapture(size_t maxEvents)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mCapture.clear();
+    mMaxCapture = maxEvents;
+    mCapturing = true;
+}
+
+void Profiler::EndCapture()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mCapturing = false;
+}
+
+bool Profiler::WriteChromeTrace(const std::string& path) const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f)
+        return false;
+
+    uint64_t origin = UINT64_MAX;
+    for (const ProfileEvent& event : mCapture)
+        origin = std::min(origin, event.start);
+
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+    for (uint32_t track = 0; track < (uint32_t)mTracks.size(); track++)
+    {
+        fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"", track);
+        WriteEscaped(f, mTracks[track].c_str());
+        fprintf(f, "\"}},\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"sort_index\":%u}}%s\n",
+            track, track, track + 1 < mTracks.size() || !mCapture.empty() ? "," : "");
+    }
+
+    // Microseconds, as the format expects, with nanosecond decimals.
+    for (size_t i = 0; i < mCapture.size(); i++)
+    {
+        const ProfileEvent& event = mCapture[i];
+        fprintf(f, "{\"name\":\"");
+        WriteEscaped(f, event.name);
+        fprintf(f, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+            event.thread,
+            (event.start - origin) / 1000.0,
+            (event.end - event.start) / 1000.0,
+            i + 1 < mCapture.size() ? "," : "");
+    }
+
+    fprintf(f, "]}\n");
+    return fclose(f) == 0;
+}
+
+void Profiler::GetStats(std::vector<ProfileZoneStats>& stats) const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    stats.clear();
+
+    uint64_t frames = std::min<uint64_t>(mFrameCount, HistoryFrames);
+    std::vector<uint64_t> totals;
+
+    for (const auto& entry : mHistory)
+    {
+        const ZoneHistory& history = entry.second;
+
+        totals.clear();
+        uint64_t calls = 0;
+        for (uint64_t f = mFrameCount - frames; f < mFrameCount; f++)
+        {
+            uint32_t n = f <= history.lastFrame ? history.calls[f % HistoryFrames] : 0;
+            if (n == 0)
+                continue;
+            totals.push_back(history.totals[f % HistoryFrames]);
+            calls += n;
+        }
+
+        if (totals.empty())
+            continue;
+
+        std::sort(totals.begin(), totals.end());
+
+        uint64_t sum = 0;
+        for (uint64_t t : totals)
+            sum += t;
+
+        size_t p99 = (totals.size() * 99 + 99) / 100 - 1;
+
+        ProfileZoneStats zone;
+        zone.name = entry.first;
+        zone.minMs = totals.front() / 1e6;
+        zone.avgMs = (double)sum / totals.size() / 1e6;
+        zone.p99Ms = totals[p99] / 1e6;
+        zone.callsPerFrame = (double)calls / totals.size();
+        stats.push_back(zone);
+    }
+
+    std::sort(stats.begin(), stats.end(), [](const ProfileZoneStats& a, const ProfileZoneStats& b)
+    {
+        return a.avgMs > b.avgMs;
+    });
+}
+
+uint64_t Profiler::DroppedCount() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    uint64_t dropped = 0;
+    for (const std::unique_ptr<ProfileThreadBuffer>& thread : mThreads)
+        dropped += thread->Dropped();
+    return dropped;
+}
+
+// ===== GpuProfiler =====
+
+GpuProfiler::GpuProfiler()
+    : mBackend(nullptr),
+    mMaxZones(0),
+    mTrack(0),
+    mSlot(0)
+{
+}
+
+void GpuProfiler::Initialize(GpuTimestampBackend* backend, uint32_t slotCount, uint32_t maxZones)
+{
+    mBackend = backend;
+    mMaxZones = maxZones;
+    mSlots.assign(slotCount, Slot());
+    mSlot = 0;
+    mTrack = Profiler::Get().AddTrack("GPU");
+}
+
+void GpuProfiler::BeginFrame(uint32_t slot)
+{
+    mSlot = slot;
+    Slot& s = mSlots[slot];
+
+    // The slot's last frame is done on the GPU: report it.
+    if (s.pending && !s.names.empty())
+    {
+        uint32_t count = (uint32_t)s.names.size() * 2;
+        mTimes.resize(count);
+
+        if (mBackend->ReadSlot(slot, count, mTimes.data()))
+        {
+            for (size_t i = 0; i < s.names.size(); i++)
+                Profiler::Get().AddEvent(mTrack, s.names[i], mTimes[i * 2], mTimes[i * 2 + 1]);
+        }
+    }
+
+    s.names.clear();
+    s.pending = false;
+}
+
+void GpuProfiler::EndFrame()
+{
+    Slot& s = mSlots[mSlot];
+    if (!s.names.empty())
+        mBackend->ResolveSlot(mSlot, (uint32_t)s.names.size() * 2);
+    s.pending = true;
+}
+
+uint32_t GpuProfiler::BeginZone(const char* name)
+{
+    Slot& s = mSlots[mSlot];
+    if (s.names.size() >= mMaxZones)
+        return UINT32_MAX;
+
+    uint32_t zone = (uint32_t)s.names.size();
+    s.names.push_back(name);
+    mBackend->WriteTimestamp(mSlot, zone * 2);
+    return zone;
+}
+
+void GpuProfiler::EndZone(uint32_t zone)
+{
+    if (zone != UINT32_MAX)
+        mBackend->WriteTimestamp(mSlot, zone * 2 + 1);
+}
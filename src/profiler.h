@@ -0,0 +1,296 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// Raw CPU timestamp: the TSC on x86, nanoseconds elsewhere. Converted to
+// nanoseconds only when events are collected.
+inline uint64_t ProfilerTicks()
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Nanoseconds on the profiler timeline (steady_clock, QPC on Windows).
+uint64_t ProfilerNow();
+
+// A finished zone, times in ProfilerNow nanoseconds.
+struct ProfileEvent
+{
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+    uint32_t thread;
+};
+
+// Zones of one thread. Only the owner pushes, only the profiler pops, so
+// neither side locks; a full buffer drops zones.
+class ProfileThreadBuffer
+{
+public:
+    static constexpr uint64_t CAPACITY = 1 << 14;
+
+    struct Record
+    {
+        const char* name;
+        uint64_t start;
+        uint64_t end;
+    };
+
+    explicit ProfileThreadBuffer(uint32_t thread);
+
+    void Push(const char* name, uint64_t start, uint64_t end)
+    {
+        uint64_t head = mHead.load(std::memory_order_relaxed);
+        if (head - mTail.load(std::memory_order_acquire) >= CAPACITY)
+        {
+            mDropped.store(mDropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return;
+        }
+
+        Record& record = mRecords[head & (CAPACITY - 1)];
+        record.name = name;
+        record.start = start;
+        record.end = end;
+        mHead.store(head + 1, std::memory_order_release);
+    }
+
+    // Profiler side: hands every pending record to fn.
+    template <typename Fn>
+    void Drain(Fn fn)
+    {
+        uint64_t tail = mTail.load(std::memory_order_relaxed);
+        uint64_t head = mHead.load(std::memory_order_acquire);
+        for (; tail != head; tail++)
+            fn(mRecords[tail & (CAPACITY - 1)]);
+        mTail.store(tail, std::memory_order_release);
+    }
+
+    uint32_t Thread() const { return mThread; }
+    uint64_t Dropped() const { return mDropped.load(std::memory_order_relaxed); }
+
+private:
+    uint32_t mThread;
+
+    alignas(64) std::atomic<uint64_t> mHead;
+    alignas(64) std::atomic<uint64_t> mTail;
+    std::atomic<uint64_t> mDropped;
+
+    Record mRecords[CAPACITY];
+};
+
+struct ProfileZoneStats
+{
+    const char* name;
+    // Per frame, over the frames in the history; a zone entered several
+    // times in a frame counts its total.
+    double minMs;
+    double avgMs;
+    double p99Ms;
+    double callsPerFrame;
+};
+
+// Collects zones from every thread. Call EndFrame once a frame on the main
+// thread; it gathers the frame's zones, keeps a history for statistics and,
+// while capturing, the events for a Chrome trace.
+class Profiler
+{
+public:
+    static Profiler& Get();
+
+    Profiler();
+
+    // Names the calling thread in traces.
+    void SetThreadName(const std::string& name);
+
+    void EndFrame();
+    uint64_t FrameCount() const { return mFrameCount; }
+
+    // Zones that took effect between BeginCapture and EndCapture, up to
+    // maxEvents, are kept for WriteChromeTrace.
+    void BeginCapture(size_t maxEvents = 1 << 20);
+    void EndCapture();
+    bool Capturing() const { return mCapturing; }
+    size_t CapturedEventCount() const { return mCapture.size(); }
+
+    // Chrome / Perfetto trace event JSON (chrome://tracing, ui.perfetto.dev).
+    bool WriteChromeTrace(const std::string& path) const;
+
+    // Over the last HistoryFrames frames, sorted by average, largest first.
+    void GetStats(std::vector<ProfileZoneStats>& stats) const;
+    uint64_t DroppedCount() const;
+
+    // Events measured elsewhere, such as GPU timestamps, on their own track.
+    uint32_t AddTrack(const std::string& name);
+    void AddEvent(uint32_t track, const char* name, uint64_t start, uint64_t end);
+
+    // Slow path of ProfileZone, once per thread.
+    ProfileThreadBuffer* RegisterThread();
+
+    static constexpr size_t HistoryFrames = 256;
+
+private:
+    struct ZoneHistory
+    {
+        // Per-frame totals in nanoseconds and call counts, a ring.
+        std::vector<uint64_t> totals;
+        std::vector<uint32_t> calls;
+        uint64_t lastFrame = 0;
+    };
+
+    uint64_t ToNanoseconds(uint64_t ticks) const;
+    void Calibrate();
+    void Collect(const ProfileEvent& event);
+    uint32_t AddTrackLocked(const std::string& name);
+
+    mutable std::mutex mMutex;
+    std::vector<std::unique_ptr<ProfileThreadBuffer>> mThreads;
+    // Names of threads and other tracks, by id.
+    std::vector<std::string> mTracks;
+    uint32_t mFrameTrack;
+    std::vector<ProfileEvent> mPendingEvents;
+
+    // ticks -> ns: mBaseNs + (ticks - mBaseTicks) * mNsPerTick, the ratio
+    // refined as the baseline grows.
+    uint64_t mBaseTicks;
+    uint64_t mBaseNs;
+    double mNsPerTick;
+
+    uint64_t mFrameCount;
+    uint64_t mFrameStart;
+    std::unordered_map<const char*, ZoneHistory> mHistory;
+
+    bool mCapturing;
+    size_t mMaxCapture;
+    std::vector<ProfileEvent> mCapture;
+};
+
+extern thread_local ProfileThreadBuffer* tProfileBuffer;
+
+// Times its scope on the calling thread. name must outlive the profiler,
+// in practice a string literal; stats group zones by that pointer.
+class ProfileZone
+{
+public:
+    explicit ProfileZone(const char* name)
+        : mName(name),
+        mStart(ProfilerTicks())
+    {
+    }
+
+    ~ProfileZone()
+    {
+        uint64_t end = ProfilerTicks();
+        ProfileThreadBuffer* buffer = tProfileBuffer;
+        if (!buffer)
+            buffer = Profiler::Get().RegisterThread();
+        buffer->Push(mName, mStart, end);
+    }
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+    const char* mName;
+    uint64_t mStart;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#if defined(PROFILER_DISABLED)
+#define PROFILE_ZONE(name)
+#else
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#endif
+
+// ===== GPU timestamps =====
+
+// Timestamp queries on a GPU queue (an ID3D12QueryHeap for D3D12). Queries
+// are grouped in slots, one per frame in flight.
+class GpuTimestampBackend
+{
+public:
+    virtual ~GpuTimestampBackend() {}
+
+    // Records a timestamp into the command list being built.
+    virtual void WriteTimestamp(uint32_t slot, uint32_t query) = 0;
+    // After the frame's last timestamp: makes the first count readable.
+    virtual void ResolveSlot(uint32_t slot, uint32_t count) = 0;
+    // Once the GPU has finished the slot's frame: the timestamps as
+    // ProfilerNow nanoseconds.
+    virtual bool ReadSlot(uint32_t slot, uint32_t count, uint64_t* nanoseconds) = 0;
+};
+
+// GPU zones around command list regions, reported to the profiler on a
+// "GPU" track when their frame slot comes around again.
+class GpuProfiler
+{
+public:
+    GpuProfiler();
+
+    void Initialize(GpuTimestampBackend* backend, uint32_t slotCount, uint32_t maxZones = 64);
+
+    // slot must be free on the GPU, as after FrameRing::BeginFrame.
+    void BeginFrame(uint32_t slot);
+    void EndFrame();
+
+    // Past maxZones in a frame, zones are ignored.
+    uint32_t BeginZone(const char* name);
+    void EndZone(uint32_t zone);
+
+private:
+    struct Slot
+    {
+        std::vector<const char*> names;
+        bool pending = false;
+    };
+
+    GpuTimestampBackend* mBackend;
+    uint32_t mMaxZones;
+    uint32_t mTrack;
+
+    std::vector<Slot> mSlots;
+    uint32_t mSlot;
+    std::vector<uint64_t> mTimes;
+};
+
+// Scoped GpuProfiler zone.
+class GpuProfileZone
+{
+public:
+    GpuProfileZone(GpuProfiler& profiler, const char* name)
+        : mProfiler(profiler),
+        mZone(profiler.BeginZone(name))
+    {
+    }
+
+    ~GpuProfileZone()
+    {
+        mProfiler.EndZone(mZone);
+    }
+
+    GpuProfileZone(const GpuProfileZone&) = delete;
+    GpuProfileZone& operator=(const GpuProfileZone&) = delete;
+
+private:
+    GpuProfiler& mProfiler;
+    uint32_t mZone;
+};
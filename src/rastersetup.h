@@ -0,0 +1,209 @@
+#pragma once
+
+// Triangle setup shared by the CPU rasterizers, SoftwareRenderer and
+// OcclusionBuffer: clipping in clip space, snapping to the sub-pixel grid,
+// culling, the covered pixel rectangle and the top-left edge functions.
+// Internal to their translation units.
+
+#include <algorithm>
+#include <cstdint>
+
+namespace RasterSetup
+{
+    // Sub-pixel precision of snapped vertex positions.
+    constexpr int SUBPIXEL_BITS = 4;
+    constexpr int SUBPIXEL = 1 << SUBPIXEL_BITS;
+
+    enum ClipPlane
+    {
+        CLIP_LEFT = 1 << 0,
+        CLIP_RIGHT = 1 << 1,
+        CLIP_BOTTOM = 1 << 2,
+        CLIP_TOP = 1 << 3,
+        CLIP_NEAR = 1 << 4,
+        CLIP_FAR = 1 << 5
+    };
+
+    inline float PlaneDistance(const float* v, int plane)
+    {
+        // v = x, y, z, w
+        switch (plane)
+        {
+        case CLIP_LEFT: return v[3] + v[0];
+        case CLIP_RIGHT: return v[3] - v[0];
+        case CLIP_BOTTOM: return v[3] + v[1];
+        case CLIP_TOP: return v[3] - v[1];
+        case CLIP_NEAR: return v[2];
+        default: return v[3] - v[2];
+        }
+    }
+
+    inline int64_t FloorDiv(int64_t a, int64_t b)
+    {
+        return a >= 0 ? a / b : -((-a + b - 1) / b);
+    }
+
+    template <typename V>
+    uint32_t OutCode(const V& v)
+    {
+        const float* p = &v.x;
+        uint32_t code = 0;
+        for (int plane = CLIP_LEFT; plane <= CLIP_FAR; plane <<= 1)
+        {
+            if (PlaneDistance(p, plane) < 0.0f)
+                code |= plane;
+        }
+        return code;
+    }
+
+    // Calls emit(a, b, c) for each triangle left of a, b, c inside the
+    // frustum, in fan order. V is all floats, starting with x, y, z, w;
+    // every field is interpolated at the clipped edges.
+    template <typename V, typename Emit>
+    void ClipTriangle(const V& a, const V& b, const V& c, Emit&& emit)
+    {
+        constexpr int MAX_CLIPPED = 3 + 6;
+        constexpr int FIELDS = sizeof(V) / sizeof(float);
+
+        uint32_t codeA = OutCode(a);
+        uint32_t codeB = OutCode(b);
+        uint32_t codeC = OutCode(c);
+
+        if (codeA & codeB & codeC)
+            return;
+
+        if ((codeA | codeB | codeC) == 0)
+        {
+            emit(a, b, c);
+            return;
+        }
+
+        // ===== Sutherland-Hodgman against the crossed planes =====
+        V polygon[2][MAX_CLIPPED];
+        int count = 3;
+        polygon[0][0] = a;
+        polygon[0][1] = b;
+        polygon[0][2] = c;
+
+        int src = 0;
+        uint32_t crossed = codeA | codeB | codeC;
+
+        for (int plane = CLIP_LEFT; plane <= CLIP_FAR && count >= 3; plane <<= 1)
+        {
+            if (!(crossed & plane))
+                continue;
+
+            const V* in = polygon[src];
+            V* out = polygon[src ^ 1];
+            int outCount = 0;
+
+            for (int k = 0; k < count; k++)
+            {
+                const V& p = in[k];
+                const V& q = in[(k + 1) % count];
+                float dp = PlaneDistance(&p.x, plane);
+                float dq = PlaneDistance(&q.x, plane);
+
+                if (dp >= 0.0f)
+                    out[outCount++] = p;
+
+                if ((dp >= 0.0f) != (dq >= 0.0f))
+                {
+                    float t = dp / (dp - dq);
+                    const float* fp = &p.x;
+                    const float* fq = &q.x;
+                    float* fr = &out[outCount].x;
+                    for (int f = 0; f < FIELDS; f++)
+                        fr[f] = fp[f] + (fq[f] - fp[f]) * t;
+                    outCount++;
+                }
+            }
+
+            count = outCount;
+            src ^= 1;
+        }
+
+        for (int k = 1; k + 1 < count; k++)
+            emit(polygon[src][0], polygon[src][k], polygon[src][k + 1]);
+    }
+
+    // A clipped triangle on the sub-pixel grid of the viewport.
+    struct SnappedTriangle
+    {
+        int64_t X[3];
+        int64_t Y[3];
+        // 1 / w of each vertex, for the attributes.
+        float invW[3];
+        // Twice the area in sub-pixel units, > 0.
+        int64_t area;
+
+        // Covered pixels, inclusive: centers at (x + 0.5, y + 0.5).
+        int minX;
+        int minY;
+        int maxX;
+        int maxY;
+    };
+
+    // Snaps v0, v1, v2 to the viewport. False when a vertex is behind the
+    // eye, the triangle is not clockwise on screen (front facing) or it
+    // covers no pixel center.
+    template <typename V>
+    bool SnapTriangle(const V& v0, const V& v1, const V& v2, int width, int height, SnappedTriangle& s)
+    {
+        const V* v[3] = { &v0, &v1, &v2 };
+
+        for (int k = 0; k < 3; k++)
+        {
+            if (v[k]->w <= 0.0f)
+                return false;
+
+            float invW = 1.0f / v[k]->w;
+            float sx = (v[k]->x * invW * 0.5f + 0.5f) * width;
+            float sy = (0.5f - v[k]->y * invW * 0.5f) * height;
+
+            // Clipped to the screen, so never below -0.5: truncation rounds.
+            s.X[k] = (int64_t)(sx * SUBPIXEL + 0.5f);
+            s.Y[k] = (int64_t)(sy * SUBPIXEL + 0.5f);
+            s.invW[k] = invW;
+        }
+
+        const int64_t* X = s.X;
+        const int64_t* Y = s.Y;
+
+        s.area = (X[1] - X[0]) * (Y[2] - Y[0]) - (Y[1] - Y[0]) * (X[2] - X[0]);
+        if (s.area <= 0)
+            return false;
+
+        int64_t minFx = std::min({ X[0], X[1], X[2] });
+        int64_t maxFx = std::max({ X[0], X[1], X[2] });
+        int64_t minFy = std::min({ Y[0], Y[1], Y[2] });
+        int64_t maxFy = std::max({ Y[0], Y[1], Y[2] });
+
+        s.minX = (int)std::max<int64_t>(0, FloorDiv(minFx - SUBPIXEL / 2 + SUBPIXEL - 1, SUBPIXEL));
+        s.maxX = (int)std::min<int64_t>(width - 1, FloorDiv(maxFx - SUBPIXEL / 2, SUBPIXEL));
+        s.minY = (int)std::max<int64_t>(0, FloorDiv(minFy - SUBPIXEL / 2 + SUBPIXEL - 1, SUBPIXEL));
+        s.maxY = (int)std::min<int64_t>(height - 1, FloorDiv(maxFy - SUBPIXEL / 2, SUBPIXEL));
+
+        return s.minX <= s.maxX && s.minY <= s.maxY;
+    }
+
+    // Edge k is opposite vertex k: E = A * x + B * y + C in sub-pixel units
+    // is >= 0 inside, the top-left bias folded into C. The viewport bounds
+    // (MAX_DIMENSION in each rasterizer) keep A and B within 32 bits.
+    inline void SetupEdges(const SnappedTriangle& s, int32_t A[3], int32_t B[3], int64_t C[3])
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            int i = (k + 1) % 3;
+            int j = (k + 2) % 3;
+
+            int64_t a = s.Y[i] - s.Y[j];
+            int64_t b = s.X[j] - s.X[i];
+            bool topLeft = a > 0 || (a == 0 && b > 0);
+
+            A[k] = (int32_t)a;
+            B[k] = (int32_t)b;
+            C[k] = -(a * s.X[i] + b * s.Y[i]) - (topLeft ? 0 : 1);
+        }
+    }
+}
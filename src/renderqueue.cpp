@@ -0,0 +1,160 @@
+#include "renderqueue.h"
+
+#include <cstring>
+
+namespace
+{
+    uint32_t Field(uint64_t key, uint32_t shift, uint32_t bits)
+    {
+        return (uint32_t)(key >> shift) & ((1u << bits) - 1);
+    }
+}
+
+uint64_t MakeSortKey(uint32_t pipeline, uint32_t material, uint32_t mesh, uint32_t depth)
+{
+    return ((uint64_t)(pipeline & ((1u << SORT_PIPELINE_BITS) - 1)) << SORT_PIPELINE_SHIFT) |
+        ((uint64_t)(material & ((1u << SORT_MATERIAL_BITS) - 1)) << SORT_MATERIAL_SHIFT) |
+        ((uint64_t)(mesh & ((1u << SORT_MESH_BITS) - 1)) << SORT_MESH_SHIFT) |
+        ((uint64_t)(depth & SORT_DEPTH_MAX) << SORT_DEPTH_SHIFT);
+}
+
+uint32_t SortKeyPipeline(uint64_t key) { return Field(key, SORT_PIPELINE_SHIFT, SORT_PIPELINE_BITS); }
+uint32_t SortKeyMaterial(uint64_t key) { return Field(key, SORT_MATERIAL_SHIFT, SORT_MATERIAL_BITS); }
+uint32_t SortKeyMesh(uint64_t key) { return Field(key, SORT_MESH_SHIFT, SORT_MESH_BITS); }
+uint32_t SortKeyDepth(uint64_t key) { return Field(key, SORT_DEPTH_SHIFT, SORT_DEPTH_BITS); }
+
+uint32_t QuantizeDepth(float depth, float nearZ, float farZ)
+{
+    float t = (depth - nearZ) / (farZ - nearZ);
+    if (!(t > 0.0f))
+        return 0;
+    if (t >= 1.0f)
+        return SORT_DEPTH_MAX;
+
+    return (uint32_t)(t * (float)SORT_DEPTH_MAX);
+}
+
+RenderQueue::RenderQueue()
+{
+}
+
+void RenderQueue::Reserve(size_t count)
+{
+    mPackets.reserve(count);
+    mScratch.reserve(count);
+}
+
+void RenderQueue::Clear()
+{
+    mPackets.clear();
+}
+
+void RenderQueue::Sort()
+{
+    mStats.sortPasses = 0;
+
+    size_t count = mPackets.size();
+    if (count < 2)
+        return;
+
+    // Already sorted input is common for static scenes.
+    bool sorted = true;
+    for (size_t i = 1; i < count && sorted; i++)
+        sorted = mPackets[i - 1].key <= mPackets[i].key;
+
+    if (sorted)
+        return;
+
+    // Every digit's histogram in one read.
+    uint32_t (*histograms)[RADIX_SIZE] = mHistograms;
+    memset(mHistograms, 0, sizeof(mHistograms));
+
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t key = mPackets[i].key;
+        for (uint32_t pass = 0; pass < RADIX_PASSES; pass++)
+            ++histograms[pass][(key >> (pass * RADIX_BITS)) & (RADIX_SIZE - 1)];
+    }
+
+    mScratch.resize(count);
+    RenderPacket* src = mPackets.data();
+    RenderPacket* dst = mScratch.data();
+
+    for (uint32_t pass = 0; pass < RADIX_PASSES; pass++)
+    {
+        uint32_t* histogram = histograms[pass];
+        uint32_t shift = pass * RADIX_BITS;
+
+        // All keys share this digit: the pass would not move anything.
+        if (histogram[(src[0].key >> shift) & (RADIX_SIZE - 1)] == count)
+            continue;
+
+        uint32_t offset = 0;
+        for (uint32_t d = 0; d < RADIX_SIZE; d++)
+        {
+            uint32_t n = histogram[d];
+            histogram[d] = offset;
+            offset += n;
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t digit = (uint32_t)(src[i].key >> shift) & (RADIX_SIZE - 1);
+            dst[histogram[digit]++] = src[i];
+        }
+
+        RenderPacket* swap = src;
+        src = dst;
+        dst = swap;
+        ++mStats.sortPasses;
+    }
+
+    if (src != mPackets.data())
+        mPackets.swap(mScratch);
+}
+
+void RenderQueue::Execute(RenderStateSink& sink)
+{
+    uint32_t passes = mStats.sortPasses;
+    mStats = RenderQueueStats();
+    mStats.sortPasses = passes;
+
+    bool first = true;
+    uint32_t pipeline = 0;
+    uint32_t material = 0;
+    uint32_t mesh = 0;
+
+    for (const RenderPacket& packet : mPackets)
+    {
+        uint32_t p = SortKeyPipeline(packet.key);
+        uint32_t m = SortKeyMaterial(packet.key);
+        uint32_t g = SortKeyMesh(packet.key);
+
+        if (first || p != pipeline)
+        {
+            sink.SetPipeline(p);
+            pipeline = p;
+            ++mStats.pipelineChanges;
+        }
+
+        if (first || m != material)
+        {
+            sink.SetMaterial(m);
+            material = m;
+            ++mStats.materialChanges;
+        }
+
+        if (first || g != mesh)
+        {
+            sink.SetMesh(g);
+            mesh = g;
+            ++mStats.meshChanges;
+        }
+
+        first = false;
+        sink.Draw(packet.payload);
+    }
+
+    mStats.draws = mPackets.size();
+    mStats.redundantChanges = mStats.draws * 3 - mStats.pipelineChanges - mStats.materialChanges - mStats.meshChanges;
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Sort key layout, most significant first: pipeline, material, mesh, depth
+// bucket. Sorting by key groups draws by the most expensive state first.
+static const uint32_t SORT_PIPELINE_BITS = 10;
+static const uint32_t SORT_MATERIAL_BITS = 16;
+static const uint32_t SORT_MESH_BITS = 16;
+static const uint32_t SORT_DEPTH_BITS = 22;
+
+static const uint32_t SORT_DEPTH_SHIFT = 0;
+static const uint32_t SORT_MESH_SHIFT = SORT_DEPTH_SHIFT + SORT_DEPTH_BITS;
+static const uint32_t SORT_MATERIAL_SHIFT = SORT_MESH_SHIFT + SORT_MESH_BITS;
+static const uint32_t SORT_PIPELINE_SHIFT = SORT_MATERIAL_SHIFT + SORT_MATERIAL_BITS;
+
+// Fields are truncated to their widths.
+uint64_t MakeSortKey(uint32_t pipeline, uint32_t material, uint32_t mesh, uint32_t depth);
+
+uint32_t SortKeyPipeline(uint64_t key);
+uint32_t SortKeyMaterial(uint64_t key);
+uint32_t SortKeyMesh(uint64_t key);
+uint32_t SortKeyDepth(uint64_t key);
+
+// View depth in [nearZ, farZ] to a depth bucket, near first. Pass
+// SORT_DEPTH_MAX - bucket to draw back to front.
+static const uint32_t SORT_DEPTH_MAX = (1u << SORT_DEPTH_BITS) - 1;
+uint32_t QuantizeDepth(float depth, float nearZ, float farZ);
+
+struct RenderPacket
+{
+    uint64_t key;
+    // Index into the caller's draw data.
+    uint32_t payload;
+    uint32_t padding;
+};
+
+// Receives the state changes and draws of a sorted queue (a command list
+// for D3D12). Ids are the fields of the sort keys.
+class RenderStateSink
+{
+public:
+    virtual ~RenderStateSink() {}
+
+    virtual void SetPipeline(uint32_t pipeline) = 0;
+    virtual void SetMaterial(uint32_t material) = 0;
+    virtual void SetMesh(uint32_t mesh) = 0;
+    virtual void Draw(uint32_t payload) = 0;
+};
+
+struct RenderQueueStats
+{
+    uint64_t draws = 0;
+    uint64_t pipelineChanges = 0;
+    uint64_t materialChanges = 0;
+    uint64_t meshChanges = 0;
+    // Against binding every piece of state for every draw.
+    uint64_t redundantChanges = 0;
+    // Radix passes run by the last Sort; uniform digits are skipped.
+    uint32_t sortPasses = 0;
+};
+
+// Per-frame list of draw packets: Submit them in any order, Sort, then
+// Execute to replay them with only the state changes actually needed.
+class RenderQueue
+{
+public:
+    RenderQueue();
+
+    void Reserve(size_t count);
+    void Clear();
+
+    void Submit(uint64_t key, uint32_t payload)
+    {
+        mPackets.push_back({ key, payload, 0 });
+    }
+
+    size_t Size() const { return mPackets.size(); }
+    const std::vector<RenderPacket>& Packets() const { return mPackets; }
+
+    // Stable LSD radix sort on the keys.
+    void Sort();
+
+    // Issues a state change only when a key field differs from the
+    // previous draw's. Sets the stats of this frame.
+    void Execute(RenderStateSink& sink);
+
+    const RenderQueueStats& Stats() const { return mStats; }
+
+private:
+    // 11-bit digits: six passes, histograms still fit in L1.
+    static const uint32_t RADIX_BITS = 11;
+    static const uint32_t RADIX_SIZE = 1u << RADIX_BITS;
+    static const uint32_t RADIX_PASSES = (64 + RADIX_BITS - 1) / RADIX_BITS;
+
+    std::vector<RenderPacket> mPackets;
+    std::vector<RenderPacket> mScratch;
+
+    uint32_t mHistograms[RADIX_PASSES][RADIX_SIZE];
+
+    RenderQueueStats mStats;
+};
@@ -37,6 +37,168 @@ namespace Shaders
     }
     )";
 
+    inline std::string PackedVertexShader = R"(
+    cbuffer ObjectCB : register(b0)
+    {
+        matrix world;
+        matrix view;
+        matrix projection;
+        float4 positionMin;
+        float4 positionExtent;
+    };
+
+    struct VSInput
+    {
+        float4 position : POSITION;
+        float2 normal : NORMAL;
+    };
+
+    struct PSInput
+    {
+        float4 position : SV_POSITION;
+        float4 color : COLOR;
+        float3 normal : NORMAL;
+    };
+
+    float3 DecodeOctahedral(float2 e)
+    {
+        float3 n = float3(e, 1.0 - abs(e.x) - abs(e.y));
+        float t = saturate(-n.z);
+        n.xy += n.xy >= 0.0 ? -t : t;
+        return normalize(n);
+    }
+
+    PSInput main(VSInput input)
+    {
+        PSInput output;
+        float3 position = positionMin.xyz + input.position.xyz * positionExtent.xyz;
+        float4 worldPos = mul(float4(position,1), world);
+        output.position = mul(worldPos, view);
+        output.position = mul(output.position, projection);
+        output.color = float4(1,1,1,1);
+        output.normal = DecodeOctahedral(input.normal);
+        return output;
+    }
+    )";
+
+    // Instanced variants: world matrix and color come from input slot 1
+    // (InstanceData), view and projection still from ObjectCB.
+    inline std::string InstancedVertexShader = R"(
+    cbuffer ObjectCB : register(b0)
+    {
+        matrix world;
+        matrix view;
+        matrix projection;
+    };
+
+    struct VSInput
+    {
+        float3 position : POSITION;
+        float4 color : COLOR;
+        float3 normal : NORMAL;
+        float4 world0 : WORLD0;
+        float4 world1 : WORLD1;
+        float4 world2 : WORLD2;
+        float4 instanceColor : INSTANCECOLOR;
+    };
+
+    struct PSInput
+    {
+        float4 position : SV_POSITION;
+        float4 color : COLOR;
+        float3 normal : NORMAL;
+    };
+
+    PSInput main(VSInput input)
+    {
+        PSInput output;
+        float4 p = float4(input.position, 1);
+        float4 worldPos = float4(dot(input.world0, p), dot(input.world1, p), dot(input.world2, p), 1);
+        output.position = mul(worldPos, view);
+        output.position = mul(output.position, projection);
+        output.color = input.color * input.instanceColor;
+        output.normal = float3(
+            dot(input.world0.xyz, input.normal),
+            dot(input.world1.xyz, input.normal),
+            dot(input.world2.xyz, input.normal));
+        return output;
+    }
+    )";
+
+    inline std::string InstancedPackedVertexShader = R"(
+    cbuffer ObjectCB : register(b0)
+    {
+        matrix world;
+        matrix view;
+        matrix projection;
+        float4 positionMin;
+        float4 positionExtent;
+    };
+
+    struct VSInput
+    {
+        float4 position : POSITION;
+        float2 normal : NORMAL;
+        float4 world0 : WORLD0;
+        float4 world1 : WORLD1;
+        float4 world2 : WORLD2;
+        float4 instanceColor : INSTANCECOLOR;
+    };
+
+    struct PSInput
+    {
+        float4 position : SV_POSITION;
+        float4 color : COLOR;
+        float3 normal : NORMAL;
+    };
+
+    float3 DecodeOctahedral(float2 e)
+    {
+        float3 n = float3(e, 1.0 - abs(e.x) - abs(e.y));
+        float t = saturate(-n.z);
+        n.xy += n.xy >= 0.0 ? -t : t;
+        return normalize(n);
+    }
+
+    PSInput main(VSInput input)
+    {
+        PSInput output;
+        float4 p = float4(positionMin.xyz + input.position.xyz * positionExtent.xyz, 1);
+        float4 worldPos = float4(dot(input.world0, p), dot(input.world1, p), dot(input.world2, p), 1);
+        output.position = mul(worldPos, view);
+        output.position = mul(output.position, projection);
+        output.color = input.instanceColor;
+        float3 n = DecodeOctahedral(input.normal);
+        output.normal = float3(dot(input.world0.xyz, n), dot(input.world1.xyz, n), dot(input.world2.xyz, n));
+        return output;
+    }
+    )";
+
+    inline std::string InstancedPixelShader = R"(
+    cbuffer LightCB : register(b1)
+    {
+        float3 lightDir;
+        float padding;
+        float4 ambientColor;
+        float4 diffuseColor;
+    };
+
+    struct PSInput
+    {
+        float4 position : SV_POSITION;
+        float4 color : COLOR;
+        float3 normal : NORMAL;
+    };
+
+    float4 main(PSInput input) : SV_TARGET
+    {
+        float3 n = normalize(input.normal);
+        float NdotL = max(dot(n, -lightDir), 0.0);
+
+        return input.color * (ambientColor + diffuseColor * NdotL);
+    }
+    )";
+
     inline std::string PixelShader = R"(
     cbuffer LightCB : register(b1)
     {
@@ -0,0 +1,221 @@
+#include "shadercache.h"
+#include "mappedfile.h"
+#include "hash.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+namespace
+{
+    constexpr char SHADER_MAGIC[4] = { 'S', 'H', 'D', 'C' };
+
+    // Bump whenever the file layout or the key changes.
+    constexpr uint32_t SHADER_VERSION = 1;
+
+    constexpr uint64_t BLOB_ALIGNMENT = 16;
+
+    struct ShaderFileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t entryCount;
+        uint64_t fileSize;
+    };
+
+    // Sorted by key, followed by the bytecode blobs.
+    struct ShaderFileEntry
+    {
+        uint64_t key;
+        uint64_t offset;
+        uint64_t size;
+        uint64_t checksum;
+    };
+
+    uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    // Length first, so "ab" + "c" and "a" + "bc" hash apart.
+    uint64_t HashString(uint64_t h, const std::string& s)
+    {
+        h = HashCombine(h, s.size());
+        return Hash64(s.data(), s.size(), h);
+    }
+}
+
+uint64_t ShaderCacheKey(const ShaderSource& shader, uint64_t compilerVersion)
+{
+    uint64_t h = HashCombine(SHADER_VERSION, compilerVersion);
+    h = HashString(h, shader.source);
+    h = HashString(h, shader.entryPoint);
+    h = HashString(h, shader.profile);
+
+    h = HashCombine(h, shader.defines.size());
+    for (const ShaderDefine& define : shader.defines)
+    {
+        h = HashString(h, define.name);
+        h = HashString(h, define.value);
+    }
+
+    return HashCombine(h, shader.flags);
+}
+
+ShaderCache::ShaderCache()
+    : mDirty(false)
+{
+}
+
+bool ShaderCache::Load(const std::string& path)
+{
+    mPath = path;
+    mEntries.clear();
+    mDirty = false;
+    mStats = ShaderCacheStats();
+
+    return Merge(path);
+}
+
+bool ShaderCache::Merge(const std::string& path)
+{
+    MappedFile file;
+    if (!file.Open(path) || file.Size() < sizeof(ShaderFileHeader))
+        return false;
+
+    ShaderFileHeader header;
+    memcpy(&header, file.Data(), sizeof(header));
+
+    if (memcmp(header.magic, SHADER_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != SHADER_VERSION ||
+        header.fileSize != file.Size() ||
+        header.entryCount > (file.Size() - sizeof(header)) / sizeof(ShaderFileEntry))
+        return false;
+
+    const char* table = file.Data() + sizeof(header);
+    for (uint64_t i = 0; i < header.entryCount; i++)
+    {
+        ShaderFileEntry entry;
+        memcpy(&entry, table + i * sizeof(entry), sizeof(entry));
+
+        if (entry.offset > file.Size() || entry.size > file.Size() - entry.offset)
+            return false;
+
+        if (mEntries.count(entry.key))
+            continue;
+
+        const char* blob = file.Data() + entry.offset;
+        if (Hash64(blob, (size_t)entry.size) != entry.checksum)
+        {
+            ++mStats.corrupt;
+            continue;
+        }
+
+        mEntries[entry.key].assign(blob, blob + entry.size);
+    }
+
+    return true;
+}
+
+bool ShaderCache::Save()
+{
+    if (!mDirty)
+        return true;
+
+    // Keep what other processes saved since Load.
+    Merge(mPath);
+
+    std::vector<uint64_t> keys;
+    keys.reserve(mEntries.size());
+    for (const auto& entry : mEntries)
+        keys.push_back(entry.first);
+    std::sort(keys.begin(), keys.end());
+
+    ShaderFileHeader header = {};
+    memcpy(header.magic, SHADER_MAGIC, sizeof(header.magic));
+    header.version = SHADER_VERSION;
+    header.entryCount = keys.size();
+
+    std::vector<ShaderFileEntry> table(keys.size());
+    uint64_t offset = AlignUp(sizeof(header) + sizeof(ShaderFileEntry) * keys.size(), BLOB_ALIGNMENT);
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        const std::vector<uint8_t>& blob = mEntries[keys[i]];
+        table[i] = { keys[i], offset, blob.size(), Hash64(blob.data(), blob.size()) };
+        offset = AlignUp(offset + blob.size(), BLOB_ALIGNMENT);
+    }
+    header.fileSize = offset;
+
+    std::string tmpPath = TemporaryPath(mPath);
+
+    FILE* f = fopen(tmpPath.c_str(), "wb");
+    if (!f)
+        return false;
+
+    static const char zeros[BLOB_ALIGNMENT] = {};
+
+    bool ok =
+        fwrite(&header, sizeof(header), 1, f) == 1 &&
+        (table.empty() || fwrite(table.data(), sizeof(ShaderFileEntry), table.size(), f) == table.size());
+
+    uint64_t written = sizeof(header) + sizeof(ShaderFileEntry) * table.size();
+    for (size_t i = 0; i < table.size() && ok; i++)
+    {
+        uint64_t pad = table[i].offset - written;
+        const std::vector<uint8_t>& blob = mEntries[keys[i]];
+
+        ok = (pad == 0 || fwrite(zeros, 1, (size_t)pad, f) == pad) &&
+            (blob.empty() || fwrite(blob.data(), 1, blob.size(), f) == blob.size());
+        written = table[i].offset + blob.size();
+    }
+
+    if (ok && written < header.fileSize)
+        ok = fwrite(zeros, 1, (size_t)(header.fileSize - written), f) == header.fileSize - written;
+
+    ok = fclose(f) == 0 && ok;
+
+    std::error_code ec;
+    if (ok)
+        std::filesystem::rename(tmpPath, mPath, ec);
+
+    if (!ok || ec)
+    {
+        std::filesystem::remove(tmpPath, ec);
+        return false;
+    }
+
+    mDirty = false;
+    return true;
+}
+
+bool ShaderCache::Get(const ShaderSource& shader, ShaderCompiler& compiler, ShaderBytecode& bytecode, std::string& errors)
+{
+    uint64_t key = ShaderCacheKey(shader, compiler.Version());
+
+    auto it = mEntries.find(key);
+    if (it != mEntries.end())
+    {
+        ++mStats.hits;
+        bytecode.data = it->second.data();
+        bytecode.size = it->second.size();
+        return true;
+    }
+
+    ++mStats.misses;
+
+    std::vector<uint8_t> compiled;
+    if (!compiler.Compile(shader, compiled, errors))
+    {
+        ++mStats.failures;
+        return false;
+    }
+
+    std::vector<uint8_t>& stored = mEntries[key];
+    stored.swap(compiled);
+    mDirty = true;
+
+    bytecode.data = stored.data();
+    bytecode.size = stored.size();
+    return true;
+}
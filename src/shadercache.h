@@ -0,0 +1,82 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+
+struct ShaderDefine
+{
+    std::string name;
+    std::string value;
+};
+
+// Everything that decides the compiled bytecode.
+struct ShaderSource
+{
+    std::string source;
+    std::string entryPoint = "main";
+    // "vs_5_0", "ps_5_0", ...
+    std::string profile;
+    std::vector<ShaderDefine> defines;
+    uint32_t flags = 0;
+};
+
+// Source to bytecode (D3DCompile on Windows).
+class ShaderCompiler
+{
+public:
+    virtual ~ShaderCompiler() {}
+
+    // Part of every cache key, so a compiler update invalidates old entries.
+    virtual uint64_t Version() const = 0;
+    virtual bool Compile(const ShaderSource& shader, std::vector<uint8_t>& bytecode, std::string& errors) = 0;
+};
+
+uint64_t ShaderCacheKey(const ShaderSource& shader, uint64_t compilerVersion);
+
+struct ShaderBytecode
+{
+    const void* data = nullptr;
+    size_t size = 0;
+};
+
+struct ShaderCacheStats
+{
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    uint32_t failures = 0;
+    // Entries dropped on Load for a bad checksum.
+    uint32_t corrupt = 0;
+};
+
+// Compiled shaders keyed by a hash of their ShaderSource, kept in a single
+// file that holds any number of permutations. Save writes a temporary file
+// and renames it over the old one, merging in entries another process
+// saved meanwhile, so readers never see a partial cache.
+class ShaderCache
+{
+public:
+    ShaderCache();
+
+    // A missing or unreadable file leaves the cache empty; Save creates it.
+    bool Load(const std::string& path);
+    bool Save();
+
+    // Looks shader up and compiles it on a miss. bytecode stays valid for
+    // the cache's lifetime.
+    bool Get(const ShaderSource& shader, ShaderCompiler& compiler, ShaderBytecode& bytecode, std::string& errors);
+
+    size_t EntryCount() const { return mEntries.size(); }
+    const ShaderCacheStats& Stats() const { return mStats; }
+
+private:
+    // Adds entries of the file at path that are not present yet.
+    bool Merge(const std::string& path);
+
+    std::string mPath;
+    std::unordered_map<uint64_t, std::vector<uint8_t>> mEntries;
+    bool mDirty;
+
+    ShaderCacheStats mStats;
+};
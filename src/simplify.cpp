@@ -0,0 +1,693 @@
+#include "simplify.h"
+#include "meshopt.h"
+
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cstring>
+#include <tuple>
+
+using namespace DirectX;
+
+namespace
+{
+    // Triangles whose normal turns further than this are treated as flipped.
+    constexpr double FLIP_DOT = 0.25;
+
+    // A level that keeps more than this fraction of its parent ends the chain.
+    constexpr float MIN_LOD_REDUCTION = 0.95f;
+
+    struct Quadric
+    {
+        double a00, a01, a02, a11, a12, a22;
+        double b0, b1, b2;
+        double c;
+        double w;
+
+        void AddPlane(double nx, double ny, double nz, double d, double weight)
+        {
+            a00 += weight * nx * nx;
+            a01 += weight * nx * ny;
+            a02 += weight * nx * nz;
+            a11 += weight * ny * ny;
+            a12 += weight * ny * nz;
+            a22 += weight * nz * nz;
+            b0 += weight * nx * d;
+            b1 += weight * ny * d;
+            b2 += weight * nz * d;
+            c += weight * d * d;
+            w += weight;
+        }
+
+        void Add(const Quadric& q)
+        {
+            a00 += q.a00; a01 += q.a01; a02 += q.a02;
+            a11 += q.a11; a12 += q.a12; a22 += q.a22;
+            b0 += q.b0; b1 += q.b1; b2 += q.b2;
+            c += q.c;
+            w += q.w;
+        }
+    };
+
+    // Weighted mean squared distance of p to the planes of a + b.
+    double DistanceSq(const Quadric& a, const Quadric& b, const XMFLOAT3& p)
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double a00 = a.a00 + b.a00, a01 = a.a01 + b.a01, a02 = a.a02 + b.a02;
+        double a11 = a.a11 + b.a11, a12 = a.a12 + b.a12, a22 = a.a22 + b.a22;
+
+        double e =
+            x * x * a00 + y * y * a11 + z * z * a22 +
+            2.0 * (x * y * a01 + x * z * a02 + y * z * a12) +
+            2.0 * (x * (a.b0 + b.b0) + y * (a.b1 + b.b1) + z * (a.b2 + b.b2)) +
+            a.c + b.c;
+
+        double w = a.w + b.w;
+        return w > 0.0 ? std::max(e, 0.0) / w : 0.0;
+    }
+
+    inline XMFLOAT3 Sub(const XMFLOAT3& a, const XMFLOAT3& b)
+    {
+        return XMFLOAT3(a.x - b.x, a.y - b.y, a.z - b.z);
+    }
+
+    inline XMFLOAT3 Cross(const XMFLOAT3& a, const XMFLOAT3& b)
+    {
+        return XMFLOAT3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+    }
+
+    inline double Dot(const XMFLOAT3& a, const XMFLOAT3& b)
+    {
+        return (double)a.x * b.x + (double)a.y * b.y + (double)a.z * b.z;
+    }
+
+    // Distance from p to the triangle abc, closest point by region.
+    double PointTriangleDistance(const XMFLOAT3& p, const XMFLOAT3& a, const XMFLOAT3& b, const XMFLOAT3& c)
+    {
+        double ab[3] = { (double)b.x - a.x, (double)b.y - a.y, (double)b.z - a.z };
+        double ac[3] = { (double)c.x - a.x, (double)c.y - a.y, (double)c.z - a.z };
+        double ap[3] = { (double)p.x - a.x, (double)p.y - a.y, (double)p.z - a.z };
+
+        auto dot = [](const double* u, const double* v) { return u[0] * v[0] + u[1] * v[1] + u[2] * v[2]; };
+
+        double d1 = dot(ab, ap);
+        double d2 = dot(ac, ap);
+        double bp[3] = { ap[0] - ab[0], ap[1] - ab[1], ap[2] - ab[2] };
+        double cp[3] = { ap[0] - ac[0], ap[1] - ac[1], ap[2] - ac[2] };
+        double e1 = dot(ab, bp);
+        double e2 = dot(ac, bp);
+        double f1 = dot(ab, cp);
+        double f2 = dot(ac, cp);
+
+        double u, v;
+        if (d1 <= 0.0 && d2 <= 0.0)
+        {
+            u = 0.0; v = 0.0;
+        }
+        else if (e1 >= 0.0 && e2 <= e1)
+        {
+            u = 1.0; v = 0.0;
+        }
+        else if (f2 >= 0.0 && f1 <= f2)
+        {
+            u = 0.0; v = 1.0;
+        }
+        else
+        {
+            double vc = d1 * e2 - e1 * d2;
+            double vb = f1 * d2 - d1 * f2;
+            double va = e1 * f2 - f1 * e2;
+
+            if (vc <= 0.0 && d1 >= 0.0 && e1 <= 0.0)
+            {
+                u = d1 / (d1 - e1); v = 0.0;
+            }
+            else if (vb <= 0.0 && d2 >= 0.0 && f2 <= 0.0)
+            {
+                u = 0.0; v = d2 / (d2 - f2);
+            }
+            else if (va <= 0.0 && (e2 - e1) >= 0.0 && (f1 - f2) >= 0.0)
+            {
+                double t = (e2 - e1) / ((e2 - e1) + (f1 - f2));
+                u = 1.0 - t; v = t;
+            }
+            else
+            {
+                double denom = 1.0 / (va + vb + vc);
+                u = vb * denom; v = vc * denom;
+            }
+        }
+
+        double dx = ap[0] - u * ab[0] - v * ac[0];
+        double dy = ap[1] - u * ab[1] - v * ac[1];
+        double dz = ap[2] - u * ab[2] - v * ac[2];
+        return std::sqrt(dx * dx + dy * dy + dz * dz);
+    }
+
+    // Row i of a CSR table.
+    struct Csr
+    {
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> items;
+
+        const uint32_t* begin(uint32_t i) const { return items.data() + offsets[i]; }
+        const uint32_t* end(uint32_t i) const { return items.data() + offsets[i + 1]; }
+    };
+
+    // Groups vertices by bitwise equal position; the group id is the
+    // smallest vertex index of the group.
+    std::vector<uint32_t> BuildPositionGroups(const Vertex* vertices, size_t vertexCount)
+    {
+        std::vector<uint32_t> order(vertexCount);
+        std::iota(order.begin(), order.end(), 0);
+
+        auto key = [&](uint32_t v)
+        {
+            uint32_t k[3];
+            memcpy(k, &vertices[v].position, sizeof(k));
+            return std::make_tuple(k[0], k[1], k[2], v);
+        };
+
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+        {
+            return key(a) < key(b);
+        });
+
+        std::vector<uint32_t> group(vertexCount);
+        for (size_t i = 0; i < vertexCount;)
+        {
+            size_t j = i + 1;
+            while (j < vertexCount &&
+                memcmp(&vertices[order[i]].position, &vertices[order[j]].position, sizeof(XMFLOAT3)) == 0)
+            {
+                j++;
+            }
+
+            // order is sorted by vertex within equal positions
+            for (size_t k = i; k < j; k++)
+                group[order[k]] = order[i];
+            i = j;
+        }
+
+        return group;
+    }
+
+    Csr BuildCsr(size_t rows, const std::vector<std::pair<uint32_t, uint32_t>>& pairs)
+    {
+        Csr csr;
+        csr.offsets.assign(rows + 1, 0);
+        csr.items.resize(pairs.size());
+
+        for (const auto& p : pairs)
+            csr.offsets[p.first + 1]++;
+
+        for (size_t i = 0; i < rows; i++)
+            csr.offsets[i + 1] += csr.offsets[i];
+
+        std::vector<uint32_t> cursor(csr.offsets.begin(), csr.offsets.end() - 1);
+        for (const auto& p : pairs)
+            csr.items[cursor[p.first]++] = p.second;
+
+        return csr;
+    }
+
+    constexpr uint8_t EDGE_BORDER = 1;
+    constexpr uint8_t EDGE_NON_MANIFOLD = 2;
+
+    // Per group: EDGE_BORDER on open edges, EDGE_NON_MANIFOLD on edges shared
+    // by more than two triangles.
+    std::vector<uint8_t> FindBorderGroups(const std::vector<uint32_t>& tri, const std::vector<uint32_t>& group)
+    {
+        std::vector<uint64_t> edges;
+        edges.reserve(tri.size());
+
+        for (size_t t = 0; t < tri.size(); t += 3)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                uint64_t a = group[tri[t + k]];
+                uint64_t b = group[tri[t + (k + 1) % 3]];
+                edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+            }
+        }
+
+        std::sort(edges.begin(), edges.end());
+
+        std::vector<uint8_t> border(group.size(), 0);
+        for (size_t i = 0; i < edges.size();)
+        {
+            size_t j = i + 1;
+            while (j < edges.size() && edges[j] == edges[i])
+                j++;
+
+            if (j - i != 2)
+            {
+                uint8_t kind = j - i == 1 ? EDGE_BORDER : EDGE_NON_MANIFOLD;
+                border[(uint32_t)(edges[i] >> 32)] |= kind;
+                border[(uint32_t)edges[i]] |= kind;
+            }
+            i = j;
+        }
+
+        return border;
+    }
+
+    struct Collapse
+    {
+        uint32_t from;
+        uint32_t to;
+        float cost;
+        float errorSq;
+    };
+
+    // Stable LSD radix sort on the cost bits; costs are never negative, so
+    // their IEEE bit patterns sort like the values.
+    void SortByCost(std::vector<Collapse>& items, std::vector<Collapse>& scratch)
+    {
+        constexpr int BITS = 11;
+        constexpr uint32_t BUCKETS = 1u << BITS;
+
+        uint32_t counts[BUCKETS];
+        scratch.resize(items.size());
+
+        for (int shift = 0; shift < 32; shift += BITS)
+        {
+            std::fill(counts, counts + BUCKETS, 0);
+
+            auto digit = [shift](const Collapse& c)
+            {
+                uint32_t bits;
+                memcpy(&bits, &c.cost, sizeof(bits));
+                return (bits >> shift) & (BUCKETS - 1);
+            };
+
+            for (const Collapse& c : items)
+                counts[digit(c)]++;
+
+            uint32_t sum = 0;
+            for (uint32_t& count : counts)
+            {
+                uint32_t n = count;
+                count = sum;
+                sum += n;
+            }
+
+            for (const Collapse& c : items)
+                scratch[counts[digit(c)]++] = c;
+
+            items.swap(scratch);
+        }
+    }
+}
+
+std::vector<uint32_t> SimplifyMesh(
+    const Vertex* vertices,
+    size_t vertexCount,
+    const uint32_t* indices,
+    size_t indexCount,
+    size_t targetIndexCount,
+    const SimplifyOptions& options,
+    float* outError)
+{
+    std::vector<uint32_t> tri(indices, indices + indexCount - indexCount % 3);
+    size_t targetTriangles = targetIndexCount / 3;
+
+    if (outError)
+        *outError = 0.0f;
+
+    if (tri.size() / 3 <= targetTriangles || vertexCount == 0)
+        return tri;
+
+    std::vector<uint32_t> group = BuildPositionGroups(vertices, vertexCount);
+
+    // ===== wedges: vertices sharing a group's position =====
+    Csr wedges;
+    {
+        std::vector<std::pair<uint32_t, uint32_t>> pairs(vertexCount);
+        for (uint32_t v = 0; v < vertexCount; v++)
+            pairs[v] = { group[v], v };
+        wedges = BuildCsr(vertexCount, pairs);
+    }
+
+    // ===== plane quadrics, area weighted =====
+    std::vector<Quadric> quadrics(vertexCount, Quadric{});
+
+    for (size_t t = 0; t < tri.size(); t += 3)
+    {
+        const XMFLOAT3& p0 = vertices[tri[t + 0]].position;
+        XMFLOAT3 n = Cross(Sub(vertices[tri[t + 1]].position, p0), Sub(vertices[tri[t + 2]].position, p0));
+
+        double len = std::sqrt(Dot(n, n));
+        if (len == 0.0)
+            continue;
+
+        double nx = n.x / len, ny = n.y / len, nz = n.z / len;
+        double d = -(nx * p0.x + ny * p0.y + nz * p0.z);
+        double area = len * 0.5;
+
+        for (int k = 0; k < 3; k++)
+            quadrics[group[tri[t + k]]].AddPlane(nx, ny, nz, d, area);
+    }
+
+    std::vector<uint8_t> border = FindBorderGroups(tri, group);
+
+    // Non-manifold edges stay locked regardless of lockBorders.
+    std::vector<uint8_t> locked(vertexCount);
+    for (size_t g = 0; g < vertexCount; g++)
+        locked[g] = (border[g] & EDGE_NON_MANIFOLD) || (options.lockBorders && border[g]);
+
+    const double normalWeightSq = (double)options.normalWeight * options.normalWeight;
+    const double maxErrorSq = (double)options.maxError * options.maxError;
+
+    // Normal difference of moving every wedge of 'from' onto its closest wedge of 'to'.
+    auto wedgeCost = [&](uint32_t from, uint32_t to, uint32_t* targets)
+    {
+        double worst = 0.0;
+        for (const uint32_t* w = wedges.begin(from); w != wedges.end(from); w++)
+        {
+            const XMFLOAT3& nw = vertices[*w].normal;
+            double best = 1e30;
+            uint32_t bestWedge = to;
+
+            for (const uint32_t* u = wedges.begin(to); u != wedges.end(to); u++)
+            {
+                XMFLOAT3 dn = Sub(nw, vertices[*u].normal);
+                double d = Dot(dn, dn);
+                if (d < best)
+                {
+                    best = d;
+                    bestWedge = *u;
+                }
+            }
+
+            worst = std::max(worst, best);
+            if (targets)
+                *targets++ = bestWedge;
+        }
+        return worst;
+    };
+
+    std::vector<uint32_t> target(vertexCount);
+    std::vector<uint32_t> touched(vertexCount, 0);
+    std::vector<Collapse> candidates;
+    std::vector<Collapse> scratch;
+    std::vector<uint32_t> wedgeTargets;
+    uint32_t pass = 0;
+
+    // The group every group was collapsed into, through all passes.
+    std::vector<uint32_t> survivor(vertexCount);
+    std::iota(survivor.begin(), survivor.end(), 0);
+
+    while (tri.size() / 3 > targetTriangles)
+    {
+        pass++;
+
+        // ===== triangles around every group =====
+        Csr adjacency;
+        {
+            std::vector<std::pair<uint32_t, uint32_t>> pairs;
+            pairs.reserve(tri.size());
+            for (size_t i = 0; i < tri.size(); i++)
+                pairs.push_back({ group[tri[i]], (uint32_t)(i / 3) });
+            adjacency = BuildCsr(vertexCount, pairs);
+        }
+
+        // ===== candidate collapses, cheaper direction of every edge =====
+        candidates.clear();
+
+        for (size_t t = 0; t < tri.size(); t += 3)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t a = group[tri[t + k]];
+                uint32_t b = group[tri[t + (k + 1) % 3]];
+
+                // Interior edges show up once in each direction; open
+                // edges only once, in either.
+                if (a > b && !(border[a] && border[b]))
+                    continue;
+
+                const XMFLOAT3& pa = vertices[a].position;
+                const XMFLOAT3& pb = vertices[b].position;
+                XMFLOAT3 e = Sub(pa, pb);
+                double lengthSq = Dot(e, e);
+
+                Collapse best = { 0, 0, 0.0f, 0.0f };
+                bool found = false;
+
+                for (int dir = 0; dir < 2; dir++)
+                {
+                    uint32_t from = dir ? b : a;
+                    uint32_t to = dir ? a : b;
+                    if (locked[from])
+                        continue;
+
+                    double posSq = DistanceSq(quadrics[from], quadrics[to], vertices[to].position);
+                    double cost = posSq + normalWeightSq * lengthSq * wedgeCost(from, to, nullptr);
+
+                    if (!found || cost < best.cost)
+                    {
+                        best = { from, to, (float)cost, (float)posSq };
+                        found = true;
+                    }
+                }
+
+                if (found && best.errorSq <= maxErrorSq)
+                    candidates.push_back(best);
+            }
+        }
+
+        SortByCost(candidates, scratch);
+
+        // ===== collapse independent edges, cheapest first =====
+        size_t toRemove = tri.size() / 3 - targetTriangles;
+        size_t removed = 0;
+        size_t collapses = 0;
+
+        for (uint32_t g = 0; g < vertexCount; g++)
+            target[g] = g;
+
+        for (const Collapse& c : candidates)
+        {
+            if (removed >= toRemove)
+                break;
+
+            if (touched[c.from] == pass || touched[c.to] == pass)
+                continue;
+
+            const XMFLOAT3& pTo = vertices[c.to].position;
+            size_t dropped = 0;
+            bool flips = false;
+
+            for (const uint32_t* t = adjacency.begin(c.from); t != adjacency.end(c.from) && !flips; t++)
+            {
+                const uint32_t* corner = &tri[*t * 3];
+                uint32_t g[3] = { group[corner[0]], group[corner[1]], group[corner[2]] };
+
+                if (g[0] == c.to || g[1] == c.to || g[2] == c.to)
+                {
+                    dropped++;
+                    continue;
+                }
+
+                XMFLOAT3 p[3] = { vertices[g[0]].position, vertices[g[1]].position, vertices[g[2]].position };
+                XMFLOAT3 before = Cross(Sub(p[1], p[0]), Sub(p[2], p[0]));
+
+                for (int k = 0; k < 3; k++)
+                {
+                    if (g[k] == c.from)
+                        p[k] = pTo;
+                }
+
+                XMFLOAT3 after = Cross(Sub(p[1], p[0]), Sub(p[2], p[0]));
+                double nb = Dot(before, before);
+                double na = Dot(after, after);
+
+                flips = na == 0.0 || Dot(before, after) < FLIP_DOT * std::sqrt(nb * na);
+            }
+
+            if (flips)
+                continue;
+
+            target[c.from] = c.to;
+            removed += dropped;
+            collapses++;
+
+            // Everything around 'from' changes shape; keep it out of this pass.
+            touched[c.to] = pass;
+            for (const uint32_t* t = adjacency.begin(c.from); t != adjacency.end(c.from); t++)
+            {
+                for (int k = 0; k < 3; k++)
+                    touched[group[tri[*t * 3 + k]]] = pass;
+            }
+        }
+
+        if (collapses == 0)
+            break;
+
+        for (uint32_t& g : survivor)
+            g = target[g];
+
+        // ===== move wedges, merge quadrics, drop degenerate triangles =====
+        std::vector<uint32_t> vertexTarget(vertexCount);
+        std::iota(vertexTarget.begin(), vertexTarget.end(), 0);
+
+        for (uint32_t from = 0; from < vertexCount; from++)
+        {
+            uint32_t to = target[from];
+            if (to == from)
+                continue;
+
+            wedgeTargets.resize(wedges.offsets[from + 1] - wedges.offsets[from]);
+            wedgeCost(from, to, wedgeTargets.data());
+
+            for (size_t w = 0; w < wedgeTargets.size(); w++)
+                vertexTarget[wedges.items[wedges.offsets[from] + w]] = wedgeTargets[w];
+
+            quadrics[to].Add(quadrics[from]);
+        }
+
+        size_t write = 0;
+        for (size_t t = 0; t < tri.size(); t += 3)
+        {
+            uint32_t v0 = vertexTarget[tri[t + 0]];
+            uint32_t v1 = vertexTarget[tri[t + 1]];
+            uint32_t v2 = vertexTarget[tri[t + 2]];
+
+            if (group[v0] == group[v1] || group[v1] == group[v2] || group[v0] == group[v2])
+                continue;
+
+            tri[write++] = v0;
+            tri[write++] = v1;
+            tri[write++] = v2;
+        }
+        tri.resize(write);
+    }
+
+    // ===== measured error =====
+    // Every input vertex against the triangles near the group it ended in:
+    // an upper bound on its distance to the result, where the quadrics only
+    // give an area-weighted mean of squared plane distances.
+    if (outError)
+    {
+        Csr around;
+        {
+            std::vector<std::pair<uint32_t, uint32_t>> pairs;
+            pairs.reserve(tri.size());
+            for (size_t i = 0; i < tri.size(); i++)
+                pairs.push_back({ group[tri[i]], (uint32_t)(i / 3) });
+            around = BuildCsr(vertexCount, pairs);
+        }
+
+        std::vector<uint8_t> measured(vertexCount, 0);
+        std::vector<uint32_t> visited(tri.size() / 3, UINT32_MAX);
+        double error = 0.0;
+
+        for (size_t i = 0; i < indexCount - indexCount % 3; i++)
+        {
+            uint32_t g = group[indices[i]];
+            uint32_t s = survivor[g];
+
+            // Survivors are vertices of the result.
+            if (s == g || measured[g])
+                continue;
+            measured[g] = 1;
+
+            const XMFLOAT3& p = vertices[g].position;
+            XMFLOAT3 e = Sub(p, vertices[s].position);
+            double distance = std::sqrt(Dot(e, e));
+
+            // Two rings: collapses can leave a position beside the ring of
+            // the group it ended in.
+            for (const uint32_t* r = around.begin(s); r != around.end(s); r++)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    uint32_t n = group[tri[*r * 3 + k]];
+                    for (const uint32_t* t = around.begin(n); t != around.end(n); t++)
+                    {
+                        if (visited[*t] == g)
+                            continue;
+                        visited[*t] = g;
+
+                        const uint32_t* corner = &tri[*t * 3];
+                        distance = std::min(distance, PointTriangleDistance(p,
+                            vertices[corner[0]].position, vertices[corner[1]].position, vertices[corner[2]].position));
+                    }
+                }
+            }
+
+            error = std::max(error, distance);
+        }
+
+        // Rounded up, so the float still bounds the distance.
+        float rounded = (float)error;
+        if (rounded < error)
+            rounded = std::nextafter(rounded, 1e30f);
+        *outError = rounded;
+    }
+
+    return tri;
+}
+
+std::vector<MeshLod> BuildLodChain(
+    const Vertex* vertices,
+    size_t vertexCount,
+    std::vector<uint32_t>& indices,
+    const LodChainOptions& options)
+{
+    std::vector<MeshLod> lods;
+    lods.push_back({ 0, (uint32_t)indices.size(), 0.0f });
+
+    size_t baseTriangles = indices.size() / 3;
+
+    for (float ratio : options.ratios)
+    {
+        const MeshLod& parent = lods.back();
+        size_t target = (size_t)(baseTriangles * ratio) * 3;
+
+        if (target >= parent.indexCount)
+            continue;
+
+        float error = 0.0f;
+        std::vector<uint32_t> lod = SimplifyMesh(
+            vertices,
+            vertexCount,
+            indices.data() + parent.indexOffset,
+            parent.indexCount,
+            target,
+            options.simplify,
+            &error
+        );
+
+        if (lod.empty() || lod.size() > parent.indexCount * MIN_LOD_REDUCTION)
+            break;
+
+        OptimizeVertexCache(lod, vertexCount, options.cacheSize);
+
+        // Every level is simplified from its parent, so errors add up.
+        MeshLod next = { (uint32_t)indices.size(), (uint32_t)lod.size(), parent.error + error };
+        indices.insert(indices.end(), lod.begin(), lod.end());
+        lods.push_back(next);
+    }
+
+    return lods;
+}
+
+size_t SelectLod(
+    const std::vector<MeshLod>& lods,
+    float distance,
+    float projectionScaleY,
+    float viewportHeight,
+    float pixelThreshold)
+{
+    float pixelsPerUnit = projectionScaleY * viewportHeight * 0.5f / std::max(distance, 1e-4f);
+
+    for (size_t i = lods.size(); i-- > 1;)
+    {
+        if (lods[i].error * pixelsPerUnit <= pixelThreshold)
+            return i;
+    }
+
+    return 0;
+}
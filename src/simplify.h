@@ -0,0 +1,76 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "vertex.h"
+
+struct SimplifyOptions
+{
+    // Weight of normal discontinuities against positional error. A patch of
+    // size L whose normal turns by |dn| costs (normalWeight * L * |dn|)^2.
+    float normalWeight = 0.5f;
+
+    // Vertices on open edges never move.
+    bool lockBorders = true;
+
+    // Collapses whose quadric error, the area-weighted RMS distance to the
+    // planes merged into the target (mesh units), exceeds this are
+    // rejected.
+    float maxError = 1e30f;
+};
+
+// Quadric edge-collapse simplification restricted to existing vertices, so
+// the result indexes the same vertex buffer. Vertices sharing a position
+// move together. outError receives the largest distance, in mesh units, of
+// an input vertex from the result, measured against the triangles around
+// the vertex it was collapsed into.
+std::vector<uint32_t> SimplifyMesh(
+    const Vertex* vertices,
+    size_t vertexCount,
+    const uint32_t* indices,
+    size_t indexCount,
+    size_t targetIndexCount,
+    const SimplifyOptions& options,
+    float* outError
+);
+
+struct MeshLod
+{
+    uint32_t indexOffset;
+    uint32_t indexCount;
+    // Measured error in mesh units, 0 for the full mesh: the parent's plus
+    // the largest distance of a parent vertex from this level.
+    float error;
+};
+
+struct LodChainOptions
+{
+    // Triangle ratios relative to LOD 0, in decreasing order.
+    std::vector<float> ratios = { 0.5f, 0.25f, 0.125f, 0.0625f };
+
+    SimplifyOptions simplify;
+
+    // Cache size for reordering every generated level.
+    unsigned cacheSize = 16;
+};
+
+// indices holds LOD 0 on input; every further level is appended to it.
+// Levels that stop shrinking end the chain.
+std::vector<MeshLod> BuildLodChain(
+    const Vertex* vertices,
+    size_t vertexCount,
+    std::vector<uint32_t>& indices,
+    const LodChainOptions& options
+);
+
+// Coarsest level whose error projects to at most pixelThreshold pixels.
+// projectionScaleY is projection._22 (cot(fovY / 2)), distance is from the
+// eye to the closest point of the mesh.
+size_t SelectLod(
+    const std::vector<MeshLod>& lods,
+    float distance,
+    float projectionScaleY,
+    float viewportHeight,
+    float pixelThreshold
+);
@@ -0,0 +1,117 @@
+#include "staging.h"
+
+#include <cstring>
+
+StagingUploader::StagingUploader()
+    : mBackend(nullptr),
+    mChunkSize(0),
+    mFenceValue(0),
+    mBatchOpen(false)
+{
+}
+
+void StagingUploader::Initialize(StagingBackend* backend, void* stagingBase, uint64_t capacity)
+{
+    mBackend = backend;
+
+    // Copies have no placement rules for buffers; 256 keeps offsets tidy.
+    mRing.Initialize(stagingBase, 0, capacity, UPLOAD_CONSTANT_ALIGNMENT);
+
+    // Quarter-buffer chunks let a large upload overlap its own batches.
+    mChunkSize = mRing.Capacity() / 4 / UPLOAD_CONSTANT_ALIGNMENT * UPLOAD_CONSTANT_ALIGNMENT;
+    if (mChunkSize == 0)
+        mChunkSize = UPLOAD_CONSTANT_ALIGNMENT;
+
+    mFenceValue = backend->CompletedValue();
+    mBatchOpen = false;
+    mInFlight.clear();
+    mStats = StagingStats();
+}
+
+uint64_t StagingUploader::Upload(void* destination, uint64_t destinationOffset, const void* data, uint64_t size)
+{
+    const uint8_t* source = (const uint8_t*)data;
+
+    while (size > 0)
+    {
+        uint64_t chunk = size < mChunkSize ? size : mChunkSize;
+
+        uint64_t position;
+        while (!mRing.AllocateBlock(chunk, position))
+        {
+            // Staging is full: everything recorded must go out before its
+            // space, or older batches' space, can come back.
+            if (mBatchOpen)
+                Flush();
+
+            ++mStats.stalls;
+            RetireOldest();
+        }
+
+        UploadAllocation allocation = mRing.Resolve(position, chunk);
+        memcpy(allocation.cpu, source, chunk);
+        mBackend->RecordCopy(destination, destinationOffset, allocation.gpu, chunk);
+
+        mBatchOpen = true;
+        ++mStats.copies;
+        mStats.bytesUploaded += chunk;
+
+        source += chunk;
+        destinationOffset += chunk;
+        size -= chunk;
+    }
+
+    return mFenceValue + (mBatchOpen ? 1 : 0);
+}
+
+uint64_t StagingUploader::Flush()
+{
+    if (!mBatchOpen)
+        return mFenceValue;
+
+    ++mFenceValue;
+    mBackend->Submit(mFenceValue);
+    mRing.EndFrame(mFenceValue);
+
+    mInFlight.push_back(mFenceValue);
+    mBatchOpen = false;
+    ++mStats.batches;
+
+    return mFenceValue;
+}
+
+bool StagingUploader::IsComplete(uint64_t ticket)
+{
+    return mBackend->CompletedValue() >= ticket;
+}
+
+void StagingUploader::Wait(uint64_t ticket)
+{
+    if (ticket > mFenceValue)
+        Flush();
+
+    mBackend->Wait(ticket);
+}
+
+void StagingUploader::WaitIdle()
+{
+    Wait(Flush());
+
+    mInFlight.clear();
+    mRing.BeginFrame(mFenceValue);
+}
+
+void StagingUploader::RetireOldest()
+{
+    if (!mInFlight.empty())
+    {
+        mBackend->Wait(mInFlight.front());
+        mInFlight.pop_front();
+    }
+
+    uint64_t completed = mBackend->CompletedValue();
+    while (!mInFlight.empty() && mInFlight.front() <= completed)
+        mInFlight.pop_front();
+
+    mRing.BeginFrame(completed);
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <deque>
+#include <cstddef>
+#include <cstdint>
+
+#include "uploadring.h"
+
+// Copy queue the staging uploader records into. Destinations are opaque
+// (ID3D12Resource* for D3D12).
+class StagingBackend
+{
+public:
+    virtual ~StagingBackend() {}
+
+    // Copies size bytes at stagingOffset of the staging buffer into
+    // destination at destinationOffset.
+    virtual void RecordCopy(void* destination, uint64_t destinationOffset, uint64_t stagingOffset, uint64_t size) = 0;
+    // Executes everything recorded so far, then signals fence.
+    virtual void Submit(uint64_t fence) = 0;
+
+    virtual uint64_t CompletedValue() = 0;
+    virtual void Wait(uint64_t fence) = 0;
+};
+
+struct StagingStats
+{
+    uint64_t bytesUploaded = 0;
+    uint64_t copies = 0;
+    uint64_t batches = 0;
+    // Times the staging buffer was full and a batch had to be waited for.
+    uint64_t stalls = 0;
+};
+
+// Streams data into GPU-local resources through one mapped staging buffer.
+// Uploads are copied into staging right away and batched into a single
+// submission; each batch signals its own fence, so the caller can keep
+// loading while earlier batches are in flight. Staging space is reused
+// once a batch's fence completes.
+class StagingUploader
+{
+public:
+    StagingUploader();
+
+    // stagingBase is the mapped staging buffer, capacity its size in bytes.
+    void Initialize(StagingBackend* backend, void* stagingBase, uint64_t capacity);
+
+    // Returns a ticket that completes once the data is in destination. The
+    // source may be freed right away. Uploads larger than a quarter of the
+    // staging buffer are split across batches.
+    uint64_t Upload(void* destination, uint64_t destinationOffset, const void* data, uint64_t size);
+
+    // Submits the open batch, if any. Returns the ticket of everything
+    // uploaded so far.
+    uint64_t Flush();
+
+    bool IsComplete(uint64_t ticket);
+    // Flushes first if the ticket is still in the open batch.
+    void Wait(uint64_t ticket);
+    void WaitIdle();
+
+    const StagingStats& Stats() const { return mStats; }
+
+private:
+    void RetireOldest();
+
+    StagingBackend* mBackend;
+    UploadRing mRing;
+    uint64_t mChunkSize;
+
+    // Fence of the open batch is mFenceValue + 1.
+    uint64_t mFenceValue;
+    bool mBatchOpen;
+    std::deque<uint64_t> mInFlight;
+
+    StagingStats mStats;
+};
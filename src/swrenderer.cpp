@@ -0,0 +1,634 @@
+#include "swrenderer.h"
+#include "rastersetup.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SW_SSE 1
+#include <emmintrin.h>
+#endif
+
+using namespace DirectX;
+using namespace RasterSetup;
+
+namespace
+{
+    // Tiles are the unit of parallel rasterization.
+    constexpr int TILE_SHIFT = 6;
+    constexpr int TILE_SIZE = 1 << TILE_SHIFT;
+    constexpr size_t TILE_PIXELS = TILE_SIZE * TILE_SIZE;
+
+    // Keeps edge functions inside a tile within 32 bits.
+    constexpr int MAX_DIMENSION = 8192;
+
+    constexpr size_t VERTEX_BATCH = 4096;
+    constexpr size_t MIN_TRIANGLES_PER_WORKER = 1024;
+
+    // Shaders::PixelShader
+    constexpr float BASE_COLOR[4] = { 0.8f, 0.3f, 0.3f, 1.0f };
+
+    inline uint32_t PackColor(float r, float g, float b, float a)
+    {
+        auto unorm = [](float c)
+        {
+            c = c > 0.0f ? c : 0.0f;
+            c = c < 1.0f ? c : 1.0f;
+            return (uint32_t)(int)(c * 255.0f + 0.5f);
+        };
+        return unorm(r) | unorm(g) << 8 | unorm(b) << 16 | unorm(a) << 24;
+    }
+
+#ifdef SW_SSE
+    // One channel of PackColor(base * (ambient + diffuse * ndl)) for 4 pixels.
+    inline __m128i ShadeChannel(__m128 base, __m128 ambient, __m128 diffuse, __m128 ndl)
+    {
+        __m128 v = _mm_mul_ps(base, _mm_add_ps(ambient, _mm_mul_ps(diffuse, ndl)));
+        v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+        return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+    }
+#endif
+}
+
+SoftwareRenderer::SoftwareRenderer()
+    : mWidth(0),
+    mHeight(0),
+    mTilesX(0),
+    mTilesY(0),
+    mThreadCount(1),
+    mClearColor(0),
+    mObject(),
+    mLight(),
+    mVertices(nullptr),
+    mVertexCount(0),
+    mIndices(nullptr),
+    mIndexCount(0),
+    mTransformedFirst(0)
+{
+}
+
+bool SoftwareRenderer::Initialize(int width, int height, unsigned threadCount)
+{
+    if (width <= 0 || height <= 0 || width > MAX_DIMENSION || height > MAX_DIMENSION)
+        return false;
+
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    mWidth = width;
+    mHeight = height;
+    mTilesX = (width + TILE_SIZE - 1) >> TILE_SHIFT;
+    mTilesY = (height + TILE_SIZE - 1) >> TILE_SHIFT;
+    mThreadCount = threadCount;
+
+    mColor.assign((size_t)mTilesX * mTilesY * TILE_PIXELS, 0);
+    mDepth.assign((size_t)mTilesX * mTilesY * TILE_PIXELS, 1.0f);
+    mResolved.assign((size_t)width * height, 0);
+    mTileClearPending.assign((size_t)mTilesX * mTilesY, 0);
+
+    mTriangles.assign(threadCount, {});
+    mBins.assign(threadCount, std::vector<std::vector<uint32_t>>((size_t)mTilesX * mTilesY));
+    mWorkerStats.assign(threadCount, {});
+
+    return true;
+}
+
+void SoftwareRenderer::SetObjectConstants(const ObjectConstants& constants)
+{
+    mObject = constants;
+}
+
+void SoftwareRenderer::SetLightConstants(const LightConstants& constants)
+{
+    mLight = constants;
+}
+
+void SoftwareRenderer::SetVertexBuffer(const Vertex* vertices, size_t vertexCount)
+{
+    mVertices = vertices;
+    mVertexCount = vertexCount;
+}
+
+void SoftwareRenderer::SetIndexBuffer(const uint32_t* indices, size_t indexCount)
+{
+    mIndices = indices;
+    mIndexCount = indexCount;
+}
+
+void SoftwareRenderer::Clear(const float color[4])
+{
+    mClearColor = PackColor(color[0], color[1], color[2], color[3]);
+    std::fill(mTileClearPending.begin(), mTileClearPending.end(), 1);
+}
+
+void SoftwareRenderer::ClearTile(uint32_t tile)
+{
+    mTileClearPending[tile] = 0;
+
+    size_t base = tile * TILE_PIXELS;
+    std::fill(mColor.begin() + base, mColor.begin() + base + TILE_PIXELS, mClearColor);
+    std::fill(mDepth.begin() + base, mDepth.begin() + base + TILE_PIXELS, 1.0f);
+}
+
+void SoftwareRenderer::ResolveClear()
+{
+    ParallelFor(mTileClearPending.size(), [&](size_t tile, unsigned)
+    {
+        if (mTileClearPending[tile])
+            ClearTile((uint32_t)tile);
+    });
+}
+
+const uint32_t* SoftwareRenderer::Pixels()
+{
+    ResolveClear();
+
+    for (int y = 0; y < mHeight; y++)
+    {
+        for (int tx = 0; tx < mTilesX; tx++)
+        {
+            int x = tx << TILE_SHIFT;
+            int width = std::min(TILE_SIZE, mWidth - x);
+            size_t tile = (size_t)(y >> TILE_SHIFT) * mTilesX + tx;
+            const uint32_t* src = mColor.data() + tile * TILE_PIXELS + ((size_t)(y & (TILE_SIZE - 1)) << TILE_SHIFT);
+            std::copy(src, src + width, mResolved.begin() + (size_t)y * mWidth + x);
+        }
+    }
+
+    return mResolved.data();
+}
+
+template <typename Fn>
+void SoftwareRenderer::ParallelFor(size_t count, Fn fn)
+{
+    unsigned workerCount = (unsigned)std::min<size_t>(mThreadCount, count);
+
+    std::atomic<size_t> next(0);
+    auto work = [&](unsigned worker)
+    {
+        for (size_t i; (i = next.fetch_add(1)) < count;)
+            fn(i, worker);
+    };
+
+    if (workerCount <= 1)
+    {
+        work(0);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    workers.reserve(workerCount - 1);
+
+    for (unsigned w = 1; w < workerCount; w++)
+        workers.emplace_back(work, w);
+
+    work(0);
+
+    for (auto& t : workers)
+        t.join();
+}
+
+void SoftwareRenderer::DrawIndexed(uint32_t indexCount, uint32_t startIndex, int32_t baseVertex)
+{
+    indexCount -= indexCount % 3;
+    if (!mVertices || !mIndices || indexCount == 0 || (size_t)startIndex + indexCount > mIndexCount)
+        return;
+
+    // ===== vertex shader over the referenced range =====
+    uint32_t first = UINT32_MAX;
+    uint32_t last = 0;
+    for (uint32_t i = startIndex; i < startIndex + indexCount; i++)
+    {
+        first = std::min(first, mIndices[i]);
+        last = std::max(last, mIndices[i]);
+    }
+
+    if ((int64_t)first + baseVertex < 0 || (int64_t)last + baseVertex >= (int64_t)mVertexCount)
+        return;
+
+    TransformVertices(baseVertex, first, last - first + 1);
+
+    // ===== triangle setup and binning, one contiguous chunk per worker =====
+    size_t triangleCount = indexCount / 3;
+    size_t chunkCount = std::min<size_t>(
+        mThreadCount,
+        std::max<size_t>(1, triangleCount / MIN_TRIANGLES_PER_WORKER)
+    );
+
+    for (size_t c = 0; c < mThreadCount; c++)
+    {
+        mTriangles[c].clear();
+        for (auto& bin : mBins[c])
+            bin.clear();
+    }
+
+    ParallelFor(chunkCount, [&](size_t chunk, unsigned)
+    {
+        uint32_t begin = startIndex + (uint32_t)(triangleCount * chunk / chunkCount) * 3;
+        uint32_t end = startIndex + (uint32_t)(triangleCount * (chunk + 1) / chunkCount) * 3;
+        SetupTriangles((unsigned)chunk, begin, end);
+    });
+
+    // ===== rasterization, one tile at a time =====
+    ParallelFor((size_t)mTilesX * mTilesY, [&](size_t tile, unsigned worker)
+    {
+        mWorkerStats[worker].pixelsShaded += RasterizeTile((uint32_t)tile);
+    });
+
+    mStats.trianglesIn += triangleCount;
+    for (SoftwareRenderStats& s : mWorkerStats)
+    {
+        mStats.trianglesDrawn += s.trianglesDrawn;
+        mStats.pixelsShaded += s.pixelsShaded;
+        s = SoftwareRenderStats();
+    }
+}
+
+void SoftwareRenderer::TransformVertices(int32_t baseVertex, uint32_t firstVertex, uint32_t vertexCount)
+{
+    // The constant buffers hold transposed matrices.
+    XMFLOAT4X4 m;
+    XMStoreFloat4x4(
+        &m,
+        XMMatrixTranspose(mObject.world) * XMMatrixTranspose(mObject.view) * XMMatrixTranspose(mObject.projection)
+    );
+
+    mTransformed.resize(vertexCount);
+    mTransformedFirst = firstVertex;
+
+    const Vertex* src = mVertices + baseVertex + firstVertex;
+
+    ParallelFor((vertexCount + VERTEX_BATCH - 1) / VERTEX_BATCH, [&](size_t batch, unsigned)
+    {
+        size_t begin = batch * VERTEX_BATCH;
+        size_t end = std::min<size_t>(begin + VERTEX_BATCH, vertexCount);
+
+        for (size_t i = begin; i < end; i++)
+        {
+            const XMFLOAT3& p = src[i].position;
+            ClipVertex& v = mTransformed[i];
+
+            v.x = p.x * m.m[0][0] + p.y * m.m[1][0] + p.z * m.m[2][0] + m.m[3][0];
+            v.y = p.x * m.m[0][1] + p.y * m.m[1][1] + p.z * m.m[2][1] + m.m[3][1];
+            v.z = p.x * m.m[0][2] + p.y * m.m[1][2] + p.z * m.m[2][2] + m.m[3][2];
+            v.w = p.x * m.m[0][3] + p.y * m.m[1][3] + p.z * m.m[2][3] + m.m[3][3];
+
+            // The vertex shader passes the normal through untransformed.
+            v.nx = src[i].normal.x;
+            v.ny = src[i].normal.y;
+            v.nz = src[i].normal.z;
+        }
+    });
+}
+
+void SoftwareRenderer::SetupTriangles(unsigned chunk, uint32_t firstIndex, uint32_t endIndex)
+{
+    for (uint32_t i = firstIndex; i < endIndex; i += 3)
+    {
+        const ClipVertex& a = mTransformed[mIndices[i] - mTransformedFirst];
+        const ClipVertex& b = mTransformed[mIndices[i + 1] - mTransformedFirst];
+        const ClipVertex& c = mTransformed[mIndices[i + 2] - mTransformedFirst];
+
+        ClipTriangle(a, b, c, [&](const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2)
+        {
+            AddTriangle(chunk, v0, v1, v2);
+        });
+    }
+}
+
+void SoftwareRenderer::AddTriangle(unsigned chunk, const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2)
+{
+    SnappedTriangle s;
+    if (!SnapTriangle(v0, v1, v2, mWidth, mHeight, s))
+        return;
+
+    const ClipVertex* v[3] = { &v0, &v1, &v2 };
+    float attr[3][4];
+    for (int k = 0; k < 3; k++)
+    {
+        attr[k][0] = v[k]->z * s.invW[k];
+        attr[k][1] = v[k]->nx * s.invW[k];
+        attr[k][2] = v[k]->ny * s.invW[k];
+        attr[k][3] = v[k]->nz * s.invW[k];
+    }
+
+    Triangle t;
+    t.minX = s.minX;
+    t.maxX = s.maxX;
+    t.minY = s.minY;
+    t.maxY = s.maxY;
+    SetupEdges(s, t.A, t.B, t.C);
+
+    // ===== attribute planes =====
+    double scale = (double)SUBPIXEL / (double)s.area;
+    for (int a = 0; a < 4; a++)
+    {
+        double d1 = (double)attr[1][a] - attr[0][a];
+        double d2 = (double)attr[2][a] - attr[0][a];
+        t.planes[a][0] = attr[0][a];
+        t.planes[a][1] = (float)((t.A[1] * d1 + t.A[2] * d2) * scale);
+        t.planes[a][2] = (float)((t.B[1] * d1 + t.B[2] * d2) * scale);
+    }
+
+    t.x0 = (float)s.X[0] / SUBPIXEL;
+    t.y0 = (float)s.Y[0] / SUBPIXEL;
+
+    // ===== binning =====
+    std::vector<Triangle>& triangles = mTriangles[chunk];
+    uint32_t index = (uint32_t)triangles.size();
+    triangles.push_back(t);
+
+    for (int ty = t.minY >> TILE_SHIFT; ty <= t.maxY >> TILE_SHIFT; ty++)
+    {
+        for (int tx = t.minX >> TILE_SHIFT; tx <= t.maxX >> TILE_SHIFT; tx++)
+            mBins[chunk][(size_t)ty * mTilesX + tx].push_back(index);
+    }
+
+    mWorkerStats[chunk].trianglesDrawn++;
+}
+
+uint64_t SoftwareRenderer::RasterizeTile(uint32_t tile)
+{
+    if (mTileClearPending[tile])
+        ClearTile(tile);
+
+    int tileX = (int)(tile % mTilesX) << TILE_SHIFT;
+    int tileY = (int)(tile / mTilesX) << TILE_SHIFT;
+    int tileMaxX = std::min(tileX + TILE_SIZE, mWidth) - 1;
+    int tileMaxY = std::min(tileY + TILE_SIZE, mHeight) - 1;
+
+    // Shaders::PixelShader constants, copied so stores to the targets
+    // cannot alias them.
+    const float lx = -mLight.lightDir.x;
+    const float ly = -mLight.lightDir.y;
+    const float lz = -mLight.lightDir.z;
+    const float ambient[4] = { mLight.ambientColor.x, mLight.ambientColor.y, mLight.ambientColor.z, mLight.ambientColor.w };
+    const float diffuse[4] = { mLight.diffuseColor.x, mLight.diffuseColor.y, mLight.diffuseColor.z, mLight.diffuseColor.w };
+
+#ifdef SW_SSE
+    const __m128 lightX = _mm_set1_ps(lx);
+    const __m128 lightY = _mm_set1_ps(ly);
+    const __m128 lightZ = _mm_set1_ps(lz);
+    __m128 baseV[4];
+    __m128 ambientV[4];
+    __m128 diffuseV[4];
+    for (int c = 0; c < 4; c++)
+    {
+        baseV[c] = _mm_set1_ps(BASE_COLOR[c]);
+        ambientV[c] = _mm_set1_ps(ambient[c]);
+        diffuseV[c] = _mm_set1_ps(diffuse[c]);
+    }
+#endif
+
+    uint64_t shaded = 0;
+
+    // Chunks hold consecutive triangle ranges, so this is submission order.
+    for (unsigned chunk = 0; chunk < mThreadCount; chunk++)
+    {
+        for (uint32_t index : mBins[chunk][tile])
+        {
+            const Triangle& t = mTriangles[chunk][index];
+
+            int x0 = std::max(t.minX, tileX);
+            int x1 = std::min(t.maxX, tileMaxX);
+            int y0 = std::max(t.minY, tileY);
+            int y1 = std::min(t.maxY, tileMaxY);
+
+            if (x0 > x1 || y0 > y1)
+                continue;
+
+            // Groups of 4 pixels start on a multiple of 4 and never leave the tile.
+            int gx = x0 & ~3;
+
+            // ===== edge values at the first group, trivial accept/reject =====
+            int32_t e[3];
+            int32_t stepX[3];
+            int32_t stepY[3];
+            bool rejected = false;
+
+            int64_t cx = (int64_t)gx * SUBPIXEL + SUBPIXEL / 2;
+            int64_t cy = (int64_t)y0 * SUBPIXEL + SUBPIXEL / 2;
+            int64_t spanX = (int64_t)(x1 - gx) * SUBPIXEL;
+            int64_t spanY = (int64_t)(y1 - y0) * SUBPIXEL;
+
+            for (int k = 0; k < 3; k++)
+            {
+                int64_t base = t.A[k] * cx + t.B[k] * cy + t.C[k];
+                int64_t dx = t.A[k] * spanX;
+                int64_t dy = t.B[k] * spanY;
+
+                int64_t lo = base + std::min<int64_t>(dx, 0) + std::min<int64_t>(dy, 0);
+                int64_t hi = base + std::max<int64_t>(dx, 0) + std::max<int64_t>(dy, 0);
+
+                if (hi < 0)
+                {
+                    rejected = true;
+                    break;
+                }
+
+                if (lo >= 0)
+                {
+                    // Inside everywhere in the rectangle: never fails.
+                    e[k] = 0;
+                    stepX[k] = 0;
+                    stepY[k] = 0;
+                }
+                else
+                {
+                    e[k] = (int32_t)base;
+                    stepX[k] = t.A[k] * SUBPIXEL;
+                    stepY[k] = t.B[k] * SUBPIXEL;
+                }
+            }
+
+            if (rejected)
+                continue;
+
+            // Attribute values at the first group, then per-pixel steps.
+            float fx = (float)gx + 0.5f - t.x0;
+            float fy = (float)y0 + 0.5f - t.y0;
+            float start[4];
+            for (int a = 0; a < 4; a++)
+                start[a] = t.planes[a][0] + t.planes[a][1] * fx + t.planes[a][2] * fy;
+
+#ifdef SW_SSE
+            const __m128i laneIndex = _mm_setr_epi32(0, 1, 2, 3);
+            const __m128 laneOffset = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+            const __m128 zero = _mm_setzero_ps();
+            const __m128i firstX = _mm_set1_epi32(x0 - 1);
+            const __m128i lastX = _mm_set1_epi32(x1 + 1);
+
+            __m128i edgeRow[3];
+            __m128i edgeStepX[3];
+            __m128i edgeStepY[3];
+            for (int k = 0; k < 3; k++)
+            {
+                edgeRow[k] = _mm_setr_epi32(e[k], e[k] + stepX[k], e[k] + stepX[k] * 2, e[k] + stepX[k] * 3);
+                edgeStepX[k] = _mm_set1_epi32(stepX[k] * 4);
+                edgeStepY[k] = _mm_set1_epi32(stepY[k]);
+            }
+
+            const __m128 dzdx = _mm_set1_ps(t.planes[0][1]);
+            const __m128 dnxdx = _mm_set1_ps(t.planes[1][1]);
+            const __m128 dnydx = _mm_set1_ps(t.planes[2][1]);
+            const __m128 dnzdx = _mm_set1_ps(t.planes[3][1]);
+#endif
+
+            for (int y = y0; y <= y1; y++)
+            {
+                int row = y - y0;
+                // Indexed by x - tileX.
+                size_t rowOffset = tile * TILE_PIXELS + ((size_t)(y - tileY) << TILE_SHIFT);
+                uint32_t* color = mColor.data() + rowOffset;
+                float* depth = mDepth.data() + rowOffset;
+
+#ifdef SW_SSE
+                __m128i edge[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    edge[k] = edgeRow[k];
+                    edgeRow[k] = _mm_add_epi32(edgeRow[k], edgeStepY[k]);
+                }
+
+                __m128 rowStart[4];
+                for (int a = 0; a < 4; a++)
+                    rowStart[a] = _mm_set1_ps(start[a] + t.planes[a][2] * (float)row);
+
+                for (int x = gx; x <= x1; x += 4)
+                {
+                    __m128i inside = _mm_or_si128(_mm_or_si128(edge[0], edge[1]), edge[2]);
+                    __m128i xs = _mm_add_epi32(_mm_set1_epi32(x), laneIndex);
+                    __m128i inRange = _mm_and_si128(_mm_cmpgt_epi32(xs, firstX), _mm_cmplt_epi32(xs, lastX));
+                    __m128 mask = _mm_castsi128_ps(_mm_andnot_si128(_mm_srai_epi32(inside, 31), inRange));
+
+                    for (int k = 0; k < 3; k++)
+                        edge[k] = _mm_add_epi32(edge[k], edgeStepX[k]);
+
+                    if (_mm_movemask_ps(mask) == 0)
+                        continue;
+
+                    __m128 px = _mm_add_ps(_mm_set1_ps((float)(x - gx)), laneOffset);
+
+                    __m128 z = _mm_add_ps(rowStart[0], _mm_mul_ps(dzdx, px));
+                    __m128 oldDepth = _mm_loadu_ps(depth + x - tileX);
+                    mask = _mm_and_ps(mask, _mm_cmplt_ps(z, oldDepth));
+
+                    int bits = _mm_movemask_ps(mask);
+                    if (bits == 0)
+                        continue;
+
+                    shaded += (bits & 1) + (bits >> 1 & 1) + (bits >> 2 & 1) + (bits >> 3 & 1);
+
+                    __m128 nx = _mm_add_ps(rowStart[1], _mm_mul_ps(dnxdx, px));
+                    __m128 ny = _mm_add_ps(rowStart[2], _mm_mul_ps(dnydx, px));
+                    __m128 nz = _mm_add_ps(rowStart[3], _mm_mul_ps(dnzdx, px));
+
+                    // dot(normalize(n), l) == dot(n, l) / |n|
+                    __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz)));
+                    __m128 ndl = _mm_add_ps(
+                        _mm_add_ps(_mm_mul_ps(nx, lightX), _mm_mul_ps(ny, lightY)),
+                        _mm_mul_ps(nz, lightZ)
+                    );
+                    ndl = _mm_div_ps(ndl, len);
+                    ndl = _mm_max_ps(ndl, zero);
+
+                    __m128i rgba = _mm_or_si128(
+                        _mm_or_si128(
+                            ShadeChannel(baseV[0], ambientV[0], diffuseV[0], ndl),
+                            _mm_slli_epi32(ShadeChannel(baseV[1], ambientV[1], diffuseV[1], ndl), 8)
+                        ),
+                        _mm_or_si128(
+                            _mm_slli_epi32(ShadeChannel(baseV[2], ambientV[2], diffuseV[2], ndl), 16),
+                            _mm_slli_epi32(ShadeChannel(baseV[3], ambientV[3], diffuseV[3], ndl), 24)
+                        )
+                    );
+
+                    __m128i maskI = _mm_castps_si128(mask);
+                    __m128i oldColor = _mm_loadu_si128((const __m128i*)(color + x - tileX));
+                    _mm_storeu_si128(
+                        (__m128i*)(color + x - tileX),
+                        _mm_or_si128(_mm_and_si128(maskI, rgba), _mm_andnot_si128(maskI, oldColor))
+                    );
+                    _mm_storeu_ps(depth + x - tileX, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, oldDepth)));
+                }
+#else
+                int32_t rowE[3];
+                for (int k = 0; k < 3; k++)
+                    rowE[k] = e[k] + stepY[k] * row;
+
+                float rowStart[4];
+                for (int a = 0; a < 4; a++)
+                    rowStart[a] = start[a] + t.planes[a][2] * (float)row;
+
+                for (int x = gx; x <= x1; x++)
+                {
+                    int32_t col = x - gx;
+                    int32_t e0 = rowE[0] + stepX[0] * col;
+                    int32_t e1 = rowE[1] + stepX[1] * col;
+                    int32_t e2 = rowE[2] + stepX[2] * col;
+
+                    if (x < x0 || (e0 | e1 | e2) < 0)
+                        continue;
+
+                    float px = (float)col;
+                    float z = rowStart[0] + t.planes[0][1] * px;
+                    if (!(z < depth[x - tileX]))
+                        continue;
+
+                    shaded++;
+
+                    float nx = rowStart[1] + t.planes[1][1] * px;
+                    float ny = rowStart[2] + t.planes[2][1] * px;
+                    float nz = rowStart[3] + t.planes[3][1] * px;
+
+                    float len = std::sqrt(nx * nx + ny * ny + nz * nz);
+                    float ndl = (nx * lx + ny * ly + nz * lz) / len;
+                    ndl = ndl > 0.0f ? ndl : 0.0f;
+
+                    float rgba[4];
+                    for (int c = 0; c < 4; c++)
+                        rgba[c] = BASE_COLOR[c] * (ambient[c] + diffuse[c] * ndl);
+
+                    color[x - tileX] = PackColor(rgba[0], rgba[1], rgba[2], rgba[3]);
+                    depth[x - tileX] = z;
+                }
+#endif
+            }
+        }
+    }
+
+    return shaded;
+}
+
+bool SoftwareRenderer::WriteImage(const std::string& path)
+{
+    const uint32_t* pixels = Pixels();
+
+    ResolveClear();
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f)
+        return false;
+
+    fprintf(f, "P6\n%d %d\n255\n", mWidth, mHeight);
+
+    std::vector<uint8_t> row((size_t)mWidth * 3);
+    bool ok = true;
+
+    for (int y = 0; y < mHeight && ok; y++)
+    {
+        const uint32_t* src = pixels + (size_t)y * mWidth;
+        for (int x = 0; x < mWidth; x++)
+        {
+            row[x * 3 + 0] = (uint8_t)(src[x]);
+            row[x * 3 + 1] = (uint8_t)(src[x] >> 8);
+            row[x * 3 + 2] = (uint8_t)(src[x] >> 16);
+        }
+        ok = fwrite(row.data(), 1, row.size(), f) == row.size();
+    }
+
+    return fclose(f) == 0 && ok;
+}
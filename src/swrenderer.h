@@ -0,0 +1,131 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+#include "vertex.h"
+#include "constants.h"
+
+struct SoftwareRenderStats
+{
+    // Triangles submitted by DrawIndexed.
+    uint64_t trianglesIn = 0;
+    // Triangles left after culling and clipping, as rasterized.
+    uint64_t trianglesDrawn = 0;
+    // Pixels that passed the depth test.
+    uint64_t pixelsShaded = 0;
+};
+
+// CPU backend mirroring the D3D12 path: Shaders::VertexShader and
+// Shaders::PixelShader with back face culling (clockwise front), depth
+// clipping and a LESS depth test on a D32 buffer.
+//
+// Every draw transforms its vertices, bins triangles into screen tiles and
+// then rasterizes the tiles in parallel. Triangles keep their submission
+// order inside a tile, so images do not depend on the thread count.
+class SoftwareRenderer
+{
+public:
+    SoftwareRenderer();
+
+    // threadCount 0 picks one worker per hardware thread.
+    bool Initialize(int width, int height, unsigned threadCount = 0);
+
+    void SetObjectConstants(const ObjectConstants& constants);
+    void SetLightConstants(const LightConstants& constants);
+
+    void SetVertexBuffer(const Vertex* vertices, size_t vertexCount);
+    void SetIndexBuffer(const uint32_t* indices, size_t indexCount);
+
+    // Clears the color target and resets depth to 1. Tiles are cleared
+    // lazily by the next draw or read, while they are in cache anyway.
+    void Clear(const float color[4]);
+
+    void DrawIndexed(uint32_t indexCount, uint32_t startIndex, int32_t baseVertex);
+
+    // RGBA8, row major, top row first.
+    const uint32_t* Pixels();
+    int Width() const { return mWidth; }
+    int Height() const { return mHeight; }
+
+    const SoftwareRenderStats& Stats() const { return mStats; }
+    void ResetStats() { mStats = SoftwareRenderStats(); }
+
+    // Binary PPM (P6).
+    bool WriteImage(const std::string& path);
+
+private:
+    struct ClipVertex
+    {
+        float x, y, z, w;
+        float nx, ny, nz;
+    };
+
+    struct Triangle
+    {
+        // Edge k is opposite vertex k. E = A * x + B * y + C in sub-pixel units
+        // is >= 0 inside; the top-left bias is folded into C.
+        int32_t A[3];
+        int32_t B[3];
+        int64_t C[3];
+
+        // Covered pixel rectangle, inclusive, clamped to the target.
+        int minX;
+        int minY;
+        int maxX;
+        int maxY;
+
+        // Vertex 0 in pixels, attributes are planes around it.
+        float x0;
+        float y0;
+
+        // z, nx / w, ny / w, nz / w: value at vertex 0, d/dx, d/dy per pixel.
+        float planes[4][3];
+    };
+
+    void TransformVertices(int32_t baseVertex, uint32_t firstVertex, uint32_t vertexCount);
+    void SetupTriangles(unsigned chunk, uint32_t firstIndex, uint32_t endIndex);
+    void AddTriangle(unsigned chunk, const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2);
+    uint64_t RasterizeTile(uint32_t tile);
+    void ClearTile(uint32_t tile);
+    void ResolveClear();
+
+    template <typename Fn>
+    void ParallelFor(size_t count, Fn fn);
+
+    int mWidth;
+    int mHeight;
+    int mTilesX;
+    int mTilesY;
+    unsigned mThreadCount;
+
+    // Targets are stored tile by tile, each tile row major, so a tile is
+    // one contiguous block. Pixels() linearizes into mResolved.
+    std::vector<uint32_t> mColor;
+    std::vector<float> mDepth;
+    std::vector<uint32_t> mResolved;
+
+    uint32_t mClearColor;
+    std::vector<uint8_t> mTileClearPending;
+
+    ObjectConstants mObject;
+    LightConstants mLight;
+
+    const Vertex* mVertices;
+    size_t mVertexCount;
+    const uint32_t* mIndices;
+    size_t mIndexCount;
+
+    // Clip space positions of the current draw, indexed like mVertices.
+    std::vector<ClipVertex> mTransformed;
+    uint32_t mTransformedFirst;
+
+    // Per setup chunk: triangles and, per tile, indices into them. Chunks
+    // cover consecutive index ranges.
+    std::vector<std::vector<Triangle>> mTriangles;
+    std::vector<std::vector<std::vector<uint32_t>>> mBins;
+    std::vector<SoftwareRenderStats> mWorkerStats;
+
+    SoftwareRenderStats mStats;
+};
@@ -0,0 +1,434 @@
+#include "tlsf.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+    // Index of the lowest / highest set bit; value must not be 0.
+    inline uint32_t LowestBit(uint64_t value)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, value);
+        return (uint32_t)index;
+#else
+        return (uint32_t)__builtin_ctzll(value);
+#endif
+    }
+
+    inline uint32_t HighestBit(uint64_t value)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return (uint32_t)index;
+#else
+        return 63u - (uint32_t)__builtin_clzll(value);
+#endif
+    }
+}
+
+TlsfAllocator::TlsfAllocator()
+    : mSize(0),
+    mGranularity(1),
+    mGranularityShift(0),
+    mFlBitmap(0),
+    mSlBitmap(),
+    mFreeHeads(),
+    mUsedBytes(0),
+    mAllocationCount(0),
+    mFreeRegionCount(0)
+{
+}
+
+void TlsfAllocator::Initialize(uint64_t size, uint64_t granularity)
+{
+    mGranularity = granularity > 0 ? granularity : 1;
+    mGranularityShift = HighestBit(mGranularity);
+    mSize = size >> mGranularityShift << mGranularityShift;
+
+    mNodes.clear();
+    mSpareNodes.clear();
+
+    mFlBitmap = 0;
+    for (uint32_t fl = 0; fl < FL_COUNT; fl++)
+    {
+        mSlBitmap[fl] = 0;
+        for (uint32_t sl = 0; sl < SL_COUNT; sl++)
+            mFreeHeads[fl][sl] = TLSF_INVALID;
+    }
+
+    mUsedBytes = 0;
+    mAllocationCount = 0;
+    mFreeRegionCount = 0;
+
+    if (mSize == 0)
+        return;
+
+    uint32_t node = NewNode();
+    mNodes[node].offset = 0;
+    mNodes[node].size = mSize >> mGranularityShift;
+    InsertFree(node);
+}
+
+// ===== size classes =====
+
+// Sizes below SL_COUNT granules get exact lists in class 0; above, class fl
+// covers [2^(fl+SL_BITS-1), 2^(fl+SL_BITS)) split into SL_COUNT slices.
+void TlsfAllocator::Mapping(uint64_t size, uint32_t& fl, uint32_t& sl)
+{
+    if (size < SL_COUNT)
+    {
+        fl = 0;
+        sl = (uint32_t)size;
+        return;
+    }
+
+    uint32_t msb = HighestBit(size);
+    fl = msb - SL_BITS + 1;
+    sl = (uint32_t)(size >> (msb - SL_BITS)) - SL_COUNT;
+}
+
+uint32_t TlsfAllocator::NewNode()
+{
+    uint32_t node;
+    if (!mSpareNodes.empty())
+    {
+        node = mSpareNodes.back();
+        mSpareNodes.pop_back();
+    }
+    else
+    {
+        node = (uint32_t)mNodes.size();
+        mNodes.emplace_back();
+    }
+
+    Node& n = mNodes[node];
+    n.offset = 0;
+    n.size = 0;
+    n.alignment = 0;
+    n.prevPhysical = TLSF_INVALID;
+    n.nextPhysical = TLSF_INVALID;
+    n.prevFree = TLSF_INVALID;
+    n.nextFree = TLSF_INVALID;
+    n.free = false;
+    return node;
+}
+
+void TlsfAllocator::ReleaseNode(uint32_t node)
+{
+    mSpareNodes.push_back(node);
+}
+
+void TlsfAllocator::InsertFree(uint32_t node)
+{
+    Node& n = mNodes[node];
+
+    uint32_t fl, sl;
+    Mapping(n.size, fl, sl);
+
+    n.free = true;
+    n.prevFree = TLSF_INVALID;
+    n.nextFree = mFreeHeads[fl][sl];
+    if (n.nextFree != TLSF_INVALID)
+        mNodes[n.nextFree].prevFree = node;
+
+    mFreeHeads[fl][sl] = node;
+    mSlBitmap[fl] |= 1u << sl;
+    mFlBitmap |= 1ull << fl;
+    ++mFreeRegionCount;
+}
+
+void TlsfAllocator::RemoveFree(uint32_t node)
+{
+    Node& n = mNodes[node];
+
+    uint32_t fl, sl;
+    Mapping(n.size, fl, sl);
+
+    if (n.prevFree != TLSF_INVALID)
+        mNodes[n.prevFree].nextFree = n.nextFree;
+    else
+        mFreeHeads[fl][sl] = n.nextFree;
+
+    if (n.nextFree != TLSF_INVALID)
+        mNodes[n.nextFree].prevFree = n.prevFree;
+
+    if (mFreeHeads[fl][sl] == TLSF_INVALID)
+    {
+        mSlBitmap[fl] &= ~(1u << sl);
+        if (mSlBitmap[fl] == 0)
+            mFlBitmap &= ~(1ull << fl);
+    }
+
+    n.free = false;
+    n.prevFree = TLSF_INVALID;
+    n.nextFree = TLSF_INVALID;
+    --mFreeRegionCount;
+}
+
+// First region from a list whose every entry is >= size ("good fit"),
+// falling back to a scan of size's own list when only it has room.
+uint32_t TlsfAllocator::FindFree(uint64_t size)
+{
+    // Round up to the next slice so any region in the list fits.
+    uint64_t rounded = size;
+    if (size >= SL_COUNT)
+        rounded += (1ull << (HighestBit(size) - SL_BITS)) - 1;
+
+    uint32_t fl, sl;
+    Mapping(rounded, fl, sl);
+
+    uint32_t slMap = mSlBitmap[fl] & (~0u << sl);
+    if (slMap == 0)
+    {
+        uint64_t flMap = fl + 1 < FL_COUNT ? mFlBitmap & (~0ull << (fl + 1)) : 0;
+        if (flMap != 0)
+        {
+            fl = LowestBit(flMap);
+            slMap = mSlBitmap[fl];
+        }
+    }
+
+    if (slMap != 0)
+        return mFreeHeads[fl][LowestBit(slMap)];
+
+    Mapping(size, fl, sl);
+    for (uint32_t node = mFreeHeads[fl][sl]; node != TLSF_INVALID; node = mNodes[node].nextFree)
+    {
+        if (mNodes[node].size >= size)
+            return node;
+    }
+
+    return TLSF_INVALID;
+}
+
+// Keeps the first size granules in node and frees the rest.
+void TlsfAllocator::SplitAfter(uint32_t node, uint64_t size)
+{
+    if (mNodes[node].size <= size)
+        return;
+
+    uint32_t rest = NewNode();
+    Node& n = mNodes[node];
+    Node& r = mNodes[rest];
+
+    r.offset = n.offset + size;
+    r.size = n.size - size;
+    r.prevPhysical = node;
+    r.nextPhysical = n.nextPhysical;
+    if (r.nextPhysical != TLSF_INVALID)
+        mNodes[r.nextPhysical].prevPhysical = rest;
+
+    n.size = size;
+    n.nextPhysical = rest;
+
+    InsertFree(rest);
+}
+
+// ===== allocate / free =====
+
+bool TlsfAllocator::Allocate(uint64_t size, uint64_t alignment, TlsfAllocation& allocation)
+{
+    if (size == 0 || mSize == 0)
+        return false;
+
+    uint64_t granules = ((size - 1) >> mGranularityShift) + 1;
+    uint64_t alignGranules = alignment > mGranularity ? alignment >> mGranularityShift : 1;
+
+    // Try a region that happens to be aligned before paying for the worst
+    // case front padding of alignGranules - 1.
+    uint32_t node = FindFree(granules);
+    if (node != TLSF_INVALID && alignGranules > 1)
+    {
+        const Node& n = mNodes[node];
+        uint64_t padding = (alignGranules - n.offset % alignGranules) % alignGranules;
+        if (padding + granules > n.size)
+            node = FindFree(granules + alignGranules - 1);
+    }
+
+    if (node == TLSF_INVALID)
+        return false;
+
+    RemoveFree(node);
+
+    uint64_t offset = mNodes[node].offset;
+    uint64_t aligned = (offset + alignGranules - 1) / alignGranules * alignGranules;
+    if (aligned != offset)
+    {
+        // Give the padding back as its own free region.
+        uint32_t padding = node;
+        SplitAfter(padding, aligned - offset);
+        node = mNodes[padding].nextPhysical;
+        RemoveFree(node);
+
+        // SplitAfter freed the tail; the padding in front is free too.
+        InsertFree(padding);
+    }
+
+    SplitAfter(node, granules);
+
+    mUsedBytes += granules << mGranularityShift;
+    ++mAllocationCount;
+
+    mNodes[node].alignment = alignGranules;
+
+    allocation.offset = mNodes[node].offset << mGranularityShift;
+    allocation.size = granules << mGranularityShift;
+    allocation.alignment = alignGranules << mGranularityShift;
+    allocation.node = node;
+    return true;
+}
+
+void TlsfAllocator::Free(const TlsfAllocation& allocation)
+{
+    uint32_t node = allocation.node;
+    if (node == TLSF_INVALID)
+        return;
+
+    mUsedBytes -= mNodes[node].size << mGranularityShift;
+    --mAllocationCount;
+
+    // Merge with free neighbours.
+    uint32_t prev = mNodes[node].prevPhysical;
+    if (prev != TLSF_INVALID && mNodes[prev].free)
+    {
+        RemoveFree(prev);
+        mNodes[prev].size += mNodes[node].size;
+        mNodes[prev].nextPhysical = mNodes[node].nextPhysical;
+        if (mNodes[prev].nextPhysical != TLSF_INVALID)
+            mNodes[mNodes[prev].nextPhysical].prevPhysical = prev;
+
+        ReleaseNode(node);
+        node = prev;
+    }
+
+    uint32_t next = mNodes[node].nextPhysical;
+    if (next != TLSF_INVALID && mNodes[next].free)
+    {
+        RemoveFree(next);
+        mNodes[node].size += mNodes[next].size;
+        mNodes[node].nextPhysical = mNodes[next].nextPhysical;
+        if (mNodes[node].nextPhysical != TLSF_INVALID)
+            mNodes[mNodes[node].nextPhysical].prevPhysical = node;
+
+        ReleaseNode(next);
+    }
+
+    InsertFree(node);
+}
+
+// ===== statistics =====
+
+uint64_t TlsfAllocator::LargestFreeRegion() const
+{
+    if (mFlBitmap == 0)
+        return 0;
+
+    // Only the top non-empty list can hold the largest region.
+    uint32_t fl = HighestBit(mFlBitmap);
+    uint32_t sl = HighestBit(mSlBitmap[fl]);
+
+    uint64_t largest = 0;
+    for (uint32_t node = mFreeHeads[fl][sl]; node != TLSF_INVALID; node = mNodes[node].nextFree)
+    {
+        if (mNodes[node].size > largest)
+            largest = mNodes[node].size;
+    }
+
+    return largest << mGranularityShift;
+}
+
+void TlsfAllocator::GetAllocations(std::vector<TlsfAllocation>& allocations) const
+{
+    allocations.clear();
+    if (mNodes.empty())
+        return;
+
+    // Node 0 is created first at offset 0 and only ever merges forward.
+    for (uint32_t node = 0; node != TLSF_INVALID; node = mNodes[node].nextPhysical)
+    {
+        const Node& n = mNodes[node];
+        if (!n.free)
+            allocations.push_back({ n.offset << mGranularityShift, n.size << mGranularityShift, n.alignment << mGranularityShift, node });
+    }
+}
+
+bool TlsfAllocator::Validate() const
+{
+    if (mNodes.empty())
+        return mSize == 0;
+
+    uint64_t offset = 0;
+    uint64_t used = 0;
+    uint32_t allocations = 0;
+    uint32_t freeRegions = 0;
+    uint32_t prev = TLSF_INVALID;
+    bool prevFree = false;
+
+    for (uint32_t node = 0; node != TLSF_INVALID; node = mNodes[node].nextPhysical)
+    {
+        const Node& n = mNodes[node];
+        if (n.offset != offset || n.size == 0 || n.prevPhysical != prev)
+            return false;
+
+        if (n.free)
+        {
+            // Adjacent free regions must have merged.
+            if (prevFree)
+                return false;
+
+            uint32_t fl, sl;
+            Mapping(n.size, fl, sl);
+            if (!(mSlBitmap[fl] & (1u << sl)))
+                return false;
+
+            ++freeRegions;
+        }
+        else
+        {
+            used += n.size;
+            ++allocations;
+        }
+
+        offset += n.size;
+        prev = node;
+        prevFree = n.free;
+    }
+
+    if (offset << mGranularityShift != mSize)
+        return false;
+
+    uint32_t listed = 0;
+    for (uint32_t fl = 0; fl < FL_COUNT; fl++)
+    {
+        for (uint32_t sl = 0; sl < SL_COUNT; sl++)
+        {
+            uint32_t prevInList = TLSF_INVALID;
+            for (uint32_t node = mFreeHeads[fl][sl]; node != TLSF_INVALID; node = mNodes[node].nextFree)
+            {
+                uint32_t nodeFl, nodeSl;
+                Mapping(mNodes[node].size, nodeFl, nodeSl);
+                if (!mNodes[node].free || nodeFl != fl || nodeSl != sl || mNodes[node].prevFree != prevInList)
+                    return false;
+
+                prevInList = node;
+                ++listed;
+            }
+
+            bool bit = (mSlBitmap[fl] & (1u << sl)) != 0;
+            if (bit != (mFreeHeads[fl][sl] != TLSF_INVALID))
+                return false;
+        }
+
+        if (((mFlBitmap >> fl) & 1) != (mSlBitmap[fl] != 0))
+            return false;
+    }
+
+    return listed == freeRegions
+        && freeRegions == mFreeRegionCount
+        && allocations == mAllocationCount
+        && used << mGranularityShift == mUsedBytes;
+}
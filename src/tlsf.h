@@ -0,0 +1,95 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+static const uint32_t TLSF_INVALID = 0xFFFFFFFFu;
+
+struct TlsfAllocation
+{
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    // As requested, for moving the allocation elsewhere.
+    uint64_t alignment = 0;
+    // Internal block handle, TLSF_INVALID when empty.
+    uint32_t node = TLSF_INVALID;
+};
+
+// Two-level segregated fit allocator over an abstract range of bytes; it
+// hands out offsets and never touches the memory itself. Allocate and Free
+// are O(1): free regions are bucketed by the top SL_BITS bits of their
+// size, and adjacent free regions merge on Free.
+class TlsfAllocator
+{
+public:
+    TlsfAllocator();
+
+    // Offsets and sizes are multiples of granularity, a power of two.
+    void Initialize(uint64_t size, uint64_t granularity);
+
+    // alignment is a power of two; smaller than granularity means granularity.
+    bool Allocate(uint64_t size, uint64_t alignment, TlsfAllocation& allocation);
+    void Free(const TlsfAllocation& allocation);
+
+    uint64_t Size() const { return mSize; }
+    uint64_t Granularity() const { return mGranularity; }
+    uint64_t UsedBytes() const { return mUsedBytes; }
+    uint64_t FreeBytes() const { return mSize - mUsedBytes; }
+    uint32_t AllocationCount() const { return mAllocationCount; }
+    uint32_t FreeRegionCount() const { return mFreeRegionCount; }
+    uint64_t LargestFreeRegion() const;
+
+    // Live allocations in address order.
+    void GetAllocations(std::vector<TlsfAllocation>& allocations) const;
+
+    // Walks every block and free list; for tests.
+    bool Validate() const;
+
+private:
+    static const uint32_t SL_BITS = 4;
+    static const uint32_t SL_COUNT = 1u << SL_BITS;
+    static const uint32_t FL_COUNT = 64;
+
+    struct Node
+    {
+        // In granules.
+        uint64_t offset;
+        uint64_t size;
+        uint64_t alignment;
+
+        // Neighbours in address order.
+        uint32_t prevPhysical;
+        uint32_t nextPhysical;
+
+        // Free list links, only while free.
+        uint32_t prevFree;
+        uint32_t nextFree;
+
+        bool free;
+    };
+
+    static void Mapping(uint64_t size, uint32_t& fl, uint32_t& sl);
+
+    uint32_t NewNode();
+    void ReleaseNode(uint32_t node);
+
+    void InsertFree(uint32_t node);
+    void RemoveFree(uint32_t node);
+    uint32_t FindFree(uint64_t size);
+    void SplitAfter(uint32_t node, uint64_t size);
+
+    uint64_t mSize;
+    uint64_t mGranularity;
+    uint32_t mGranularityShift;
+
+    std::vector<Node> mNodes;
+    std::vector<uint32_t> mSpareNodes;
+
+    uint64_t mFlBitmap;
+    uint32_t mSlBitmap[FL_COUNT];
+    uint32_t mFreeHeads[FL_COUNT][SL_COUNT];
+
+    uint64_t mUsedBytes;
+    uint32_t mAllocationCount;
+    uint32_t mFreeRegionCount;
+};
@@ -0,0 +1,550 @@
+#include "transforms.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TRANSFORM_X86 1
+#include <emmintrin.h>
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+    // ===== scalar =====
+
+    // The SSE path evaluates the same expressions in the same order, so
+    // results match bit for bit.
+    struct Affine
+    {
+        // Rotation and scale rows, then translation.
+        float m[3][3];
+        float t[3];
+    };
+
+    inline void LocalAffine(
+        float px, float py, float pz,
+        float qx, float qy, float qz, float qw,
+        float sx, float sy, float sz,
+        Affine& a)
+    {
+        float x2 = qx + qx;
+        float y2 = qy + qy;
+        float z2 = qz + qz;
+
+        float xx = qx * x2;
+        float yy = qy * y2;
+        float zz = qz * z2;
+        float xy = qx * y2;
+        float xz = qx * z2;
+        float yz = qy * z2;
+        float wx = qw * x2;
+        float wy = qw * y2;
+        float wz = qw * z2;
+
+        a.m[0][0] = (1.0f - (yy + zz)) * sx;
+        a.m[0][1] = (xy + wz) * sx;
+        a.m[0][2] = (xz - wy) * sx;
+
+        a.m[1][0] = (xy - wz) * sy;
+        a.m[1][1] = (1.0f - (xx + zz)) * sy;
+        a.m[1][2] = (yz + wx) * sy;
+
+        a.m[2][0] = (xz + wy) * sz;
+        a.m[2][1] = (yz - wx) * sz;
+        a.m[2][2] = (1.0f - (xx + yy)) * sz;
+
+        a.t[0] = px;
+        a.t[1] = py;
+        a.t[2] = pz;
+    }
+
+    inline void StoreAffine(const Affine& a, TransformMatrix& out)
+    {
+        for (int k = 0; k < 3; k++)
+            out.rows[k] = XMFLOAT4(a.m[0][k], a.m[1][k], a.m[2][k], a.t[k]);
+    }
+
+    // out = local * parent, with row vectors.
+    inline void ComposeAffine(const Affine& a, const TransformMatrix& parent, TransformMatrix& out)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            // Column k of the parent: its row k, transposed.
+            const XMFLOAT4& p = parent.rows[k];
+
+            out.rows[k] = XMFLOAT4(
+                a.m[0][0] * p.x + a.m[0][1] * p.y + a.m[0][2] * p.z,
+                a.m[1][0] * p.x + a.m[1][1] * p.y + a.m[1][2] * p.z,
+                a.m[2][0] * p.x + a.m[2][1] * p.y + a.m[2][2] * p.z,
+                a.t[0] * p.x + a.t[1] * p.y + a.t[2] * p.z + p.w
+            );
+        }
+    }
+
+    // values[i] = values[order[i]]
+    template <typename T>
+    void Permute(std::vector<T>& values, const std::vector<uint32_t>& order, std::vector<T>& scratch)
+    {
+        scratch.resize(order.size());
+        for (size_t i = 0; i < order.size(); i++)
+            scratch[i] = values[order[i]];
+        values.swap(scratch);
+    }
+}
+
+TransformHierarchy::TransformHierarchy()
+    : mOrderDirty(false),
+    mAnyDirty(false)
+{
+}
+
+TransformHandle TransformHierarchy::Create(TransformHandle parent, const Transform& local)
+{
+    TransformHandle handle;
+    if (!mFreeHandles.empty())
+    {
+        handle = mFreeHandles.back();
+        mFreeHandles.pop_back();
+    }
+    else
+    {
+        handle = (TransformHandle)mNodes.size();
+        mNodes.emplace_back();
+    }
+
+    uint32_t index = (uint32_t)mHandle.size();
+    uint32_t depth = parent == TRANSFORM_NONE ? 0 : mNodes[parent].depth + 1;
+
+    Node& node = mNodes[handle];
+    node.index = index;
+    node.parent = parent;
+    node.depth = depth;
+    node.destroyed = false;
+
+    mPositionX.push_back(local.position.x);
+    mPositionY.push_back(local.position.y);
+    mPositionZ.push_back(local.position.z);
+    mRotationX.push_back(local.rotation.x);
+    mRotationY.push_back(local.rotation.y);
+    mRotationZ.push_back(local.rotation.z);
+    mRotationW.push_back(local.rotation.w);
+    mScaleX.push_back(local.scale.x);
+    mScaleY.push_back(local.scale.y);
+    mScaleZ.push_back(local.scale.z);
+
+    mParent.push_back(parent == TRANSFORM_NONE ? TRANSFORM_NONE : mNodes[parent].index);
+    mHandle.push_back(handle);
+    mDirty.push_back(1);
+    mWorld.emplace_back();
+    mAnyDirty = true;
+
+    // Appending to the deepest level, or starting the next one, keeps the
+    // order; anything else waits for Rebuild.
+    if (!mOrderDirty && depth + 1 == mLevelEnd.size())
+        mLevelEnd.back() = index + 1;
+    else if (!mOrderDirty && depth == mLevelEnd.size())
+        mLevelEnd.push_back(index + 1);
+    else
+        mOrderDirty = true;
+
+    return handle;
+}
+
+void TransformHierarchy::Destroy(TransformHandle node)
+{
+    mNodes[node].destroyed = true;
+    mOrderDirty = true;
+}
+
+void TransformHierarchy::Reserve(size_t nodeCount)
+{
+    mNodes.reserve(nodeCount);
+    mPositionX.reserve(nodeCount);
+    mPositionY.reserve(nodeCount);
+    mPositionZ.reserve(nodeCount);
+    mRotationX.reserve(nodeCount);
+    mRotationY.reserve(nodeCount);
+    mRotationZ.reserve(nodeCount);
+    mRotationW.reserve(nodeCount);
+    mScaleX.reserve(nodeCount);
+    mScaleY.reserve(nodeCount);
+    mScaleZ.reserve(nodeCount);
+    mParent.reserve(nodeCount);
+    mHandle.reserve(nodeCount);
+    mDirty.reserve(nodeCount);
+    mWorld.reserve(nodeCount);
+}
+
+Transform TransformHierarchy::Local(TransformHandle node) const
+{
+    uint32_t i = mNodes[node].index;
+
+    Transform local;
+    local.position = XMFLOAT3(mPositionX[i], mPositionY[i], mPositionZ[i]);
+    local.rotation = XMFLOAT4(mRotationX[i], mRotationY[i], mRotationZ[i], mRotationW[i]);
+    local.scale = XMFLOAT3(mScaleX[i], mScaleY[i], mScaleZ[i]);
+    return local;
+}
+
+void TransformHierarchy::MarkDirty(uint32_t index)
+{
+    mDirty[index] = 1;
+    mAnyDirty = true;
+}
+
+void TransformHierarchy::SetLocal(TransformHandle node, const Transform& local)
+{
+    SetPosition(node, local.position);
+    SetRotation(node, local.rotation);
+    SetScale(node, local.scale);
+}
+
+void TransformHierarchy::SetPosition(TransformHandle node, const XMFLOAT3& position)
+{
+    uint32_t i = mNodes[node].index;
+    mPositionX[i] = position.x;
+    mPositionY[i] = position.y;
+    mPositionZ[i] = position.z;
+    MarkDirty(i);
+}
+
+void TransformHierarchy::SetRotation(TransformHandle node, const XMFLOAT4& rotation)
+{
+    uint32_t i = mNodes[node].index;
+    mRotationX[i] = rotation.x;
+    mRotationY[i] = rotation.y;
+    mRotationZ[i] = rotation.z;
+    mRotationW[i] = rotation.w;
+    MarkDirty(i);
+}
+
+void TransformHierarchy::SetScale(TransformHandle node, const XMFLOAT3& scale)
+{
+    uint32_t i = mNodes[node].index;
+    mScaleX[i] = scale.x;
+    mScaleY[i] = scale.y;
+    mScaleZ[i] = scale.z;
+    MarkDirty(i);
+}
+
+XMFLOAT4X4 TransformHierarchy::World(TransformHandle node) const
+{
+    const TransformMatrix& w = mWorld[mNodes[node].index];
+
+    XMFLOAT4X4 m;
+    for (int k = 0; k < 3; k++)
+    {
+        m.m[0][k] = w.rows[k].x;
+        m.m[1][k] = w.rows[k].y;
+        m.m[2][k] = w.rows[k].z;
+        m.m[3][k] = w.rows[k].w;
+    }
+
+    m.m[0][3] = 0.0f;
+    m.m[1][3] = 0.0f;
+    m.m[2][3] = 0.0f;
+    m.m[3][3] = 1.0f;
+    return m;
+}
+
+// ===== reordering =====
+
+void TransformHierarchy::Rebuild()
+{
+    size_t count = mHandle.size();
+
+    // Counting sort by depth.
+    std::vector<uint32_t> levelEnd;
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t depth = mNodes[mHandle[i]].depth;
+        if (depth >= levelEnd.size())
+            levelEnd.resize(depth + 1, 0);
+        ++levelEnd[depth];
+    }
+
+    uint32_t sum = 0;
+    for (uint32_t& end : levelEnd)
+    {
+        uint32_t n = end;
+        end = sum;
+        sum += n;
+    }
+
+    std::vector<uint32_t> sorted(count);
+    for (size_t i = 0; i < count; i++)
+        sorted[levelEnd[mNodes[mHandle[i]].depth]++] = (uint32_t)i;
+
+    // Level by level, so parents have their new index before their
+    // children are placed, and a destroyed ancestor is known before its
+    // descendants are reached.
+    std::vector<uint32_t> order;
+    order.reserve(count);
+    mLevelEnd.clear();
+
+    uint32_t begin = 0;
+    for (uint32_t end : levelEnd)
+    {
+        // Siblings together, in parent order: the pass then reads parents
+        // front to back.
+        std::stable_sort(sorted.begin() + begin, sorted.begin() + end, [&](uint32_t a, uint32_t b)
+        {
+            TransformHandle pa = mNodes[mHandle[a]].parent;
+            TransformHandle pb = mNodes[mHandle[b]].parent;
+            uint32_t ia = pa == TRANSFORM_NONE ? 0 : mNodes[pa].index;
+            uint32_t ib = pb == TRANSFORM_NONE ? 0 : mNodes[pb].index;
+            return ia < ib;
+        });
+
+        for (uint32_t i = begin; i < end; i++)
+        {
+            Node& node = mNodes[mHandle[sorted[i]]];
+
+            if (node.parent != TRANSFORM_NONE && mNodes[node.parent].destroyed)
+                node.destroyed = true;
+
+            if (node.destroyed)
+                continue;
+
+            node.index = (uint32_t)order.size();
+            order.push_back(sorted[i]);
+        }
+
+        // Destroying every node of a level removes all deeper ones too.
+        if (order.size() > (mLevelEnd.empty() ? 0 : mLevelEnd.back()))
+            mLevelEnd.push_back((uint32_t)order.size());
+
+        begin = end;
+    }
+
+    // Handles are released only after the walk: a freed handle's node
+    // still has to mark its children.
+    for (uint32_t old : sorted)
+    {
+        TransformHandle handle = mHandle[old];
+        if (mNodes[handle].destroyed)
+        {
+            mNodes[handle].index = TRANSFORM_NONE;
+            mFreeHandles.push_back(handle);
+        }
+    }
+
+    std::vector<float> scratch;
+    Permute(mPositionX, order, scratch);
+    Permute(mPositionY, order, scratch);
+    Permute(mPositionZ, order, scratch);
+    Permute(mRotationX, order, scratch);
+    Permute(mRotationY, order, scratch);
+    Permute(mRotationZ, order, scratch);
+    Permute(mRotationW, order, scratch);
+    Permute(mScaleX, order, scratch);
+    Permute(mScaleY, order, scratch);
+    Permute(mScaleZ, order, scratch);
+
+    std::vector<uint8_t> dirtyScratch;
+    Permute(mDirty, order, dirtyScratch);
+
+    std::vector<TransformMatrix> worldScratch;
+    Permute(mWorld, order, worldScratch);
+
+    std::vector<TransformHandle> handleScratch;
+    Permute(mHandle, order, handleScratch);
+
+    mParent.resize(order.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        TransformHandle parent = mNodes[mHandle[i]].parent;
+        mParent[i] = parent == TRANSFORM_NONE ? TRANSFORM_NONE : mNodes[parent].index;
+    }
+
+    mOrderDirty = false;
+}
+
+// ===== world matrices =====
+
+size_t TransformHierarchy::UpdateRange(size_t begin, size_t end, bool roots, bool simd)
+{
+    size_t updated = 0;
+    size_t i = begin;
+
+#ifdef TRANSFORM_X86
+    if (simd)
+    {
+        const __m128 one = _mm_set1_ps(1.0f);
+
+        for (; i + 4 <= end; i += 4)
+        {
+            // A node is recomputed when it or its parent changed; the flag
+            // stays set for its own children.
+            uint8_t dirty[4];
+            memcpy(dirty, mDirty.data() + i, sizeof(dirty));
+            if (!roots)
+            {
+                for (int lane = 0; lane < 4; lane++)
+                    dirty[lane] |= mDirty[mParent[i + lane]];
+            }
+
+            uint32_t flags;
+            memcpy(&flags, dirty, sizeof(flags));
+            if (flags == 0)
+                continue;
+
+            memcpy(mDirty.data() + i, dirty, sizeof(dirty));
+
+            __m128 qx = _mm_loadu_ps(mRotationX.data() + i);
+            __m128 qy = _mm_loadu_ps(mRotationY.data() + i);
+            __m128 qz = _mm_loadu_ps(mRotationZ.data() + i);
+            __m128 qw = _mm_loadu_ps(mRotationW.data() + i);
+            __m128 sx = _mm_loadu_ps(mScaleX.data() + i);
+            __m128 sy = _mm_loadu_ps(mScaleY.data() + i);
+            __m128 sz = _mm_loadu_ps(mScaleZ.data() + i);
+
+            __m128 x2 = _mm_add_ps(qx, qx);
+            __m128 y2 = _mm_add_ps(qy, qy);
+            __m128 z2 = _mm_add_ps(qz, qz);
+
+            __m128 xx = _mm_mul_ps(qx, x2);
+            __m128 yy = _mm_mul_ps(qy, y2);
+            __m128 zz = _mm_mul_ps(qz, z2);
+            __m128 xy = _mm_mul_ps(qx, y2);
+            __m128 xz = _mm_mul_ps(qx, z2);
+            __m128 yz = _mm_mul_ps(qy, z2);
+            __m128 wx = _mm_mul_ps(qw, x2);
+            __m128 wy = _mm_mul_ps(qw, y2);
+            __m128 wz = _mm_mul_ps(qw, z2);
+
+            // Local rows a[r][c] and translation t, one node per lane.
+            __m128 a[3][3];
+            a[0][0] = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx);
+            a[0][1] = _mm_mul_ps(_mm_add_ps(xy, wz), sx);
+            a[0][2] = _mm_mul_ps(_mm_sub_ps(xz, wy), sx);
+
+            a[1][0] = _mm_mul_ps(_mm_sub_ps(xy, wz), sy);
+            a[1][1] = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy);
+            a[1][2] = _mm_mul_ps(_mm_add_ps(yz, wx), sy);
+
+            a[2][0] = _mm_mul_ps(_mm_add_ps(xz, wy), sz);
+            a[2][1] = _mm_mul_ps(_mm_sub_ps(yz, wx), sz);
+            a[2][2] = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz);
+
+            __m128 t[3];
+            t[0] = _mm_loadu_ps(mPositionX.data() + i);
+            t[1] = _mm_loadu_ps(mPositionY.data() + i);
+            t[2] = _mm_loadu_ps(mPositionZ.data() + i);
+
+            TransformMatrix* out = mWorld.data() + i;
+
+            for (int k = 0; k < 3; k++)
+            {
+                __m128 c0, c1, c2, c3;
+
+                if (roots)
+                {
+                    c0 = a[0][k];
+                    c1 = a[1][k];
+                    c2 = a[2][k];
+                    c3 = t[k];
+                }
+                else
+                {
+                    // Row k of the 4 parents, transposed into one vector
+                    // per component.
+                    __m128 px = _mm_loadu_ps(&mWorld[mParent[i + 0]].rows[k].x);
+                    __m128 py = _mm_loadu_ps(&mWorld[mParent[i + 1]].rows[k].x);
+                    __m128 pz = _mm_loadu_ps(&mWorld[mParent[i + 2]].rows[k].x);
+                    __m128 pw = _mm_loadu_ps(&mWorld[mParent[i + 3]].rows[k].x);
+                    _MM_TRANSPOSE4_PS(px, py, pz, pw);
+
+                    c0 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0][0], px), _mm_mul_ps(a[0][1], py)), _mm_mul_ps(a[0][2], pz));
+                    c1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[1][0], px), _mm_mul_ps(a[1][1], py)), _mm_mul_ps(a[1][2], pz));
+                    c2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[2][0], px), _mm_mul_ps(a[2][1], py)), _mm_mul_ps(a[2][2], pz));
+                    c3 = _mm_add_ps(
+                        _mm_add_ps(_mm_add_ps(_mm_mul_ps(t[0], px), _mm_mul_ps(t[1], py)), _mm_mul_ps(t[2], pz)),
+                        pw
+                    );
+                }
+
+                // Back to one row per node. Clean lanes are rewritten with
+                // the value they already hold.
+                _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+                _mm_storeu_ps(&out[0].rows[k].x, c0);
+                _mm_storeu_ps(&out[1].rows[k].x, c1);
+                _mm_storeu_ps(&out[2].rows[k].x, c2);
+                _mm_storeu_ps(&out[3].rows[k].x, c3);
+            }
+
+            updated += (dirty[0] != 0) + (dirty[1] != 0) + (dirty[2] != 0) + (dirty[3] != 0);
+        }
+    }
+#endif
+
+    for (; i < end; i++)
+    {
+        if (!roots)
+            mDirty[i] |= mDirty[mParent[i]];
+
+        if (!mDirty[i])
+            continue;
+
+        Affine a;
+        LocalAffine(
+            mPositionX[i], mPositionY[i], mPositionZ[i],
+            mRotationX[i], mRotationY[i], mRotationZ[i], mRotationW[i],
+            mScaleX[i], mScaleY[i], mScaleZ[i],
+            a
+        );
+
+        if (roots)
+            StoreAffine(a, mWorld[i]);
+        else
+            ComposeAffine(a, mWorld[mParent[i]], mWorld[i]);
+
+        ++updated;
+    }
+
+    return updated;
+}
+
+size_t TransformHierarchy::Update(const TransformUpdateOptions& options)
+{
+    if (mOrderDirty)
+        Rebuild();
+
+    if (!mAnyDirty)
+        return 0;
+
+    // Every level reads only the one before it, so a level splits freely
+    // across workers: chunks are runs of sibling groups, whole subtrees'
+    // slices of that depth.
+    size_t updated = 0;
+    size_t begin = 0;
+
+    for (size_t level = 0; level < mLevelEnd.size(); level++)
+    {
+        size_t end = mLevelEnd[level];
+        bool roots = level == 0;
+
+        if (options.jobs && end - begin > UpdateGrain)
+        {
+            std::atomic<size_t> levelUpdated(0);
+            options.jobs->ParallelFor(end - begin, UpdateGrain, [&](size_t b, size_t e)
+            {
+                levelUpdated.fetch_add(UpdateRange(begin + b, begin + e, roots, options.simd), std::memory_order_relaxed);
+            });
+            updated += levelUpdated.load(std::memory_order_relaxed);
+        }
+        else
+        {
+            updated += UpdateRange(begin, end, roots, options.simd);
+        }
+
+        begin = end;
+    }
+
+    memset(mDirty.data(), 0, mDirty.size());
+    mAnyDirty = false;
+    return updated;
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "jobs.h"
+
+typedef uint32_t TransformHandle;
+
+static const TransformHandle TRANSFORM_NONE = 0xFFFFFFFFu;
+
+// Local transform relative to the parent: scale, then rotation (unit
+// quaternion), then translation.
+struct Transform
+{
+    DirectX::XMFLOAT3 position = { 0.0f, 0.0f, 0.0f };
+    DirectX::XMFLOAT4 rotation = { 0.0f, 0.0f, 0.0f, 1.0f };
+    DirectX::XMFLOAT3 scale = { 1.0f, 1.0f, 1.0f };
+};
+
+// Rows of the transposed world matrix, translation in w; the layout of
+// InstanceData::world, so the array can be copied into an upload buffer.
+struct TransformMatrix
+{
+    DirectX::XMFLOAT4 rows[3];
+};
+
+struct TransformUpdateOptions
+{
+    // Null updates on the calling thread.
+    JobSystem* jobs = nullptr;
+
+    // Off runs the scalar path; both give bit-identical matrices.
+    bool simd = true;
+};
+
+// Parent/child transforms for many objects. Local TRS lives in one array per
+// component, ordered by depth so every parent comes before its children;
+// Update then computes world matrices in a single forward pass, 4 nodes at
+// a time. Only nodes whose local transform or an ancestor changed since the
+// last Update are recomputed.
+//
+// Handles stay valid until their node is destroyed. Node indices, the
+// position in WorldMatrices(), change when the hierarchy does.
+class TransformHierarchy
+{
+public:
+    TransformHierarchy();
+
+    TransformHandle Create(TransformHandle parent = TRANSFORM_NONE, const Transform& local = Transform());
+    // Removes node and its whole subtree on the next Update.
+    void Destroy(TransformHandle node);
+
+    void Reserve(size_t nodeCount);
+
+    Transform Local(TransformHandle node) const;
+    void SetLocal(TransformHandle node, const Transform& local);
+    void SetPosition(TransformHandle node, const DirectX::XMFLOAT3& position);
+    void SetRotation(TransformHandle node, const DirectX::XMFLOAT4& rotation);
+    void SetScale(TransformHandle node, const DirectX::XMFLOAT3& scale);
+
+    TransformHandle Parent(TransformHandle node) const { return mNodes[node].parent; }
+
+    // Applies pending creates and destroys, then recomputes changed world
+    // matrices. Returns how many were recomputed.
+    size_t Update(const TransformUpdateOptions& options = TransformUpdateOptions());
+
+    // World matrices by node index, valid after Update.
+    size_t Count() const { return mWorld.size(); }
+    const TransformMatrix* WorldMatrices() const { return mWorld.data(); }
+    uint32_t Index(TransformHandle node) const { return mNodes[node].index; }
+    DirectX::XMFLOAT4X4 World(TransformHandle node) const;
+
+    size_t LevelCount() const { return mLevelEnd.size(); }
+
+private:
+    // Nodes per job; each level of the hierarchy is split separately.
+    static const size_t UpdateGrain = 16384;
+
+    struct Node
+    {
+        // Position in the component arrays, TRANSFORM_NONE once freed.
+        uint32_t index;
+        TransformHandle parent;
+        uint32_t depth;
+        bool destroyed;
+    };
+
+    void MarkDirty(uint32_t index);
+
+    // Sorts by depth and drops destroyed subtrees.
+    void Rebuild();
+
+    size_t UpdateRange(size_t begin, size_t end, bool roots, bool simd);
+
+    std::vector<Node> mNodes;
+    std::vector<TransformHandle> mFreeHandles;
+
+    // ===== per index =====
+    std::vector<float> mPositionX;
+    std::vector<float> mPositionY;
+    std::vector<float> mPositionZ;
+    std::vector<float> mRotationX;
+    std::vector<float> mRotationY;
+    std::vector<float> mRotationZ;
+    std::vector<float> mRotationW;
+    std::vector<float> mScaleX;
+    std::vector<float> mScaleY;
+    std::vector<float> mScaleZ;
+
+    // Index of the parent, TRANSFORM_NONE for roots.
+    std::vector<uint32_t> mParent;
+    std::vector<TransformHandle> mHandle;
+    // Nonzero when the world matrix must be recomputed.
+    std::vector<uint8_t> mDirty;
+    std::vector<TransformMatrix> mWorld;
+
+    // One past the last index of every depth.
+    std::vector<uint32_t> mLevelEnd;
+
+    // Creates or destroys that broke the depth order.
+    bool mOrderDirty;
+    bool mAnyDirty;
+};
@@ -0,0 +1,150 @@
+#include "uploadring.h"
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// ===== UploadRing =====
+
+UploadRing::UploadRing()
+    : mCpuBase(nullptr),
+    mGpuBase(0),
+    mCapacity(0),
+    mBlockSize(UPLOAD_CONSTANT_ALIGNMENT),
+    mHead(0),
+    mTail(0),
+    mFrameNumber(0)
+{
+}
+
+void UploadRing::Initialize(void* cpuBase, uint64_t gpuBase, uint64_t capacity, uint64_t blockSize)
+{
+    mCpuBase = (uint8_t*)cpuBase;
+    mGpuBase = gpuBase;
+    mBlockSize = AlignUp(blockSize > 0 ? blockSize : 1, UPLOAD_CONSTANT_ALIGNMENT);
+    mCapacity = capacity / mBlockSize * mBlockSize;
+
+    mHead.store(0);
+    mTail.store(0);
+    mFrameNumber.store(0);
+    mFrames.clear();
+}
+
+void UploadRing::BeginFrame(uint64_t completedFence)
+{
+    while (!mFrames.empty() && mFrames.front().fence <= completedFence)
+    {
+        mTail.store(mFrames.front().head, std::memory_order_release);
+        mFrames.pop_front();
+    }
+
+    mFrameNumber.fetch_add(1, std::memory_order_release);
+}
+
+void UploadRing::EndFrame(uint64_t fence)
+{
+    mFrames.push_back({ fence, mHead.load(std::memory_order_acquire) });
+}
+
+bool UploadRing::AllocateBlock(uint64_t size, uint64_t& start)
+{
+    uint64_t bytes = size > mBlockSize ? AlignUp(size, mBlockSize) : mBlockSize;
+    if (bytes > mCapacity)
+        return false;
+
+    uint64_t head = mHead.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        // Never straddle the end of the buffer: skip to the next lap.
+        uint64_t begin = head;
+        uint64_t offset = begin % mCapacity;
+        if (offset + bytes > mCapacity)
+            begin += mCapacity - offset;
+
+        uint64_t end = begin + bytes;
+        if (end - mTail.load(std::memory_order_acquire) > mCapacity)
+            return false;
+
+        if (mHead.compare_exchange_weak(head, end, std::memory_order_acq_rel, std::memory_order_relaxed))
+        {
+            start = begin;
+            return true;
+        }
+    }
+}
+
+bool UploadRing::Allocate(uint64_t size, UploadAllocation& allocation)
+{
+    uint64_t start;
+    if (!AllocateBlock(size, start))
+        return false;
+
+    allocation = Resolve(start, size);
+    return true;
+}
+
+UploadAllocation UploadRing::Resolve(uint64_t position, uint64_t size) const
+{
+    uint64_t offset = position % mCapacity;
+
+    UploadAllocation allocation;
+    allocation.cpu = mCpuBase + offset;
+    allocation.gpu = mGpuBase + offset;
+    allocation.size = size;
+    return allocation;
+}
+
+uint64_t UploadRing::UsedBytes() const
+{
+    return mHead.load(std::memory_order_acquire) - mTail.load(std::memory_order_acquire);
+}
+
+// ===== UploadContext =====
+
+UploadContext::UploadContext()
+    : mRing(nullptr),
+    mFrame(0),
+    mCursor(0),
+    mEnd(0)
+{
+}
+
+void UploadContext::Initialize(UploadRing* ring)
+{
+    mRing = ring;
+    mFrame = ring->FrameNumber();
+    mCursor = 0;
+    mEnd = 0;
+}
+
+bool UploadContext::Allocate(uint64_t size, uint64_t alignment, UploadAllocation& allocation)
+{
+    uint64_t frame = mRing->FrameNumber();
+    if (frame != mFrame)
+    {
+        // The previous block belongs to a frame that has been submitted.
+        mFrame = frame;
+        mCursor = 0;
+        mEnd = 0;
+    }
+
+    uint64_t begin = AlignUp(mCursor, alignment);
+    if (begin + size > mEnd)
+    {
+        // Big requests get their own blocks and keep the current one.
+        if (size > mRing->BlockSize() / 2)
+            return mRing->Allocate(size, allocation);
+
+        uint64_t start;
+        if (!mRing->AllocateBlock(mRing->BlockSize(), start))
+            return false;
+
+        begin = start;
+        mEnd = start + mRing->BlockSize();
+    }
+
+    mCursor = begin + size;
+    allocation = mRing->Resolve(begin, size);
+    return true;
+}
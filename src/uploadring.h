@@ -0,0 +1,97 @@
+#pragma once
+#include <atomic>
+#include <deque>
+#include <cstddef>
+#include <cstdint>
+
+// D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT
+static const uint64_t UPLOAD_CONSTANT_ALIGNMENT = 256;
+
+struct UploadAllocation
+{
+    void* cpu;
+    // Pass straight to SetGraphicsRootConstantBufferView and friends.
+    uint64_t gpu;
+    uint64_t size;
+};
+
+// Linear allocator over one persistently mapped upload buffer. Space is
+// handed out in blocks with a lock-free bump of the head, and reclaimed
+// frame by frame once the fence value recorded at EndFrame has completed.
+//
+// BeginFrame / EndFrame belong to the frame thread; AllocateBlock and
+// Allocate may be called from any thread in between.
+class UploadRing
+{
+public:
+    UploadRing();
+
+    // capacity is rounded down to a multiple of blockSize, which should be
+    // a multiple of UPLOAD_CONSTANT_ALIGNMENT.
+    void Initialize(void* cpuBase, uint64_t gpuBase, uint64_t capacity, uint64_t blockSize = 64 * 1024);
+
+    // Frees the space of every frame whose fence has reached completedFence.
+    void BeginFrame(uint64_t completedFence);
+    // Everything allocated since BeginFrame is in use until fence completes.
+    void EndFrame(uint64_t fence);
+
+    // Reserves size contiguous bytes at a block boundary. start is a ring
+    // position for Resolve. False if the GPU still holds the space.
+    bool AllocateBlock(uint64_t size, uint64_t& start);
+
+    // One-off allocation taking a whole block; use an UploadContext for
+    // many small ones.
+    bool Allocate(uint64_t size, UploadAllocation& allocation);
+
+    UploadAllocation Resolve(uint64_t position, uint64_t size) const;
+
+    uint64_t Capacity() const { return mCapacity; }
+    uint64_t BlockSize() const { return mBlockSize; }
+    uint64_t FrameNumber() const { return mFrameNumber.load(std::memory_order_acquire); }
+
+    // Bytes not yet reclaimed, padding included.
+    uint64_t UsedBytes() const;
+
+private:
+    struct FrameRecord
+    {
+        uint64_t fence;
+        uint64_t head;
+    };
+
+    uint8_t* mCpuBase;
+    uint64_t mGpuBase;
+    uint64_t mCapacity;
+    uint64_t mBlockSize;
+
+    // Monotonic positions; the buffer offset is position % capacity.
+    std::atomic<uint64_t> mHead;
+    std::atomic<uint64_t> mTail;
+    std::atomic<uint64_t> mFrameNumber;
+
+    std::deque<FrameRecord> mFrames;
+};
+
+// Per-thread bump allocator feeding off UploadRing blocks, so only one
+// allocation in BlockSize() touches shared state. Blocks are dropped when
+// the ring moves to a new frame.
+class UploadContext
+{
+public:
+    UploadContext();
+
+    void Initialize(UploadRing* ring);
+
+    bool Allocate(uint64_t size, uint64_t alignment, UploadAllocation& allocation);
+
+    bool AllocateConstants(uint64_t size, UploadAllocation& allocation)
+    {
+        return Allocate(size, UPLOAD_CONSTANT_ALIGNMENT, allocation);
+    }
+
+private:
+    UploadRing* mRing;
+    uint64_t mFrame;
+    uint64_t mCursor;
+    uint64_t mEnd;
+};
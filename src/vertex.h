@@ -0,0 +1,9 @@
+#pragma once
+#include <DirectXMath.h>
+
+struct Vertex
+{
+    DirectX::XMFLOAT3 position;
+    DirectX::XMFLOAT4 color;
+    DirectX::XMFLOAT3 normal;
+};
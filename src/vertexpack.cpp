@@ -0,0 +1,119 @@
+#include "vertexpack.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+    inline int16_t ToSnorm16(float v)
+    {
+        v = std::min(std::max(v, -1.0f), 1.0f);
+        return (int16_t)std::lround(v * 32767.0f);
+    }
+
+    inline float FromSnorm16(int16_t v)
+    {
+        return std::max((float)v / 32767.0f, -1.0f);
+    }
+
+    inline uint16_t ToUnorm16(float v)
+    {
+        v = std::min(std::max(v, 0.0f), 1.0f);
+        return (uint16_t)std::lround(v * 65535.0f);
+    }
+
+    inline float SignNotZero(float v)
+    {
+        return v >= 0.0f ? 1.0f : -1.0f;
+    }
+}
+
+size_t VertexStride(VertexFormat format)
+{
+    return format == VertexFormat::Packed ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+void EncodeOctahedral(const XMFLOAT3& n, int16_t out[2])
+{
+    float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (l1 == 0.0f)
+    {
+        out[0] = 0;
+        out[1] = 0;
+        return;
+    }
+
+    float x = n.x / l1;
+    float y = n.y / l1;
+
+    // ===== fold the lower hemisphere over the diagonals =====
+    if (n.z < 0.0f)
+    {
+        float fx = (1.0f - std::fabs(y)) * SignNotZero(x);
+        float fy = (1.0f - std::fabs(x)) * SignNotZero(y);
+        x = fx;
+        y = fy;
+    }
+
+    out[0] = ToSnorm16(x);
+    out[1] = ToSnorm16(y);
+}
+
+XMFLOAT3 DecodeOctahedral(const int16_t in[2])
+{
+    float x = FromSnorm16(in[0]);
+    float y = FromSnorm16(in[1]);
+    float z = 1.0f - std::fabs(x) - std::fabs(y);
+
+    float t = std::min(std::max(-z, 0.0f), 1.0f);
+    x += x >= 0.0f ? -t : t;
+    y += y >= 0.0f ? -t : t;
+
+    float len = std::sqrt(x * x + y * y + z * z);
+    return XMFLOAT3(x / len, y / len, z / len);
+}
+
+void PackVertices(
+    const Vertex* src,
+    size_t count,
+    const XMFLOAT3& boundsMin,
+    const XMFLOAT3& boundsMax,
+    PackedVertex* dst)
+{
+    float ex = boundsMax.x - boundsMin.x;
+    float ey = boundsMax.y - boundsMin.y;
+    float ez = boundsMax.z - boundsMin.z;
+
+    float sx = ex > 0.0f ? 1.0f / ex : 0.0f;
+    float sy = ey > 0.0f ? 1.0f / ey : 0.0f;
+    float sz = ez > 0.0f ? 1.0f / ez : 0.0f;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const Vertex& v = src[i];
+        PackedVertex& p = dst[i];
+
+        p.position[0] = ToUnorm16((v.position.x - boundsMin.x) * sx);
+        p.position[1] = ToUnorm16((v.position.y - boundsMin.y) * sy);
+        p.position[2] = ToUnorm16((v.position.z - boundsMin.z) * sz);
+        p.position[3] = 0;
+
+        EncodeOctahedral(v.normal, p.normal);
+    }
+}
+
+Vertex UnpackVertex(
+    const PackedVertex& v,
+    const XMFLOAT3& boundsMin,
+    const XMFLOAT3& boundsMax)
+{
+    Vertex out{};
+    out.position.x = boundsMin.x + (float)v.position[0] / 65535.0f * (boundsMax.x - boundsMin.x);
+    out.position.y = boundsMin.y + (float)v.position[1] / 65535.0f * (boundsMax.y - boundsMin.y);
+    out.position.z = boundsMin.z + (float)v.position[2] / 65535.0f * (boundsMax.z - boundsMin.z);
+    out.color = XMFLOAT4(1, 1, 1, 1);
+    out.normal = DecodeOctahedral(v.normal);
+    return out;
+}
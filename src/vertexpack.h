@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "vertex.h"
+
+enum class VertexFormat
+{
+    // Vertex as is: float3 position, float4 color, float3 normal (40 bytes).
+    Full,
+    // PackedVertex: 16-bit position inside the mesh bounds, octahedral
+    // normal, no color (12 bytes).
+    Packed
+};
+
+struct PackedVertex
+{
+    uint16_t position[4];   // R16G16B16A16_UNORM, w unused
+    int16_t normal[2];      // R16G16_SNORM, octahedral
+};
+
+static_assert(sizeof(PackedVertex) == 12, "PackedVertex must match the input layout");
+
+size_t VertexStride(VertexFormat format);
+
+void EncodeOctahedral(const DirectX::XMFLOAT3& n, int16_t out[2]);
+DirectX::XMFLOAT3 DecodeOctahedral(const int16_t in[2]);
+
+// Positions are stored relative to [boundsMin, boundsMax]; the shader gets
+// the same bounds to decode them.
+void PackVertices(
+    const Vertex* src,
+    size_t count,
+    const DirectX::XMFLOAT3& boundsMin,
+    const DirectX::XMFLOAT3& boundsMax,
+    PackedVertex* dst
+);
+
+// CPU mirror of the shader decode. Color comes back white.
+Vertex UnpackVertex(
+    const PackedVertex& v,
+    const DirectX::XMFLOAT3& boundsMin,
+    const DirectX::XMFLOAT3& boundsMax
+);
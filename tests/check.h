@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdio>
+
+// Minimal checks for the standalone test executables in tests/. A failed
+// CHECK prints its location and the test keeps going; main returns
+// TestResult() so any failure exits with 1.
+
+inline int& TestFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                      \
+    do                                                                        \
+    {                                                                         \
+        if (!(condition))                                                     \
+        {                                                                     \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            TestFailures()++;                                                 \
+        }                                                                     \
+    } while (0)
+
+inline int TestResult(const char* name)
+{
+    if (TestFailures() == 0)
+    {
+        printf("%s: all checks passed\n", name);
+        return 0;
+    }
+
+    printf("%s: %d checks failed\n", name, TestFailures());
+    return 1;
+}
@@ -0,0 +1,496 @@
+// Tests for the batch culling paths: CullSpheres and CullBoxes must return
+// exactly the objects SphereInFrustum and BoxInFrustum accept, in order,
+// on every CullPath and thread count, including objects that touch a
+// plane and counts that leave a partial SIMD tail. Also checks the world
+// space BoxBounds::Add against the transformed corners, that meshlets
+// reproduce their source triangles within the limits and inside their
+// spheres, and that CullMeshlets never drops a front-facing triangle in
+// view, judged per triangle by brute force.
+//
+// Linux build, from the repository root, with DirectXMath on the include
+// path:
+//
+//   g++ -std=c++17 -O1 -g -fsanitize=address,undefined -pthread -Isrc
+//       -o cullingtest tests/cullingtest.cpp src/culling.cpp src/meshlet.cpp
+
+#include "check.h"
+#include "culling.h"
+#include "meshlet.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+    // Above MIN_OBJECTS_PER_THREAD * 3, so threadCount 3 splits the batch,
+    // and neither a multiple of 4 nor of 8.
+    const size_t OBJECT_COUNT = 100003;
+
+    const CullPath PATHS[] = { CullPath::Scalar, CullPath::SSE, CullPath::AVX2, CullPath::Auto };
+    const unsigned THREAD_COUNTS[] = { 1, 3, 0 };
+
+    Frustum MakeFrustum()
+    {
+        XMMATRIX view = XMMatrixLookAtLH(XMVectorSet(0, 2, -5, 1), XMVectorZero(), XMVectorSet(0, 1, 0, 0));
+        XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 100.0f);
+
+        XMFLOAT4X4 viewProj;
+        XMStoreFloat4x4(&viewProj, view * projection);
+        return ExtractFrustum(viewProj);
+    }
+
+    // Signed distance as SphereInFrustum evaluates it.
+    float PlaneDistance(const XMFLOAT4& p, const XMFLOAT3& c)
+    {
+        return p.x * c.x + p.y * c.y + p.z * c.z + p.w;
+    }
+
+    SphereBounds MakeSpheres(const Frustum& frustum, size_t count)
+    {
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<float> position(-60.0f, 60.0f);
+        std::uniform_real_distribution<float> size(0.0f, 4.0f);
+
+        SphereBounds bounds;
+        for (size_t i = 0; i < count; i++)
+        {
+            XMFLOAT3 center(position(rng), position(rng) * 0.5f, position(rng) + 50.0f);
+            float radius = size(rng);
+
+            // Every 7th sphere touches a plane exactly, where < and <=
+            // part ways.
+            if (i % 7 == 0)
+                radius = -PlaneDistance(frustum.planes[i % 6], center);
+            if (i % 101 == 0)
+                radius = 0.0f;
+
+            bounds.Add(center, radius);
+        }
+        return bounds;
+    }
+
+    BoxBounds MakeBoxes(const Frustum& frustum, size_t count)
+    {
+        std::mt19937 rng(2);
+        std::uniform_real_distribution<float> position(-60.0f, 60.0f);
+        std::uniform_real_distribution<float> size(0.0f, 4.0f);
+
+        BoxBounds bounds;
+        for (size_t i = 0; i < count; i++)
+        {
+            XMFLOAT3 center(position(rng), position(rng) * 0.5f, position(rng) + 50.0f);
+            XMFLOAT3 extent(size(rng), size(rng), size(rng));
+
+            // A cube whose support distance equals the plane distance.
+            if (i % 7 == 0)
+            {
+                const XMFLOAT4& p = frustum.planes[i % 6];
+                float e = -PlaneDistance(p, center) / (std::fabs(p.x) + std::fabs(p.y) + std::fabs(p.z));
+                extent = XMFLOAT3(e, e, e);
+            }
+
+            bounds.Add(
+                XMFLOAT3(center.x - extent.x, center.y - extent.y, center.z - extent.z),
+                XMFLOAT3(center.x + extent.x, center.y + extent.y, center.z + extent.z)
+            );
+        }
+        return bounds;
+    }
+
+    std::vector<uint32_t> ReferenceSpheres(const Frustum& frustum, const SphereBounds& bounds)
+    {
+        std::vector<uint32_t> visible;
+        for (size_t i = 0; i < bounds.Size(); i++)
+        {
+            XMFLOAT3 center(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]);
+            if (SphereInFrustum(frustum, center, bounds.radius[i]))
+                visible.push_back((uint32_t)i);
+        }
+        return visible;
+    }
+
+    std::vector<uint32_t> ReferenceBoxes(const Frustum& frustum, const BoxBounds& bounds)
+    {
+        std::vector<uint32_t> visible;
+        for (size_t i = 0; i < bounds.Size(); i++)
+        {
+            XMFLOAT3 center(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]);
+            XMFLOAT3 extent(bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i]);
+            if (BoxInFrustum(frustum, center, extent))
+                visible.push_back((uint32_t)i);
+        }
+        return visible;
+    }
+
+    void TestSpheres()
+    {
+        Frustum frustum = MakeFrustum();
+
+        // Every tail length of the 8 wide path, then the large batch.
+        for (size_t count : { (size_t)0, (size_t)1, (size_t)5, (size_t)8, (size_t)13, OBJECT_COUNT })
+        {
+            SphereBounds bounds = MakeSpheres(frustum, count);
+            std::vector<uint32_t> expected = ReferenceSpheres(frustum, bounds);
+            if (count == OBJECT_COUNT)
+                CHECK(!expected.empty() && expected.size() < count);
+
+            for (CullPath path : PATHS)
+            {
+                for (unsigned threads : THREAD_COUNTS)
+                {
+                    CullOptions options;
+                    options.path = path;
+                    options.threadCount = threads;
+
+                    std::vector<uint32_t> visible(count);
+                    visible.resize(CullSpheres(frustum, bounds, visible.data(), options));
+                    CHECK(visible == expected);
+                }
+            }
+        }
+    }
+
+    void TestBoxes()
+    {
+        Frustum frustum = MakeFrustum();
+
+        for (size_t count : { (size_t)0, (size_t)1, (size_t)5, (size_t)8, (size_t)13, OBJECT_COUNT })
+        {
+            BoxBounds bounds = MakeBoxes(frustum, count);
+            std::vector<uint32_t> expected = ReferenceBoxes(frustum, bounds);
+            if (count == OBJECT_COUNT)
+                CHECK(!expected.empty() && expected.size() < count);
+
+            for (CullPath path : PATHS)
+            {
+                for (unsigned threads : THREAD_COUNTS)
+                {
+                    CullOptions options;
+                    options.path = path;
+                    options.threadCount = threads;
+
+                    std::vector<uint32_t> visible(count);
+                    visible.resize(CullBoxes(frustum, bounds, visible.data(), options));
+                    CHECK(visible == expected);
+                }
+            }
+        }
+    }
+
+    // The world box holds every transformed corner, and is exact when the
+    // matrix only scales and translates.
+    void TestWorldBox()
+    {
+        XMFLOAT3 boundsMin(-1.0f, -2.0f, -0.5f);
+        XMFLOAT3 boundsMax(3.0f, 1.0f, 0.5f);
+
+        XMFLOAT4X4 moved;
+        XMStoreFloat4x4(&moved, XMMatrixScaling(2.0f, 1.0f, 4.0f) * XMMatrixTranslation(10.0f, -3.0f, 7.0f));
+
+        BoxBounds bounds;
+        bounds.Add(boundsMin, boundsMax, moved);
+        CHECK(bounds.Size() == 1);
+        CHECK(bounds.centerX[0] == 12.0f && bounds.centerY[0] == -3.5f && bounds.centerZ[0] == 7.0f);
+        CHECK(bounds.extentX[0] == 4.0f && bounds.extentY[0] == 1.5f && bounds.extentZ[0] == 2.0f);
+
+        std::mt19937 rng(3);
+        std::uniform_real_distribution<float> angle(-XM_PI, XM_PI);
+        for (int t = 0; t < 100; t++)
+        {
+            XMMATRIX matrix =
+                XMMatrixScaling(1.0f + t * 0.01f, 2.0f, 0.5f) *
+                XMMatrixRotationRollPitchYaw(angle(rng), angle(rng), angle(rng)) *
+                XMMatrixTranslation(angle(rng), angle(rng), angle(rng));
+
+            XMFLOAT4X4 world;
+            XMStoreFloat4x4(&world, matrix);
+
+            BoxBounds box;
+            box.Add(boundsMin, boundsMax, world);
+
+            for (int corner = 0; corner < 8; corner++)
+            {
+                XMVECTOR local = XMVectorSet(
+                    corner & 1 ? boundsMax.x : boundsMin.x,
+                    corner & 2 ? boundsMax.y : boundsMin.y,
+                    corner & 4 ? boundsMax.z : boundsMin.z,
+                    1.0f
+                );
+                XMFLOAT3 p;
+                XMStoreFloat3(&p, XMVector3TransformCoord(local, matrix));
+
+                const float slack = 1e-4f;
+                CHECK(std::fabs(p.x - box.centerX[0]) <= box.extentX[0] + slack);
+                CHECK(std::fabs(p.y - box.centerY[0]) <= box.extentY[0] + slack);
+                CHECK(std::fabs(p.z - box.centerZ[0]) <= box.extentZ[0] + slack);
+            }
+        }
+    }
+
+    // A bumpy grid, so the meshlets have cones worth testing.
+    void MakeGrid(int size, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+    {
+        vertices.clear();
+        indices.clear();
+
+        for (int y = 0; y <= size; y++)
+        {
+            for (int x = 0; x <= size; x++)
+            {
+                Vertex v = {};
+                v.position = XMFLOAT3((float)x, std::sin(x * 0.3f) * std::cos(y * 0.2f) * 4.0f, (float)y);
+                v.normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+                vertices.push_back(v);
+            }
+        }
+
+        for (int y = 0; y < size; y++)
+        {
+            for (int x = 0; x < size; x++)
+            {
+                uint32_t i = (uint32_t)(y * (size + 1) + x);
+                indices.insert(indices.end(), { i, i + size + 1, i + 1, i + 1, i + size + 1, i + size + 2 });
+            }
+        }
+    }
+
+    // A closed sphere around (32, 0, 32), clockwise seen from outside. With
+    // shuffle its triangles come in random order, so meshlets scatter.
+    void MakeSphere(int rings, bool shuffle, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+    {
+        vertices.clear();
+        indices.clear();
+
+        const int SEGMENTS = rings * 2;
+        for (int r = 0; r <= rings; r++)
+        {
+            float theta = 3.14159265f * r / rings;
+            for (int s = 0; s <= SEGMENTS; s++)
+            {
+                float phi = 6.2831853f * s / SEGMENTS;
+
+                Vertex v = {};
+                v.normal = XMFLOAT3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+                v.position = XMFLOAT3(32.0f + v.normal.x * 20.0f, v.normal.y * 20.0f, 32.0f + v.normal.z * 20.0f);
+                vertices.push_back(v);
+            }
+        }
+
+        std::vector<uint32_t> triangles;
+        for (int r = 0; r < rings; r++)
+        {
+            for (int s = 0; s < SEGMENTS; s++)
+            {
+                uint32_t i = (uint32_t)(r * (SEGMENTS + 1) + s);
+                uint32_t below = i + SEGMENTS + 1;
+                if (r > 0)
+                    triangles.insert(triangles.end(), { i, i + 1, below });
+                if (r + 1 < rings)
+                    triangles.insert(triangles.end(), { i + 1, below + 1, below });
+            }
+        }
+
+        std::mt19937 rng(3);
+        std::vector<size_t> order(triangles.size() / 3);
+        for (size_t t = 0; t < order.size(); t++)
+            order[t] = t;
+        if (shuffle)
+            std::shuffle(order.begin(), order.end(), rng);
+
+        for (size_t t : order)
+            indices.insert(indices.end(), { triangles[t * 3], triangles[t * 3 + 1], triangles[t * 3 + 2] });
+    }
+
+    // The meshlets cover the source triangles in order, each through its
+    // own vertex and triangle tables, within the limits, and every vertex
+    // of a meshlet lies in its sphere.
+    void CheckMeshletLayout(
+        const MeshletData& data,
+        const std::vector<Vertex>& vertices,
+        const std::vector<uint32_t>& indices,
+        const MeshletOptions& options)
+    {
+        CHECK(data.bounds.Size() == data.meshlets.size());
+
+        uint32_t indexOffset = 0;
+        for (size_t i = 0; i < data.meshlets.size(); i++)
+        {
+            const Meshlet& m = data.meshlets[i];
+
+            CHECK(m.triangleCount > 0 && m.triangleCount <= options.maxTriangles);
+            CHECK(m.vertexCount > 0 && m.vertexCount <= options.maxVertices);
+            CHECK(m.indexOffset == indexOffset);
+            CHECK(m.vertexOffset + m.vertexCount <= data.vertices.size());
+            CHECK((m.triangleOffset + m.triangleCount) * 3 <= data.triangles.size());
+            indexOffset += m.triangleCount * 3;
+
+            const uint32_t* local = data.vertices.data() + m.vertexOffset;
+            for (uint32_t t = 0; t < m.triangleCount * 3; t++)
+            {
+                uint8_t k = data.triangles[m.triangleOffset * 3 + t];
+                CHECK(k < m.vertexCount);
+                CHECK(local[k] == indices[m.indexOffset + t]);
+            }
+
+            // No vertex listed twice.
+            std::vector<uint32_t> sorted(local, local + m.vertexCount);
+            std::sort(sorted.begin(), sorted.end());
+            CHECK(std::adjacent_find(sorted.begin(), sorted.end()) == sorted.end());
+
+            for (uint32_t v = 0; v < m.vertexCount; v++)
+            {
+                const XMFLOAT3& p = vertices[local[v]].position;
+                double dx = (double)p.x - m.center.x;
+                double dy = (double)p.y - m.center.y;
+                double dz = (double)p.z - m.center.z;
+                CHECK(std::sqrt(dx * dx + dy * dy + dz * dz) <= m.radius * (1.0 + 1e-5) + 1e-5);
+            }
+
+            CHECK(data.bounds.centerX[i] == m.center.x && data.bounds.radius[i] == m.radius);
+        }
+
+        CHECK(indexOffset == indices.size());
+    }
+
+    // True when some vertex of the triangle is inside the clip volume of
+    // viewProj, with a little margin so rounding cannot decide it.
+    bool TriangleInView(const XMFLOAT4X4& viewProj, const XMFLOAT3* corners)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            const XMFLOAT3& p = corners[k];
+            double clip[4];
+            for (int c = 0; c < 4; c++)
+                clip[c] = p.x * viewProj.m[0][c] + p.y * viewProj.m[1][c] + p.z * viewProj.m[2][c] + viewProj.m[3][c];
+
+            double w = clip[3] * (1.0 - 1e-4);
+            if (w > 0.0 && std::fabs(clip[0]) < w && std::fabs(clip[1]) < w && clip[2] > clip[3] * 1e-4 && clip[2] < w)
+                return true;
+        }
+        return false;
+    }
+
+    // Clockwise front faces in a left-handed space: the eye is on the side
+    // (b - a) x (c - a) points to, clearly rather than within rounding.
+    bool TriangleFrontFacing(const XMFLOAT3* corners, const XMFLOAT3& eye)
+    {
+        double ux = corners[1].x - corners[0].x, uy = corners[1].y - corners[0].y, uz = corners[1].z - corners[0].z;
+        double vx = corners[2].x - corners[0].x, vy = corners[2].y - corners[0].y, vz = corners[2].z - corners[0].z;
+        double nx = uy * vz - uz * vy, ny = uz * vx - ux * vz, nz = ux * vy - uy * vx;
+
+        double ex = eye.x - corners[0].x, ey = eye.y - corners[0].y, ez = eye.z - corners[0].z;
+        double n = std::sqrt(nx * nx + ny * ny + nz * nz);
+        double e = std::sqrt(ex * ex + ey * ey + ez * ez);
+        return nx * ex + ny * ey + nz * ez > 1e-3 * n * e;
+    }
+
+    // For random cameras, CullMeshlets never drops a triangle that faces
+    // the eye and has a vertex in view, and draws nothing twice.
+    void CheckMeshletCulling(const MeshletData& data, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+    {
+        std::mt19937 rng(4);
+        std::uniform_real_distribution<float> around(-40.0f, 104.0f);
+        std::uniform_real_distribution<float> height(-30.0f, 30.0f);
+        std::uniform_real_distribution<float> target(16.0f, 48.0f);
+
+        size_t triangleCount = indices.size() / 3;
+        std::vector<uint32_t> scratch;
+
+        for (int c = 0; c < 60; c++)
+        {
+            XMFLOAT3 eye(around(rng), height(rng), around(rng));
+            XMVECTOR at = XMVectorSet(target(rng), height(rng) * 0.2f, target(rng), 1.0f);
+
+            XMMATRIX view = XMMatrixLookAtLH(XMLoadFloat3(&eye), at, XMVectorSet(0, 1, 0, 0));
+            XMFLOAT4X4 viewProj;
+            XMStoreFloat4x4(&viewProj, view * XMMatrixPerspectiveFovLH(XM_PIDIV4, 1.0f, 0.1f, 100.0f));
+            Frustum frustum = ExtractFrustum(viewProj);
+
+            std::vector<DrawRange> ranges;
+            CullMeshlets(data, frustum, eye, ranges, scratch);
+
+            std::vector<uint8_t> drawn(triangleCount, 0);
+            for (const DrawRange& range : ranges)
+            {
+                CHECK(range.indexOffset % 3 == 0 && range.indexCount % 3 == 0);
+                CHECK(range.indexOffset + range.indexCount <= indices.size());
+                for (uint32_t t = 0; t < range.indexCount / 3 && range.indexOffset / 3 + t < triangleCount; t++)
+                    drawn[range.indexOffset / 3 + t]++;
+            }
+
+            for (size_t t = 0; t < triangleCount; t++)
+            {
+                CHECK(drawn[t] <= 1);
+
+                XMFLOAT3 corners[3] = {
+                    vertices[indices[t * 3]].position,
+                    vertices[indices[t * 3 + 1]].position,
+                    vertices[indices[t * 3 + 2]].position,
+                };
+                if (!drawn[t])
+                    CHECK(!TriangleInView(viewProj, corners) || !TriangleFrontFacing(corners, eye));
+            }
+        }
+
+        // Conservative still culls: looking away from the mesh draws nothing.
+        XMFLOAT3 eye(32.0f, 0.0f, -60.0f);
+        XMMATRIX view = XMMatrixLookAtLH(XMLoadFloat3(&eye), XMVectorSet(32.0f, 0.0f, -70.0f, 1.0f), XMVectorSet(0, 1, 0, 0));
+        XMFLOAT4X4 viewProj;
+        XMStoreFloat4x4(&viewProj, view * XMMatrixPerspectiveFovLH(XM_PIDIV4, 1.0f, 0.1f, 100.0f));
+
+        std::vector<DrawRange> ranges;
+        CullMeshlets(data, ExtractFrustum(viewProj), eye, ranges, scratch);
+        CHECK(ranges.empty());
+    }
+
+    void TestMeshlets()
+    {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+
+        MeshletOptions limits[4];
+        limits[1].maxVertices = 3;
+        limits[1].maxTriangles = 1;
+        limits[2].maxVertices = 32;
+        limits[2].maxTriangles = 16;
+        limits[3].maxVertices = 256;
+        limits[3].maxTriangles = 512;
+
+        for (int mesh = 0; mesh < 3; mesh++)
+        {
+            if (mesh == 0)
+                MakeGrid(64, vertices, indices);
+            else
+                MakeSphere(32, mesh == 2, vertices, indices);
+
+            for (const MeshletOptions& options : limits)
+            {
+                MeshletData data = BuildMeshlets(vertices.data(), vertices.size(), indices.data(), indices.size(), options);
+                CheckMeshletLayout(data, vertices, indices, options);
+            }
+
+            MeshletData data = BuildMeshlets(vertices.data(), vertices.size(), indices.data(), indices.size(), MeshletOptions());
+            CheckMeshletCulling(data, vertices, indices);
+
+            // Bounds that did not come from BuildMeshlets are rebuilt the same.
+            MeshletData copy;
+            copy.meshlets = data.meshlets;
+            UpdateMeshletBounds(copy);
+            CHECK(copy.bounds.radius == data.bounds.radius && copy.bounds.centerX == data.bounds.centerX);
+        }
+    }
+}
+
+int main()
+{
+    TestSpheres();
+    TestBoxes();
+    TestWorldBox();
+    TestMeshlets();
+
+    return TestResult("cullingtest");
+}
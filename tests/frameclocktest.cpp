@@ -0,0 +1,244 @@
+// Tests for FramePacer and FrameClock on a clock that only moves when the
+// test says so: paced frames land on a fixed grid without drift, the sleep
+// margin grows to cover a coarse timer and shrinks back when it improves,
+// a missed deadline restarts the grid instead of bursting, and the app's
+// loop of Tick, fixed steps and Wait runs exactly one step per frame when
+// the pacer and the simulation share a rate.
+//
+// Linux build, from the repository root:
+//
+//   g++ -std=c++17 -O1 -g -fsanitize=address,undefined -Isrc
+//       -o frameclocktest tests/frameclocktest.cpp src/frameclock.cpp
+
+#include "check.h"
+#include "frameclock.h"
+
+namespace
+{
+    const uint64_t MILLISECOND = 1000000;
+    const uint64_t TARGET = NANOSECONDS_PER_SECOND / 60;
+
+    // Time moves only when told to; SleepFor oversleeps by a set amount to
+    // act like a coarse OS timer.
+    class ManualClock : public Clock
+    {
+    public:
+        ManualClock() : mNow(1000 * MILLISECOND), mOversleep(0), mPauseCost(1000), mSlept(0), mPauses(0) {}
+
+        uint64_t Now() override { return mNow; }
+
+        void SleepFor(uint64_t nanoseconds) override
+        {
+            mNow += nanoseconds + mOversleep;
+            mSlept += nanoseconds + mOversleep;
+        }
+
+        void Pause() override { mNow += mPauseCost; ++mPauses; }
+
+        void Advance(uint64_t nanoseconds) { mNow += nanoseconds; }
+        void SetOversleep(uint64_t nanoseconds) { mOversleep = nanoseconds; }
+
+        uint64_t PauseCost() const { return mPauseCost; }
+        uint64_t SleptTime() const { return mSlept; }
+        uint64_t PauseCount() const { return mPauses; }
+
+    private:
+        uint64_t mNow;
+        uint64_t mOversleep;
+        uint64_t mPauseCost;
+        uint64_t mSlept;
+        uint64_t mPauses;
+    };
+
+    // Frames that take work nanoseconds of CPU each return on the grid
+    // start + k * TARGET, within one pause of it.
+    void TestGrid()
+    {
+        ManualClock clock;
+        FramePacer pacer;
+        pacer.Initialize(&clock, TARGET);
+        uint64_t start = clock.Now();
+
+        for (uint64_t frame = 1; frame <= 1000; frame++)
+        {
+            clock.Advance(5 * MILLISECOND);
+            pacer.Wait();
+
+            uint64_t deadline = start + frame * TARGET;
+            CHECK(clock.Now() >= deadline);
+            CHECK(clock.Now() < deadline + clock.PauseCost());
+        }
+
+        const FramePacerStats& stats = pacer.Stats();
+        CHECK(stats.frames == 1000);
+        CHECK(stats.missed == 0);
+
+        // Nearly all of the idle time is slept; only the margin is spun.
+        CHECK(stats.spinTime <= 1000 * (pacer.SleepMargin() + clock.PauseCost()));
+        CHECK(stats.sleepTime >= 1000 * (TARGET - 5 * MILLISECOND - pacer.SleepMargin() - clock.PauseCost()));
+        CHECK(clock.SleptTime() == stats.sleepTime);
+    }
+
+    // A timer that wakes 2ms late makes the first frame late; the margin
+    // then covers it. Once the timer is exact again the margin decays.
+    void TestOversleep()
+    {
+        ManualClock clock;
+        clock.SetOversleep(2 * MILLISECOND);
+
+        FramePacer pacer;
+        pacer.Initialize(&clock, TARGET);
+        uint64_t start = clock.Now();
+        uint64_t initialMargin = pacer.SleepMargin();
+
+        for (uint64_t frame = 1; frame <= 100; frame++)
+        {
+            clock.Advance(3 * MILLISECOND);
+            pacer.Wait();
+
+            uint64_t deadline = start + frame * TARGET;
+            if (frame == 1)
+            {
+                CHECK(clock.Now() > deadline);
+                continue;
+            }
+
+            CHECK(clock.Now() >= deadline);
+            CHECK(clock.Now() < deadline + clock.PauseCost());
+        }
+
+        CHECK(pacer.SleepMargin() >= 2 * MILLISECOND);
+        CHECK(pacer.Stats().missed == 0);
+
+        clock.SetOversleep(0);
+        uint64_t coarseMargin = pacer.SleepMargin();
+        for (int frame = 0; frame < 200; frame++)
+        {
+            clock.Advance(3 * MILLISECOND);
+            pacer.Wait();
+        }
+
+        CHECK(pacer.SleepMargin() < coarseMargin);
+        CHECK(pacer.SleepMargin() < initialMargin + 100000);
+        CHECK(pacer.Stats().missed == 0);
+    }
+
+    // Frames slower than the target never wait; the frame after them gets
+    // a whole period from where the slow one ended.
+    void TestMiss()
+    {
+        ManualClock clock;
+        FramePacer pacer;
+        pacer.Initialize(&clock, TARGET);
+
+        for (int frame = 0; frame < 5; frame++)
+        {
+            clock.Advance(25 * MILLISECOND);
+            uint64_t before = clock.Now();
+            pacer.Wait();
+            CHECK(clock.Now() == before);
+        }
+        CHECK(pacer.Stats().missed == 5);
+
+        uint64_t restart = clock.Now();
+        clock.Advance(MILLISECOND);
+        pacer.Wait();
+        CHECK(clock.Now() >= restart + TARGET);
+        CHECK(clock.Now() < restart + TARGET + clock.PauseCost());
+        CHECK(pacer.Stats().missed == 5);
+    }
+
+    // A target of 0 leaves pacing to someone else.
+    void TestDisabled()
+    {
+        ManualClock clock;
+        FramePacer pacer;
+        pacer.Initialize(&clock, 0);
+
+        uint64_t before = clock.Now();
+        for (int frame = 0; frame < 10; frame++)
+            pacer.Wait();
+
+        CHECK(clock.Now() == before);
+        CHECK(clock.PauseCount() == 0);
+        CHECK(pacer.Stats().frames == 0);
+    }
+
+    void TestFixedStep()
+    {
+        ManualClock clock;
+        FrameClock frameClock;
+        frameClock.Initialize(&clock, TARGET, NANOSECONDS_PER_SECOND / 4);
+
+        // 5ms frames for a second: every whole step runs, the rest is alpha.
+        uint64_t steps = 0;
+        for (int frame = 0; frame < 200; frame++)
+        {
+            clock.Advance(5 * MILLISECOND);
+            frameClock.Tick();
+            CHECK(frameClock.FrameTime() == 5 * MILLISECOND);
+
+            while (frameClock.StepSimulation())
+                steps++;
+
+            CHECK(frameClock.Alpha() >= 0.0 && frameClock.Alpha() < 1.0);
+        }
+
+        CHECK(steps == 200 * 5 * MILLISECOND / TARGET);
+        CHECK(frameClock.FrameCount() == 200);
+
+        // A 2 second stall catches up a quarter second at most.
+        clock.Advance(2 * NANOSECONDS_PER_SECOND);
+        frameClock.Tick();
+
+        uint64_t catchUp = 0;
+        while (frameClock.StepSimulation())
+            catchUp++;
+        CHECK(catchUp <= NANOSECONDS_PER_SECOND / 4 / TARGET + 1);
+        CHECK(catchUp >= NANOSECONDS_PER_SECOND / 4 / TARGET);
+    }
+
+    // DX12App::Run with the pacer and the simulation at the same rate: no
+    // frame runs two steps or none, whatever each frame costs.
+    void TestPacedLoop()
+    {
+        ManualClock clock;
+        clock.SetOversleep(MILLISECOND);
+
+        FrameClock frameClock;
+        FramePacer pacer;
+        frameClock.Initialize(&clock, TARGET);
+        pacer.Initialize(&clock, TARGET);
+
+        for (int frame = 0; frame < 600; frame++)
+        {
+            frameClock.Tick();
+
+            int steps = 0;
+            while (frameClock.StepSimulation())
+                steps++;
+
+            // The first Tick sees no time pass; the second follows the
+            // one frame that may come back late.
+            if (frame > 2)
+                CHECK(steps == 1);
+
+            clock.Advance((uint64_t)(frame % 7 + 1) * MILLISECOND);
+            pacer.Wait();
+        }
+
+        CHECK(pacer.Stats().missed == 0);
+    }
+}
+
+int main()
+{
+    TestGrid();
+    TestOversleep();
+    TestMiss();
+    TestDisabled();
+    TestFixedStep();
+    TestPacedLoop();
+
+    return TestResult("frameclocktest");
+}
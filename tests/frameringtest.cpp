@@ -0,0 +1,184 @@
+// Tests for FrameRing against a mock queue whose signals complete only
+// when the test retires them: with N frames in flight the first N frames
+// never block, frame N + 1 waits for exactly the fence of the slot it
+// reuses, frames the GPU already retired never block, and Flush waits
+// for the last signal.
+//
+// Linux build, from the repository root:
+//
+//   g++ -std=c++17 -O1 -g -fsanitize=address,undefined -Isrc
+//       -o frameringtest tests/frameringtest.cpp src/framering.cpp
+
+#include "check.h"
+#include "framering.h"
+
+#include <deque>
+#include <vector>
+
+namespace
+{
+    // Stand-in for a GPU queue: signals complete in order, only when
+    // Retire() is called or a Wait() forces them.
+    class MockFrameQueue : public FrameQueue
+    {
+    public:
+        explicit MockFrameQueue(uint64_t completed = 0) : mCompleted(completed), mLastSignal(completed) {}
+
+        void Signal(uint64_t value) override
+        {
+            // Fence values only go up.
+            CHECK(value > mLastSignal);
+            mLastSignal = value;
+            mPending.push_back(value);
+        }
+
+        uint64_t CompletedValue() override { return mCompleted; }
+
+        void Wait(uint64_t value) override
+        {
+            mWaits.push_back(value);
+
+            // Waiting on a value never signaled would hang a real queue.
+            CHECK(value <= mLastSignal);
+            while (mCompleted < value && !mPending.empty())
+                Retire();
+        }
+
+        // Completes the oldest count pending signals, as if the GPU
+        // finished them.
+        void Retire(size_t count = 1)
+        {
+            for (; count > 0 && !mPending.empty(); --count)
+            {
+                mCompleted = mPending.front();
+                mPending.pop_front();
+            }
+        }
+
+        size_t PendingCount() const { return mPending.size(); }
+        const std::vector<uint64_t>& Waits() const { return mWaits; }
+
+    private:
+        std::deque<uint64_t> mPending;
+        std::vector<uint64_t> mWaits;
+        uint64_t mCompleted;
+        uint64_t mLastSignal;
+    };
+
+    // The GPU never catches up on its own: every frame past the first N
+    // waits for the frame N before it.
+    void TestGpuBound()
+    {
+        const uint32_t FRAMES = 3;
+
+        MockFrameQueue queue;
+        FrameRing ring;
+        ring.Initialize(&queue, FRAMES);
+        CHECK(ring.FrameCount() == FRAMES);
+
+        for (uint32_t frame = 0; frame < 10; frame++)
+        {
+            CHECK(ring.CurrentFenceValue() == frame + 1);
+            CHECK(ring.BeginFrame() == frame % FRAMES);
+            CHECK(ring.FrameIndex() == frame % FRAMES);
+            ring.EndFrame();
+            CHECK(ring.FrameNumber() == frame + 1);
+
+            // Never more than FRAMES frames queued on the GPU.
+            CHECK(queue.PendingCount() <= FRAMES);
+        }
+
+        CHECK(ring.StallCount() == 10 - FRAMES);
+        CHECK(queue.Waits().size() == 10 - FRAMES);
+        for (size_t i = 0; i < queue.Waits().size(); i++)
+            CHECK(queue.Waits()[i] == i + 1);
+
+        ring.Flush();
+        CHECK(queue.CompletedValue() == 10);
+        CHECK(queue.PendingCount() == 0);
+        CHECK(queue.Waits().size() == 10 - FRAMES + 1);
+
+        // Nothing left to wait for.
+        ring.Flush();
+        CHECK(queue.Waits().size() == 10 - FRAMES + 1);
+    }
+
+    // A GPU that keeps up, retiring each frame one frame late, never
+    // stalls the CPU.
+    void TestCpuBound()
+    {
+        MockFrameQueue queue;
+        FrameRing ring;
+        ring.Initialize(&queue, 2);
+
+        for (int frame = 0; frame < 100; frame++)
+        {
+            ring.BeginFrame();
+            ring.EndFrame();
+            queue.Retire();
+            CHECK(ring.CompletedFenceValue() == (uint64_t)frame + 1);
+        }
+
+        CHECK(ring.StallCount() == 0);
+        CHECK(queue.Waits().empty());
+    }
+
+    // A GPU one frame behind: with one frame in flight every frame after
+    // the first stalls, with two none do.
+    void TestLatency()
+    {
+        for (uint32_t frames : { 1u, 2u })
+        {
+            MockFrameQueue queue;
+            FrameRing ring;
+            ring.Initialize(&queue, frames);
+
+            for (int frame = 0; frame < 20; frame++)
+            {
+                if (queue.PendingCount() > 1)
+                    queue.Retire();
+                ring.BeginFrame();
+                ring.EndFrame();
+            }
+
+            CHECK(ring.StallCount() == (frames == 1 ? 19u : 0u));
+        }
+    }
+
+    // Fences continue from whatever the queue completed before, and a
+    // frame count of 0 still gives one slot.
+    void TestInitialize()
+    {
+        MockFrameQueue queue(41);
+        FrameRing ring;
+        ring.Initialize(&queue, 0);
+        CHECK(ring.FrameCount() == 1);
+        CHECK(ring.CurrentFenceValue() == 42);
+
+        ring.BeginFrame();
+        ring.EndFrame();
+        CHECK(ring.StallCount() == 0);
+
+        ring.BeginFrame();
+        ring.EndFrame();
+        CHECK(ring.StallCount() == 1);
+        CHECK(queue.Waits().size() == 1 && queue.Waits()[0] == 42);
+
+        ring.Flush();
+        CHECK(queue.CompletedValue() == 43);
+
+        // Flush before Initialize does nothing.
+        FrameRing empty;
+        empty.Flush();
+    }
+}
+
+int main()
+{
+    TestGpuBound();
+    TestCpuBound();
+    TestLatency();
+    TestInitialize();
+
+    return TestResult("frameringtest");
+}
@@ -0,0 +1,263 @@
+// Tests for the job system: every spawned job runs exactly once, waits
+// return only after their jobs, ParallelFor covers its range once, and
+// SpawnAfter runs after its dependency without holding a worker; one
+// worker used to deadlock when SpawnAfter waited inside a job. Best run
+// with sanitizers, thread and address both.
+//
+// Linux build, from the repository root:
+//
+//   g++ -std=c++17 -O1 -g -fsanitize=thread -pthread -Isrc -o jobstest
+//       tests/jobstest.cpp src/jobs.cpp
+
+#include "check.h"
+#include "jobs.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    void TestSpawnWait(JobSystem& jobs)
+    {
+        std::atomic<uint32_t> runs(0);
+        std::atomic<uint32_t>* pruns = &runs;
+
+        JobCounter counter;
+        CHECK(counter.Done());
+
+        for (int i = 0; i < 10000; i++)
+            jobs.Spawn(counter, [pruns]() { pruns->fetch_add(1, std::memory_order_relaxed); });
+
+        jobs.Wait(counter);
+        CHECK(counter.Done());
+        CHECK(runs.load() == 10000);
+    }
+
+    // Jobs that spawn and wait on their own counters.
+    void TestNested(JobSystem& jobs)
+    {
+        std::atomic<uint32_t> runs(0);
+        struct Context { JobSystem* jobs; std::atomic<uint32_t>* runs; };
+        Context context = { &jobs, &runs };
+        Context* pcontext = &context;
+
+        JobCounter counter;
+        for (int i = 0; i < 64; i++)
+        {
+            jobs.Spawn(counter, [pcontext]()
+            {
+                JobCounter inner;
+                for (int k = 0; k < 64; k++)
+                {
+                    std::atomic<uint32_t>* runs = pcontext->runs;
+                    pcontext->jobs->Spawn(inner, [runs]() { runs->fetch_add(1, std::memory_order_relaxed); });
+                }
+                pcontext->jobs->Wait(inner);
+            });
+        }
+
+        jobs.Wait(counter);
+        CHECK(runs.load() == 64 * 64);
+    }
+
+    void TestParallelFor(JobSystem& jobs)
+    {
+        const size_t counts[] = { 0, 1, 7, 1000, 100003 };
+        for (size_t count : counts)
+        {
+            std::vector<std::atomic<uint8_t>> hits(count);
+            for (std::atomic<uint8_t>& hit : hits)
+                hit.store(0);
+
+            std::atomic<uint8_t>* phits = hits.data();
+            jobs.ParallelFor(count, 64, [phits](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                    phits[i].fetch_add(1, std::memory_order_relaxed);
+            });
+
+            bool once = true;
+            for (std::atomic<uint8_t>& hit : hits)
+                once = once && hit.load() == 1;
+            CHECK(once);
+        }
+    }
+
+    // Every continuation sees all of its dependency's jobs finished.
+    void TestSpawnAfter(JobSystem& jobs)
+    {
+        for (int round = 0; round < 200; round++)
+        {
+            std::atomic<uint32_t> first(0);
+            std::atomic<uint32_t> early(0);
+            std::atomic<uint32_t> after(0);
+            std::atomic<uint32_t>* pfirst = &first;
+            std::atomic<uint32_t>* pearly = &early;
+            std::atomic<uint32_t>* pafter = &after;
+
+            JobCounter dependency;
+            JobCounter counter;
+
+            for (int i = 0; i < 32; i++)
+                jobs.Spawn(dependency, [pfirst]() { pfirst->fetch_add(1, std::memory_order_relaxed); });
+
+            for (int i = 0; i < 8; i++)
+            {
+                jobs.SpawnAfter(dependency, counter, [pfirst, pearly, pafter]()
+                {
+                    if (pfirst->load(std::memory_order_relaxed) != 32)
+                        pearly->fetch_add(1, std::memory_order_relaxed);
+                    pafter->fetch_add(1, std::memory_order_relaxed);
+                });
+            }
+
+            jobs.Wait(counter);
+            CHECK(after.load() == 8);
+            CHECK(early.load() == 0);
+            CHECK(dependency.Done());
+        }
+    }
+
+    void TestSpawnAfterDone(JobSystem& jobs)
+    {
+        std::atomic<uint32_t> runs(0);
+        std::atomic<uint32_t>* pruns = &runs;
+
+        JobCounter dependency;
+        JobCounter counter;
+        jobs.SpawnAfter(dependency, counter, [pruns]() { pruns->fetch_add(1); });
+
+        jobs.Wait(counter);
+        CHECK(runs.load() == 1);
+    }
+
+    // a -> b -> c -> ... each link a counter of its own, spawned up front.
+    void TestChain(JobSystem& jobs)
+    {
+        const int LINKS = 256;
+        std::vector<JobCounter> counters(LINKS + 1);
+        std::atomic<int> order(0);
+        std::atomic<int> misordered(0);
+
+        struct Context { std::atomic<int>* order; std::atomic<int>* misordered; };
+        Context context = { &order, &misordered };
+        Context* pcontext = &context;
+
+        jobs.Spawn(counters[0], [pcontext]() { pcontext->order->fetch_add(1); });
+
+        for (int i = 1; i <= LINKS; i++)
+        {
+            jobs.SpawnAfter(counters[i - 1], counters[i], [pcontext, i]()
+            {
+                if (pcontext->order->fetch_add(1) != i)
+                    pcontext->misordered->fetch_add(1);
+            });
+        }
+
+        jobs.Wait(counters[LINKS]);
+        CHECK(order.load() == LINKS + 1);
+        CHECK(misordered.load() == 0);
+        for (JobCounter& counter : counters)
+            CHECK(counter.Done());
+    }
+
+    // One worker, so jobs pop in reverse spawn order: c1, then c2 inside
+    // it, then d and k. A continuation that waited inside its job left c2
+    // waiting on K1 above c1, which counts towards K1, and never returned.
+    void TestSingleWorker()
+    {
+        JobSystem jobs;
+        jobs.Initialize(1);
+
+        for (int round = 0; round < 100; round++)
+        {
+            std::atomic<int> order(0);
+            std::atomic<int> misordered(0);
+            struct Context { std::atomic<int>* order; std::atomic<int>* misordered; };
+            Context context = { &order, &misordered };
+            Context* pcontext = &context;
+
+            JobCounter k1;
+            JobCounter d;
+            JobCounter k2;
+
+            jobs.Spawn(k1, [pcontext]() { pcontext->order->fetch_add(1); });
+            jobs.Spawn(d, [pcontext]() { pcontext->order->fetch_add(1); });
+            jobs.SpawnAfter(k1, k2, [pcontext]()
+            {
+                if (pcontext->order->fetch_add(1) != 3)
+                    pcontext->misordered->fetch_add(1);
+            });
+            jobs.SpawnAfter(d, k1, [pcontext]() { pcontext->order->fetch_add(1); });
+
+            jobs.Wait(k2);
+            CHECK(order.load() == 4);
+            CHECK(misordered.load() == 0);
+        }
+
+        // A long chain runs one link after another, not one wait deeper each.
+        const int LINKS = 100000;
+        std::vector<JobCounter> counters(LINKS + 1);
+        std::atomic<int> runs(0);
+        std::atomic<int>* pruns = &runs;
+
+        jobs.Spawn(counters[0], [pruns]() { pruns->fetch_add(1); });
+        for (int i = 1; i <= LINKS; i++)
+            jobs.SpawnAfter(counters[i - 1], counters[i], [pruns]() { pruns->fetch_add(1); });
+
+        jobs.Wait(counters[LINKS]);
+        CHECK(runs.load() == LINKS + 1);
+    }
+
+    // Threads that are not workers spawn, chain and wait too.
+    void TestExternal(JobSystem& jobs)
+    {
+        std::atomic<uint32_t> runs(0);
+        std::atomic<uint32_t>* pruns = &runs;
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 3; t++)
+        {
+            threads.emplace_back([&jobs, pruns]()
+            {
+                for (int round = 0; round < 50; round++)
+                {
+                    JobCounter dependency;
+                    JobCounter counter;
+                    for (int i = 0; i < 16; i++)
+                        jobs.Spawn(dependency, [pruns]() { pruns->fetch_add(1, std::memory_order_relaxed); });
+                    jobs.SpawnAfter(dependency, counter, [pruns]() { pruns->fetch_add(1, std::memory_order_relaxed); });
+                    jobs.Wait(counter);
+                }
+            });
+        }
+
+        for (std::thread& thread : threads)
+            thread.join();
+
+        CHECK(runs.load() == 3 * 50 * 17);
+    }
+}
+
+int main()
+{
+    JobSystem jobs;
+    jobs.Initialize(4);
+
+    TestSpawnWait(jobs);
+    TestNested(jobs);
+    TestParallelFor(jobs);
+    TestSpawnAfter(jobs);
+    TestSpawnAfterDone(jobs);
+    TestChain(jobs);
+    TestExternal(jobs);
+
+    JobStats stats = jobs.Stats();
+    CHECK(stats.executed > 0);
+
+    jobs.Shutdown();
+    TestSingleWorker();
+
+    return TestResult("jobstest");
+}
@@ -0,0 +1,380 @@
+// Tests for the .mesh cache: a cache written the way BuildObj writes one
+// must open warm with the same key and give back the vertices, indices,
+// subsets, LODs, meshlets and bounds byte for byte. Every change that can
+// make it stale must make Open fail: new source contents, any OBJ load,
+// optimizer or LOD option that changes the geometry, a file from another
+// MESH_VERSION, a truncated or extended file, and corrupted section
+// offsets, counts or ranges. The key hashes the source contents, so a
+// source touched without changing its bytes keeps its cache.
+//
+// Linux build, from the repository root, with DirectXMath on the include
+// path:
+//
+//   g++ -std=c++17 -O1 -g -fsanitize=address,undefined -pthread -Isrc
+//       -o meshcachetest tests/meshcachetest.cpp src/meshcache.cpp
+//       src/meshstream.cpp src/parcer.cpp src/meshopt.cpp src/simplify.cpp
+//       src/meshlet.cpp src/culling.cpp src/vertexpack.cpp src/bvh.cpp
+//       src/jobs.cpp src/hash.cpp src/mappedfile.cpp src/profiler.cpp
+
+#include "check.h"
+#include "meshcache.h"
+#include "meshstream.h"
+#include "meshopt.h"
+#include "parcer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // Byte offsets into MeshFileHeader in meshcache.cpp.
+    constexpr size_t HEADER_VERSION = 4;
+    constexpr size_t HEADER_VERTICES = 56;
+    constexpr size_t HEADER_INDICES = 72;
+    constexpr size_t HEADER_SUBSETS = 88;
+    constexpr size_t HEADER_LODS = 104;
+    constexpr size_t HEADER_FILE_SIZE = 136;
+
+    std::string TempPath(const char* name)
+    {
+        return (std::filesystem::temp_directory_path() / name).string();
+    }
+
+    std::vector<char> ReadFile(const std::string& path)
+    {
+        std::vector<char> bytes((size_t)std::filesystem::file_size(path));
+        FILE* f = fopen(path.c_str(), "rb");
+        if (!bytes.empty())
+            fread(bytes.data(), 1, bytes.size(), f);
+        fclose(f);
+        return bytes;
+    }
+
+    void WriteFile(const std::string& path, const std::vector<char>& bytes)
+    {
+        FILE* f = fopen(path.c_str(), "wb");
+        if (!bytes.empty())
+            fwrite(bytes.data(), 1, bytes.size(), f);
+        fclose(f);
+    }
+
+    template <typename T>
+    T Read(const std::vector<char>& bytes, size_t offset)
+    {
+        T value;
+        memcpy(&value, bytes.data() + offset, sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    void Write(std::vector<char>& bytes, size_t offset, T value)
+    {
+        memcpy(bytes.data() + offset, &value, sizeof(T));
+    }
+
+    // A UV sphere with one normal per vertex.
+    void WriteSphereObj(const std::string& path, int rings, int segments)
+    {
+        FILE* f = fopen(path.c_str(), "wb");
+        for (int r = 0; r <= rings; r++)
+        {
+            for (int s = 0; s < segments; s++)
+            {
+                float theta = 3.14159265f * r / rings;
+                float phi = 6.2831853f * s / segments;
+                float x = std::sin(theta) * std::cos(phi);
+                float y = std::cos(theta);
+                float z = std::sin(theta) * std::sin(phi);
+                fprintf(f, "v %f %f %f\nvn %f %f %f\n", x, y, z, x, y, z);
+            }
+        }
+
+        for (int r = 0; r < rings; r++)
+        {
+            for (int s = 0; s < segments; s++)
+            {
+                int a = r * segments + s + 1;
+                int b = r * segments + (s + 1) % segments + 1;
+                int c = a + segments;
+                int d = b + segments;
+                fprintf(f, "f %d//%d %d//%d %d//%d\n", a, a, b, b, c, c);
+                fprintf(f, "f %d//%d %d//%d %d//%d\n", b, b, d, d, c, c);
+            }
+        }
+        fclose(f);
+    }
+
+    // BuildObj's cold start, with subsets small enough that there are
+    // several.
+    MeshData BuildMesh(
+        const std::string& source,
+        const OBJLoadOptions& loadOptions,
+        const MeshOptimizeOptions& optimizeOptions,
+        const LodChainOptions& lodOptions)
+    {
+        MeshData mesh;
+        OBJLoadStats stats;
+        CHECK(LoadOBJ(source, mesh.vertices, mesh.indices, loadOptions, &stats));
+
+        OptimizeMesh(mesh.vertices, mesh.indices, optimizeOptions);
+        mesh.lods = BuildLodChain(mesh.vertices.data(), mesh.vertices.size(), mesh.indices, lodOptions);
+        mesh.boundsMin = stats.boundsMin;
+        mesh.boundsMax = stats.boundsMax;
+
+        mesh.meshlets = BuildMeshlets(
+            mesh.vertices.data(), mesh.vertices.size(),
+            mesh.indices.data() + mesh.lods[0].indexOffset, mesh.lods[0].indexCount,
+            MeshletOptions()
+        ).meshlets;
+
+        SubmeshLimits limits;
+        limits.maxIndexBytes = 3000 * sizeof(uint32_t);
+        CHECK(SplitSubmeshes(mesh.indices.data(), mesh.indices.size(), limits, mesh.subsets));
+        return mesh;
+    }
+
+    template <typename T>
+    bool SameBytes(const T* data, size_t count, const std::vector<T>& expected)
+    {
+        return count == expected.size() && (count == 0 || memcmp(data, expected.data(), count * sizeof(T)) == 0);
+    }
+
+    bool Opens(const std::string& path, const MeshCacheKey& key)
+    {
+        MeshCacheFile cache;
+        return cache.Open(path, key);
+    }
+
+    void TestRoundTrip(const std::string& source, const std::string& cachePath)
+    {
+        OBJLoadOptions loadOptions;
+        MeshOptimizeOptions optimizeOptions;
+        LodChainOptions lodOptions;
+
+        MeshCacheKey key;
+        CHECK(ComputeMeshCacheKey(source, loadOptions, optimizeOptions, lodOptions, key));
+
+        MeshData mesh = BuildMesh(source, loadOptions, optimizeOptions, lodOptions);
+        CHECK(mesh.subsets.size() > 1);
+        CHECK(mesh.lods.size() > 1);
+        CHECK(!mesh.meshlets.empty());
+
+        CHECK(!Opens(cachePath, key));
+        CHECK(WriteMeshCache(cachePath, key, mesh));
+
+        MeshCacheFile cache;
+        CHECK(cache.Open(cachePath, key));
+        CHECK(SameBytes(cache.Vertices(), cache.VertexCount(), mesh.vertices));
+        CHECK(SameBytes(cache.Indices(), cache.IndexCount(), mesh.indices));
+        CHECK(SameBytes(cache.Subsets(), cache.SubsetCount(), mesh.subsets));
+        CHECK(SameBytes(cache.Lods(), cache.LodCount(), mesh.lods));
+        CHECK(SameBytes(cache.Meshlets(), cache.MeshletCount(), mesh.meshlets));
+        DirectX::XMFLOAT3 boundsMin = cache.BoundsMin();
+        DirectX::XMFLOAT3 boundsMax = cache.BoundsMax();
+        CHECK(memcmp(&boundsMin, &mesh.boundsMin, sizeof(boundsMin)) == 0);
+        CHECK(memcmp(&boundsMax, &mesh.boundsMax, sizeof(boundsMax)) == 0);
+
+        // Every section starts on a page.
+        CHECK(((uintptr_t)cache.Vertices() - (uintptr_t)cache.File().Data()) % 4096 == 0);
+        CHECK(((uintptr_t)cache.Indices() - (uintptr_t)cache.File().Data()) % 4096 == 0);
+        CHECK(((uintptr_t)cache.Lods() - (uintptr_t)cache.File().Data()) % 4096 == 0);
+    }
+
+    void TestOptions(const std::string& source, const std::string& cachePath)
+    {
+        MeshCacheKey key;
+        CHECK(ComputeMeshCacheKey(source, OBJLoadOptions(), MeshOptimizeOptions(), LodChainOptions(), key));
+
+        struct Options
+        {
+            OBJLoadOptions load;
+            MeshOptimizeOptions optimize;
+            LodChainOptions lod;
+        };
+
+        const std::function<void(Options&)> changes[] = {
+            [](Options& o) { o.load.weld = OBJWeldMode::None; },
+            [](Options& o) { o.load.weld = OBJWeldMode::Position; },
+            [](Options& o) { o.load.weld = OBJWeldMode::Position; o.load.weldEpsilon = 1e-3f; },
+            [](Options& o) { o.optimize.vertexCache = false; },
+            [](Options& o) { o.optimize.overdraw = false; },
+            [](Options& o) { o.optimize.vertexFetch = false; },
+            [](Options& o) { o.optimize.cacheSize = 32; },
+            [](Options& o) { o.optimize.overdrawThreshold = 1.1f; },
+            [](Options& o) { o.lod.ratios.pop_back(); },
+            [](Options& o) { o.lod.ratios[1] = 0.3f; },
+            [](Options& o) { o.lod.simplify.normalWeight = 1.0f; },
+            [](Options& o) { o.lod.simplify.lockBorders = false; },
+            [](Options& o) { o.lod.simplify.maxError = 0.01f; },
+            [](Options& o) { o.lod.cacheSize = 32; },
+        };
+
+        std::vector<uint64_t> hashes(1, key.optionsHash);
+        for (const std::function<void(Options&)>& change : changes)
+        {
+            Options options;
+            change(options);
+
+            MeshCacheKey changed;
+            CHECK(ComputeMeshCacheKey(source, options.load, options.optimize, options.lod, changed));
+            CHECK(changed.sourceHash == key.sourceHash);
+            CHECK(!Opens(cachePath, changed));
+
+            // Every option lands in the hash on its own.
+            CHECK(std::find(hashes.begin(), hashes.end(), changed.optionsHash) == hashes.end());
+            hashes.push_back(changed.optionsHash);
+        }
+
+        // The thread count never changes the geometry.
+        OBJLoadOptions threads;
+        threads.threadCount = 7;
+        MeshCacheKey same;
+        CHECK(ComputeMeshCacheKey(source, threads, MeshOptimizeOptions(), LodChainOptions(), same));
+        CHECK(same.sourceHash == key.sourceHash && same.optionsHash == key.optionsHash);
+        CHECK(Opens(cachePath, same));
+    }
+
+    void TestSource(const std::string& source, const std::string& cachePath)
+    {
+        MeshCacheKey key;
+        CHECK(ComputeMeshCacheKey(source, OBJLoadOptions(), MeshOptimizeOptions(), LodChainOptions(), key));
+        CHECK(Opens(cachePath, key));
+
+        std::vector<char> original = ReadFile(source);
+        std::filesystem::file_time_type time = std::filesystem::last_write_time(source);
+
+        // Touched: rewritten with the same bytes and a new time.
+        WriteFile(source, original);
+        std::filesystem::last_write_time(source, time + std::chrono::hours(1));
+        MeshCacheKey touched;
+        CHECK(ComputeMeshCacheKey(source, OBJLoadOptions(), MeshOptimizeOptions(), LodChainOptions(), touched));
+        CHECK(touched.sourceHash == key.sourceHash && touched.optionsHash == key.optionsHash);
+        CHECK(Opens(cachePath, touched));
+
+        // One digit changed, same size and time.
+        std::vector<char> modified = original;
+        size_t digit = modified.size() / 2;
+        while (modified[digit] < '0' || modified[digit] > '8')
+            digit++;
+        modified[digit]++;
+
+        WriteFile(source, modified);
+        std::filesystem::last_write_time(source, time);
+        MeshCacheKey changed;
+        CHECK(ComputeMeshCacheKey(source, OBJLoadOptions(), MeshOptimizeOptions(), LodChainOptions(), changed));
+        CHECK(changed.sourceHash != key.sourceHash && changed.optionsHash == key.optionsHash);
+        CHECK(!Opens(cachePath, changed));
+
+        // A line added at the end.
+        std::vector<char> appended = original;
+        const char comment[] = "# edited\n";
+        appended.insert(appended.end(), comment, comment + sizeof(comment) - 1);
+        WriteFile(source, appended);
+        CHECK(ComputeMeshCacheKey(source, OBJLoadOptions(), MeshOptimizeOptions(), LodChainOptions(), changed));
+        CHECK(changed.sourceHash != key.sourceHash);
+        CHECK(!Opens(cachePath, changed));
+
+        WriteFile(source, original);
+        CHECK(ComputeMeshCacheKey(source, OBJLoadOptions(), MeshOptimizeOptions(), LodChainOptions(), changed));
+        CHECK(changed.sourceHash == key.sourceHash);
+        CHECK(Opens(cachePath, changed));
+
+        // No source, no key.
+        CHECK(!ComputeMeshCacheKey(source + ".missing", OBJLoadOptions(), MeshOptimizeOptions(), LodChainOptions(), changed));
+    }
+
+    void TestDamagedFile(const std::string& source, const std::string& cachePath)
+    {
+        MeshCacheKey key;
+        CHECK(ComputeMeshCacheKey(source, OBJLoadOptions(), MeshOptimizeOptions(), LodChainOptions(), key));
+
+        const std::vector<char> good = ReadFile(cachePath);
+        const uint64_t fileSize = good.size();
+        CHECK(Read<uint64_t>(good, HEADER_FILE_SIZE) == fileSize);
+        CHECK(Read<uint64_t>(good, HEADER_VERTICES) == 4096);
+
+        const uint64_t subsetOffset = Read<uint64_t>(good, HEADER_SUBSETS);
+        const uint64_t lodOffset = Read<uint64_t>(good, HEADER_LODS);
+        const uint64_t vertexCount = Read<uint64_t>(good, HEADER_VERTICES + 8);
+        const uint64_t indexCount = Read<uint64_t>(good, HEADER_INDICES + 8);
+
+        auto rejected = [&](const std::function<void(std::vector<char>&)>& damage)
+        {
+            std::vector<char> bytes = good;
+            damage(bytes);
+            WriteFile(cachePath, bytes);
+            return !Opens(cachePath, key);
+        };
+
+        CHECK(!rejected([](std::vector<char>&) {}));
+
+        // ===== another MESH_VERSION =====
+        uint32_t version = Read<uint32_t>(good, HEADER_VERSION);
+        CHECK(rejected([&](std::vector<char>& b) { Write<uint32_t>(b, HEADER_VERSION, version + 1); }));
+        CHECK(rejected([&](std::vector<char>& b) { Write<uint32_t>(b, HEADER_VERSION, version - 1); }));
+        CHECK(rejected([](std::vector<char>& b) { b[0] = 'X'; }));
+
+        // ===== truncated or extended =====
+        for (uint64_t size : { (uint64_t)0, (uint64_t)100, (uint64_t)4096, fileSize / 2, fileSize - 4096, fileSize - 1 })
+            CHECK(rejected([&](std::vector<char>& b) { b.resize((size_t)size); }));
+        CHECK(rejected([](std::vector<char>& b) { b.push_back(0); }));
+        CHECK(rejected([&](std::vector<char>& b)
+        {
+            b.resize(b.size() + 4096);
+            Write<uint64_t>(b, HEADER_FILE_SIZE, fileSize + 4096);
+            Write<uint64_t>(b, HEADER_LODS + 8, (fileSize + 4096 - lodOffset) / sizeof(MeshLod) + 1);
+        }));
+
+        // ===== section offsets and counts =====
+        CHECK(rejected([](std::vector<char>& b) { Write<uint64_t>(b, HEADER_VERTICES, 4096 + 16); }));
+        CHECK(rejected([&](std::vector<char>& b) { Write<uint64_t>(b, HEADER_INDICES, fileSize + 4096); }));
+        CHECK(rejected([&](std::vector<char>& b) { Write<uint64_t>(b, HEADER_INDICES, fileSize - 4096); }));
+        CHECK(rejected([&](std::vector<char>& b) { Write<uint64_t>(b, HEADER_LODS, fileSize); }));
+        CHECK(rejected([&](std::vector<char>& b) { Write<uint64_t>(b, HEADER_SUBSETS, subsetOffset + 4); }));
+        CHECK(rejected([&](std::vector<char>& b) { Write<uint64_t>(b, HEADER_VERTICES + 8, vertexCount * 1000); }));
+        CHECK(rejected([](std::vector<char>& b) { Write<uint64_t>(b, HEADER_LODS + 8, 0); }));
+
+        // ===== ranges inside the sections =====
+        CHECK(rejected([&](std::vector<char>& b)
+        {
+            MeshLod lod = Read<MeshLod>(b, (size_t)lodOffset);
+            lod.indexCount = (uint32_t)indexCount + 3;
+            Write(b, (size_t)lodOffset, lod);
+        }));
+        CHECK(rejected([&](std::vector<char>& b)
+        {
+            MeshSubset subset = Read<MeshSubset>(b, (size_t)subsetOffset);
+            subset.vertexOffset = (uint32_t)vertexCount;
+            Write(b, (size_t)subsetOffset, subset);
+        }));
+
+        WriteFile(cachePath, good);
+        CHECK(Opens(cachePath, key));
+    }
+}
+
+int main()
+{
+    std::string source = TempPath("meshcachetest.obj");
+    std::string cachePath = MeshCachePath(source);
+    std::filesystem::remove(cachePath);
+
+    WriteSphereObj(source, 40, 80);
+
+    TestRoundTrip(source, cachePath);
+    TestOptions(source, cachePath);
+    TestSource(source, cachePath);
+    TestDamagedFile(source, cachePath);
+
+    std::filesystem::remove(source);
+    std::filesystem::remove(cachePath);
+
+    return TestResult("meshcachetest");
+}
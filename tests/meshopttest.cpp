@@ -0,0 +1,355 @@
+// Tests for the OBJ parser and the mesh optimizer on malformed input: a
+// face with an out-of-range corner must be dropped whole, and index
+// buffers that end in a partial triangle must go through every pass
+// without reading or writing past the arrays. Welding must share exactly
+// the corners with the same position and normal records (or positions
+// within the epsilon), whatever their texcoords, number vertices in order
+// of first use for every thread count, and report it in OBJLoadStats. A
+// file large enough to be parsed in chunks, with negative indices and
+// faces on records of earlier chunks, must load to the same bytes as its
+// absolute form for every thread count. Best run with sanitizers.
+//
+// Linux build, from the repository root, with DirectXMath on the include
+// path:
+//
+//   g++ -std=c++17 -O1 -g -fsanitize=address,undefined -pthread -Isrc
+//       -o meshopttest tests/meshopttest.cpp src/parcer.cpp src/meshopt.cpp
+//       src/mappedfile.cpp src/profiler.cpp
+
+#include "check.h"
+#include "parcer.h"
+#include "meshopt.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace
+{
+    std::string WriteTempObj(const char* name, const char* text)
+    {
+        std::string path = (std::filesystem::temp_directory_path() / name).string();
+        FILE* f = fopen(path.c_str(), "wb");
+        fputs(text, f);
+        fclose(f);
+        return path;
+    }
+
+    // Triangles as sorted corner triples, independent of order and rotation.
+    std::vector<std::vector<uint32_t>> TriangleSet(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+    {
+        std::vector<std::vector<uint32_t>> set;
+        for (size_t t = 0; t + 2 < indices.size(); t += 3)
+        {
+            std::vector<uint32_t> tri;
+            for (int k = 0; k < 3; k++)
+            {
+                const Vertex& v = vertices[indices[t + k]];
+                tri.push_back((uint32_t)(v.position.x * 1000.0f) * 1000000u + (uint32_t)(v.position.y * 1000.0f));
+            }
+            std::sort(tri.begin(), tri.end());
+            set.push_back(tri);
+        }
+        std::sort(set.begin(), set.end());
+        return set;
+    }
+
+    void TestInvalidCorner()
+    {
+        // The second face references position 9 of 4.
+        std::string path = WriteTempObj(
+            "meshopttest_bad_corner.obj",
+            "v 0 0 0\nv 1 0 0\nv 0 1 0\nv 1 1 0\n"
+            "vn 0 0 1\n"
+            "f 1//1 2//1 3//1\n"
+            "f 2//1 9//1 3//1\n"
+            "f 2//1 4//1 3//1\n"
+        );
+
+        for (unsigned threads : { 1u, 4u })
+        {
+            OBJLoadOptions options;
+            options.threadCount = threads;
+
+            std::vector<Vertex> vertices;
+            std::vector<uint32_t> indices;
+            CHECK(LoadOBJ(path, vertices, indices, options));
+            CHECK(indices.size() == 6);
+            CHECK(vertices.size() == 4);
+
+            for (uint32_t index : indices)
+                CHECK(index < vertices.size());
+
+            MeshOptimizeOptions optimize;
+            OptimizeMesh(vertices, indices, optimize);
+            CHECK(indices.size() == 6);
+        }
+
+        std::filesystem::remove(path);
+    }
+
+    void TestWeld()
+    {
+        // Position 5 is position 4 moved by 1e-7. Face 3 repeats face 2
+        // with texcoords, face 5 with the other normal.
+        std::string path = WriteTempObj(
+            "meshopttest_weld.obj",
+            "v 0 0 0\nv 1 0 0\nv 0 1 0\nv 1 1 0\nv 1 1 0.0000001\n"
+            "vt 0 0\nvt 1 1\n"
+            "vn 0 0 1\nvn 0 0 -1\n"
+            "f 1//1 2//1 3//1\n"
+            "f 2//1 4//1 3//1\n"
+            "f 2/1/1 4/2/1 3/1/1\n"
+            "f 2//1 5//1 3//1\n"
+            "f 2//2 4//2 3//2\n"
+        );
+
+        struct Case
+        {
+            OBJWeldMode weld;
+            float epsilon;
+            std::vector<uint32_t> indices;
+        };
+
+        const Case cases[] = {
+            { OBJWeldMode::Indices, 0.0f, { 0, 1, 2, 1, 3, 2, 1, 3, 2, 1, 4, 2, 5, 6, 7 } },
+            { OBJWeldMode::Position, 1e-5f, { 0, 1, 2, 1, 3, 2, 1, 3, 2, 1, 3, 2, 4, 5, 6 } },
+            { OBJWeldMode::Position, 1e-9f, { 0, 1, 2, 1, 3, 2, 1, 3, 2, 1, 4, 2, 5, 6, 7 } },
+            { OBJWeldMode::None, 0.0f, { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14 } },
+        };
+
+        for (const Case& c : cases)
+        {
+            OBJLoadOptions options;
+            options.weld = c.weld;
+            options.weldEpsilon = c.epsilon;
+
+            // Appends after what is already there.
+            std::vector<Vertex> vertices(2);
+            std::vector<uint32_t> indices(1, 99);
+            OBJLoadStats stats;
+            CHECK(LoadOBJ(path, vertices, indices, options, &stats));
+
+            size_t vertexCount = *std::max_element(c.indices.begin(), c.indices.end()) + 1;
+            CHECK(vertices.size() == 2 + vertexCount);
+            CHECK(indices.size() == 1 + c.indices.size());
+            for (size_t i = 0; i < c.indices.size() && i + 1 < indices.size(); i++)
+                CHECK(indices[i + 1] == 2 + c.indices[i]);
+
+            CHECK(stats.cornerCount == 15);
+            CHECK(stats.indexCount == 15);
+            CHECK(stats.vertexCount == vertexCount);
+            CHECK(stats.VertexBytesSaved() == (15 - vertexCount) * sizeof(Vertex));
+
+            // Every corner keeps its own position and normal.
+            const int positions[15] = { 1, 2, 3, 2, 4, 3, 2, 4, 3, 2, 5, 3, 2, 4, 3 };
+            for (size_t i = 0; i < 15 && i + 1 < indices.size(); i++)
+            {
+                const Vertex& v = vertices[indices[i + 1]];
+                CHECK(v.normal.z == (i < 12 ? 1.0f : -1.0f));
+                CHECK((v.position.x > 0.0f) == (positions[i] == 2 || positions[i] >= 4));
+                CHECK((v.position.y > 0.0f) == (positions[i] >= 3));
+            }
+        }
+
+        std::filesystem::remove(path);
+    }
+
+    // A grid written row by row, each row's positions and normal just
+    // before the faces that first use them, so a file split into chunks has
+    // vertices first used in every chunk and faces using records of the
+    // chunk before. Every 16th row also has a face on the first row's
+    // positions and the first normal, in the first chunk. With 'relative'
+    // every index counts back from the last record, OBJ's negative form.
+    // Returns the corners as (position, normal) record pairs.
+    std::vector<std::pair<int, int>> WriteGridObj(const std::string& path, int size, bool relative)
+    {
+        std::vector<std::pair<int, int>> corners;
+        FILE* f = fopen(path.c_str(), "wb");
+        fprintf(f, "vn 0 0 1\n");
+
+        int positions = 0;
+        int normals = 1;
+
+        auto face = [&](std::pair<int, int> a, std::pair<int, int> b, std::pair<int, int> c)
+        {
+            fprintf(f, "f");
+            for (const std::pair<int, int>& corner : { a, b, c })
+            {
+                fprintf(f, " %d//%d",
+                    relative ? corner.first - positions - 1 : corner.first,
+                    relative ? corner.second - normals - 1 : corner.second);
+                corners.push_back(corner);
+            }
+            fprintf(f, "\n");
+        };
+
+        for (int y = 0; y <= size; y++)
+        {
+            for (int x = 0; x <= size; x++)
+                fprintf(f, "v %d %d %d\n", x, y, (x * 7 + y * 3) % 11);
+            fprintf(f, "vn 0 %d 10\n", y % 5);
+            positions += size + 1;
+            normals++;
+
+            for (int x = 0; y > 0 && x < size; x++)
+            {
+                int a = (y - 1) * (size + 1) + x + 1;
+                int c = a + size + 1;
+                int normal = (x + y) % 3 == 0 ? normals - 1 : normals;
+
+                face({ a, 1 }, { c, 1 }, { a + 1, 1 });
+                face({ a + 1, normal }, { c, normal }, { c + 1, normal });
+            }
+
+            if (y % 16 == 15)
+                face({ 1, 1 }, { positions, 1 }, { 2, 1 });
+        }
+
+        fclose(f);
+        return corners;
+    }
+
+    void TestWeldChunks()
+    {
+        // About 8.5 MB: seven chunks at 7 threads.
+        std::string path = (std::filesystem::temp_directory_path() / "meshopttest_weld_grid.obj").string();
+        std::vector<std::pair<int, int>> corners = WriteGridObj(path, 340, false);
+
+        // Single pass reference: vertices numbered in order of first use.
+        std::map<std::pair<int, int>, uint32_t> numbers;
+        std::vector<uint32_t> expected;
+        for (const std::pair<int, int>& corner : corners)
+        {
+            auto it = numbers.emplace(corner, (uint32_t)numbers.size()).first;
+            expected.push_back(it->second);
+        }
+
+        for (unsigned threads : { 1u, 2u, 7u, 0u })
+        {
+            OBJLoadOptions options;
+            options.threadCount = threads;
+
+            std::vector<Vertex> vertices;
+            std::vector<uint32_t> indices;
+            OBJLoadStats stats;
+            CHECK(LoadOBJ(path, vertices, indices, options, &stats));
+            CHECK(indices == expected);
+            CHECK(vertices.size() == numbers.size());
+            CHECK(stats.vertexCount == numbers.size());
+            CHECK(stats.cornerCount == corners.size());
+        }
+
+        std::filesystem::remove(path);
+    }
+
+    void TestRelativeIndices()
+    {
+        // The same grid with absolute and with negative indices, each about
+        // 8.5 MB: seven chunks at 7 threads.
+        std::string absolutePath = (std::filesystem::temp_directory_path() / "meshopttest_absolute.obj").string();
+        std::string relativePath = (std::filesystem::temp_directory_path() / "meshopttest_relative.obj").string();
+        std::vector<std::pair<int, int>> corners = WriteGridObj(absolutePath, 340, false);
+        CHECK(WriteGridObj(relativePath, 340, true) == corners);
+
+        for (OBJWeldMode weld : { OBJWeldMode::Indices, OBJWeldMode::None })
+        {
+            OBJLoadOptions options;
+            options.weld = weld;
+            options.threadCount = 1;
+
+            std::vector<Vertex> expectedVertices;
+            std::vector<uint32_t> expectedIndices;
+            CHECK(LoadOBJ(absolutePath, expectedVertices, expectedIndices, options));
+            CHECK(expectedIndices.size() == corners.size());
+
+            for (unsigned threads : { 1u, 2u, 7u, 0u })
+            {
+                options.threadCount = threads;
+
+                std::vector<Vertex> vertices;
+                std::vector<uint32_t> indices;
+                CHECK(LoadOBJ(relativePath, vertices, indices, options));
+                CHECK(indices == expectedIndices);
+                CHECK(vertices.size() == expectedVertices.size() &&
+                    memcmp(vertices.data(), expectedVertices.data(), vertices.size() * sizeof(Vertex)) == 0);
+            }
+        }
+
+        std::filesystem::remove(absolutePath);
+        std::filesystem::remove(relativePath);
+    }
+
+    void TestPartialTriangle()
+    {
+        // A 4 x 4 grid of quads and two trailing indices.
+        std::vector<Vertex> vertices;
+        for (int y = 0; y < 5; y++)
+        {
+            for (int x = 0; x < 5; x++)
+            {
+                Vertex v{};
+                v.position = DirectX::XMFLOAT3((float)x, (float)y, 0.0f);
+                v.normal = DirectX::XMFLOAT3(0.0f, 0.0f, 1.0f);
+                vertices.push_back(v);
+            }
+        }
+
+        std::vector<uint32_t> indices;
+        for (uint32_t y = 0; y < 4; y++)
+        {
+            for (uint32_t x = 0; x < 4; x++)
+            {
+                uint32_t v = y * 5 + x;
+                uint32_t quad[6] = { v, v + 5, v + 1, v + 1, v + 5, v + 6 };
+                indices.insert(indices.end(), quad, quad + 6);
+            }
+        }
+        indices.push_back(3);
+        indices.push_back(7);
+
+        std::vector<uint32_t> whole(indices.begin(), indices.end() - 2);
+        auto expected = TriangleSet(vertices, whole);
+
+        // ===== each pass keeps the triangles and the tail =====
+        std::vector<uint32_t> cache = indices;
+        OptimizeVertexCache(cache, vertices.size(), 16);
+        CHECK(cache.size() == indices.size());
+        CHECK(cache[cache.size() - 2] == 3 && cache.back() == 7);
+        CHECK(TriangleSet(vertices, cache) == expected);
+
+        std::vector<uint32_t> overdraw = cache;
+        OptimizeOverdraw(overdraw, vertices, 16, 1.05f);
+        CHECK(overdraw.size() == indices.size());
+        CHECK(overdraw[overdraw.size() - 2] == 3 && overdraw.back() == 7);
+        CHECK(TriangleSet(vertices, overdraw) == expected);
+
+        CHECK(AnalyzeVertexCache(indices, vertices.size(), 16) > 0.0f);
+
+        // ===== the whole pipeline =====
+        std::vector<Vertex> meshVertices = vertices;
+        std::vector<uint32_t> meshIndices = indices;
+        OptimizeMesh(meshVertices, meshIndices, MeshOptimizeOptions());
+        CHECK(meshIndices.size() == indices.size());
+
+        for (uint32_t index : meshIndices)
+            CHECK(index < meshVertices.size());
+
+        meshIndices.resize(meshIndices.size() - 2);
+        CHECK(TriangleSet(meshVertices, meshIndices) == expected);
+    }
+}
+
+int main()
+{
+    TestInvalidCorner();
+    TestWeld();
+    TestWeldChunks();
+    TestRelativeIndices();
+    TestPartialTriangle();
+    return TestResult("meshopttest");
+}
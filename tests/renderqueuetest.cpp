@@ -0,0 +1,256 @@
+// Tests for RenderQueue: Sort must give the order std::stable_sort gives
+// on the keys, equal keys keeping their submission order, for random keys,
+// keys that differ in a single digit, full 64-bit keys, sorted, reversed
+// and constant input, and empty or single packet queues. Passes over
+// digits every key shares are skipped and counted as such. Execute must
+// issue exactly the state changes between neighbouring draws, and the
+// sort key fields must round-trip through MakeSortKey.
+//
+// Linux build, from the repository root:
+//
+//   g++ -std=c++17 -O1 -g -fsanitize=address,undefined -Isrc
+//       -o renderqueuetest tests/renderqueuetest.cpp src/renderqueue.cpp
+
+#include "check.h"
+#include "renderqueue.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace
+{
+    // Records what Execute issues, in order.
+    class RecordingSink : public RenderStateSink
+    {
+    public:
+        struct Call
+        {
+            char kind;
+            uint32_t id;
+        };
+
+        void SetPipeline(uint32_t pipeline) override { mCalls.push_back({ 'p', pipeline }); }
+        void SetMaterial(uint32_t material) override { mCalls.push_back({ 'm', material }); }
+        void SetMesh(uint32_t mesh) override { mCalls.push_back({ 'g', mesh }); }
+        void Draw(uint32_t payload) override { mCalls.push_back({ 'd', payload }); }
+
+        const std::vector<Call>& Calls() const { return mCalls; }
+
+    private:
+        std::vector<Call> mCalls;
+    };
+
+    // Submits the keys with their index as payload, sorts, and compares
+    // with std::stable_sort of the same packets.
+    void CheckSort(RenderQueue& queue, const std::vector<uint64_t>& keys)
+    {
+        std::vector<RenderPacket> expected;
+        queue.Clear();
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            queue.Submit(keys[i], (uint32_t)i);
+            expected.push_back({ keys[i], (uint32_t)i, 0 });
+        }
+
+        std::stable_sort(expected.begin(), expected.end(), [](const RenderPacket& a, const RenderPacket& b)
+        {
+            return a.key < b.key;
+        });
+
+        queue.Sort();
+
+        const std::vector<RenderPacket>& packets = queue.Packets();
+        CHECK(packets.size() == expected.size());
+        for (size_t i = 0; i < packets.size() && i < expected.size(); i++)
+            CHECK(packets[i].key == expected[i].key && packets[i].payload == expected[i].payload);
+    }
+
+    void TestRandomKeys()
+    {
+        RenderQueue queue;
+        std::mt19937_64 rng(1);
+
+        // Full 64-bit keys touch every digit, the top one only 9 bits wide.
+        std::vector<uint64_t> keys(100000);
+        for (uint64_t& key : keys)
+            key = rng();
+        CheckSort(queue, keys);
+        CHECK(queue.Stats().sortPasses == 6);
+
+        // Few distinct keys: long runs of equal keys must stay in
+        // submission order.
+        for (uint64_t& key : keys)
+            key = MakeSortKey((uint32_t)(rng() % 4), (uint32_t)(rng() % 64), (uint32_t)(rng() % 3), 0);
+        CheckSort(queue, keys);
+
+        // Realistic fields, reusing the queue's scratch.
+        for (uint64_t& key : keys)
+            key = MakeSortKey((uint32_t)(rng() % 4), (uint32_t)(rng() % 64), (uint32_t)(rng() % 2000), (uint32_t)rng());
+        CheckSort(queue, keys);
+
+        // Sizes around small counts.
+        for (size_t count = 2; count < 40; count++)
+        {
+            std::vector<uint64_t> small(count);
+            for (uint64_t& key : small)
+                key = rng() % 5 == 0 ? ~0ull : rng() >> (rng() % 64);
+            CheckSort(queue, small);
+        }
+    }
+
+    // Only the digits that differ between keys cost a pass.
+    void TestSkippedPasses()
+    {
+        RenderQueue queue;
+        std::mt19937_64 rng(2);
+
+        // Keys differing in the pipeline only: bits 54 to 63, the last
+        // two 11-bit digits.
+        std::vector<uint64_t> keys(5000);
+        for (uint64_t& key : keys)
+            key = MakeSortKey((uint32_t)(rng() % 1024), 7, 9, 11);
+        CheckSort(queue, keys);
+        CHECK(queue.Stats().sortPasses == 2);
+
+        // Depth only, below 2048: the first digit.
+        for (uint64_t& key : keys)
+            key = MakeSortKey(1, 2, 3, (uint32_t)(rng() % 2048));
+        CheckSort(queue, keys);
+        CHECK(queue.Stats().sortPasses == 1);
+
+        // An odd pass count leaves the result in the scratch buffer.
+        for (uint64_t& key : keys)
+            key = MakeSortKey(1, (uint32_t)(rng() % 8), 3, (uint32_t)(rng() % 2048));
+        CheckSort(queue, keys);
+        CHECK(queue.Stats().sortPasses == 2);
+
+        for (uint64_t& key : keys)
+            key = MakeSortKey(1, (uint32_t)(rng() % 8), (uint32_t)(rng() % 8), (uint32_t)(rng() % 2048));
+        CheckSort(queue, keys);
+        CHECK(queue.Stats().sortPasses == 3);
+    }
+
+    void TestOrderedInput()
+    {
+        RenderQueue queue;
+
+        std::vector<uint64_t> keys(3000);
+        for (size_t i = 0; i < keys.size(); i++)
+            keys[i] = (uint64_t)i * 0x9E3779B97F4A7C15ull % 0xFFFFFFFFFFull;
+        std::sort(keys.begin(), keys.end());
+
+        // Sorted: one scan and no passes.
+        CheckSort(queue, keys);
+        CHECK(queue.Stats().sortPasses == 0);
+
+        // Sorted again in place.
+        queue.Sort();
+        CHECK(queue.Stats().sortPasses == 0);
+        CHECK(queue.Packets().front().payload == 0 && queue.Packets().back().payload == keys.size() - 1);
+
+        std::reverse(keys.begin(), keys.end());
+        CheckSort(queue, keys);
+        CHECK(queue.Stats().sortPasses > 0);
+
+        std::vector<uint64_t> constant(1000, 0x123456789ull);
+        CheckSort(queue, constant);
+        CHECK(queue.Stats().sortPasses == 0);
+
+        CheckSort(queue, std::vector<uint64_t>());
+        CheckSort(queue, std::vector<uint64_t>(1, ~0ull));
+        CHECK(queue.Stats().sortPasses == 0);
+    }
+
+    void TestSortKey()
+    {
+        uint64_t key = MakeSortKey(1023, 65535, 65535, SORT_DEPTH_MAX);
+        CHECK(key == ~0ull);
+
+        key = MakeSortKey(5, 600, 40000, 123456);
+        CHECK(SortKeyPipeline(key) == 5);
+        CHECK(SortKeyMaterial(key) == 600);
+        CHECK(SortKeyMesh(key) == 40000);
+        CHECK(SortKeyDepth(key) == 123456);
+
+        // Oversized fields are truncated and do not spill into neighbours.
+        key = MakeSortKey(1024 + 3, 65536 + 4, 65536 + 5, SORT_DEPTH_MAX + 1 + 6);
+        CHECK(key == MakeSortKey(3, 4, 5, 6));
+
+        // A more significant field outweighs everything below it.
+        CHECK(MakeSortKey(1, 0, 0, 0) > MakeSortKey(0, 65535, 65535, SORT_DEPTH_MAX));
+        CHECK(MakeSortKey(0, 1, 0, 0) > MakeSortKey(0, 0, 65535, SORT_DEPTH_MAX));
+        CHECK(MakeSortKey(0, 0, 1, 0) > MakeSortKey(0, 0, 0, SORT_DEPTH_MAX));
+
+        CHECK(QuantizeDepth(0.1f, 0.1f, 100.0f) == 0);
+        CHECK(QuantizeDepth(-5.0f, 0.1f, 100.0f) == 0);
+        CHECK(QuantizeDepth(100.0f, 0.1f, 100.0f) == SORT_DEPTH_MAX);
+        CHECK(QuantizeDepth(1e9f, 0.1f, 100.0f) == SORT_DEPTH_MAX);
+
+        uint32_t previous = 0;
+        for (float depth = 0.1f; depth < 100.0f; depth += 0.37f)
+        {
+            uint32_t bucket = QuantizeDepth(depth, 0.1f, 100.0f);
+            CHECK(bucket >= previous);
+            previous = bucket;
+        }
+    }
+
+    void TestExecute()
+    {
+        RenderQueue queue;
+        queue.Submit(MakeSortKey(1, 2, 3, 50), 10);
+        queue.Submit(MakeSortKey(0, 9, 9, 0), 11);
+        queue.Submit(MakeSortKey(1, 2, 3, 40), 12);
+        queue.Submit(MakeSortKey(1, 2, 4, 0), 13);
+        queue.Submit(MakeSortKey(1, 5, 4, 0), 14);
+        queue.Submit(MakeSortKey(0, 9, 9, 0), 15);
+        queue.Sort();
+
+        RecordingSink sink;
+        queue.Execute(sink);
+
+        // Order (0,9,9) x2, (1,2,3,40), (1,2,3,50), (1,2,4), (1,5,4).
+        const char* kinds = "pmgddpmgddgdmd";
+        const uint32_t ids[] = { 0, 9, 9, 11, 15, 1, 2, 3, 12, 10, 4, 13, 5, 14 };
+
+        const std::vector<RecordingSink::Call>& calls = sink.Calls();
+        CHECK(calls.size() == 14);
+        for (size_t i = 0; i < calls.size() && i < 14; i++)
+            CHECK(calls[i].kind == kinds[i] && calls[i].id == ids[i]);
+
+        const RenderQueueStats& stats = queue.Stats();
+        CHECK(stats.draws == 6);
+        CHECK(stats.pipelineChanges == 2);
+        CHECK(stats.materialChanges == 3);
+        CHECK(stats.meshChanges == 3);
+        CHECK(stats.redundantChanges == 18 - 8);
+
+        // The first draw binds everything even when every id is 0.
+        RenderQueue zero;
+        zero.Submit(0, 7);
+        zero.Sort();
+        RecordingSink zeroSink;
+        zero.Execute(zeroSink);
+        CHECK(zeroSink.Calls().size() == 4);
+        CHECK(zero.Stats().redundantChanges == 0);
+
+        // An empty queue issues nothing.
+        RenderQueue empty;
+        RecordingSink emptySink;
+        empty.Execute(emptySink);
+        CHECK(emptySink.Calls().empty());
+        CHECK(empty.Stats().draws == 0);
+    }
+}
+
+int main()
+{
+    TestRandomKeys();
+    TestSkippedPasses();
+    TestOrderedInput();
+    TestSortKey();
+    TestExecute();
+
+    return TestResult("renderqueuetest");
+}
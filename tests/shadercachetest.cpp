@@ -0,0 +1,310 @@
+// Tests for ShaderCache against a stub compiler that counts its calls: a
+// hit never compiles, every part of ShaderSource and the compiler version
+// keys apart, a saved cache loads back without compiling, a corrupt blob
+// is dropped and compiled again, and caches saving the same file from
+// several threads at once each leave a whole file behind.
+//
+// Linux build, from the repository root:
+//
+//   g++ -std=c++17 -O1 -g -fsanitize=address,undefined -pthread -Isrc
+//       -o shadercachetest tests/shadercachetest.cpp src/shadercache.cpp
+//       src/mappedfile.cpp src/hash.cpp
+
+#include "check.h"
+#include "shadercache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // Bytecode is the source with the profile appended, so a wrong entry
+    // shows up as the wrong bytes.
+    class StubCompiler : public ShaderCompiler
+    {
+    public:
+        explicit StubCompiler(uint64_t version = 1) : mVersion(version), mCompiles(0) {}
+
+        uint64_t Version() const override { return mVersion; }
+
+        bool Compile(const ShaderSource& shader, std::vector<uint8_t>& bytecode, std::string& errors) override
+        {
+            mCompiles.fetch_add(1);
+            if (shader.source.find("error") != std::string::npos)
+            {
+                errors = "stub: error in source";
+                return false;
+            }
+
+            std::string text = shader.source + "|" + shader.profile;
+            bytecode.assign(text.begin(), text.end());
+            return true;
+        }
+
+        uint32_t Compiles() const { return mCompiles.load(); }
+
+    private:
+        uint64_t mVersion;
+        std::atomic<uint32_t> mCompiles;
+    };
+
+    ShaderSource MakeShader(const char* source, const char* profile = "vs_5_0")
+    {
+        ShaderSource shader;
+        shader.source = source;
+        shader.profile = profile;
+        return shader;
+    }
+
+    std::string Bytes(const ShaderBytecode& bytecode)
+    {
+        return std::string((const char*)bytecode.data, bytecode.size);
+    }
+
+    std::string TempCachePath(const char* name)
+    {
+        std::string path = (std::filesystem::temp_directory_path() / name).string();
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+        return path;
+    }
+
+    // Temporary files the saves left next to path.
+    size_t StrayFiles(const std::string& path)
+    {
+        std::filesystem::path file(path);
+        std::string prefix = file.filename().string() + ".";
+
+        size_t count = 0;
+        for (const auto& entry : std::filesystem::directory_iterator(file.parent_path()))
+        {
+            if (entry.path().filename().string().compare(0, prefix.size(), prefix) == 0)
+                count++;
+        }
+        return count;
+    }
+
+    void TestHitMiss()
+    {
+        StubCompiler compiler;
+        ShaderCache cache;
+        CHECK(!cache.Load(TempCachePath("shadercachetest_missing.cache")));
+        CHECK(cache.EntryCount() == 0);
+
+        ShaderBytecode bytecode;
+        std::string errors;
+        ShaderSource shader = MakeShader("float4 main() : SV_Position { return 0; }");
+
+        CHECK(cache.Get(shader, compiler, bytecode, errors));
+        CHECK(Bytes(bytecode) == shader.source + "|vs_5_0");
+        CHECK(cache.Get(shader, compiler, bytecode, errors));
+        CHECK(Bytes(bytecode) == shader.source + "|vs_5_0");
+
+        CHECK(compiler.Compiles() == 1);
+        CHECK(cache.Stats().hits == 1);
+        CHECK(cache.Stats().misses == 1);
+
+        // A failure reports the compiler's errors and stores nothing.
+        ShaderSource bad = MakeShader("error");
+        CHECK(!cache.Get(bad, compiler, bytecode, errors));
+        CHECK(errors == "stub: error in source");
+        CHECK(cache.Stats().failures == 1);
+        CHECK(!cache.Get(bad, compiler, bytecode, errors));
+        CHECK(compiler.Compiles() == 3);
+        CHECK(cache.EntryCount() == 1);
+    }
+
+    void TestKeys()
+    {
+        ShaderSource base = MakeShader("a");
+        base.defines.push_back({ "LIGHTS", "4" });
+
+        std::vector<ShaderSource> variants(7, base);
+        variants[1].source = "b";
+        variants[2].entryPoint = "other";
+        variants[3].profile = "ps_5_0";
+        variants[4].defines[0].value = "8";
+        variants[5].defines.push_back({ "SHADOWS", "" });
+        variants[6].flags = 1;
+
+        for (size_t i = 0; i < variants.size(); i++)
+        {
+            for (size_t k = i + 1; k < variants.size(); k++)
+                CHECK(ShaderCacheKey(variants[i], 1) != ShaderCacheKey(variants[k], 1));
+        }
+
+        CHECK(ShaderCacheKey(base, 1) == ShaderCacheKey(base, 1));
+        CHECK(ShaderCacheKey(base, 1) != ShaderCacheKey(base, 2));
+
+        // Name and value boundaries hash apart.
+        ShaderSource left = MakeShader("a");
+        left.defines.push_back({ "AB", "C" });
+        ShaderSource right = MakeShader("a");
+        right.defines.push_back({ "A", "BC" });
+        CHECK(ShaderCacheKey(left, 1) != ShaderCacheKey(right, 1));
+    }
+
+    void TestSaveLoad()
+    {
+        std::string path = TempCachePath("shadercachetest_roundtrip.cache");
+        std::vector<ShaderSource> shaders = { MakeShader("one"), MakeShader("two", "ps_5_0"), MakeShader("three") };
+
+        {
+            StubCompiler compiler;
+            ShaderCache cache;
+            cache.Load(path);
+
+            ShaderBytecode bytecode;
+            std::string errors;
+            for (const ShaderSource& shader : shaders)
+                CHECK(cache.Get(shader, compiler, bytecode, errors));
+            CHECK(cache.Save());
+        }
+
+        CHECK(StrayFiles(path) == 0);
+
+        {
+            StubCompiler compiler;
+            ShaderCache cache;
+            CHECK(cache.Load(path));
+            CHECK(cache.EntryCount() == shaders.size());
+
+            ShaderBytecode bytecode;
+            std::string errors;
+            for (const ShaderSource& shader : shaders)
+            {
+                CHECK(cache.Get(shader, compiler, bytecode, errors));
+                CHECK(Bytes(bytecode) == shader.source + "|" + shader.profile);
+            }
+            CHECK(compiler.Compiles() == 0);
+
+            // A new compiler version misses every entry.
+            StubCompiler updated(2);
+            CHECK(cache.Get(shaders[0], updated, bytecode, errors));
+            CHECK(updated.Compiles() == 1);
+        }
+
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+    }
+
+    void TestCorrupt()
+    {
+        std::string path = TempCachePath("shadercachetest_corrupt.cache");
+        ShaderSource shader = MakeShader("corrupt me");
+
+        {
+            StubCompiler compiler;
+            ShaderCache cache;
+            cache.Load(path);
+
+            ShaderBytecode bytecode;
+            std::string errors;
+            CHECK(cache.Get(shader, compiler, bytecode, errors));
+            CHECK(cache.Save());
+        }
+
+        // Flip a byte inside the blob; its checksum no longer matches.
+        {
+            std::vector<char> data;
+            FILE* f = fopen(path.c_str(), "rb");
+            CHECK(f != nullptr);
+            if (!f)
+                return;
+            fseek(f, 0, SEEK_END);
+            data.resize((size_t)ftell(f));
+            fseek(f, 0, SEEK_SET);
+            CHECK(fread(data.data(), 1, data.size(), f) == data.size());
+            fclose(f);
+
+            std::string blob = shader.source + "|" + shader.profile;
+            auto at = std::search(data.begin(), data.end(), blob.begin(), blob.end());
+            CHECK(at != data.end());
+            if (at != data.end())
+                *at ^= 1;
+
+            f = fopen(path.c_str(), "wb");
+            fwrite(data.data(), 1, data.size(), f);
+            fclose(f);
+        }
+
+        StubCompiler compiler;
+        ShaderCache cache;
+        CHECK(cache.Load(path));
+        CHECK(cache.Stats().corrupt == 1);
+        CHECK(cache.EntryCount() == 0);
+
+        ShaderBytecode bytecode;
+        std::string errors;
+        CHECK(cache.Get(shader, compiler, bytecode, errors));
+        CHECK(Bytes(bytecode) == shader.source + "|" + shader.profile);
+        CHECK(compiler.Compiles() == 1);
+
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+    }
+
+    // Each thread is a process of its own with one shader. A shared
+    // temporary name let one writer rename or truncate another's file.
+    void TestConcurrentSave()
+    {
+        const int THREADS = 4;
+        const int ROUNDS = 50;
+
+        std::string path = TempCachePath("shadercachetest_shared.cache");
+        std::atomic<int> failedSaves(0);
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < THREADS; t++)
+        {
+            threads.emplace_back([&, t]()
+            {
+                for (int round = 0; round < ROUNDS; round++)
+                {
+                    StubCompiler compiler;
+                    ShaderCache cache;
+                    cache.Load(path);
+
+                    std::string source = "thread " + std::to_string(t) + " round " + std::to_string(round);
+                    ShaderBytecode bytecode;
+                    std::string errors;
+                    cache.Get(MakeShader(source.c_str()), compiler, bytecode, errors);
+
+                    if (!cache.Save())
+                        failedSaves.fetch_add(1);
+                }
+            });
+        }
+
+        for (std::thread& thread : threads)
+            thread.join();
+
+        CHECK(failedSaves.load() == 0);
+        CHECK(StrayFiles(path) == 0);
+
+        // Whatever the last rename left is a whole cache.
+        ShaderCache cache;
+        CHECK(cache.Load(path));
+        CHECK(cache.Stats().corrupt == 0);
+        CHECK(cache.EntryCount() > 0);
+
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+    }
+}
+
+int main()
+{
+    TestHitMiss();
+    TestKeys();
+    TestSaveLoad();
+    TestCorrupt();
+    TestConcurrentSave();
+
+    return TestResult("shadercachetest");
+}
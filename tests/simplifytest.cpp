@@ -0,0 +1,326 @@
+// Tests for the LOD chain on a noisy closed sphere and on a bumpy open
+// grid: every level's recorded error must cover the distance of every
+// parent vertex from it, measured by brute force over all of its
+// triangles; no level holds a degenerate triangle; the sphere reaches every
+// requested triangle ratio; and with lockBorders the open edges of the
+// grid come through every level unchanged.
+//
+// Linux build, from the repository root, with DirectXMath on the include
+// path:
+//
+//   g++ -std=c++17 -O1 -g -fsanitize=address,undefined -Isrc
+//       -o simplifytest tests/simplifytest.cpp src/simplify.cpp src/meshopt.cpp
+
+#include "check.h"
+#include "simplify.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <random>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+    typedef std::tuple<float, float, float> Position;
+
+    Position Key(const Vertex& v)
+    {
+        return Position(v.position.x, v.position.y, v.position.z);
+    }
+
+    // A cube of n x n cells per face pushed out to a sphere of radius 10,
+    // each vertex moved radially by up to 2% noise. Lattice points are
+    // shared between faces, so the surface is closed.
+    void MakeNoisySphere(int n, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+    {
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<float> noise(0.98f, 1.02f);
+        std::map<std::tuple<int, int, int>, uint32_t> lattice;
+
+        auto vertex = [&](int x, int y, int z)
+        {
+            auto it = lattice.find(std::make_tuple(x, y, z));
+            if (it != lattice.end())
+                return it->second;
+
+            float l = std::sqrt((float)(x * x + y * y + z * z));
+            float r = 10.0f * noise(rng) / l;
+
+            Vertex v = {};
+            v.position = XMFLOAT3(x * r, y * r, z * r);
+            v.normal = XMFLOAT3(x / l, y / l, z / l);
+            v.color = XMFLOAT4(1, 1, 1, 1);
+            vertices.push_back(v);
+
+            uint32_t index = (uint32_t)vertices.size() - 1;
+            lattice[std::make_tuple(x, y, z)] = index;
+            return index;
+        };
+
+        // Face axis, then the two in-face axes.
+        for (int axis = 0; axis < 3; axis++)
+        {
+            for (int side = -1; side <= 1; side += 2)
+            {
+                for (int i = 0; i < n; i++)
+                {
+                    for (int j = 0; j < n; j++)
+                    {
+                        uint32_t q[4];
+                        for (int k = 0; k < 4; k++)
+                        {
+                            int c[3];
+                            c[axis] = side * n;
+                            c[(axis + 1) % 3] = -n + 2 * (i + (k == 1 || k == 2));
+                            c[(axis + 2) % 3] = -n + 2 * (j + (k >= 2));
+                            q[k] = vertex(c[0], c[1], c[2]);
+                        }
+
+                        if (side > 0)
+                            indices.insert(indices.end(), { q[0], q[1], q[2], q[0], q[2], q[3] });
+                        else
+                            indices.insert(indices.end(), { q[0], q[2], q[1], q[0], q[3], q[2] });
+                    }
+                }
+            }
+        }
+    }
+
+    void MakeBumpyGrid(int n, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+    {
+        for (int y = 0; y <= n; y++)
+        {
+            for (int x = 0; x <= n; x++)
+            {
+                Vertex v = {};
+                v.position = XMFLOAT3((float)x, std::sin(x * 0.4f) * std::cos(y * 0.3f), (float)y);
+                v.normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+                v.color = XMFLOAT4(1, 1, 1, 1);
+                vertices.push_back(v);
+            }
+        }
+
+        for (int y = 0; y < n; y++)
+        {
+            for (int x = 0; x < n; x++)
+            {
+                uint32_t i = (uint32_t)(y * (n + 1) + x);
+                indices.insert(indices.end(), { i, i + n + 1, i + 1, i + 1, i + n + 1, i + n + 2 });
+            }
+        }
+    }
+
+    double SegmentDistance(const XMFLOAT3& p, const XMFLOAT3& a, const XMFLOAT3& b)
+    {
+        double ab[3] = { (double)b.x - a.x, (double)b.y - a.y, (double)b.z - a.z };
+        double ap[3] = { (double)p.x - a.x, (double)p.y - a.y, (double)p.z - a.z };
+        double len = ab[0] * ab[0] + ab[1] * ab[1] + ab[2] * ab[2];
+        double t = len > 0.0 ? (ap[0] * ab[0] + ap[1] * ab[1] + ap[2] * ab[2]) / len : 0.0;
+        t = std::min(1.0, std::max(0.0, t));
+
+        double dx = ap[0] - t * ab[0], dy = ap[1] - t * ab[1], dz = ap[2] - t * ab[2];
+        return std::sqrt(dx * dx + dy * dy + dz * dz);
+    }
+
+    // Plane distance when p projects inside the triangle, else the
+    // nearest edge.
+    double TriangleDistance(const XMFLOAT3& p, const XMFLOAT3& a, const XMFLOAT3& b, const XMFLOAT3& c)
+    {
+        double u[3] = { (double)b.x - a.x, (double)b.y - a.y, (double)b.z - a.z };
+        double v[3] = { (double)c.x - a.x, (double)c.y - a.y, (double)c.z - a.z };
+        double n[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+        double nn = n[0] * n[0] + n[1] * n[1] + n[2] * n[2];
+
+        if (nn > 0.0)
+        {
+            const XMFLOAT3* corners[3] = { &a, &b, &c };
+            bool inside = true;
+            for (int k = 0; k < 3 && inside; k++)
+            {
+                const XMFLOAT3& e0 = *corners[k];
+                const XMFLOAT3& e1 = *corners[(k + 1) % 3];
+                double e[3] = { (double)e1.x - e0.x, (double)e1.y - e0.y, (double)e1.z - e0.z };
+                double q[3] = { (double)p.x - e0.x, (double)p.y - e0.y, (double)p.z - e0.z };
+                double side[3] = { e[1] * q[2] - e[2] * q[1], e[2] * q[0] - e[0] * q[2], e[0] * q[1] - e[1] * q[0] };
+                inside = side[0] * n[0] + side[1] * n[1] + side[2] * n[2] >= 0.0;
+            }
+
+            if (inside)
+            {
+                double d = ((double)p.x - a.x) * n[0] + ((double)p.y - a.y) * n[1] + ((double)p.z - a.z) * n[2];
+                return std::fabs(d) / std::sqrt(nn);
+            }
+        }
+
+        return std::min(SegmentDistance(p, a, b), std::min(SegmentDistance(p, b, c), SegmentDistance(p, c, a)));
+    }
+
+    // Largest distance of a vertex of parent from any triangle of child.
+    double Deviation(const std::vector<Vertex>& vertices, const uint32_t* parent, size_t parentCount,
+        const uint32_t* child, size_t childCount)
+    {
+        std::vector<uint32_t> used(parent, parent + parentCount);
+        std::sort(used.begin(), used.end());
+        used.erase(std::unique(used.begin(), used.end()), used.end());
+
+        double worst = 0.0;
+        for (uint32_t v : used)
+        {
+            const XMFLOAT3& p = vertices[v].position;
+            double best = 1e30;
+            for (size_t t = 0; t < childCount; t += 3)
+            {
+                best = std::min(best, TriangleDistance(p,
+                    vertices[child[t]].position, vertices[child[t + 1]].position, vertices[child[t + 2]].position));
+            }
+            worst = std::max(worst, best);
+        }
+        return worst;
+    }
+
+    // Edges used by a single triangle, by position.
+    std::vector<std::pair<Position, Position>> OpenEdges(const std::vector<Vertex>& vertices, const uint32_t* indices, size_t count)
+    {
+        std::map<std::pair<Position, Position>, int> uses;
+        for (size_t t = 0; t < count; t += 3)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                Position a = Key(vertices[indices[t + k]]);
+                Position b = Key(vertices[indices[t + (k + 1) % 3]]);
+                uses[a < b ? std::make_pair(a, b) : std::make_pair(b, a)]++;
+            }
+        }
+
+        std::vector<std::pair<Position, Position>> open;
+        for (const auto& edge : uses)
+        {
+            if (edge.second == 1)
+                open.push_back(edge.first);
+        }
+        return open;
+    }
+
+    void CheckChain(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+        const std::vector<MeshLod>& lods, double scale)
+    {
+        CHECK(lods[0].indexOffset == 0 && lods[0].error == 0.0f);
+
+        for (size_t k = 1; k < lods.size(); k++)
+        {
+            const MeshLod& parent = lods[k - 1];
+            const MeshLod& lod = lods[k];
+            const uint32_t* tri = indices.data() + lod.indexOffset;
+
+            CHECK(lod.indexCount % 3 == 0 && lod.indexCount < parent.indexCount);
+            CHECK(lod.indexOffset + lod.indexCount <= indices.size());
+
+            for (size_t t = 0; t < lod.indexCount; t += 3)
+            {
+                CHECK(tri[t] < vertices.size() && tri[t + 1] < vertices.size() && tri[t + 2] < vertices.size());
+
+                const XMFLOAT3& a = vertices[tri[t]].position;
+                const XMFLOAT3& b = vertices[tri[t + 1]].position;
+                const XMFLOAT3& c = vertices[tri[t + 2]].position;
+                CHECK(Key(vertices[tri[t]]) != Key(vertices[tri[t + 1]]));
+                CHECK(Key(vertices[tri[t + 1]]) != Key(vertices[tri[t + 2]]));
+                CHECK(Key(vertices[tri[t]]) != Key(vertices[tri[t + 2]]));
+                double u[3] = { (double)b.x - a.x, (double)b.y - a.y, (double)b.z - a.z };
+                double v[3] = { (double)c.x - a.x, (double)c.y - a.y, (double)c.z - a.z };
+                double n[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+                CHECK(n[0] * n[0] + n[1] * n[1] + n[2] * n[2] > 0.0);
+            }
+
+            // The recorded error grows by at least the measured deviation
+            // of this level from its parent.
+            double deviation = Deviation(vertices, indices.data() + parent.indexOffset, parent.indexCount, tri, lod.indexCount);
+            CHECK(deviation > 0.0);
+            CHECK(deviation <= (double)lod.error - parent.error + 1e-6 * scale);
+        }
+    }
+
+    void TestSphere()
+    {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        MakeNoisySphere(16, vertices, indices);
+
+        size_t baseTriangles = indices.size() / 3;
+
+        LodChainOptions options;
+        options.simplify.lockBorders = true;
+        CHECK(OpenEdges(vertices, indices.data(), indices.size()).empty());
+
+        std::vector<MeshLod> lods = BuildLodChain(vertices.data(), vertices.size(), indices, options);
+
+        // A closed surface has nothing locked: every ratio is reached.
+        CHECK(lods.size() == options.ratios.size() + 1);
+        for (size_t k = 1; k < lods.size() && k <= options.ratios.size(); k++)
+            CHECK(lods[k].indexCount / 3 <= (size_t)(baseTriangles * options.ratios[k - 1]));
+
+        CheckChain(vertices, indices, lods, 10.0);
+
+        // Errors grow along the chain.
+        for (size_t k = 1; k < lods.size(); k++)
+            CHECK(lods[k].error >= lods[k - 1].error);
+    }
+
+    void TestLockedBorders()
+    {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        MakeBumpyGrid(48, vertices, indices);
+
+        LodChainOptions options;
+        options.simplify.lockBorders = true;
+
+        std::vector<MeshLod> lods = BuildLodChain(vertices.data(), vertices.size(), indices, options);
+        CHECK(lods.size() >= 3);
+
+        CheckChain(vertices, indices, lods, 48.0);
+
+        std::vector<std::pair<Position, Position>> border = OpenEdges(vertices, indices.data(), lods[0].indexCount);
+        CHECK(border.size() == 48 * 4);
+
+        for (size_t k = 1; k < lods.size(); k++)
+            CHECK(OpenEdges(vertices, indices.data() + lods[k].indexOffset, lods[k].indexCount) == border);
+    }
+
+    void TestSimplifyMesh()
+    {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        MakeBumpyGrid(16, vertices, indices);
+
+        // Nothing to remove: the input comes back with no error.
+        float error = -1.0f;
+        std::vector<uint32_t> same = SimplifyMesh(vertices.data(), vertices.size(), indices.data(), indices.size(),
+            indices.size(), SimplifyOptions(), &error);
+        CHECK(same == indices);
+        CHECK(error == 0.0f);
+
+        // A flat grid simplifies without error.
+        for (Vertex& v : vertices)
+            v.position.y = 0.0f;
+
+        std::vector<uint32_t> flat = SimplifyMesh(vertices.data(), vertices.size(), indices.data(), indices.size(),
+            indices.size() / 4, SimplifyOptions(), &error);
+        CHECK(flat.size() <= indices.size() / 4);
+        CHECK(error < 1e-6f);
+    }
+}
+
+int main()
+{
+    TestSphere();
+    TestLockedBorders();
+    TestSimplifyMesh();
+
+    return TestResult("simplifytest");
+}
@@ -0,0 +1,265 @@
+// Tests for StagingUploader against a mock copy queue. The mock runs a
+// batch's copies only when the test lets the GPU complete it, reading the
+// staging buffer at that moment, so staging space reused before its batch
+// finished shows up as wrong bytes in the destination. Also checks that
+// tickets complete with their batch, that waiting never targets a fence
+// that was not submitted, that uploads larger than the staging buffer
+// stream through it, and that sources may be reused as soon as Upload
+// returns.
+//
+// Linux build, from the repository root:
+//
+//   g++ -std=c++17 -O1 -g -fsanitize=address,undefined -Isrc
+//       -o stagingtest tests/stagingtest.cpp src/staging.cpp src/uploadring.cpp
+
+#include "check.h"
+#include "staging.h"
+
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <vector>
+
+namespace
+{
+    typedef std::vector<uint8_t> Buffer;
+
+    class MockCopyQueue : public StagingBackend
+    {
+    public:
+        MockCopyQueue(const Buffer& staging, uint64_t completed = 0)
+            : mStaging(staging),
+            mSubmitted(completed),
+            mCompleted(completed)
+        {
+        }
+
+        void RecordCopy(void* destination, uint64_t destinationOffset, uint64_t stagingOffset, uint64_t size) override
+        {
+            CHECK(stagingOffset + size <= mStaging.size());
+            CHECK(destinationOffset + size <= ((Buffer*)destination)->size());
+            mRecorded.push_back({ (Buffer*)destination, destinationOffset, stagingOffset, size });
+        }
+
+        void Submit(uint64_t fence) override
+        {
+            CHECK(fence > mSubmitted);
+            CHECK(!mRecorded.empty());
+            mSubmitted = fence;
+            mBatches.push_back({ fence, mRecorded });
+            mRecorded.clear();
+        }
+
+        uint64_t CompletedValue() override { return mCompleted; }
+
+        void Wait(uint64_t fence) override
+        {
+            // A fence nobody submitted would hang a real queue.
+            CHECK(fence <= mSubmitted);
+            while (mCompleted < fence && !mBatches.empty())
+                CompleteOne();
+        }
+
+        // The GPU finishes the oldest batch: its copies run now.
+        void CompleteOne()
+        {
+            if (mBatches.empty())
+                return;
+
+            for (const Copy& copy : mBatches.front().copies)
+            {
+                for (uint64_t i = 0; i < copy.size; i++)
+                    (*copy.destination)[copy.destinationOffset + i] = mStaging[copy.stagingOffset + i];
+            }
+
+            mCompleted = mBatches.front().fence;
+            mBatches.pop_front();
+        }
+
+        size_t PendingBatches() const { return mBatches.size(); }
+        size_t RecordedCopies() const { return mRecorded.size(); }
+
+    private:
+        struct Copy
+        {
+            Buffer* destination;
+            uint64_t destinationOffset;
+            uint64_t stagingOffset;
+            uint64_t size;
+        };
+
+        struct Batch
+        {
+            uint64_t fence;
+            std::vector<Copy> copies;
+        };
+
+        const Buffer& mStaging;
+        std::vector<Copy> mRecorded;
+        std::deque<Batch> mBatches;
+        uint64_t mSubmitted;
+        uint64_t mCompleted;
+    };
+
+    Buffer Pattern(size_t size, uint32_t seed)
+    {
+        std::mt19937 rng(seed);
+        Buffer data(size);
+        for (uint8_t& b : data)
+            b = (uint8_t)rng();
+        return data;
+    }
+
+    void TestTickets()
+    {
+        Buffer staging(64 * 1024);
+        MockCopyQueue queue(staging);
+        StagingUploader uploader;
+        uploader.Initialize(&queue, staging.data(), staging.size());
+
+        Buffer destination(4096, 0);
+        Buffer a = Pattern(1000, 1);
+        Buffer b = Pattern(2000, 2);
+
+        uint64_t ticketA = uploader.Upload(&destination, 0, a.data(), a.size());
+        uint64_t ticketB = uploader.Upload(&destination, 2048, b.data(), b.size());
+
+        // One open batch: both uploads share its fence and nothing is
+        // submitted yet.
+        CHECK(ticketA == 1 && ticketB == 1);
+        CHECK(!uploader.IsComplete(ticketA));
+        CHECK(queue.PendingBatches() == 0);
+
+        // The source may change as soon as Upload returns.
+        a.assign(a.size(), 0xEE);
+
+        CHECK(uploader.Flush() == 1);
+        CHECK(uploader.Flush() == 1);
+        CHECK(queue.PendingBatches() == 1);
+        CHECK(!uploader.IsComplete(ticketB));
+
+        queue.CompleteOne();
+        CHECK(uploader.IsComplete(ticketA) && uploader.IsComplete(ticketB));
+
+        Buffer expectedA = Pattern(1000, 1);
+        CHECK(std::equal(expectedA.begin(), expectedA.end(), destination.begin()));
+        CHECK(std::equal(b.begin(), b.end(), destination.begin() + 2048));
+
+        // Waiting on the open batch submits it first.
+        Buffer c = Pattern(100, 3);
+        uint64_t ticketC = uploader.Upload(&destination, 1500, c.data(), c.size());
+        CHECK(ticketC == 2);
+        uploader.Wait(ticketC);
+        CHECK(uploader.IsComplete(ticketC));
+        CHECK(std::equal(c.begin(), c.end(), destination.begin() + 1500));
+
+        const StagingStats& stats = uploader.Stats();
+        CHECK(stats.copies == 3);
+        CHECK(stats.batches == 2);
+        CHECK(stats.bytesUploaded == 3100);
+        CHECK(stats.stalls == 0);
+    }
+
+    // An upload four times the staging buffer goes out in quarter-buffer
+    // chunks, waiting on its own earlier batches for space.
+    void TestLargeUpload()
+    {
+        const size_t CAPACITY = 16 * 1024;
+
+        Buffer staging(CAPACITY);
+        MockCopyQueue queue(staging);
+        StagingUploader uploader;
+        uploader.Initialize(&queue, staging.data(), staging.size());
+
+        Buffer data = Pattern(4 * CAPACITY + 123, 4);
+        Buffer destination(data.size() + 64, 0);
+
+        uint64_t ticket = uploader.Upload(&destination, 64, data.data(), data.size());
+        uploader.Wait(ticket);
+
+        CHECK(std::equal(data.begin(), data.end(), destination.begin() + 64));
+        CHECK(uploader.Stats().copies == 17);
+        CHECK(uploader.Stats().stalls > 0);
+        CHECK(uploader.Stats().batches > 1);
+        CHECK(queue.PendingBatches() == 0);
+    }
+
+    // Many uploads to several destinations while the GPU completes
+    // batches at random; the destinations end up as a CPU copy says.
+    void TestRandom()
+    {
+        const size_t CAPACITY = 32 * 1024;
+        const size_t DESTINATION = 64 * 1024;
+
+        Buffer staging(CAPACITY);
+        MockCopyQueue queue(staging, 100);
+        StagingUploader uploader;
+        uploader.Initialize(&queue, staging.data(), staging.size());
+
+        std::vector<Buffer> destinations(3, Buffer(DESTINATION, 0));
+        std::vector<Buffer> expected = destinations;
+
+        std::mt19937 rng(5);
+        uint64_t lastTicket = 0;
+        for (int i = 0; i < 2000; i++)
+        {
+            size_t target = rng() % destinations.size();
+            size_t size = 1 + rng() % (rng() % 8 == 0 ? 20000 : 600);
+            size_t offset = rng() % (DESTINATION - size);
+
+            Buffer data = Pattern(size, (uint32_t)i);
+            std::copy(data.begin(), data.end(), expected[target].begin() + offset);
+
+            uint64_t ticket = uploader.Upload(&destinations[target], offset, data.data(), data.size());
+            CHECK(ticket > 100);
+            CHECK(ticket >= lastTicket);
+            lastTicket = ticket;
+
+            switch (rng() % 8)
+            {
+            case 0: uploader.Flush(); break;
+            case 1: queue.CompleteOne(); break;
+            case 2: uploader.Flush(); queue.CompleteOne(); break;
+            default: break;
+            }
+        }
+
+        uploader.WaitIdle();
+        CHECK(uploader.IsComplete(lastTicket));
+        CHECK(queue.PendingBatches() == 0);
+        CHECK(queue.RecordedCopies() == 0);
+        CHECK(destinations == expected);
+        CHECK(uploader.Stats().stalls > 0);
+
+        // Idle again: new uploads start from a free staging buffer.
+        uint64_t stallsBefore = uploader.Stats().stalls;
+        Buffer data = Pattern(CAPACITY / 4, 6);
+        uploader.Wait(uploader.Upload(&destinations[0], 0, data.data(), data.size()));
+        CHECK(std::equal(data.begin(), data.end(), destinations[0].begin()));
+        CHECK(uploader.Stats().stalls == stallsBefore);
+    }
+
+    void TestIdle()
+    {
+        Buffer staging(4096);
+        MockCopyQueue queue(staging);
+        StagingUploader uploader;
+        uploader.Initialize(&queue, staging.data(), staging.size());
+
+        // Nothing uploaded: no submission and nothing to wait for.
+        CHECK(uploader.Flush() == 0);
+        uploader.WaitIdle();
+        CHECK(uploader.IsComplete(0));
+        CHECK(uploader.Stats().batches == 0);
+    }
+}
+
+int main()
+{
+    TestTickets();
+    TestLargeUpload();
+    TestRandom();
+    TestIdle();
+
+    return TestResult("stagingtest");
+}
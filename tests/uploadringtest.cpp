@@ -0,0 +1,345 @@
+// Tests for UploadRing and UploadContext against a fake fence that lags
+// the CPU by a few frames. Every allocation is stamped into the buffer and
+// checked again when its fence retires, so space handed out while the GPU
+// still reads it shows up as a broken stamp. The ring runs for many laps;
+// allocations must stay inside the buffer, never straddle its end, fail
+// while the GPU holds the space and succeed again once it retires.
+//
+// Linux build, from the repository root:
+//
+//   g++ -std=c++17 -O1 -g -fsanitize=address,undefined -pthread -Isrc
+//       -o uploadringtest tests/uploadringtest.cpp src/uploadring.cpp
+
+#include "check.h"
+#include "uploadring.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    const uint64_t GPU_BASE = 0x100000000ull;
+
+    // A GPU fence that completes a frame lag frames after it was
+    // signaled, or never while stalled.
+    class FakeFence
+    {
+    public:
+        explicit FakeFence(uint64_t lag) : mLag(lag), mSignaled(0), mCompleted(0), mStalled(false) {}
+
+        uint64_t Signal() { return ++mSignaled; }
+
+        uint64_t Completed()
+        {
+            if (!mStalled && mSignaled > mLag)
+                mCompleted = std::max(mCompleted, mSignaled - mLag);
+            return mCompleted;
+        }
+
+        void Stall(bool stalled) { mStalled = stalled; }
+        void Drain() { mCompleted = mSignaled; }
+
+    private:
+        uint64_t mLag;
+        uint64_t mSignaled;
+        uint64_t mCompleted;
+        bool mStalled;
+    };
+
+    struct Live
+    {
+        uint64_t offset;
+        uint64_t size;
+        uint64_t fence;
+        uint8_t stamp;
+    };
+
+    // The buffer and every allocation the GPU may still be reading.
+    class Shadow
+    {
+    public:
+        Shadow(std::vector<uint8_t>& buffer) : mBuffer(buffer), mBroken(0) {}
+
+        void Add(const UploadAllocation& allocation, uint64_t fence)
+        {
+            uint64_t offset = (uint8_t*)allocation.cpu - mBuffer.data();
+            CHECK(allocation.gpu == GPU_BASE + offset);
+            CHECK(offset + allocation.size <= mBuffer.size());
+
+            for (const Live& live : mLive)
+                CHECK(offset + allocation.size <= live.offset || live.offset + live.size <= offset);
+
+            uint8_t stamp = (uint8_t)(mLive.size() * 31 + fence);
+            memset(allocation.cpu, stamp, (size_t)allocation.size);
+            mLive.push_back({ offset, allocation.size, fence, stamp });
+        }
+
+        // Checks and forgets the allocations of fences up to completed.
+        void Retire(uint64_t completed)
+        {
+            size_t n = 0;
+            for (const Live& live : mLive)
+            {
+                if (live.fence > completed)
+                {
+                    mLive[n++] = live;
+                    continue;
+                }
+
+                for (uint64_t i = 0; i < live.size; i++)
+                {
+                    if (mBuffer[live.offset + i] != live.stamp)
+                    {
+                        mBroken++;
+                        break;
+                    }
+                }
+            }
+            mLive.resize(n);
+        }
+
+        size_t BrokenCount() const { return mBroken; }
+        size_t LiveCount() const { return mLive.size(); }
+
+    private:
+        std::vector<uint8_t>& mBuffer;
+        std::vector<Live> mLive;
+        size_t mBroken;
+    };
+
+    // Mixed sizes through UploadContext and whole blocks over many laps of
+    // a small ring, with the GPU three frames behind.
+    void TestWraparound()
+    {
+        const uint64_t CAPACITY = 64 * 1024;
+        const uint64_t BLOCK = 4 * 1024;
+        const int FRAMES = 5000;
+
+        std::vector<uint8_t> buffer(CAPACITY);
+        UploadRing ring;
+        ring.Initialize(buffer.data(), GPU_BASE, CAPACITY, BLOCK);
+        CHECK(ring.Capacity() == CAPACITY);
+
+        UploadContext context;
+        context.Initialize(&ring);
+
+        FakeFence fence(3);
+        Shadow shadow(buffer);
+        std::mt19937 rng(1);
+        std::uniform_int_distribution<uint64_t> size(1, 3 * BLOCK);
+
+        uint64_t allocated = 0;
+        size_t failures = 0;
+        for (int frame = 0; frame < FRAMES; frame++)
+        {
+            uint64_t completed = fence.Completed();
+            ring.BeginFrame(completed);
+            shadow.Retire(completed);
+
+            uint64_t current = fence.Signal();
+            for (int i = 0; i < 8; i++)
+            {
+                uint64_t bytes = size(rng);
+                if (i % 3 == 0)
+                    bytes = bytes % 512 + 1;
+
+                UploadAllocation allocation;
+                bool ok = i % 4 == 3 ? ring.Allocate(bytes, allocation) : context.AllocateConstants(bytes, allocation);
+                if (!ok)
+                {
+                    failures++;
+                    continue;
+                }
+
+                CHECK(allocation.size == bytes);
+                if (i % 4 != 3)
+                    CHECK(allocation.gpu % UPLOAD_CONSTANT_ALIGNMENT == 0);
+                else
+                    CHECK((allocation.gpu - GPU_BASE) % BLOCK == 0);
+
+                shadow.Add(allocation, current);
+                allocated += bytes;
+            }
+
+            ring.EndFrame(current);
+            CHECK(ring.UsedBytes() <= CAPACITY);
+        }
+
+        fence.Drain();
+        shadow.Retire(fence.Completed());
+        ring.BeginFrame(fence.Completed());
+
+        // Many laps, some frames too big for the space the GPU left.
+        CHECK(allocated > 50 * CAPACITY);
+        CHECK(failures > 0);
+        CHECK(shadow.BrokenCount() == 0);
+        CHECK(shadow.LiveCount() == 0);
+        CHECK(ring.UsedBytes() == 0);
+    }
+
+    // A stalled GPU fills the ring; allocation fails without touching the
+    // frames in flight and recovers once the fence moves.
+    void TestStall()
+    {
+        const uint64_t CAPACITY = 16 * 1024;
+        const uint64_t BLOCK = 1024;
+
+        std::vector<uint8_t> buffer(CAPACITY);
+        UploadRing ring;
+        ring.Initialize(buffer.data(), GPU_BASE, CAPACITY + 100, BLOCK);
+        CHECK(ring.Capacity() == CAPACITY);
+
+        FakeFence fence(0);
+        Shadow shadow(buffer);
+
+        // Start mid lap, so the stall wraps.
+        for (int frame = 0; frame < 5; frame++)
+        {
+            ring.BeginFrame(fence.Completed());
+            uint64_t current = fence.Signal();
+            UploadAllocation allocation;
+            CHECK(ring.Allocate(3 * BLOCK, allocation));
+            ring.EndFrame(current);
+        }
+
+        fence.Stall(true);
+        size_t granted = 0;
+        for (int frame = 0; frame < 10; frame++)
+        {
+            uint64_t completed = fence.Completed();
+            ring.BeginFrame(completed);
+            shadow.Retire(completed);
+
+            uint64_t current = fence.Signal();
+            UploadAllocation allocation;
+            if (ring.Allocate(BLOCK + 1, allocation))
+            {
+                granted++;
+                shadow.Add(allocation, current);
+            }
+            ring.EndFrame(current);
+        }
+
+        // 2 blocks each. The frame in flight at the stall holds 3 blocks
+        // and the one block before the end of the lap is skipped.
+        CHECK(granted == (CAPACITY / BLOCK - 3 - 1) / 2);
+        CHECK(ring.UsedBytes() <= CAPACITY);
+
+        UploadAllocation allocation;
+        CHECK(!ring.Allocate(BLOCK, allocation));
+
+        fence.Stall(false);
+        uint64_t completed = fence.Completed();
+        ring.BeginFrame(completed);
+        shadow.Retire(completed);
+        CHECK(shadow.BrokenCount() == 0);
+
+        CHECK(ring.Allocate(BLOCK, allocation));
+        CHECK(ring.UsedBytes() < CAPACITY);
+    }
+
+    void TestLimits()
+    {
+        const uint64_t CAPACITY = 8 * 1024;
+        const uint64_t BLOCK = 1024;
+
+        std::vector<uint8_t> buffer(CAPACITY);
+        UploadRing ring;
+        ring.Initialize(buffer.data(), GPU_BASE, CAPACITY, BLOCK);
+
+        UploadAllocation allocation;
+        CHECK(!ring.Allocate(CAPACITY + 1, allocation));
+        CHECK(ring.UsedBytes() == 0);
+
+        CHECK(ring.Allocate(CAPACITY, allocation));
+        CHECK(allocation.cpu == buffer.data() && allocation.gpu == GPU_BASE);
+        ring.EndFrame(1);
+        ring.BeginFrame(1);
+        CHECK(ring.UsedBytes() == 0);
+
+        // Three blocks with two left before the end skip to the start.
+        CHECK(ring.Allocate(6 * BLOCK, allocation));
+        ring.EndFrame(2);
+        ring.BeginFrame(2);
+        CHECK(ring.Allocate(3 * BLOCK, allocation));
+        CHECK(allocation.cpu == buffer.data());
+        CHECK(ring.UsedBytes() == 5 * BLOCK);
+    }
+
+    // Contexts on several threads share one ring between BeginFrame and
+    // EndFrame; their ranges never overlap.
+    void TestThreads()
+    {
+        const uint64_t CAPACITY = 1024 * 1024;
+        const uint64_t BLOCK = 4 * 1024;
+        const int THREADS = 4;
+        const int FRAMES = 200;
+
+        std::vector<uint8_t> buffer(CAPACITY);
+        UploadRing ring;
+        ring.Initialize(buffer.data(), GPU_BASE, CAPACITY, BLOCK);
+
+        std::vector<UploadContext> contexts(THREADS);
+        for (UploadContext& context : contexts)
+            context.Initialize(&ring);
+
+        FakeFence fence(2);
+        Shadow shadow(buffer);
+        std::mutex mutex;
+        size_t failures = 0;
+
+        for (int frame = 0; frame < FRAMES; frame++)
+        {
+            uint64_t completed = fence.Completed();
+            ring.BeginFrame(completed);
+            shadow.Retire(completed);
+            uint64_t current = fence.Signal();
+
+            std::vector<std::thread> threads;
+            for (int t = 0; t < THREADS; t++)
+            {
+                threads.emplace_back([&, t]()
+                {
+                    std::mt19937 rng((unsigned)(frame * THREADS + t));
+                    std::uniform_int_distribution<uint64_t> size(16, 1024);
+
+                    for (int i = 0; i < 64; i++)
+                    {
+                        UploadAllocation allocation;
+                        bool ok = contexts[t].AllocateConstants(size(rng), allocation);
+
+                        std::lock_guard<std::mutex> lock(mutex);
+                        if (ok)
+                            shadow.Add(allocation, current);
+                        else
+                            failures++;
+                    }
+                });
+            }
+
+            for (std::thread& thread : threads)
+                thread.join();
+
+            ring.EndFrame(current);
+        }
+
+        fence.Drain();
+        shadow.Retire(fence.Completed());
+        CHECK(shadow.BrokenCount() == 0);
+        CHECK(failures == 0);
+    }
+}
+
+int main()
+{
+    TestWraparound();
+    TestStall();
+    TestLimits();
+    TestThreads();
+
+    return TestResult("uploadringtest");
+}
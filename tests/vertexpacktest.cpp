@@ -0,0 +1,208 @@
+// Round-trip error tests for the packed vertex format: positions come back
+// within half a 16-bit step of the mesh bounds on every axis, bounds
+// corners come back exact, a flat axis stays flat, and octahedral normals
+// come back unit length within a small angle of the original over random
+// directions, the axes, the diagonals and the folded lower hemisphere.
+//
+// Linux build, from the repository root, with DirectXMath on the include
+// path:
+//
+//   g++ -std=c++17 -O1 -g -fsanitize=address,undefined -Isrc
+//       -o vertexpacktest tests/vertexpacktest.cpp src/vertexpack.cpp
+
+#include "check.h"
+#include "vertexpack.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+    // 16-bit octahedral normals measure about 0.0036 degrees at worst,
+    // near the fold of the lower hemisphere.
+    const double MAX_NORMAL_DEGREES = 0.005;
+
+    double AngleDegrees(const XMFLOAT3& a, const XMFLOAT3& b)
+    {
+        double dot = (double)a.x * b.x + (double)a.y * b.y + (double)a.z * b.z;
+        double la = std::sqrt((double)a.x * a.x + (double)a.y * a.y + (double)a.z * a.z);
+        double lb = std::sqrt((double)b.x * b.x + (double)b.y * b.y + (double)b.z * b.z);
+        dot = std::min(1.0, std::max(-1.0, dot / (la * lb)));
+        return std::acos(dot) * 180.0 / 3.14159265358979323846;
+    }
+
+    double Length(const XMFLOAT3& v)
+    {
+        return std::sqrt((double)v.x * v.x + (double)v.y * v.y + (double)v.z * v.z);
+    }
+
+    XMFLOAT3 RoundTrip(const XMFLOAT3& n)
+    {
+        int16_t packed[2];
+        EncodeOctahedral(n, packed);
+        return DecodeOctahedral(packed);
+    }
+
+    void TestPositions()
+    {
+        const XMFLOAT3 boundsMin(-3.5f, 0.25f, -1000.0f);
+        const XMFLOAT3 boundsMax(2.0f, 0.75f, 1000.0f);
+        const float extent[3] = { 5.5f, 0.5f, 2000.0f };
+
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+        std::vector<Vertex> vertices(100000);
+        for (Vertex& v : vertices)
+        {
+            v.position = XMFLOAT3(
+                boundsMin.x + unit(rng) * extent[0],
+                boundsMin.y + unit(rng) * extent[1],
+                boundsMin.z + unit(rng) * extent[2]
+            );
+            v.normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+        }
+
+        // The corners themselves.
+        vertices[0].position = boundsMin;
+        vertices[1].position = boundsMax;
+
+        std::vector<PackedVertex> packed(vertices.size());
+        PackVertices(vertices.data(), vertices.size(), boundsMin, boundsMax, packed.data());
+
+        double worst[3] = {};
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            CHECK(packed[i].position[3] == 0);
+
+            Vertex v = UnpackVertex(packed[i], boundsMin, boundsMax);
+            const float* original = &vertices[i].position.x;
+            const float* decoded = &v.position.x;
+            for (int k = 0; k < 3; k++)
+                worst[k] = std::max(worst[k], std::fabs((double)decoded[k] - original[k]) / extent[k]);
+
+            CHECK(v.color.x == 1.0f && v.color.y == 1.0f && v.color.z == 1.0f && v.color.w == 1.0f);
+        }
+
+        // Half a step, plus float rounding of the decode relative to the
+        // extent.
+        for (int k = 0; k < 3; k++)
+            CHECK(worst[k] <= 0.5 / 65535.0 + 1e-6);
+
+        CHECK(packed[0].position[0] == 0 && packed[0].position[1] == 0 && packed[0].position[2] == 0);
+        CHECK(packed[1].position[0] == 65535 && packed[1].position[1] == 65535 && packed[1].position[2] == 65535);
+
+        Vertex low = UnpackVertex(packed[0], boundsMin, boundsMax);
+        CHECK(low.position.x == boundsMin.x && low.position.y == boundsMin.y && low.position.z == boundsMin.z);
+    }
+
+    // A flat mesh keeps its flat axis exactly; points outside the bounds
+    // clamp to them.
+    void TestDegenerateBounds()
+    {
+        const XMFLOAT3 boundsMin(0.0f, 5.0f, -1.0f);
+        const XMFLOAT3 boundsMax(1.0f, 5.0f, 1.0f);
+
+        Vertex vertices[3] = {};
+        vertices[0].position = XMFLOAT3(0.5f, 5.0f, 0.0f);
+        vertices[1].position = XMFLOAT3(-2.0f, 5.0f, 3.0f);
+        vertices[2].position = XMFLOAT3(1.5f, 5.0f, -3.0f);
+
+        PackedVertex packed[3];
+        PackVertices(vertices, 3, boundsMin, boundsMax, packed);
+
+        for (const PackedVertex& p : packed)
+            CHECK(UnpackVertex(p, boundsMin, boundsMax).position.y == 5.0f);
+
+        Vertex clampedLow = UnpackVertex(packed[1], boundsMin, boundsMax);
+        CHECK(clampedLow.position.x == 0.0f && clampedLow.position.z == 1.0f);
+        Vertex clampedHigh = UnpackVertex(packed[2], boundsMin, boundsMax);
+        CHECK(clampedHigh.position.x == 1.0f && clampedHigh.position.z == -1.0f);
+    }
+
+    void TestNormals()
+    {
+        std::vector<XMFLOAT3> normals;
+
+        // Axes, face diagonals, corners, and the equator where the fold
+        // starts.
+        for (int x = -1; x <= 1; x++)
+        {
+            for (int y = -1; y <= 1; y++)
+            {
+                for (int z = -1; z <= 1; z++)
+                {
+                    if (x != 0 || y != 0 || z != 0)
+                        normals.push_back(XMFLOAT3((float)x, (float)y, (float)z));
+                }
+            }
+        }
+        normals.push_back(XMFLOAT3(1.0f, 1e-7f, -1e-7f));
+        normals.push_back(XMFLOAT3(-1e-7f, 1.0f, -1e-7f));
+        normals.push_back(XMFLOAT3(0.3f, -0.2f, -1e-6f));
+
+        // Uniform on the sphere.
+        std::mt19937 rng(2);
+        std::normal_distribution<float> gauss;
+        while (normals.size() < 200000)
+        {
+            XMFLOAT3 n(gauss(rng), gauss(rng), gauss(rng));
+            float l = (float)Length(n);
+            if (l > 1e-3f)
+                normals.push_back(XMFLOAT3(n.x / l, n.y / l, n.z / l));
+        }
+
+        double worst = 0.0;
+        double worstLength = 0.0;
+        for (const XMFLOAT3& n : normals)
+        {
+            XMFLOAT3 decoded = RoundTrip(n);
+            worst = std::max(worst, AngleDegrees(n, decoded));
+            worstLength = std::max(worstLength, std::fabs(Length(decoded) - 1.0));
+
+            // Packing an unpacked normal again does not drift. Its code may
+            // change sides of the fold seam, which names the same direction.
+            CHECK(AngleDegrees(RoundTrip(decoded), decoded) <= MAX_NORMAL_DEGREES);
+        }
+
+        CHECK(worst <= MAX_NORMAL_DEGREES);
+        CHECK(worstLength <= 1e-6);
+
+        // Exact directions stay exact.
+        XMFLOAT3 up = RoundTrip(XMFLOAT3(0.0f, 0.0f, 1.0f));
+        CHECK(up.x == 0.0f && up.y == 0.0f && up.z == 1.0f);
+        XMFLOAT3 down = RoundTrip(XMFLOAT3(0.0f, 0.0f, -1.0f));
+        CHECK(down.x == 0.0f && down.y == 0.0f && down.z == -1.0f);
+
+        // Unnormalized input encodes its direction; zero decodes to +z
+        // rather than NaN.
+        CHECK(AngleDegrees(RoundTrip(XMFLOAT3(0.0f, 30.0f, -40.0f)), XMFLOAT3(0.0f, 0.6f, -0.8f)) <= MAX_NORMAL_DEGREES);
+        XMFLOAT3 zero = RoundTrip(XMFLOAT3(0.0f, 0.0f, 0.0f));
+        CHECK(zero.x == 0.0f && zero.y == 0.0f && zero.z == 1.0f);
+
+        // -32768 is a valid SNORM16 value and decodes as -1.
+        int16_t extreme[2] = { -32768, 0 };
+        XMFLOAT3 left = DecodeOctahedral(extreme);
+        CHECK(AngleDegrees(left, XMFLOAT3(-1.0f, 0.0f, 0.0f)) <= MAX_NORMAL_DEGREES);
+    }
+
+    void TestStride()
+    {
+        CHECK(VertexStride(VertexFormat::Full) == sizeof(Vertex));
+        CHECK(VertexStride(VertexFormat::Packed) == 12);
+    }
+}
+
+int main()
+{
+    TestPositions();
+    TestDegenerateBounds();
+    TestNormals();
+    TestStride();
+
+    return TestResult("vertexpacktest");
+}